@@ -1,6 +1,7 @@
 #include "tasktimer.h"
 
 #include "cva_list.h"
+#include "tracerecorder.h"
 
 #include <iomanip>
 #include <map>
@@ -187,6 +188,13 @@ void TaskTimer::init(LogLevel logLevel, const char* task, va_list args) {
         s = strs[0];
     }
 
+    // Only the lowest level timer is recorded, see upperLevel
+    if (0 == upperLevel && TraceRecorder::enabled ())
+    {
+        TraceRecorder::begin (s.c_str ());
+        traced_ = true;
+    }
+
     logprint( s.c_str() );
 
     for (unsigned i=1; i<strs.size(); i++)
@@ -340,6 +348,9 @@ double TaskTimer::elapsedTime()
 
 
 TaskTimer::~TaskTimer() {
+    if (traced_)
+        TraceRecorder::end ();
+
     if (DISABLE_TASKTIMER)
         return;
 
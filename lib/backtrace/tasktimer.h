@@ -74,6 +74,12 @@ Where tt.partlyDone() will output an extra dot "." for each call.
 
 
 Use TaskInfo to omit "done in 100 ms."
+
+
+Timeline
+--------
+When TraceRecorder is enabled each TaskTimer is also recorded as a scope in
+the timeline of its thread.
 */
 class TaskTimer {
 public:
@@ -115,6 +121,7 @@ private:
     unsigned numPartlyDone;
     bool is_unwinding;
     bool suppressTimingInfo;
+    bool traced_ = false;
     LogLevel logLevel;
 
     TaskTimer* upperLevel; // obsolete
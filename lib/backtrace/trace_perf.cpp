@@ -1,4 +1,5 @@
 #include "trace_perf.h"
+#include "tracerecorder.h"
 #include "detectgdb.h"
 #include "shared_state.h"
 
@@ -304,6 +305,11 @@ void trace_perf::
         reset()
 {
     double d = timer.elapsed ();
+
+    if (traced)
+        TraceRecorder::end ();
+    traced = false;
+
     if (!info.empty ())
         traces->log (filename, info, d);
 }
@@ -315,6 +321,13 @@ void trace_perf::
     reset();
 
     this->info = info;
+
+    if (TraceRecorder::enabled ())
+    {
+        TraceRecorder::begin (info.c_str ());
+        traced = true;
+    }
+
     this->timer.restart ();
 }
 
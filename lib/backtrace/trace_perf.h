@@ -17,6 +17,8 @@
  *
  * The results stored in a complementary database file regardless of failure
  * or success when the process quits.
+ *
+ * The scope is also recorded by TraceRecorder when it is enabled.
  */
 class trace_perf
 {
@@ -34,6 +36,7 @@ private:
     Timer timer;
     std::string info;
     std::string filename;
+    bool traced = false;
 };
 
 #define TRACE_PERF(info) trace_perf trace_perf_{__FILE__, info}
@@ -0,0 +1,494 @@
+#include "tracerecorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+struct Event
+{
+    unsigned long long ns;      // since the first event in the process
+    char phase;                 // 'B' or 'E'
+    char name[TraceRecorder::NameLength];
+};
+
+
+struct ThreadBuffer
+{
+    int tid;
+    string name;                // guarded by registry_lock
+    vector<Event> events;
+    atomic<unsigned long long> count;
+};
+
+
+atomic<bool> enabled_(false);
+mutex registry_lock;
+
+// Never deleted, threads and static destructors may record after exit
+vector<shared_ptr<ThreadBuffer>>& registry()
+{
+    static vector<shared_ptr<ThreadBuffer>>* r = new vector<shared_ptr<ThreadBuffer>>;
+    return *r;
+}
+
+
+steady_clock::time_point epoch()
+{
+    static const steady_clock::time_point t = steady_clock::now ();
+    return t;
+}
+
+
+// Buffers of threads that have exited, the oldest first. Guarded by registry_lock
+deque<shared_ptr<ThreadBuffer>>& exited()
+{
+    static deque<shared_ptr<ThreadBuffer>>* r = new deque<shared_ptr<ThreadBuffer>>;
+    return *r;
+}
+
+int next_tid = 0; // guarded by registry_lock
+
+
+void retire(ThreadBuffer* b)
+{
+    lock_guard<mutex> l(registry_lock);
+    vector<shared_ptr<ThreadBuffer>>& r = registry();
+    for (const auto& p : r)
+        if (p.get () == b)
+            exited().push_back (p);
+
+    if (exited().size () > TraceRecorder::ExitedThreads)
+    {
+        shared_ptr<ThreadBuffer> oldest = exited().front ();
+        exited().pop_front ();
+        r.erase (remove (r.begin (), r.end (), oldest), r.end ());
+    }
+}
+
+
+thread_local ThreadBuffer* this_thread_buffer = 0;
+thread_local bool this_thread_exited = false;
+
+// Given to the buffer when it is created, so that naming a thread doesn't
+// allocate a buffer. Not a string, that could be destroyed before the owner
+thread_local char this_thread_name[TraceRecorder::NameLength] = {0};
+
+// Hands the buffer over to another thread when this thread exits
+struct ThreadBufferOwner
+{
+    ~ThreadBufferOwner()
+    {
+        this_thread_exited = true;
+        if (this_thread_buffer)
+            retire (this_thread_buffer);
+        this_thread_buffer = 0;
+    }
+};
+
+thread_local ThreadBufferOwner this_thread_owner;
+
+
+ThreadBuffer* buffer()
+{
+    if (!this_thread_buffer && !this_thread_exited)
+    {
+        (void)&this_thread_owner; // constructed on first use, destroyed when the thread exits
+
+        lock_guard<mutex> l(registry_lock);
+        if (exited().size () >= TraceRecorder::ExitedThreads)
+        {
+            ThreadBuffer* b = exited().front ().get ();
+            exited().pop_front ();
+            b->count = 0;
+            b->name = this_thread_name;
+            b->tid = next_tid++;
+            this_thread_buffer = b;
+        }
+        else
+        {
+            shared_ptr<ThreadBuffer> b(new ThreadBuffer);
+            b->events.resize (TraceRecorder::EventsPerThread);
+            b->count = 0;
+            b->name = this_thread_name;
+            b->tid = next_tid++;
+            registry().push_back (b);
+            this_thread_buffer = b.get ();
+        }
+    }
+
+    return this_thread_buffer;
+}
+
+
+void record(char phase, const char* name)
+{
+    steady_clock::time_point now = steady_clock::now ();
+    ThreadBuffer* b = buffer ();
+    if (!b)
+        return;
+
+    unsigned long long i = b->count.load (memory_order_relaxed);
+    Event& e = b->events[i % TraceRecorder::EventsPerThread];
+    e.ns = duration_cast<nanoseconds>(now - epoch ()).count ();
+    e.phase = phase;
+    if (name)
+    {
+        strncpy (e.name, name, sizeof(e.name) - 1);
+        e.name[sizeof(e.name) - 1] = 0;
+    }
+    else
+        e.name[0] = 0;
+
+    b->count.store (i+1, memory_order_release);
+}
+
+
+void writeJsonString(ostream& o, const char* s)
+{
+    o << '"';
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            o << '\\' << c;
+        else if (c < 0x20)
+        {
+            char u[8];
+            snprintf (u, sizeof(u), "\\u%04x", c);
+            o << u;
+        }
+        else
+            o << c;
+    }
+    o << '"';
+}
+
+} // namespace
+
+
+bool TraceRecorder::
+        enabled()
+{
+    return enabled_.load (memory_order_relaxed);
+}
+
+
+void TraceRecorder::
+        setEnabled(bool v)
+{
+    epoch ();
+    enabled_ = v;
+}
+
+
+void TraceRecorder::
+        begin(const char* name)
+{
+    record ('B', name);
+}
+
+
+void TraceRecorder::
+        end()
+{
+    record ('E', 0);
+}
+
+
+void TraceRecorder::
+        setThreadName(const string& name)
+{
+    strncpy (this_thread_name, name.c_str (), sizeof(this_thread_name) - 1);
+    this_thread_name[sizeof(this_thread_name) - 1] = 0;
+
+    // The buffer is created with the name on the first event
+    ThreadBuffer* b = this_thread_buffer;
+    if (!b)
+        return;
+
+    lock_guard<mutex> l(registry_lock);
+    b->name = this_thread_name;
+}
+
+
+void TraceRecorder::
+        dump(ostream& o)
+{
+    vector<shared_ptr<ThreadBuffer>> buffers;
+    vector<string> names;
+    {
+        lock_guard<mutex> l(registry_lock);
+        buffers = registry();
+        for (const auto& b : buffers)
+            names.push_back (b->name);
+    }
+
+    o << "{\"traceEvents\":[";
+    bool first = true;
+
+    for (size_t k=0; k<buffers.size (); k++)
+    {
+        const ThreadBuffer& b = *buffers[k];
+        string name = names[k].empty () ? "Thread " + to_string(b.tid) : names[k];
+
+        o << (first ? "\n" : ",\n");
+        first = false;
+        o << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.tid << ",\"args\":{\"name\":";
+        writeJsonString (o, name.c_str ());
+        o << "}}";
+
+        unsigned long long count = b.count.load (memory_order_acquire);
+        unsigned long long n = min(count, (unsigned long long)EventsPerThread);
+
+        // The oldest events may have been overwritten, skip ends without a beginning
+        int depth = 0;
+        for (unsigned long long i=count-n; i<count; i++)
+        {
+            const Event& e = b.events[i % EventsPerThread];
+            if (e.phase == 'E' && 0 == depth)
+                continue;
+            depth += e.phase == 'B' ? 1 : -1;
+
+            char ts[32];
+            snprintf (ts, sizeof(ts), "%.3f", e.ns*1e-3);
+
+            o << ",\n{\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << b.tid << ",\"ts\":" << ts;
+            if (e.phase == 'B')
+            {
+                o << ",\"name\":";
+                writeJsonString (o, e.name);
+            }
+            o << "}";
+        }
+    }
+
+    o << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+
+bool TraceRecorder::
+        dump(const string& filename)
+{
+    ofstream o(filename.c_str ());
+    if (!o)
+        return false;
+
+    dump (o);
+    return (bool)o;
+}
+
+
+void TraceRecorder::
+        clear()
+{
+    lock_guard<mutex> l(registry_lock);
+    for (const auto& b : registry())
+        b->count = 0;
+}
+
+
+TraceScope::
+        TraceScope(const char* name)
+    :
+      active_(TraceRecorder::enabled ())
+{
+    if (active_)
+        TraceRecorder::begin (name);
+}
+
+
+TraceScope::
+        TraceScope(const string& name)
+    :
+      active_(TraceRecorder::enabled ())
+{
+    if (active_)
+        TraceRecorder::begin (name.c_str ());
+}
+
+
+TraceScope::
+        ~TraceScope()
+{
+    if (active_)
+        TraceRecorder::end ();
+}
+
+
+#include "exceptionassert.h"
+#include "tasktimer.h"
+#include "timer.h"
+
+#include <sstream>
+#include <thread>
+
+static size_t occurrences(const string& s, const string& x)
+{
+    size_t n = 0;
+    for (size_t i = s.find (x); i != string::npos; i = s.find (x, i+1))
+        n++;
+    return n;
+}
+
+
+void TraceRecorder::
+        test()
+{
+    bool was_enabled = enabled ();
+
+    // It should record when scopes begin and end in all threads and write
+    // them as Chrome trace-event JSON.
+    {
+        setEnabled (true);
+        clear ();
+
+        thread t([](){
+            setThreadName ("Worker \"1\"");
+            TRACE_SCOPE("outer");
+            {
+                TRACE_SCOPE(string("inner"));
+            }
+        });
+        t.join ();
+
+        {
+            TaskTimer tt("tasktimer scope");
+        }
+
+        ostringstream ss;
+        dump (ss);
+        string json = ss.str ();
+
+        EXCEPTION_ASSERTX(json.find ("{\"traceEvents\":[") == 0, json);
+        EXCEPTION_ASSERTX(json.find ("\"args\":{\"name\":\"Worker \\\"1\\\"\"}") != string::npos, json);
+        EXCEPTION_ASSERTX(json.find ("\"name\":\"outer\"") != string::npos, json);
+        EXCEPTION_ASSERTX(json.find ("\"name\":\"inner\"") != string::npos, json);
+        EXCEPTION_ASSERTX(json.find ("\"name\":\"tasktimer scope\"") != string::npos, json);
+        EXCEPTION_ASSERT_EQUALS(occurrences (json, "\"ph\":\"B\""), occurrences (json, "\"ph\":\"E\""));
+    }
+
+    // It should not allocate a buffer to name a thread, only on the first
+    // event.
+    {
+        setEnabled (false);
+        clear ();
+
+        size_t before;
+        {
+            lock_guard<mutex> l(registry_lock);
+            before = registry().size () - exited().size ();
+        }
+
+        bool has_buffer = true;
+        size_t after = 0;
+        thread t([&has_buffer, &after](){
+            setThreadName ("Named");
+            has_buffer = 0 != this_thread_buffer;
+            {
+                lock_guard<mutex> l(registry_lock);
+                after = registry().size () - exited().size ();
+            }
+
+            setEnabled (true);
+            TRACE_SCOPE("named scope");
+        });
+        t.join ();
+        EXCEPTION_ASSERT(!has_buffer);
+        EXCEPTION_ASSERT_EQUALS(after, before);
+
+        ostringstream ss;
+        dump (ss);
+        EXCEPTION_ASSERTX(ss.str ().find ("\"args\":{\"name\":\"Named\"}") != string::npos, ss.str ());
+    }
+
+    // It should keep the latest EventsPerThread events in each thread.
+    {
+        clear ();
+
+        thread t([](){
+            TRACE_SCOPE("outermost");
+            for (int i=0; i<EventsPerThread; i++)
+                TRACE_SCOPE("repeated");
+        });
+        t.join ();
+
+        ostringstream ss;
+        dump (ss);
+        string json = ss.str ();
+
+        EXCEPTION_ASSERTX(json.find ("\"name\":\"outermost\"") == string::npos, json.substr (0, 1000));
+        size_t begins = occurrences (json, "\"ph\":\"B\"");
+        size_t ends = occurrences (json, "\"ph\":\"E\"");
+        // The oldest remaining event and the end of "outermost" are orphan ends
+        EXCEPTION_ASSERT_EQUALS(begins, (size_t)EventsPerThread/2 - 1);
+        EXCEPTION_ASSERT_EQUALS(ends, begins);
+    }
+
+    // It should reuse the buffers of threads that have exited, except for the
+    // latest ExitedThreads.
+    {
+        size_t before;
+        {
+            lock_guard<mutex> l(registry_lock);
+            before = registry().size ();
+        }
+
+        for (int i=0; i<4*ExitedThreads; i++)
+        {
+            thread t([](){ TRACE_SCOPE("short lived"); });
+            t.join ();
+        }
+
+        lock_guard<mutex> l(registry_lock);
+        EXCEPTION_ASSERT_LESS_OR_EQUAL(registry().size (), before + ExitedThreads);
+        EXCEPTION_ASSERT_EQUALS(exited().size (), (size_t)ExitedThreads);
+    }
+
+    // It should keep the events of the threads that have exited last.
+    {
+        clear ();
+
+        thread t([](){ TRACE_SCOPE("exited"); });
+        t.join ();
+
+        ostringstream ss;
+        dump (ss);
+        EXCEPTION_ASSERTX(ss.str ().find ("\"name\":\"exited\"") != string::npos, ss.str ());
+    }
+
+    // It should have a low overhead.
+    {
+        clear ();
+        const int N = 10000;
+
+        Timer t;
+        for (int i=0; i<N; i++)
+            TRACE_SCOPE("benchmark");
+        double T = t.elapsed ()/N;
+
+        setEnabled (false);
+        Timer t2;
+        for (int i=0; i<N; i++)
+            TRACE_SCOPE("benchmark");
+        double T2 = t2.elapsed ()/N;
+
+        EXCEPTION_ASSERT_LESS(T, 1e-6);
+        EXCEPTION_ASSERT_LESS(T2, 1e-7);
+    }
+
+    clear ();
+    setEnabled (was_enabled);
+}
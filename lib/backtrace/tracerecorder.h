@@ -0,0 +1,81 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <string>
+#include <ostream>
+
+/**
+ * @brief The TraceRecorder class should record when scopes begin and end in
+ * all threads and write them as Chrome trace-event JSON, which can be viewed
+ * in chrome://tracing or ui.perfetto.dev.
+ *
+ * Each thread records into its own ring buffer of EventsPerThread events,
+ * the oldest events are overwritten. Recording doesn't take any lock and
+ * doesn't allocate except for the first event in each thread. Names are
+ * truncated to NameLength characters.
+ *
+ * The events of the last ExitedThreads threads that have exited are kept for
+ * dump. Buffers of threads that exited before them are reused by new threads.
+ * Events recorded by a thread after its thread_local objects are destroyed
+ * are ignored.
+ *
+ * Recording is off by default. TaskTimer and TRACE_PERF record their scopes
+ * when it is on, TRACE_SCOPE records a scope without logging.
+ *
+ * Events recorded while dump is running may be missing or garbled in the
+ * dump.
+ */
+class TraceRecorder
+{
+public:
+    enum { EventsPerThread = 1<<16, NameLength = 51, ExitedThreads = 8 };
+
+    static bool enabled();
+    static void setEnabled(bool);
+
+    static void begin(const char* name);
+    static void end();
+
+    /**
+     * @brief setThreadName names the calling thread in the dump. Doesn't
+     * allocate anything, also when recording is off.
+     */
+    static void setThreadName(const std::string& name);
+
+    static void dump(std::ostream&);
+
+    /**
+     * @brief dump writes a JSON file. Returns false if it couldn't be written.
+     */
+    static bool dump(const std::string& filename);
+
+    /**
+     * @brief clear removes all recorded events.
+     */
+    static void clear();
+
+public:
+    static void test();
+};
+
+
+/**
+ * @brief The TraceScope class should record a scope with TraceRecorder if
+ * it is enabled.
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char* name);
+    TraceScope(const std::string& name);
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    ~TraceScope();
+
+private:
+    bool active_;
+};
+
+#define TRACE_SCOPE(name) TraceScope trace_scope_{name}
+
+#endif // TRACERECORDER_H
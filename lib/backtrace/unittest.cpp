@@ -6,6 +6,7 @@
 #include "shared_state.h"
 #include "tasktimer.h"
 #include "timer.h"
+#include "tracerecorder.h"
 #include "verifyexecutiontime.h"
 #include "demangle.h"
 #include "barrier.h"
@@ -39,6 +40,7 @@ int UnitTest::
         RUNTEST(ExceptionAssert);
         RUNTEST(PrettifySegfault);
         RUNTEST(Timer);
+        RUNTEST(TraceRecorder);
         RUNTEST(shared_state_test);
         RUNTEST(VerifyExecutionTime);
         RUNTEST(spinning_barrier);
@@ -0,0 +1,545 @@
+#include "cpumemorypool.h"
+#include "cpuproperties.h"
+#include "exceptionassert.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t THREAD_CACHE_BLOCKS_PER_CLASS = 8;
+const size_t HUGE_PAGE_SIZE = 1<<21;
+
+const unsigned NUMBER_OF_CLASSES = 4*(8*sizeof(size_t) - 6) + 1;
+
+
+unsigned floor_log2_size(size_t v)
+{
+    unsigned r = 0;
+    while (v >>= 1)
+        r++;
+    return r;
+}
+
+
+/**
+ * Size classes are 64 bytes and then four classes per power of two, i.e
+ * 80, 96, 112, 128, 160, 192, 224, 256, 320, ...
+ */
+unsigned classIndex(size_t bytes, size_t* class_bytes)
+{
+    if (bytes <= (size_t)CpuMemoryPool::Alignment)
+    {
+        *class_bytes = CpuMemoryPool::Alignment;
+        return 0;
+    }
+
+    unsigned b = floor_log2_size (bytes-1); // 2^b < bytes <= 2^(b+1)
+    size_t base = (size_t)1 << b;
+    size_t step = base >> 2;
+    size_t q = (bytes - base + step - 1) / step; // 1..4
+
+    *class_bytes = base + q*step;
+    return 4*(b-6) + (unsigned)q;
+}
+
+
+struct Settings {
+    Settings()
+        :
+          max_cached_bytes(0),
+          huge_pages(false)
+    {
+        size_t m = CpuProperties::cpu_memory_size ();
+        max_cached_bytes = m ? m/16 : (size_t)256 << 20;
+    }
+
+    std::atomic<size_t> max_cached_bytes;
+    std::atomic<bool> huge_pages;
+};
+
+
+Settings& settings()
+{
+    static Settings s;
+    return s;
+}
+
+
+struct PoolCounters {
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> returned;
+    std::atomic<size_t> cached_bytes;
+};
+
+
+PoolCounters& poolCounters()
+{
+    static PoolCounters c = {{0}, {0}, {0}, {0}};
+    return c;
+}
+
+
+void* systemAllocate(size_t bytes)
+{
+    size_t alignment = CpuMemoryPool::Alignment;
+#ifdef __linux__
+    bool huge = settings().huge_pages && bytes >= HUGE_PAGE_SIZE;
+    if (huge)
+        alignment = HUGE_PAGE_SIZE;
+#endif
+
+    void* p = 0;
+#ifdef _WIN32
+    p = _aligned_malloc (bytes, alignment);
+#else
+    if (0 != posix_memalign (&p, alignment, bytes))
+        p = 0;
+#endif
+
+#ifdef __linux__
+    if (p && huge)
+        madvise (p, bytes, MADV_HUGEPAGE);
+#endif
+
+    return p;
+}
+
+
+void systemFree(void* p)
+{
+    poolCounters().returned++;
+
+#ifdef _WIN32
+    _aligned_free (p);
+#else
+    free (p);
+#endif
+}
+
+
+/**
+ * Free list shared by all threads. Blocks are returned to the system in the
+ * order they were released when the free lists grow larger than
+ * max_cached_bytes.
+ */
+class SharedPool
+{
+public:
+    void* pop(unsigned index, size_t class_bytes)
+    {
+        std::lock_guard<std::mutex> l(lock_);
+
+        std::vector<lru_t::iterator>& v = classes_[index];
+        if (v.empty ())
+            return 0;
+
+        lru_t::iterator i = v.back ();
+        v.pop_back ();
+
+        void* p = i->p;
+        lru_.erase (i);
+        poolCounters().cached_bytes -= class_bytes;
+        return p;
+    }
+
+
+    void push(void* p, unsigned index, size_t class_bytes)
+    {
+        size_t max_cached_bytes = settings().max_cached_bytes;
+        if (class_bytes > max_cached_bytes)
+        {
+            systemFree (p);
+            return;
+        }
+
+        std::vector<void*> evicted;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+
+            Block b = { p, index, class_bytes };
+            classes_[index].push_back (lru_.insert (lru_.end (), b));
+            poolCounters().cached_bytes += class_bytes;
+
+            while (poolCounters().cached_bytes > max_cached_bytes && !lru_.empty ())
+                evicted.push_back (popOldest ());
+        }
+
+        for (void* e : evicted)
+            systemFree (e);
+    }
+
+
+    void trim(size_t max_cached_bytes=0)
+    {
+        std::vector<void*> evicted;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            while (poolCounters().cached_bytes > max_cached_bytes && !lru_.empty ())
+                evicted.push_back (popOldest ());
+        }
+
+        for (void* e : evicted)
+            systemFree (e);
+    }
+
+private:
+    struct Block {
+        void* p;
+        unsigned index;
+        size_t class_bytes;
+    };
+
+    typedef std::list<Block> lru_t;
+
+    void* popOldest()
+    {
+        Block b = lru_.front ();
+
+        // The oldest block in lru_ is also the oldest block of its class
+        std::vector<lru_t::iterator>& v = classes_[b.index];
+        EXCEPTION_ASSERT( !v.empty () && v.front () == lru_.begin () );
+        v.erase (v.begin ());
+
+        lru_.pop_front ();
+        poolCounters().cached_bytes -= b.class_bytes;
+        return b.p;
+    }
+
+    std::mutex lock_;
+    lru_t lru_;
+    std::vector<lru_t::iterator> classes_[NUMBER_OF_CLASSES];
+};
+
+
+SharedPool& sharedPool()
+{
+    // Never destroyed, storage may be released during static destruction
+    static SharedPool* p = new SharedPool;
+    return *p;
+}
+
+
+thread_local bool thread_cache_destroyed = false;
+
+/**
+ * Free lists of small blocks that don't need a lock. Moved to the shared
+ * pool when the thread exits.
+ */
+class ThreadCache
+{
+public:
+    ~ThreadCache()
+    {
+        thread_cache_destroyed = true;
+        trim();
+    }
+
+
+    void* pop(unsigned index, size_t class_bytes)
+    {
+        std::vector<void*>& v = classes_[index];
+        if (v.empty ())
+            return 0;
+
+        void* p = v.back ();
+        v.pop_back ();
+        poolCounters().cached_bytes -= class_bytes;
+        return p;
+    }
+
+
+    bool push(void* p, unsigned index, size_t class_bytes)
+    {
+        std::vector<void*>& v = classes_[index];
+        if (v.size () >= THREAD_CACHE_BLOCKS_PER_CLASS)
+            return false;
+
+        v.push_back (p);
+        poolCounters().cached_bytes += class_bytes;
+        return true;
+    }
+
+
+    void trim()
+    {
+        size_t class_bytes;
+        for (unsigned i=0; i<THREAD_CACHE_CLASSES; i++)
+        {
+            for (void* p : classes_[i])
+            {
+                classBytes (i, &class_bytes);
+                poolCounters().cached_bytes -= class_bytes;
+                sharedPool().push (p, i, class_bytes);
+            }
+            classes_[i].clear ();
+        }
+    }
+
+
+    static bool handles(unsigned index)
+    {
+        return index < THREAD_CACHE_CLASSES;
+    }
+
+private:
+    static void classBytes(unsigned index, size_t* class_bytes)
+    {
+        if (0 == index)
+        {
+            *class_bytes = CpuMemoryPool::Alignment;
+            return;
+        }
+
+        unsigned b = (index-1)/4 + 6;
+        size_t q = (index-1)%4 + 1;
+        *class_bytes = ((size_t)1 << b) + q*(((size_t)1 << b) >> 2);
+    }
+
+    // Size classes up to 64 KB
+    static const unsigned THREAD_CACHE_CLASSES = 4*(16-6) + 1;
+
+    std::vector<void*> classes_[THREAD_CACHE_CLASSES];
+};
+
+
+ThreadCache* threadCache()
+{
+    if (thread_cache_destroyed)
+        return 0;
+
+    thread_local ThreadCache c;
+    return &c;
+}
+
+} // namespace
+
+
+void* CpuMemoryPool::
+        allocate(size_t bytes)
+{
+    size_t class_bytes;
+    unsigned index = classIndex (bytes, &class_bytes);
+
+    void* p = 0;
+    if (ThreadCache::handles (index))
+        if (ThreadCache* t = threadCache ())
+            p = t->pop (index, class_bytes);
+
+    if (!p)
+        p = sharedPool().pop (index, class_bytes);
+
+    if (p)
+    {
+        poolCounters().hits++;
+        return p;
+    }
+
+    poolCounters().misses++;
+    p = systemAllocate (class_bytes);
+    if (!p)
+    {
+        // Give cached memory back and try again
+        trim();
+        p = systemAllocate (class_bytes);
+    }
+
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+
+void CpuMemoryPool::
+        release(void* p, size_t bytes)
+{
+    if (!p)
+        return;
+
+    size_t class_bytes;
+    unsigned index = classIndex (bytes, &class_bytes);
+
+    if (ThreadCache::handles (index))
+        if (ThreadCache* t = threadCache ())
+            if (t->push (p, index, class_bytes))
+                return;
+
+    sharedPool().push (p, index, class_bytes);
+}
+
+
+CpuMemoryPool::Counters CpuMemoryPool::
+        counters()
+{
+    PoolCounters& c = poolCounters();
+    Counters r;
+    r.hits = c.hits;
+    r.misses = c.misses;
+    r.returned = c.returned;
+    r.cached_bytes = c.cached_bytes;
+    return r;
+}
+
+
+void CpuMemoryPool::
+        resetCounters()
+{
+    PoolCounters& c = poolCounters();
+    c.hits = 0;
+    c.misses = 0;
+    c.returned = 0;
+}
+
+
+void CpuMemoryPool::
+        trim()
+{
+    if (ThreadCache* t = threadCache ())
+        t->trim ();
+
+    sharedPool().trim ();
+}
+
+
+size_t CpuMemoryPool::
+        max_cached_bytes()
+{
+    return settings().max_cached_bytes;
+}
+
+
+void CpuMemoryPool::
+        max_cached_bytes(size_t v)
+{
+    settings().max_cached_bytes = v;
+    sharedPool().trim (v);
+}
+
+
+void CpuMemoryPool::
+        use_huge_pages(bool v)
+{
+    settings().huge_pages = v;
+}
+
+
+size_t CpuMemoryPool::
+        size_class(size_t bytes)
+{
+    size_t class_bytes;
+    classIndex (bytes, &class_bytes);
+    return class_bytes;
+}
+
+
+void CpuMemoryPool::
+        test()
+{
+    // It should round sizes up to size classes
+    {
+        EXCEPTION_ASSERT_EQUALS( size_class (0), 64u );
+        EXCEPTION_ASSERT_EQUALS( size_class (64), 64u );
+        EXCEPTION_ASSERT_EQUALS( size_class (65), 80u );
+        EXCEPTION_ASSERT_EQUALS( size_class (128), 128u );
+        EXCEPTION_ASSERT_EQUALS( size_class (129), 160u );
+        EXCEPTION_ASSERT_EQUALS( size_class (1000), 1024u );
+        EXCEPTION_ASSERT_EQUALS( size_class (1025), 1280u );
+        EXCEPTION_ASSERT_EQUALS( size_class (3<<20), 3u<<20 );
+        EXCEPTION_ASSERT_EQUALS( size_class ((3<<20) + 1), 7u<<19 );
+    }
+
+    // It should provide aligned memory
+    {
+        for (size_t bytes : {1, 100, 5000, 1<<20})
+        {
+            void* p = allocate (bytes);
+            EXCEPTION_ASSERT_EQUALS( (size_t)p % Alignment, 0u );
+            memset (p, 0, bytes);
+            release (p, bytes);
+        }
+    }
+
+    // It should reuse released memory of the same size class
+    {
+        for (size_t bytes : {100, 3<<20})
+        {
+            trim ();
+            resetCounters ();
+
+            void* a = allocate (bytes);
+            release (a, bytes);
+            void* b = allocate (bytes - 1);
+
+            Counters c = counters ();
+            EXCEPTION_ASSERT( a == b );
+            EXCEPTION_ASSERT_EQUALS( c.hits, 1u );
+            EXCEPTION_ASSERT_EQUALS( c.misses, 1u );
+            release (b, bytes - 1);
+        }
+    }
+
+    // It should reuse memory released by other threads
+    {
+        trim ();
+        resetCounters ();
+
+        size_t bytes = 1000;
+        void* a = 0;
+        std::thread t([&a, bytes]() {
+            a = allocate (bytes);
+            release (a, bytes);
+        });
+        t.join ();
+
+        void* b = allocate (bytes);
+        EXCEPTION_ASSERT( a == b );
+        EXCEPTION_ASSERT_EQUALS( counters ().hits, 1u );
+        release (b, bytes);
+    }
+
+    // It should not keep more than max_cached_bytes
+    {
+        trim ();
+        EXCEPTION_ASSERT_EQUALS( counters ().cached_bytes, 0u );
+
+        size_t max_cached = max_cached_bytes ();
+        max_cached_bytes (5<<20);
+
+        std::vector<void*> P;
+        for (int i=0; i<4; i++)
+            P.push_back (allocate (2<<20));
+
+        resetCounters ();
+        for (void* p : P)
+            release (p, 2<<20);
+
+        Counters c = counters ();
+        EXCEPTION_ASSERT_EQUALS( c.cached_bytes, 4u<<20 );
+        EXCEPTION_ASSERT_EQUALS( c.returned, 2u );
+
+        // The most recently released blocks are kept
+        EXCEPTION_ASSERT( P[3] == allocate (2<<20) );
+        release (P[3], 2<<20);
+
+        max_cached_bytes (max_cached);
+        trim ();
+        EXCEPTION_ASSERT_EQUALS( counters ().cached_bytes, 0u );
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef CPUMEMORYPOOL_H
+#define CPUMEMORYPOOL_H
+
+#include <stddef.h>
+
+/**
+ * @brief The CpuMemoryPool class should provide aligned memory for
+ * CpuMemoryStorage and reuse released memory instead of returning it to the
+ * system.
+ *
+ * Sizes are rounded up to size classes, four per power of two. Released
+ * memory is first kept in a free list of the releasing thread, small blocks
+ * only, and then in a free list shared by all threads. At most
+ * max_cached_bytes() are kept in the free lists, the oldest blocks are
+ * returned to the system first.
+ *
+ * CpuMemoryPool is thread-safe.
+ */
+class CpuMemoryPool
+{
+public:
+    enum { Alignment = 64 };
+
+    /**
+     * @brief allocate returns memory for at least 'bytes' bytes aligned to
+     * Alignment. Throws std::bad_alloc if the memory can't be allocated.
+     */
+    static void* allocate(size_t bytes);
+
+    /**
+     * @brief release gives back memory from allocate. 'bytes' must be the
+     * same as was given to allocate.
+     */
+    static void release(void* p, size_t bytes);
+
+    struct Counters {
+        unsigned long long hits;        // allocations served from a free list
+        unsigned long long misses;      // allocations from the system
+        unsigned long long returned;    // blocks returned to the system
+        size_t cached_bytes;            // bytes currently in the free lists
+    };
+
+    static Counters counters();
+    static void resetCounters();
+
+    /**
+     * @brief trim returns all memory in the shared free list, and in the free
+     * list of the calling thread, to the system.
+     */
+    static void trim();
+
+    /**
+     * Defaults to 1/16 of the physical memory, or 256 MB if unknown.
+     */
+    static size_t max_cached_bytes();
+    static void max_cached_bytes(size_t);
+
+    /**
+     * @brief use_huge_pages asks the system to back allocations of 2 MB or
+     * more with huge pages. Only has an effect on Linux, off by default.
+     */
+    static void use_huge_pages(bool);
+
+    /**
+     * @brief size_class returns the number of bytes actually allocated for a
+     * request of 'bytes' bytes.
+     */
+    static size_t size_class(size_t bytes);
+
+public:
+    static void test();
+};
+
+#endif // CPUMEMORYPOOL_H
@@ -1,38 +1,69 @@
 #include "cpumemorystorage.h"
+#include "cpumemorypool.h"
 
 #include <string.h> // memset, memcpy
 
 CpuMemoryStorage::
         CpuMemoryStorage(DataStorageVoid* p, bool, bool)
     :
-    DataStorageImplementation( p ),
+    DataStorageImplementation( p, Slot ),
     data( 0 ),
-    borrowsData( false )
+    borrowsData( false ),
+    pooled( true ),
+    pooledBytes( 0 )
 {
     CpuMemoryStorage* q = p->FindStorage<CpuMemoryStorage>();
     EXCEPTION_ASSERT( q == this );
 
-    data = new char[ p->numberOfBytes() ];
+    pooledBytes = p->numberOfBytes();
+    data = CpuMemoryPool::allocate( pooledBytes );
 }
 
 
 CpuMemoryStorage::
         CpuMemoryStorage( DataStorageVoid* p, void* data, bool adoptData )
     :
-    DataStorageImplementation( p ),
+    DataStorageImplementation( p, Slot ),
     data( data ),
-    borrowsData( !adoptData )
+    borrowsData( !adoptData ),
+    pooled( false ),
+    pooledBytes( 0 )
 {
     CpuMemoryStorage* q = p->AccessStorage<CpuMemoryStorage>( false, true ); // Mark borrowed memory as up to date
     EXCEPTION_ASSERT( q == this );
 }
 
 
+CpuMemoryStorage::
+        CpuMemoryStorage( DataStorageVoid* p, void* data, boost::shared_ptr<void> owner, bool copyBeforeWrite )
+    :
+    DataStorageImplementation( p, Slot ),
+    data( data ),
+    borrowsData( true ),
+    pooled( false ),
+    pooledBytes( 0 )
+{
+    CpuMemoryStorage* q = p->AccessStorage<CpuMemoryStorage>( false, true ); // Mark viewed memory as up to date
+    EXCEPTION_ASSERT( q == this );
+
+    // Set after marking the memory as up to date, or makeWritable would copy it
+    if (copyBeforeWrite)
+        this->viewed = owner;
+    else
+        this->sliced = owner;
+}
+
+
 CpuMemoryStorage::
         ~CpuMemoryStorage()
 {
-    if (!borrowsData)
-        delete [](char*)data;
+    if (borrowsData)
+        return;
+
+    if (pooled)
+        CpuMemoryPool::release( data, pooledBytes );
+    else
+        delete [](char*)data; // adopted data
 }
 
 
@@ -66,6 +97,7 @@ bool CpuMemoryStorage::
 void CpuMemoryStorage::
         clear()
 {
+    makeWritable( false );
     memset( data, 0, dataStorage()->numberOfBytes() );
 }
 
@@ -82,3 +114,22 @@ bool CpuMemoryStorage::
 {
     return !borrowsData;
 }
+
+
+void CpuMemoryStorage::
+        makeWritable(bool keepContents)
+{
+    if (!viewed)
+        return;
+
+    size_t bytes = dataStorage()->numberOfBytes();
+    void* p = CpuMemoryPool::allocate( bytes );
+    if (keepContents)
+        memcpy( p, data, bytes );
+
+    data = p;
+    borrowsData = false;
+    pooled = true;
+    pooledBytes = bytes;
+    viewed.reset();
+}
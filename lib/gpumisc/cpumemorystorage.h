@@ -7,8 +7,10 @@
 class CpuMemoryStorage: public DataStorageImplementation
 {
 public:
+    static const DataStorageVoid::StorageSlot Slot = DataStorageVoid::Slot_Cpu;
+
     template<unsigned Dimension, typename T> static
-    CpuMemoryReadOnly<T, Dimension> ReadOnly( boost::shared_ptr<DataStorage<T> >p )
+    CpuMemoryReadOnly<T, Dimension> ReadOnly( const boost::shared_ptr<DataStorage<T> >& p )
     {
         return ReadOnly<T, Dimension>( p.get() );
     }
@@ -21,7 +23,7 @@ public:
 
 
     template<unsigned Dimension, typename T> static
-    CpuMemoryWriteOnly<T, Dimension> ReadWrite( boost::shared_ptr<DataStorage<T> > p )
+    CpuMemoryWriteOnly<T, Dimension> ReadWrite( const boost::shared_ptr<DataStorage<T> >& p )
     {
         return ReadWrite<T, Dimension>( p.get() );
     }
@@ -34,7 +36,7 @@ public:
 
 
     template<unsigned Dimension, typename T> static
-    CpuMemoryWriteOnly<T, Dimension> WriteAll( boost::shared_ptr<DataStorage<T> > p )
+    CpuMemoryWriteOnly<T, Dimension> WriteAll( const boost::shared_ptr<DataStorage<T> >& p )
     {
         return WriteAll<T, Dimension>( p.get() );
     }
@@ -73,16 +75,79 @@ public:
         return ds;
     }
 
+
+    /**
+      Returns a DataStorage that refers to 'size' elements of 'source' starting
+      at element 'offset' without copying any data. The view keeps 'source'
+      alive and takes a private copy the first time it is written to.
+      Subsequent writes to 'source' are visible through the view, it is up to
+      the owner of 'source' to not modify data that is being viewed.
+      */
+    template<typename T>
+    static boost::shared_ptr<DataStorage<T> > ViewPtr( boost::shared_ptr<DataStorage<T> > source, DataStorageSize size, size_t offset=0 )
+    {
+        EXCEPTION_ASSERT_LESS_OR_EQUAL( offset + size.width*size.height*size.depth, source->numberOfElements() );
+
+        T* data = ReadOnly<1>( source ).ptr() + offset;
+        return ViewPtr( size, data, boost::shared_ptr<void>(source) );
+    }
+
+
+    /**
+      Like ViewPtr above but refers to memory that is kept alive by 'owner',
+      for instance a memory mapped file. The memory is never written to.
+      */
+    template<typename T>
+    static boost::shared_ptr<DataStorage<T> > ViewPtr( DataStorageSize size, T* data, boost::shared_ptr<void> owner )
+    {
+        boost::shared_ptr<DataStorage<T> > ds( new DataStorage<T>(size) );
+        new CpuMemoryStorage( ds.get(), data, owner ); // Memory managed by DataStorage
+        return ds;
+    }
+
+
+    /**
+      Returns a DataStorage that refers to 'size' elements of 'source' starting
+      at element 'offset'. Unlike ViewPtr writes to the slice go straight to
+      the memory of 'source'. The slice keeps 'source' alive, it is up to the
+      owner of 'source' to not share it with copy-on-write while there are
+      slices of it.
+      */
+    template<typename T>
+    static boost::shared_ptr<DataStorage<T> > SlicePtr( boost::shared_ptr<DataStorage<T> > source, DataStorageSize size, size_t offset=0 )
+    {
+        EXCEPTION_ASSERT_LESS_OR_EQUAL( offset + size.width*size.height*size.depth, source->numberOfElements() );
+
+        T* data = ReadWrite<1>( source ).ptr() + offset;
+        boost::shared_ptr<DataStorage<T> > ds( new DataStorage<T>(size) );
+        new CpuMemoryStorage( ds.get(), data, boost::shared_ptr<void>(source), false ); // Memory managed by DataStorage
+        return ds;
+    }
+
 private:
+    CpuMemoryStorage( DataStorageVoid* p, void* data, boost::shared_ptr<void> owner, bool copyBeforeWrite=true );
+
+
     virtual bool updateFromOther(DataStorageImplementation *p);
     virtual bool updateOther(DataStorageImplementation *p);
     virtual void clear();
     virtual DataStorageImplementation* newInstance( DataStorageVoid* p );
     virtual bool allowCow();
+    virtual void makeWritable(bool keepContents);
 
     void* data;
 
     bool borrowsData;
+
+    /// Set if 'data' was allocated from CpuMemoryPool, with 'pooledBytes' bytes
+    bool pooled;
+    size_t pooledBytes;
+
+    /// Set if 'data' is borrowed from another DataStorage or file, see ViewPtr
+    boost::shared_ptr<void> viewed;
+
+    /// Set if 'data' is a slice of another DataStorage, see SlicePtr
+    boost::shared_ptr<void> sliced;
 };
 
 
@@ -4,6 +4,17 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
 
 double CpuProperties::
         cpu_memory_speed(unsigned *sz)
@@ -28,3 +39,75 @@ double CpuProperties::
 
     return 2*M*n/dt;
 }
+
+
+size_t CpuProperties::
+        cpu_memory_size()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx (&status))
+        return 0;
+    return status.ullTotalPhys;
+#else
+    long pages = sysconf (_SC_PHYS_PAGES);
+    long page_size = sysconf (_SC_PAGESIZE);
+    if (pages < 0 || page_size < 0)
+        return 0;
+    return (size_t)pages * page_size;
+#endif
+}
+
+
+static CpuProperties::SimdLevel detect_simd_level()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f"))
+        return CpuProperties::Simd_AVX512;
+    if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+        return CpuProperties::Simd_AVX2;
+    if (__builtin_cpu_supports ("sse2"))
+        return CpuProperties::Simd_SSE2;
+    return CpuProperties::Simd_None;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid (info, 0);
+    int max_leaf = info[0];
+
+    __cpuid (info, 1);
+    bool sse2 = (info[3] & (1<<26)) != 0;
+    bool fma = (info[2] & (1<<12)) != 0;
+    bool osxsave = (info[2] & (1<<27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv (0) : 0;
+    bool os_ymm = (xcr0 & 0x6) == 0x6;
+    bool os_zmm = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512f = false;
+    if (max_leaf >= 7)
+    {
+        __cpuidex (info, 7, 0);
+        avx2 = (info[1] & (1<<5)) != 0;
+        avx512f = (info[1] & (1<<16)) != 0;
+    }
+
+    if (avx512f && os_zmm)
+        return CpuProperties::Simd_AVX512;
+    if (avx2 && fma && os_ymm)
+        return CpuProperties::Simd_AVX2;
+    if (sse2)
+        return CpuProperties::Simd_SSE2;
+    return CpuProperties::Simd_None;
+#else
+    return CpuProperties::Simd_None;
+#endif
+}
+
+
+CpuProperties::SimdLevel CpuProperties::
+        simd_level()
+{
+    static SimdLevel level = detect_simd_level ();
+    return level;
+}
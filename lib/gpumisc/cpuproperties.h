@@ -1,10 +1,28 @@
 #ifndef CPUPROPERTIES_H
 #define CPUPROPERTIES_H
 
+#include <stddef.h>
+
 class CpuProperties
 {
 public:
     static double cpu_memory_speed(unsigned *n=0);
+
+    /// Total amount of physical memory in bytes, or 0 if unknown.
+    static size_t cpu_memory_size();
+
+    enum SimdLevel {
+        Simd_None,
+        Simd_SSE2,
+        Simd_AVX2,      // AVX2 and FMA3
+        Simd_AVX512     // AVX-512F
+    };
+
+    /**
+     * @brief simd_level returns the widest vector instruction set supported
+     * by both the cpu and the operating system. Detected once per process.
+     */
+    static SimdLevel simd_level();
 };
 
 #endif // CPUPROPERTIES_H
@@ -16,7 +16,7 @@ storageCudaMemsetFixT storageCudaMemsetFix;
 CudaGlobalStorage::
         CudaGlobalStorage( DataStorageVoid* p, bool, bool, bool allocateWithPitch )
             :
-            DataStorageImplementation( p ),
+            DataStorageImplementation( p, Slot ),
             borrowsData( false ),
             allocatedWithPitch( allocateWithPitch )
 {
@@ -45,7 +45,7 @@ CudaGlobalStorage::
 CudaGlobalStorage::
         CudaGlobalStorage( DataStorageVoid* p, cudaPitchedPtr externalData, bool adoptData )
             :
-            DataStorageImplementation( p ),
+            DataStorageImplementation( p, Slot ),
             borrowsData( !adoptData ),
             allocatedWithPitch( externalData.pitch != externalData.xsize )
 {
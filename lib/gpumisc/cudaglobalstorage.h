@@ -11,6 +11,8 @@ extern storageCudaMemsetFixT storageCudaMemsetFix;
 class CudaGlobalStorage: public DataStorageImplementation
 {
 public:
+    static const DataStorageVoid::StorageSlot Slot = DataStorageVoid::Slot_Cuda;
+
     template<unsigned Dimension, typename T> static
     CudaGlobalReadOnly<T, Dimension> ReadOnly( boost::shared_ptr< DataStorage<T> >p )
     {
@@ -4,8 +4,11 @@
 #include "cpumemorystorage.h"
 #include "tasktimer.h"
 #include "demangle.h"
+#include "timer.h"
 
 #include <algorithm>
+#include <vector>
+#include <string.h>
 
 #include <boost/assert.hpp>
 #include <boost/foreach.hpp>
@@ -14,8 +17,9 @@
 #define TIME_DataStorageImplementation if(0)
 
 DataStorageImplementation::
-        DataStorageImplementation( DataStorageVoid* dataStorage )
+        DataStorageImplementation( DataStorageVoid* dataStorage, DataStorageVoid::StorageSlot slot )
             :
+            slot_(slot),
             dataStorage_(dataStorage)
 {
     TIME_DataStorageImplementation
@@ -26,19 +30,21 @@ DataStorageImplementation::
 
     EXCEPTION_ASSERT( dataStorage_ );
 
-    dataStorage_->storage_.insert( this );
+    // There must be at most one of each type
+    EXCEPTION_ASSERT( 0 == dataStorage_->storage_[slot_] );
+    dataStorage_->storage_[slot_] = this;
 }
 
 
 DataStorageImplementation::
         ~DataStorageImplementation()
 {
-    bool dataStorageHasThis = (1 == dataStorage_->storage_.count( this ));
+    bool dataStorageHasThis = (this == dataStorage_->storage_[slot_]);
     EXCEPTION_ASSERT( dataStorageHasThis );
     EXCEPTION_ASSERT( dataStorageCow_.empty() );
 
-    dataStorage_->storage_.erase( this );
-    dataStorage_->validContent_.erase( this );
+    dataStorage_->clearValid( this );
+    dataStorage_->storage_[slot_] = 0;
 }
 
 
@@ -47,10 +53,12 @@ void DataStorageImplementation::
 {
     EXCEPTION_ASSERT( dataStorage_->numberOfBytes() == parent->numberOfBytes() );
 
+    EXCEPTION_ASSERT( 0 == parent->storage_[slot_] );
+
     dataStorageCow_.insert( parent );
-    parent->storage_.insert( this );
-    if (dataStorage_->validContent_.count(this))
-        parent->validContent_.insert( this );
+    parent->storage_[slot_] = this;
+    if (dataStorage_->isValid( this ))
+        parent->setValid( this );
 }
 
 
@@ -60,8 +68,8 @@ bool DataStorageImplementation::
     if (dataStorageCow_.count(parent))
     {
         dataStorageCow_.erase(parent);
-        parent->storage_.erase(this);
-        parent->validContent_.erase(this);
+        parent->clearValid(this);
+        parent->storage_[slot_] = 0;
         return true;
     }
 
@@ -71,8 +79,8 @@ bool DataStorageImplementation::
     {
         DataStorageVoid* q = *dataStorageCow_.begin ();
         dataStorageCow_.erase (q);
-        dataStorage_->validContent_.erase (this);
-        dataStorage_->storage_.erase (this);
+        dataStorage_->clearValid (this);
+        dataStorage_->storage_[slot_] = 0;
         dataStorage_ = q;
         return true;
     }
@@ -84,6 +92,13 @@ bool DataStorageImplementation::
 DataStorageImplementation* DataStorageImplementation::
         copyOnWrite(DataStorageVoid* parent)
 {
+    if (dataStorageCow_.empty ())
+    {
+        // Nothing to copy, 'parent' is the owner
+        EXCEPTION_ASSERT( parent == dataStorage_ );
+        return this;
+    }
+
     DataStorageImplementation* r = 0;
 
     std::set<DataStorageVoid*> cows = dataStorageCow_;
@@ -97,7 +112,7 @@ DataStorageImplementation* DataStorageImplementation::
         DataStorageImplementation* q = newInstance( p );
         bool updated = q->updateThis( this );
         EXCEPTION_ASSERT( updated );
-        p->validContent_.insert( q );
+        p->setValid( q );
 
         if (parent == p)
             r = q;
@@ -114,9 +129,9 @@ DataStorageImplementation* DataStorageImplementation::
 bool DataStorageImplementation::
         updateThis()
 {
-    DataStorageVoid::StorageImplementations validContent = dataStorage()->validContent();
+    DataStorageVoid* d = dataStorage();
 
-    if (validContent.empty())
+    if (0 == d->validContent_)
     {
         TIME_DataStorageImplementation
                 TaskTimer tt("%s %p clear( %u, %u, %u ), elemsize %u",
@@ -129,12 +144,13 @@ bool DataStorageImplementation::
         return true;
     }
 
-    if (1 == validContent.count(this))
+    if (d->isValid(this))
         return true;
 
-    BOOST_FOREACH( DataStorageImplementation* p, validContent )
+    for (int i=0; i<DataStorageVoid::Slot_Count; ++i)
     {
-        if (updateThis(p))
+        DataStorageImplementation* p = d->storage_[i];
+        if (p && d->isValid(p) && updateThis(p))
             return true;
     }
 
@@ -149,6 +165,8 @@ bool DataStorageImplementation::
             demangle( typeid(*this) ).c_str(), dataStorage_,
             size().width, size().height, size().depth, dataStorage_->bytesPerElement() );
 
+    makeWritable( false );
+
     if (p->updateOther( this ))
     {
         TIME_DataStorageImplementation TaskInfo(
@@ -172,18 +190,23 @@ bool DataStorageImplementation::
 DataStorageVoid::
         DataStorageVoid(DataStorageSize size, size_t bytesPerElement)
     :
+    validContent_( 0 ),
     size_( size ),
     bytesPerElement_( bytesPerElement )
 {
+    std::fill( storage_, storage_ + Slot_Count, (DataStorageImplementation*)0 );
 }
 
 
 DataStorageVoid::
         DataStorageVoid( const DataStorageVoid& b )
     :
+    validContent_( 0 ),
     size_( b.size_ ),
     bytesPerElement_( b.bytesPerElement_ )
 {
+    std::fill( storage_, storage_ + Slot_Count, (DataStorageImplementation*)0 );
+
     *this = b;
 }
 
@@ -207,9 +230,10 @@ DataStorageSize DataStorageVoid::
 void DataStorageVoid::
         ClearContents()
 {
-    BOOST_FOREACH( DataStorageImplementation* p, validContent_ )
+    for (int i=0; i<Slot_Count; ++i)
     {
-        p->clear();
+        if (storage_[i] && isValid(storage_[i]))
+            storage_[i]->clear();
     }
 }
 
@@ -219,21 +243,25 @@ void DataStorageVoid::
 {
     TIME_DataStorageImplementation
             TaskTimer tt("%s.DiscardAllData %p #%d ( %u, %u, %u ), elemsize %u",
-                         vartype(*this).c_str(), this, storage_.size(),
+                         vartype(*this).c_str(), this, storages().size(),
                          size().width, size().height, size().depth,
                          bytesPerElement());
 
-    validContent_.clear();
+    validContent_ = 0;
 
-    while (!storage_.empty())
+    for (int i=0; i<Slot_Count; ++i)
     {
-        if (!(**storage_.begin()).removeCowCopy(this))
+        DataStorageImplementation* p = storage_[i];
+        if (!p)
+            continue;
+
+        if (!p->removeCowCopy(this))
         {
-            (**storage_.begin()).copyOnWrite(this);
-            size_t s = storage_.size();
-            delete *storage_.begin();
-            EXCEPTION_ASSERT( storage_.size() + 1 == s );
+            p->copyOnWrite(this);
+            delete p;
         }
+
+        EXCEPTION_ASSERT( 0 == storage_[i] );
     }
 }
 
@@ -242,15 +270,17 @@ DataStorageVoid& DataStorageVoid::
         operator=(const DataStorageVoid& b)
 {
     bool allowCow = false;
-    BOOST_FOREACH( DataStorageImplementation* p, b.validContent_ )
+    for (int i=0; i<Slot_Count; ++i)
     {
         // There has to be one instances that permits Cow copies
-        allowCow |= p->allowCow();
+        if (b.storage_[i] && b.isValid(b.storage_[i]))
+            allowCow |= b.storage_[i]->allowCow();
     }
-    BOOST_FOREACH( DataStorageImplementation* p, this->storage_ )
+    for (int i=0; i<Slot_Count; ++i)
     {
         // All allocated instances in 'this' must support being replaced by 'Cow' copies.
-        allowCow &= p->allowCow();
+        if (storage_[i])
+            allowCow &= storage_[i]->allowCow();
     }
 
     if (allowCow)
@@ -261,9 +291,10 @@ DataStorageVoid& DataStorageVoid::
         // COW, copy on write, postpones copying of data chunks until 'UpdateValidContent'
         DiscardAllData();
 
-        BOOST_FOREACH( DataStorageImplementation* p, b.storage_ )
+        for (int i=0; i<Slot_Count; ++i)
         {
-            if (p->allowCow())
+            DataStorageImplementation* p = b.storage_[i];
+            if (p && p->allowCow())
                 p->addCowCopy( this );
         }
     }
@@ -279,11 +310,11 @@ DataStorageVoid& DataStorageVoid::
 void DataStorageVoid::
         DeepCopy(const DataStorageVoid&b)
 {
-    validContent_.clear();
+    validContent_ = 0;
 
     DataStorageImplementation* p = CopyStorage(b);
     if (p)
-        validContent_.insert( p );
+        setValid( p );
 }
 
 
@@ -328,19 +359,17 @@ void DataStorageVoid::
 void DataStorageVoid::
         OnlyKeepOneStorage(DataStorageImplementation* t)
 {
-    EXCEPTION_ASSERT(storage_.count(t) && validContent_.count(t));
-
-    StorageImplementations toRemove = storage_;
-    toRemove.erase( t );
+    EXCEPTION_ASSERT(storage_[t->slot()] == t && isValid(t));
 
-    BOOST_FOREACH( DataStorageImplementation* p, toRemove )
+    for (int i=0; i<Slot_Count; ++i)
     {
-        delete p; // removes from storage_
+        if (storage_[i] && storage_[i] != t)
+            delete storage_[i]; // removes from storage_
     }
 
-    EXCEPTION_ASSERT( storage_.size() == 1 );
-    EXCEPTION_ASSERT( storage_.count(t) == 1 );
-    validContent_ = storage_;
+    EXCEPTION_ASSERT( storages().size() == 1 );
+    EXCEPTION_ASSERT( storage_[t->slot()] == t );
+    validContent_ = slotBit( t->slot() );
 }
 
 
@@ -349,22 +378,22 @@ DataStorageImplementation* DataStorageVoid::
 {
     if (read)
     {
-        bool storageIsUpToDate = 0!=validContent_.count(t);
+        bool storageIsUpToDate = isValid(t);
 
         if (!storageIsUpToDate)
         {
             t = t->copyOnWrite(this);
             bool success = t->updateThis();
             EXCEPTION_ASSERT( success );
-            validContent_.insert( t );
+            setValid( t );
         }
     }
 
     if (write)
     {
         t = t->copyOnWrite(this);
-        validContent_.clear();
-        validContent_.insert( t );
+        t->makeWritable( read ); // WriteAll overwrites everything, no need to copy
+        validContent_ = slotBit( t->slot() );
     }
 
     EXCEPTION_ASSERT(read || write);
@@ -378,34 +407,34 @@ DataStorageImplementation* DataStorageVoid::
 {
     // Look for anything we have allocated that can use valid content from 'b'
     // Note. if b.validContent_ is empty this operator doesn't do anything.
-    StorageImplementations oldValidContent = validContent_;
-    validContent_.clear();
+    unsigned oldValidContent = validContent_;
+    validContent_ = 0;
 
-    BOOST_FOREACH( DataStorageImplementation* p, oldValidContent )
+    // First try storages that had valid content, then the other allocations
+    for (int pass=0; pass<2; ++pass)
     {
-        BOOST_FOREACH( DataStorageImplementation* bp, b.validContent_ )
+        for (int i=0; i<Slot_Count; ++i)
         {
-            if (p->updateThis( bp ))
-                return p;
+            DataStorageImplementation* p = storage_[i];
+            bool wasValid = 0 != (oldValidContent & slotBit( (StorageSlot)i ));
+            if (!p || wasValid != (0 == pass))
+                continue;
+
+            for (int j=0; j<Slot_Count; ++j)
+            {
+                DataStorageImplementation* bp = b.storage_[j];
+                if (bp && b.isValid( bp ) && p->updateThis( bp ))
+                    return p;
+            }
         }
     }
-    StorageImplementations oldAllocations = storage_;
 
-    // skip storages that has already been tried above
-    BOOST_FOREACH( DataStorageImplementation* p, oldValidContent )
-        oldAllocations.erase( p );
-
-    BOOST_FOREACH( DataStorageImplementation* p, oldAllocations )
+    for (int j=0; j<Slot_Count; ++j)
     {
-        BOOST_FOREACH( DataStorageImplementation* bp, b.validContent_ )
-        {
-            if (p->updateThis( bp ))
-                return p;
-        }
-    }
+        DataStorageImplementation* bp = b.storage_[j];
+        if (!bp || !b.isValid( bp ))
+            continue;
 
-    BOOST_FOREACH( DataStorageImplementation* bp, b.validContent_ )
-    {
         DataStorageImplementation* p = bp->newInstance( this );
 
         EXCEPTION_ASSERT( p );
@@ -420,7 +449,183 @@ DataStorageImplementation* DataStorageVoid::
 }
 
 
+DataStorageVoid::StorageImplementations DataStorageVoid::
+        validContent() const
+{
+    StorageImplementations r;
+    for (int i=0; i<Slot_Count; ++i)
+        if (storage_[i] && isValid(storage_[i]))
+            r.insert( storage_[i] );
+    return r;
+}
+
+
+DataStorageVoid::StorageImplementations DataStorageVoid::
+        storages() const
+{
+    StorageImplementations r;
+    for (int i=0; i<Slot_Count; ++i)
+        if (storage_[i])
+            r.insert( storage_[i] );
+    return r;
+}
+
+
+bool DataStorageVoid::
+        isValid(const DataStorageImplementation* p) const
+{
+    return storage_[p->slot()] == p && 0 != (validContent_ & slotBit( p->slot() ));
+}
+
+
+void DataStorageVoid::
+        setValid(DataStorageImplementation* p)
+{
+    EXCEPTION_ASSERT( storage_[p->slot()] == p );
+    validContent_ |= slotBit( p->slot() );
+}
+
+
+void DataStorageVoid::
+        clearValid(const DataStorageImplementation* p)
+{
+    if (storage_[p->slot()] == p)
+        validContent_ &= ~slotBit( p->slot() );
+}
+
+
 void* getCpuMemory(DataStorageVoid*p)
 {
     return p->AccessStorage<CpuMemoryStorage>( true, true )->AccessBytes<3>().ptr();
 }
+
+
+namespace {
+
+/**
+ * A second storage type for testing copies between storages. Takes the
+ * OpenCl slot.
+ */
+class TestStorage: public DataStorageImplementation
+{
+public:
+    static const DataStorageVoid::StorageSlot Slot = DataStorageVoid::Slot_OpenCl;
+
+    TestStorage( DataStorageVoid* p, bool, bool )
+        :
+          DataStorageImplementation( p, Slot ),
+          data( p->numberOfBytes() )
+    {
+    }
+
+    std::vector<char> data;
+
+private:
+    virtual bool updateFromOther(DataStorageImplementation *p)
+    {
+        if (TestStorage* t = dynamic_cast<TestStorage*>(p))
+            data = t->data;
+        else if (CpuMemoryStorage* c = dynamic_cast<CpuMemoryStorage*>(p))
+            memcpy( &data[0], c->AccessBytes<1>().ptr(), data.size() );
+        else
+            return false;
+        return true;
+    }
+
+    virtual bool updateOther(DataStorageImplementation *p)
+    {
+        if (CpuMemoryStorage* c = dynamic_cast<CpuMemoryStorage*>(p))
+        {
+            memcpy( c->AccessBytes<1>().ptr(), &data[0], data.size() );
+            return true;
+        }
+        return false;
+    }
+
+    virtual void clear() { std::fill( data.begin(), data.end(), 0 ); }
+    virtual DataStorageImplementation* newInstance( DataStorageVoid* p ) { return new TestStorage( p, false, false ); }
+    virtual bool allowCow() { return true; }
+};
+
+} // namespace
+
+
+void DataStorageVoid::
+        test()
+{
+    // It should keep track of which storage types that are up to date
+    {
+        DataStorage<float>::ptr d(new DataStorage<float>(4));
+        EXCEPTION_ASSERT( !d->HasValidContent<CpuMemoryStorage>() );
+
+        float* p = CpuMemoryStorage::WriteAll<1>( d ).ptr();
+        p[0] = 1; p[1] = 2; p[2] = 3; p[3] = 4;
+        EXCEPTION_ASSERT( d->HasValidContent<CpuMemoryStorage>() );
+        EXCEPTION_ASSERT( !d->HasValidContent<TestStorage>() );
+
+        TestStorage* t = d->AccessStorage<TestStorage>( true, false );
+        EXCEPTION_ASSERT_EQUALS( ((float*)&t->data[0])[2], 3.f );
+        EXCEPTION_ASSERT( d->HasValidContent<CpuMemoryStorage>() );
+        EXCEPTION_ASSERT( d->HasValidContent<TestStorage>() );
+        EXCEPTION_ASSERT_EQUALS( d->validContent().size(), 2u );
+
+        t = d->AccessStorage<TestStorage>( true, true );
+        ((float*)&t->data[0])[2] = 5;
+        EXCEPTION_ASSERT( !d->HasValidContent<CpuMemoryStorage>() );
+        EXCEPTION_ASSERT( d->HasValidContent<TestStorage>() );
+
+        // The same allocation is updated
+        EXCEPTION_ASSERT( p == CpuMemoryStorage::ReadOnly<1>( d ).ptr() );
+        EXCEPTION_ASSERT_EQUALS( p[2], 5.f );
+        EXCEPTION_ASSERT( d->HasValidContent<CpuMemoryStorage>() );
+
+        d->OnlyKeepOneStorage<CpuMemoryStorage>();
+        EXCEPTION_ASSERT( 0 == d->FindStorage<TestStorage>() );
+        EXCEPTION_ASSERT_EQUALS( p[3], 4.f );
+    }
+
+    // It should postpone copies with copy-on-write
+    {
+        DataStorage<float>::ptr a(new DataStorage<float>(4));
+        float* p = CpuMemoryStorage::WriteAll<1>( a ).ptr();
+        p[0] = 1; p[1] = 2; p[2] = 3; p[3] = 4;
+        a->AccessStorage<TestStorage>( true, false );
+
+        DataStorage<float>::ptr b(new DataStorage<float>(4));
+        *b = *a;
+        EXCEPTION_ASSERT( b->FindStorage<CpuMemoryStorage>() == a->FindStorage<CpuMemoryStorage>() );
+        EXCEPTION_ASSERT( b->HasValidContent<TestStorage>() );
+
+        float* q = CpuMemoryStorage::ReadWrite<1>( b ).ptr();
+        EXCEPTION_ASSERT( b->FindStorage<CpuMemoryStorage>() != a->FindStorage<CpuMemoryStorage>() );
+        q[1] = 7;
+        EXCEPTION_ASSERT_EQUALS( CpuMemoryStorage::ReadOnly<1>( a ).ptr()[1], 2.f );
+        EXCEPTION_ASSERT_EQUALS( CpuMemoryStorage::ReadOnly<1>( b ).ptr()[1], 7.f );
+        EXCEPTION_ASSERT( !b->HasValidContent<TestStorage>() );
+        EXCEPTION_ASSERT( a->HasValidContent<TestStorage>() );
+
+        a.reset ();
+        EXCEPTION_ASSERT_EQUALS( CpuMemoryStorage::ReadOnly<1>( b ).ptr()[0], 1.f );
+    }
+
+    // It should have a low overhead for accessing storage that is up to date
+    {
+        DataStorage<float>::ptr d(new DataStorage<float>(1000));
+        CpuMemoryStorage::WriteAll<1>( d );
+
+        const int N = 100000;
+        float s = 0;
+        Timer t;
+        for (int i=0; i<N; i++)
+            s += CpuMemoryStorage::ReadOnly<1>( d ).ptr()[i%1000];
+        double readonly = t.elapsedAndRestart () / N;
+
+        for (int i=0; i<N; i++)
+            CpuMemoryStorage::WriteAll<1>( d ).ptr()[i%1000] = s;
+        double writeall = t.elapsed () / N;
+
+        TaskInfo("ReadOnly %.0f ns, WriteAll %.0f ns", readonly*1e9, writeall*1e9);
+        EXCEPTION_ASSERT_LESS( readonly, 1e-6 );
+        EXCEPTION_ASSERT_LESS( writeall, 1e-6 );
+    }
+}
@@ -23,9 +23,21 @@ protected:
     virtual ~DataStorageVoid();
 
 public:
+    /**
+      Each type of storage implementation has a fixed slot. There is at most
+      one storage of each type in a DataStorageVoid. Implementations declare
+      their slot as 'static const StorageSlot Slot'.
+      */
+    enum StorageSlot {
+        Slot_Cpu,
+        Slot_Cuda,
+        Slot_OpenCl,
+        Slot_Count
+    };
+
     typedef std::set<DataStorageImplementation*> StorageImplementations;
 
-    const StorageImplementations& validContent() const { return validContent_; }
+    StorageImplementations validContent() const;
 
 
     DataStorageSize size() const { return size_; }
@@ -51,44 +63,14 @@ public:
     template<typename T>
     T* FindStorage() const
     {
-        T* r = 0;
-
-        // boost/foreach.hpp seems to not work with nvcc and boost/assert.hpp in windows
-        for( StorageImplementations::const_iterator itr = storage_.begin();
-             itr != storage_.end(); ++itr )
-        {
-            DataStorageImplementation* p = *itr;
-            if (T* t = dynamic_cast<T*>( p ))
-            {
-                // There must be at most one of each type
-                EXCEPTION_ASSERT( r == 0 );
-                r = t;
-            }
-        }
-
-        return r;
+        return static_cast<T*>( storage_[T::Slot] );
     }
 
 
     template<typename T>
     bool HasValidContent() const
     {
-        bool r = false;
-
-        // boost/foreach.hpp seems to not work with nvcc and boost/assert.hpp in windows
-        for( StorageImplementations::const_iterator itr = validContent_.begin();
-             itr != validContent_.end(); ++itr )
-        {
-            DataStorageImplementation* p = *itr;
-            if (dynamic_cast<T*>( p ))
-            {
-                // There must be at most one of each type
-                EXCEPTION_ASSERT( r == false );
-                r = true;
-            }
-        }
-
-        return r;
+        return 0 != (validContent_ & slotBit( T::Slot ));
     }
 
 
@@ -96,18 +78,22 @@ public:
     StorageType* AccessStorage(bool read, bool write)
     {
         StorageType* t = FindStorage<StorageType>();
+
+        // Reading content that is already up to date doesn't change anything
+        if (t && read && !write && (validContent_ & slotBit( StorageType::Slot )))
+            return t;
+
         if (!t)
             t = new StorageType(this, read, write);
 
-        t = dynamic_cast<StorageType*>(UpdateValidContent( t, read, write ));
-        return t;
+        return static_cast<StorageType*>(UpdateValidContent( t, read, write ));
     }
 
 
     template<typename StorageType>
     void OnlyKeepOneStorage()
     {
-        if (!validContent_.empty ())
+        if (0 != validContent_)
         {
             DataStorageImplementation* t = AccessStorage<StorageType>(true, true);
             OnlyKeepOneStorage( t );
@@ -146,8 +132,17 @@ public:
 protected:
     friend class DataStorageImplementation;
 
-    StorageImplementations storage_;
-    StorageImplementations validContent_;
+    static unsigned slotBit(StorageSlot slot) { return 1u << slot; }
+
+    bool isValid(const DataStorageImplementation* p) const;
+    void setValid(DataStorageImplementation* p);
+    void clearValid(const DataStorageImplementation* p);
+
+    /// At most one storage of each type, indexed by StorageSlot
+    DataStorageImplementation* storage_[Slot_Count];
+
+    /// Bit i is set if storage_[i] has up-to-date content
+    unsigned validContent_;
 
 
 private:
@@ -160,13 +155,13 @@ private:
     DataStorageImplementation* UpdateValidContent( DataStorageImplementation* t, bool read, bool write );
     DataStorageImplementation* CopyStorage(const DataStorageVoid& b);
 
-};
+    /// Storages that are allocated in 'this'
+    StorageImplementations storages() const;
 
+public:
+    static void test();
+};
 
-// findImplementationType<DataStorageImplementation> is an invalid template argument
-template<>
-DataStorageImplementation* DataStorageVoid::
-        FindStorage<DataStorageImplementation>() const;
 
 
 void* getCpuMemory(DataStorageVoid*);
@@ -325,11 +320,14 @@ public:
 class DataStorageImplementation: boost::noncopyable
 {
 protected:
-    DataStorageImplementation( DataStorageVoid* p );
+    DataStorageImplementation( DataStorageVoid* p, DataStorageVoid::StorageSlot slot );
 public:
     virtual ~DataStorageImplementation();
 
 
+    DataStorageVoid::StorageSlot slot() const { return slot_; }
+
+
     DataStorageSize size() const { return dataStorage()->size(); }
 
 
@@ -397,6 +395,14 @@ public:
       */
     virtual bool allowCow() = 0;
 
+
+    /**
+      Called before the contents of 'this' is modified. Implementations that
+      refer to memory owned by another DataStorage (a view) take a private
+      copy here. The current contents is only copied if 'keepContents' is true.
+      */
+    virtual void makeWritable(bool /*keepContents*/) {}
+
 private:
     /**
       Return true if p was updated from this
@@ -411,6 +417,7 @@ private:
 
 
 private:
+    const DataStorageVoid::StorageSlot slot_;
     DataStorageVoid* dataStorage_;
     std::set<DataStorageVoid*> dataStorageCow_;
 };
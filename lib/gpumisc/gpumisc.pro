@@ -19,6 +19,7 @@ QT += opengl
 DEFINES += GPUMISC_LIBRARY
 
 SOURCES += \
+    cpumemorypool.cpp \
     cpumemorystorage.cpp \
     cpuproperties.cpp \
     datastorage.cpp \
@@ -46,6 +47,7 @@ SOURCES += \
 HEADERS += \
     computationkernel.h \
     cpumemoryaccess.h \
+    cpumemorypool.h \
     cpumemorystorage.h \
     datastorage.h \
     datastorageaccess.h \
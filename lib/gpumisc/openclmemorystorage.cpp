@@ -7,7 +7,7 @@
 OpenClMemoryStorage::
         OpenClMemoryStorage( DataStorageVoid* p, bool read, bool write )
             :
-            DataStorageImplementation( p ),
+            DataStorageImplementation( p, Slot ),
             data( 0 ),
             flags( 0 ),
             borrowsData( false )
@@ -27,7 +27,7 @@ OpenClMemoryStorage::
 OpenClMemoryStorage::
         OpenClMemoryStorage( DataStorageVoid* p, cl_mem data, cl_mem_flags flags, bool adoptData )
             :
-            DataStorageImplementation( p ),
+            DataStorageImplementation( p, Slot ),
             data( data ),
             flags( flags ),
             borrowsData( !adoptData )
@@ -9,6 +9,8 @@
 class OpenClMemoryStorage : public DataStorageImplementation
 {
 public:
+    static const DataStorageVoid::StorageSlot Slot = DataStorageVoid::Slot_OpenCl;
+
     template<unsigned Dimension, typename T> static
     OpenClMemoryAccess<T, Dimension> ReadOnly( boost::shared_ptr<DataStorage<T> >p )
     {
@@ -1,6 +1,8 @@
 #include "unittest.h"
 
 // gpumisc units
+#include "cpumemorypool.h"
+#include "datastorage.h"
 #include "datastoragestring.h"
 #include "factor.h"
 #include "geometricalgebra.h"
@@ -40,6 +42,8 @@ int UnitTest::
         Timer(); // Init performance counting
         TaskTimer tt("Running tests");
 
+        RUNTEST(CpuMemoryPool);
+        RUNTEST(DataStorageVoid);
         RUNTEST(DataStorageString);
         RUNTEST(Factor);
         RUNTEST(GeometricAlgebra);
@@ -1,5 +1,6 @@
 #include "blockcache.h"
 #include "reference_hash.h"
+#include "render/glblock.h"
 
 #include "tasktimer.h"
 
@@ -7,8 +8,18 @@ using namespace std;
 
 namespace Heightmap {
 
+static size_t blockByteSize(const pBlock& b)
+{
+    return b->glblock
+            ? b->glblock->allocated_bytes_per_element() * b->block_layout().texels_per_block ()
+            : 0;
+}
+
+
 BlockCache::
         BlockCache()
+    :
+      byte_size_(0)
 {
 }
 
@@ -18,10 +29,10 @@ pBlock BlockCache::
 {
     lock_guard<mutex> l(mutex_);
 
-    cache_t::const_iterator itr = cache_.find( ref );
+    entries_t::const_iterator itr = cache_.find( ref );
     if (itr != cache_.end())
       {
-        return itr->second;
+        return itr->second.block;
       }
     else
       {
@@ -35,7 +46,39 @@ void BlockCache::
 {
     lock_guard<mutex> l(mutex_);
 
-    cache_[ b->reference() ] = b;
+    Entry& e = cache_[ b->reference() ];
+    if (e.block)
+      {
+        lru_.erase (e.lru);
+        byte_size_ -= e.bytes;
+      }
+
+    e.block = b;
+    e.bytes = blockByteSize (b);
+    byte_size_ += e.bytes;
+    // Blocks are mostly inserted in the current frame, which makes the hint
+    // at the end of lru_ correct and the insertion amortized constant time.
+    e.lru = lru_.insert (lru_.end (), lru_t::value_type(b->frame_number_last_used, b->reference ()));
+}
+
+
+void BlockCache::
+        touch( const pBlock& b, unsigned frame_number )
+{
+    lock_guard<mutex> l(mutex_);
+
+    b->frame_number_last_used = frame_number;
+
+    entries_t::iterator i = cache_.find( b->reference() );
+    if (i == cache_.end() || i->second.block != b)
+        return;
+
+    Entry& e = i->second;
+    if (e.lru->first == frame_number)
+        return;
+
+    lru_.erase (e.lru);
+    e.lru = lru_.insert (lru_.end (), lru_t::value_type(frame_number, b->reference ()));
 }
 
 
@@ -44,9 +87,13 @@ void BlockCache::
 {
     lock_guard<mutex> l(mutex_);
 
-    cache_t::iterator i = cache_.find(ref);
+    entries_t::iterator i = cache_.find(ref);
     if (i != cache_.end())
+      {
+        lru_.erase(i->second.lru);
+        byte_size_ -= i->second.bytes;
         cache_.erase(i);
+      }
 }
 
 
@@ -56,7 +103,13 @@ BlockCache::cache_t BlockCache::
     lock_guard<mutex> l(mutex_);
 
     BlockCache::cache_t c;
-    c.swap(cache_);
+    c.reserve (cache_.size ());
+    for (const entries_t::value_type& v : cache_)
+        c[v.first] = v.second.block;
+
+    cache_.clear ();
+    lru_.clear ();
+    byte_size_ = 0;
     return c;
 }
 
@@ -70,6 +123,15 @@ size_t BlockCache::
 }
 
 
+size_t BlockCache::
+        byteSize() const
+{
+    lock_guard<mutex> l(mutex_);
+
+    return byte_size_;
+}
+
+
 bool BlockCache::
         empty() const
 {
@@ -84,12 +146,51 @@ BlockCache::cache_t BlockCache::
 {
     lock_guard<mutex> l(mutex_);
 
-    BlockCache::cache_t C = cache_;
+    BlockCache::cache_t C;
+    C.reserve (cache_.size ());
+    for (const entries_t::value_type& v : cache_)
+        C[v.first] = v.second.block;
 
     return C;
 }
 
 
+std::vector<pBlock> BlockCache::
+        leastRecentlyUsed( unsigned frame_number, size_t max_count ) const
+{
+    lock_guard<mutex> l(mutex_);
+
+    std::vector<pBlock> R;
+    for (lru_t::const_iterator i = lru_.begin ();
+         i != lru_.end () && i->first < frame_number && R.size () < max_count;
+         ++i)
+    {
+        R.push_back (cache_.find (i->second)->second.block);
+    }
+
+    return R;
+}
+
+
+size_t BlockCache::
+        countUsedInFrame( unsigned frame_number ) const
+{
+    lock_guard<mutex> l(mutex_);
+
+    return lru_.count (frame_number);
+}
+
+
+void BlockCache::
+        for_each( const std::function<void(const pBlock&)>& f ) const
+{
+    lock_guard<mutex> l(mutex_);
+
+    for (const entries_t::value_type& v : cache_)
+        f(v.second.block);
+}
+
+
 void BlockCache::
         test()
 {
@@ -117,6 +218,59 @@ void BlockCache::
         EXCEPTION_ASSERT( b1 == b5 );
         EXCEPTION_ASSERT( b6 == pBlock() );
     }
+
+    // It should keep the blocks ordered by when they were last used
+    {
+        Reference r1;
+        Reference r2 = r1.right ();
+        Reference r3 = r2.right ();
+        BlockLayout bl(2,2,1);
+        VisualizationParams::ptr vp;
+        pBlock b1(new Block(r1, bl, vp));
+        pBlock b2(new Block(r2, bl, vp));
+        pBlock b3(new Block(r3, bl, vp));
+
+        BlockCache c;
+        b1->frame_number_last_used = 3;
+        b2->frame_number_last_used = 4;
+        c.insert (b2);
+        c.insert (b1);
+        c.touch (b3, 5); // not in the cache
+        c.insert (b3);
+
+        EXCEPTION_ASSERT_EQUALS( b3->frame_number_last_used, 5u );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (5) == (std::vector<pBlock>{b1, b2}) );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (5, 1) == (std::vector<pBlock>{b1}) );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (4) == (std::vector<pBlock>{b1}) );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (3).empty () );
+
+        c.touch (b1, 6);
+        EXCEPTION_ASSERT_EQUALS( b1->frame_number_last_used, 6u );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (7) == (std::vector<pBlock>{b2, b3, b1}) );
+        EXCEPTION_ASSERT_EQUALS( c.countUsedInFrame (6), 1u );
+        EXCEPTION_ASSERT_EQUALS( c.countUsedInFrame (3), 0u );
+
+        c.touch (b2, 6);
+        EXCEPTION_ASSERT_EQUALS( c.countUsedInFrame (6), 2u );
+
+        c.erase (r1);
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (7) == (std::vector<pBlock>{b3, b2}) );
+        EXCEPTION_ASSERT_EQUALS( c.countUsedInFrame (6), 1u );
+
+        // Replacing a block replaces its position in the order
+        pBlock b4(new Block(r3, bl, vp));
+        b4->frame_number_last_used = 7;
+        c.insert (b4);
+        EXCEPTION_ASSERT_EQUALS( c.size (), 2u );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (8) == (std::vector<pBlock>{b2, b4}) );
+
+        // Touching a block that has been replaced doesn't move the new block
+        c.touch (b3, 9);
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (8) == (std::vector<pBlock>{b2, b4}) );
+
+        EXCEPTION_ASSERT_EQUALS( c.clear ().size (), 2u );
+        EXCEPTION_ASSERT( c.leastRecentlyUsed (10).empty () );
+    }
 }
 
 } // namespace Heightmap
@@ -5,6 +5,9 @@
 #include "reference_hash.h"
 
 #include <unordered_map>
+#include <map>
+#include <vector>
+#include <functional>
 #include <thread>
 
 namespace Heightmap {
@@ -36,6 +39,13 @@ public:
      */
     void        insert( pBlock b );
 
+    /**
+     * @brief touch sets b->frame_number_last_used and moves the block
+     * accordingly in the least recently used order. Blocks in the cache
+     * should only be marked as used through touch.
+     */
+    void        touch( const pBlock& b, unsigned frame_number );
+
     /**
      * @brief removeBlock
      * @param b
@@ -49,11 +59,50 @@ public:
 
     size_t      size() const;
 
+    /**
+     * @brief byteSize is the sum of the memory allocated by the blocks in the
+     * cache, as it was when each block was inserted. Kept up to date on
+     * insert and erase instead of summing over all blocks.
+     */
+    size_t      byteSize() const;
+
     bool        empty() const;
 
     cache_t     clone() const;
 
+    /**
+     * @brief leastRecentlyUsed returns at most 'max_count' blocks that
+     * haven't been used since 'frame_number', the least recently used block
+     * first. Doesn't depend on the number of blocks in the cache.
+     */
+    std::vector<pBlock> leastRecentlyUsed( unsigned frame_number, size_t max_count=(size_t)-1 ) const;
+
+    /**
+     * @brief countUsedInFrame counts the blocks that were last used in frame 'frame_number'.
+     */
+    size_t      countUsedInFrame( unsigned frame_number ) const;
+
+    /**
+     * @brief for_each calls 'f' for each block without copying the cache.
+     * The cache is locked while 'f' runs, so 'f' may not use the cache.
+     */
+    void        for_each( const std::function<void(const pBlock&)>& f ) const;
+
 private:
+    /**
+     * lru_ orders the blocks by frame_number_last_used as it was when the
+     * block was inserted or touched, oldest first. It holds references
+     * rather than blocks to not affect pBlock::use_count.
+     */
+    typedef std::multimap<unsigned, Reference> lru_t;
+
+    struct Entry {
+        pBlock block;
+        lru_t::iterator lru;
+        size_t bytes;
+    };
+
+    typedef std::unordered_map<Reference, Entry> entries_t;
 
 
     /**
@@ -65,7 +114,9 @@ private:
       */
 
     mutable std::mutex  mutex_;
-    cache_t             cache_;
+    entries_t           cache_;
+    lru_t               lru_;
+    size_t              byte_size_;
 
 public:
     static void test();
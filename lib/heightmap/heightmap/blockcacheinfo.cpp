@@ -28,6 +28,13 @@ unsigned long BlockCacheInfo::
 }
 
 
+unsigned long BlockCacheInfo::
+        cacheByteSize(const BlockCache& cache)
+{
+    return cache.byteSize ();
+}
+
+
 void BlockCacheInfo::
         printCacheSize(const BlockCache::cache_t& cache)
 {
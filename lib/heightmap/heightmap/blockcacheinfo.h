@@ -9,6 +9,7 @@ class BlockCacheInfo
 {
 public:
     static unsigned long cacheByteSize(const BlockCache::cache_t& cache);
+    static unsigned long cacheByteSize(const BlockCache& cache);
     static void printCacheSize(const BlockCache::cache_t& cache);
 
 public:
@@ -10,8 +10,6 @@
 #include "computationkernel.h"
 #include "neat_math.h"
 
-#include <functional>
-
 // Limit the amount of memory used for caches by memoryUsedForCaches < freeMemory*MAX_FRACTION_FOR_CACHES
 #define MAX_FRACTION_FOR_CACHES (1.f/8.f)
 
@@ -24,25 +22,6 @@ namespace Heightmap {
 namespace Blocks {
 
 
-pBlock getOldestBlock(unsigned frame_counter, BlockCache::cache_t& cache, unsigned min_age) {
-    typedef const BlockCache::cache_t::value_type pair;
-    auto i = std::max_element(cache.begin(), cache.end(), [frame_counter](pair& a, pair& b) {
-            unsigned age_a = frame_counter - a.second->frame_number_last_used;
-            unsigned age_b = frame_counter - b.second->frame_number_last_used;
-            return age_a < age_b;
-        });
-
-    if (i == cache.end())
-        return pBlock();
-
-    unsigned age = frame_counter - i->second->frame_number_last_used;
-    if (age < min_age)
-        return pBlock();
-
-    return i->second;
-}
-
-
 GarbageCollector::
         GarbageCollector(BlockCache::const_ptr cache)
     :
@@ -54,30 +33,19 @@ GarbageCollector::
 unsigned GarbageCollector::
         countBlocksUsedThisFrame(unsigned frame_counter)
 {
-    const BlockCache::cache_t C = cache_->clone (); // copy
-
-    unsigned i = 0;
-    for (const BlockCache::cache_t::value_type& v : C)
-        i += frame_counter == v.second->frame_number_last_used;
-
-    return i;
+    return cache_->countUsedInFrame (frame_counter);
 }
 
 
 pBlock GarbageCollector::
         runOnce(unsigned frame_counter)
 {
-    size_t free_memory = availableMemoryForSingleAllocation();
-    BlockCache::cache_t cacheCopy = cache_->clone();
-    size_t allocatedMemory = BlockCacheInfo::cacheByteSize (cacheCopy);
-
-    if (allocatedMemory < free_memory*MAX_FRACTION_FOR_CACHES)
-        return pBlock(); // No need to release memory
-
-    pBlock releasedBlock = getOldestBlock(frame_counter, cacheCopy, 2);
-    if (!releasedBlock)
+    size_t allocatedMemory = 0;
+    std::vector<pBlock> oldest = getOldest(frame_counter, 1, &allocatedMemory);
+    if (oldest.empty ())
         return pBlock(); // Nothing to release
 
+    pBlock releasedBlock = oldest.front ();
     Heightmap::Block::pGlBlock glblock = releasedBlock->glblock;
     size_t blockMemory = glblock
             ? glblock->allocated_bytes_per_element() * releasedBlock->block_layout().texels_per_block ()
@@ -88,9 +56,9 @@ pBlock GarbageCollector::
                  % releasedBlock->getRegion ()
                  % (frame_counter - releasedBlock->frame_number_last_used)
                  % DataStorageVoid::getMemorySizeText( blockMemory )
-                 % DataStorageVoid::getMemorySizeText( free_memory )
+                 % DataStorageVoid::getMemorySizeText( availableMemoryForSingleAllocation() )
                  % DataStorageVoid::getMemorySizeText( allocatedMemory )
-                 % cacheCopy.size()
+                 % cache_->size()
                  );
 
     return releasedBlock;
@@ -100,28 +68,35 @@ pBlock GarbageCollector::
 std::vector<pBlock> GarbageCollector::
         runUntilComplete(unsigned frame_counter)
 {
-    BlockCache::cache_t cacheCopy = cache_->clone();
     size_t free_memory = availableMemoryForSingleAllocation();
-    size_t allocatedMemory = BlockCacheInfo::cacheByteSize (cacheCopy);
-
-    auto sorted = getSorted(frame_counter);
+    size_t allocatedMemory = 0;
 
-    std::vector<pBlock> R;
-    R.reserve (sorted.size ());
+    // Fetch blocks in growing batches until enough memory is released
+    // instead of listing all old blocks.
+    size_t batch = 16;
+    std::vector<pBlock> R = getOldest(frame_counter, batch, &allocatedMemory);
 
     // Go from oldest to newest
-    for (pBlock b : sorted)
+    for (size_t i=0; i<R.size (); ++i)
     {
         if (allocatedMemory < free_memory*MAX_FRACTION_FOR_CACHES)
+        {
+            R.resize (i);
             break;
+        }
 
-        Heightmap::Block::pGlBlock glblock = b->glblock;
+        Heightmap::Block::pGlBlock glblock = R[i]->glblock;
         size_t blockMemory = glblock
-                ? glblock->allocated_bytes_per_element() * b->block_layout().texels_per_block ()
+                ? glblock->allocated_bytes_per_element() * R[i]->block_layout().texels_per_block ()
                 : 0;
 
         allocatedMemory = clamped_sub(allocatedMemory, blockMemory);
-        R.push_back (b);
+
+        if (i+1 == batch)
+        {
+            batch *= 2;
+            R = cache_->leastRecentlyUsed (frame_counter - 1, batch);
+        }
     }
 
     return R;
@@ -131,17 +106,7 @@ std::vector<pBlock> GarbageCollector::
 std::vector<pBlock> GarbageCollector::
         releaseNOldest(unsigned frame_counter, unsigned N)
 {
-    auto sorted = getSorted(frame_counter);
-
-    std::vector<pBlock> R;
-    R.reserve (N);
-
-    // Go from oldest to newest
-    for (pBlock b : sorted)
-        if (R.size () < N)
-            R.push_back (b);
-
-    return R;
+    return getOldest(frame_counter, N);
 }
 
 
@@ -149,52 +114,37 @@ std::vector<pBlock> GarbageCollector::
         releaseAllNotUsedInThisFrame(unsigned frame_counter)
 {
     std::vector<pBlock> R;
-    const BlockCache::cache_t C = cache_->clone (); // copy
-    TaskTimer tt("Collection doing garbage collection. Cache size %u", C.size());
-    BlockCacheInfo::printCacheSize(C);
+    const std::vector<pBlock> C = cache_->leastRecentlyUsed (frame_counter); // copy
+    TaskTimer tt("Collection doing garbage collection. Cache size %u", cache_->size ());
+    BlockCacheInfo::printCacheSize(cache_->clone ());
 
-    for (BlockCache::cache_t::const_iterator itr = C.begin(); itr!=C.end(); itr++ )
+    for (const pBlock& b : C)
     {
-        EXCEPTION_ASSERT_LESS_OR_EQUAL(4, itr->second.use_count ());
-        if (itr->second.use_count () == 4) // recent, cache, C and itr->second
-        {
-            if (frame_counter != itr->second->frame_number_last_used )
-                R.push_back (itr->second);
-        }
+        EXCEPTION_ASSERT_LESS_OR_EQUAL(4, b.use_count ());
+        if (b.use_count () == 4) // recent, cache, C and b
+            R.push_back (b);
     }
 
     return R;
 }
 
 
-GarbageCollector::Sorted GarbageCollector::
-        getSorted(unsigned frame_counter)
+std::vector<pBlock> GarbageCollector::
+        getOldest(unsigned frame_counter, size_t max_count, size_t* allocatedMemoryOut)
 {
     size_t free_memory = availableMemoryForSingleAllocation();
-    BlockCache::cache_t cacheCopy = cache_->clone();
-    size_t allocatedMemory = BlockCacheInfo::cacheByteSize (cacheCopy);
-
-    // Sort with decreasing age
-    GarbageCollector::Sorted sorted (
-            [frame_counter](const pBlock& a, const pBlock& b) {
-                unsigned age_a = frame_counter - a->frame_number_last_used;
-                unsigned age_b = frame_counter - b->frame_number_last_used;
-                if (age_a == age_b)
-                    return a < b;
-                return age_a > age_b;
-            }
-    );
+    size_t allocatedMemory = cache_->byteSize ();
+    if (allocatedMemoryOut)
+        *allocatedMemoryOut = allocatedMemory;
 
     if (allocatedMemory < free_memory*MAX_FRACTION_FOR_CACHES)
-        return sorted; // No need to release memory
+        return std::vector<pBlock>(); // No need to release memory
 
-    for (auto& v : cacheCopy) {
-        unsigned age = frame_counter - v.second->frame_number_last_used;
-        if (age>1) // Initial filtering
-            sorted.insert (v.second);
-    }
+    if (frame_counter < 2)
+        return std::vector<pBlock>();
 
-    return sorted;
+    // Initial filtering, only blocks with an age > 1
+    return cache_->leastRecentlyUsed (frame_counter - 1, max_count);
 }
 
 
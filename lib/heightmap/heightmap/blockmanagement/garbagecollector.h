@@ -3,8 +3,7 @@
 
 #include "heightmap/blockcache.h"
 #include "heightmap/render/glblock.h"
-#include <functional>
-#include <set>
+#include <vector>
 
 namespace Heightmap {
 namespace Blocks {
@@ -23,9 +22,12 @@ public:
 private:
     BlockCache::const_ptr cache_;
 
-    typedef std::set<pBlock, std::function<bool(const pBlock&, const pBlock&)>> Sorted;
-
-    Sorted getSorted(unsigned frame_counter);
+    /**
+     * @brief getOldest returns at most 'max_count' blocks not used in the
+     * last two frames, oldest first. Returns an empty list if the cache
+     * doesn't use enough memory to release anything.
+     */
+    std::vector<pBlock> getOldest(unsigned frame_counter, size_t max_count, size_t* allocatedMemory=0);
 };
 
 } // namespace Block
@@ -86,18 +86,16 @@ void Collection::
 void Collection::
         next_frame()
 {
-    BlockCache::cache_t cache = cache_->clone ();
-
     VERBOSE_EACH_FRAME_COLLECTION TaskTimer tt(boost::format("%s(), %u")
-            % __FUNCTION__ % cache.size ());
+            % __FUNCTION__ % cache_->size ());
 
     block_factory_->next_frame();
 
     boost::unordered_set<Reference> blocksToPoke;
 
-    for (const BlockCache::cache_t::value_type& b : cache)
-    {
-        Block* block = b.second.get();
+    // Iterate under the lock of the cache instead of copying it every frame
+    cache_->for_each ([this, &blocksToPoke](const pBlock& b) {
+        Block* block = b.get();
         if (block->frame_number_last_used == _frame_counter)
         {
             // Mark these blocks and surrounding blocks as in-use
@@ -110,7 +108,7 @@ void Collection::
 //            INFO_COLLECTION TaskTimer tt(boost::format("Deleting texture for block %s") % block->getRegion ());
             //block->glblock->delete_texture ();
         }
-    }
+    });
 
     boost::unordered_set<Reference> blocksToPoke2;
 
@@ -147,9 +145,8 @@ void Collection::
 
     for (const Reference& r : blocksToPoke2)
     {
-        auto i = cache.find (r);
-        if (i != cache.end ())
-            poke(i->second);
+        if (pBlock b = cache_->find (r))
+            poke(b);
     }
 
 
@@ -169,7 +166,7 @@ unsigned Collection::
 void Collection::
         poke(pBlock b)
 {
-    b->frame_number_last_used = _frame_counter;
+    cache_->touch (b, _frame_counter);
 }
 
 
@@ -264,7 +261,7 @@ int Collection::
     {
         // Make sure this global block covering everything is available to provide a background color
         pBlock b = getBlock(entireHeightmap ());
-        b->frame_number_last_used = _frame_counter;
+        cache_->touch (b, _frame_counter);
     }
 
     Blocks::GarbageCollector gc(cache_);
@@ -311,7 +308,7 @@ int Collection::
 unsigned long Collection::
         cacheByteSize() const
 {
-    return BlockCacheInfo::cacheByteSize (cache_->clone ());
+    return cache_->byteSize ();
 }
 
 
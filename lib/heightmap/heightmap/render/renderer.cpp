@@ -380,19 +380,17 @@ void Renderer::
         BlockLayout bl = collection->block_layout ();
         collection.unlock ();
 
-        // Copy the block list
-        auto cache = this->collection.raw ()->cache ()->clone ();
+        BlockCache::ptr cache = this->collection.raw ()->cache ();
 
         Render::RenderBlock::Renderer block_renderer(&_render_block, bl);
 
         for(const Reference& r : R)
         {
-            auto i = cache.find(r);
-            if (i != cache.end() && i->second && i->second->glblock)
+            pBlock block = cache->find(r);
+            if (block && block->glblock)
             {
-                pBlock block = i->second;
                 block_renderer.renderBlock(block);
-                block->frame_number_last_used = frame_number;
+                cache->touch (block, frame_number);
                 render_settings.drawn_blocks++;
             }
             else
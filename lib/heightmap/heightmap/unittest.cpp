@@ -1,6 +1,7 @@
 #include "unittest.h"
 
 #include "heightmap/freqaxis.h"
+#include "heightmap/blockcache.h"
 #include "heightmap/blockmanagement/merge/mergertexture.h"
 #include "heightmap/blockmanagement/blockfactory.h"
 #include "heightmap/blockmanagement/blockinitializer.h"
@@ -39,6 +40,7 @@ int UnitTest::
 
         RUNTEST(Heightmap::FreqAxis);
         RUNTEST(Heightmap::Block);
+        RUNTEST(Heightmap::BlockCache);
         RUNTEST(Heightmap::BlockManagement::Merge::MergerTexture);
         RUNTEST(Heightmap::BlockManagement::BlockFactory);
         RUNTEST(Heightmap::BlockManagement::BlockInitializer);
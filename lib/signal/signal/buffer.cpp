@@ -92,6 +92,19 @@ Interval MonoBuffer::
 }
 
 
+pMonoBuffer MonoBuffer::
+        view(Interval I) const
+{
+    EXCEPTION_ASSERT( getInterval().contains (I) );
+    EXCEPTION_ASSERT( I );
+
+    IntervalType offset = I.first - getInterval().first;
+    pTimeSeriesData p = CpuMemoryStorage::ViewPtr( time_series_, DataStorageSize( I.count ()), offset );
+
+    return pMonoBuffer(new MonoBuffer(sample_offset_ + offset, p, sample_rate_));
+}
+
+
 MonoBuffer& MonoBuffer::
         operator|=(const MonoBuffer& b)
 {
@@ -189,6 +202,11 @@ MonoBuffer& MonoBuffer::
             write = CpuMemoryStorage::BorrowPtr(
                 DataStorageSize(i.count()),
                 CpuMemoryStorage::ReadWrite<1>( time_series_ ).ptr() + offs_write, false);
+        } else if (toCpu) {
+            // Keep the samples outside of 'i'
+            write = CpuMemoryStorage::BorrowPtr(
+                DataStorageSize(i.count()),
+                CpuMemoryStorage::ReadWrite<1>( time_series_ ).ptr() + offs_write, false);
         } else {
             write = CpuMemoryStorage::BorrowPtr(
                 DataStorageSize(i.count()),
@@ -260,11 +278,19 @@ bool MonoBuffer::
 Buffer::
         Buffer(Interval I,
        float sample_rate,
-       int number_of_channels)
+       int number_of_channels,
+       Layout layout)
 {
     EXCEPTION_ASSERT( 0 < sample_rate );
     EXCEPTION_ASSERT( 0 < number_of_channels );
 
+    if (Layout_Planar == layout)
+    {
+        EXCEPTION_ASSERT( 0 < I.count ());
+        initPlanar (I.first, pTimeSeriesData(new TimeSeriesData(I.count (), number_of_channels)), sample_rate);
+        return;
+    }
+
     channels_.resize(number_of_channels);
     for (int i=0; i<number_of_channels; ++i)
         channels_[i].reset(new MonoBuffer(I, sample_rate));
@@ -275,11 +301,19 @@ Buffer::
         Buffer(UnsignedF first_sample,
        IntervalType number_of_samples,
        float sample_rate,
-       int number_of_channels)
+       int number_of_channels,
+       Layout layout)
 {
     EXCEPTION_ASSERT( 0 <= sample_rate );
     EXCEPTION_ASSERT( 0 < number_of_channels );
 
+    if (Layout_Planar == layout)
+    {
+        EXCEPTION_ASSERT( 0 < number_of_samples );
+        initPlanar (first_sample, pTimeSeriesData(new TimeSeriesData(number_of_samples, number_of_channels)), sample_rate);
+        return;
+    }
+
     channels_.resize(number_of_channels);
     for (int i=0; i<number_of_channels; ++i)
         channels_[i].reset(new MonoBuffer(first_sample, number_of_samples, sample_rate));
@@ -294,21 +328,30 @@ Buffer::
 }
 
 
+Buffer::
+        Buffer(const std::vector<pMonoBuffer>& channels)
+    :
+      channels_(channels)
+{
+    EXCEPTION_ASSERT( !channels_.empty () );
+    for (unsigned i=1; i<number_of_channels (); ++i)
+    {
+        EXCEPTION_ASSERT_EQUALS( channels_[i]->getInterval (), getInterval () );
+        EXCEPTION_ASSERT_EQUALS( channels_[i]->sample_rate (), sample_rate () );
+    }
+}
+
+
 Buffer::
         Buffer(UnsignedF first_sample, pTimeSeriesData ptr, float sample_rate)
 {
     DataStorageSize sz = ptr->size ();
     EXCEPTION_ASSERT( 1 == sz.depth );
-    channels_.resize (sz.height);
 
-    float* p = ptr->getCpuMemory ();
-    for (unsigned i=0; i<number_of_channels (); ++i)
-    {
-        pTimeSeriesData qtr(new TimeSeriesData(sz.width));
-        float* q = qtr->getCpuMemory();
-        memcpy(q, p + i*sz.width, sz.width*sizeof(float));
-        channels_[i].reset(new MonoBuffer(first_sample, qtr, sample_rate));
-    }
+    // The copy is made when initPlanar takes the slices
+    pTimeSeriesData planar(new TimeSeriesData(sz));
+    *planar = *ptr;
+    initPlanar (first_sample, planar, sample_rate);
 }
 
 
@@ -317,6 +360,21 @@ Buffer::
 {}
 
 
+void Buffer::
+        initPlanar(UnsignedF first_sample, pTimeSeriesData planar, float sample_rate)
+{
+    DataStorageSize sz = planar->size ();
+    planar_ = planar;
+    channels_.resize (sz.height);
+
+    for (int i=0; i<sz.height; ++i)
+    {
+        pTimeSeriesData p = CpuMemoryStorage::SlicePtr( planar_, DataStorageSize(sz.width), (size_t)i*sz.width );
+        channels_[i].reset (new MonoBuffer(first_sample, p, sample_rate));
+    }
+}
+
+
 void Buffer::
         release_extra_resources()
 {
@@ -347,6 +405,15 @@ pTimeSeriesData Buffer::
     if (1 == number_of_channels())
         return getChannel (0)->waveform_data ();
 
+    if (planar_)
+    {
+        // Bring back the slices of channels that were modified in another storage
+        for (unsigned i=0; i<number_of_channels(); ++i)
+            CpuMemoryStorage::ReadOnly<1>( getChannel (i)->waveform_data () );
+
+        return CpuMemoryStorage::ViewPtr( planar_, planar_->size () );
+    }
+
     pTimeSeriesData r( new TimeSeriesData(number_of_samples(), number_of_channels()));
     float* p = r->getCpuMemory ();
     for (unsigned i=0; i<number_of_channels(); ++i)
@@ -358,6 +425,30 @@ pTimeSeriesData Buffer::
 }
 
 
+pBuffer Buffer::
+        view(Interval I) const
+{
+    std::vector<pMonoBuffer> channels(number_of_channels());
+    for (unsigned i=0; i<number_of_channels(); ++i)
+        channels[i] = getChannel (i)->view (I);
+    return pBuffer(new Buffer(channels));
+}
+
+
+bool Buffer::
+        is_shared() const
+{
+    // Every channel holds one reference to planar_, the rest are views from mergeChannelData
+    if (planar_ && planar_.use_count () > 1 + (long)number_of_channels ())
+        return true;
+
+    for (unsigned i=0; i<number_of_channels(); ++i)
+        if (channels_[i]->is_shared ())
+            return true;
+    return false;
+}
+
+
 Buffer& Buffer::
         operator|=(const Buffer& b)
 {
@@ -416,6 +507,75 @@ void Buffer::
     EXCEPTION_ASSERTX( bpcpu == bp, "Buffer |= didn't do a copy on write");
     EXCEPTION_ASSERTX( bpcpu != cp2, "Buffer |= didn't do a copy on write");
     EXCEPTION_ASSERTX( cpcpu == cp2, "Buffer |= didn't do a copy on write");
+
+    // Test that a view shares data with 'b' until it is written to
+    {
+        pBuffer v = b->view (Interval(23,27));
+        EXCEPTION_ASSERT_EQUALS( v->getInterval (), Interval(23,27) );
+        EXCEPTION_ASSERT_EQUALS( v->number_of_channels (), b->number_of_channels () );
+        EXCEPTION_ASSERT( b->is_shared () );
+
+        float * vp = CpuMemoryStorage::ReadOnly<1>(v->getChannel (0)->waveform_data ()).ptr();
+        EXCEPTION_ASSERTX( vp == bpcpu + 3, "Buffer::view didn't share data");
+
+        pBuffer e(new Buffer(Interval(23,27), 40, 7));
+        *e |= *b;
+        EXCEPTION_ASSERT( *v == *e );
+
+        float * vpcpu = v->getChannel (0)->waveform_data ()->getCpuMemory ();
+        EXCEPTION_ASSERTX( vpcpu != vp, "Buffer::view didn't copy on write");
+        EXCEPTION_ASSERT( *v == *e );
+        vpcpu[0] = -1;
+        EXCEPTION_ASSERT_EQUALS( bpcpu[3], 3/10.f );
+    }
+    EXCEPTION_ASSERT( !b->is_shared () );
+
+    // Test that channels of a planar Buffer share one allocation
+    {
+        pBuffer p(new Buffer(Interval(20,30), 40, 7, Buffer::Layout_Planar));
+        EXCEPTION_ASSERT_EQUALS( p->layout (), Buffer::Layout_Planar );
+        EXCEPTION_ASSERT( !p->is_shared () );
+        *p |= *b;
+        EXCEPTION_ASSERT( *p == *b );
+
+        float* p0 = CpuMemoryStorage::ReadOnly<1>(p->getChannel (0)->waveform_data ()).ptr();
+        for (unsigned c=1; c<p->number_of_channels (); ++c)
+        {
+            float* pc = p->getChannel (c)->waveform_data ()->getCpuMemory ();
+            EXCEPTION_ASSERTX( pc == p0 + c*p->number_of_samples (), "Buffer::Layout_Planar didn't share data");
+        }
+
+        // mergeChannelData doesn't copy and sees later writes to the channels
+        pTimeSeriesData m = p->mergeChannelData ();
+        EXCEPTION_ASSERT_EQUALS( m->size (), DataStorageSize(10, 7) );
+        EXCEPTION_ASSERT( p->is_shared () );
+        float* mp = CpuMemoryStorage::ReadOnly<1>(m).ptr();
+        EXCEPTION_ASSERTX( mp == p0, "Buffer::mergeChannelData copied a planar Buffer");
+        p->getChannel (2)->waveform_data ()->getCpuMemory ()[1] = -2;
+        EXCEPTION_ASSERT_EQUALS( mp[2*10 + 1], -2.f );
+
+        // Writes to the merged data doesn't change the channels
+        float* mpcpu = m->getCpuMemory ();
+        EXCEPTION_ASSERT( mpcpu != mp );
+        mpcpu[0] = -3;
+        EXCEPTION_ASSERT_EQUALS( p0[0], 0.f );
+        m.reset ();
+        EXCEPTION_ASSERT( !p->is_shared () );
+
+        // Copying a channel of a planar Buffer makes a deep copy
+        pBuffer q(new Buffer(Interval(20,30), 40, 7));
+        *q |= *p;
+        EXCEPTION_ASSERT( *q == *p );
+        EXCEPTION_ASSERT( q->getChannel (2)->waveform_data ()->getCpuMemory () != p0 + 2*10 );
+        EXCEPTION_ASSERT_EQUALS( p0[2*10 + 1], -2.f );
+
+        // A Buffer created from merged data is planar
+        pBuffer r(new Buffer(p->sample_offset (), p->mergeChannelData (), p->sample_rate ()));
+        EXCEPTION_ASSERT_EQUALS( r->layout (), Buffer::Layout_Planar );
+        EXCEPTION_ASSERT( *r == *p );
+        r->getChannel (0)->waveform_data ()->getCpuMemory ()[0] = 5;
+        EXCEPTION_ASSERT_EQUALS( p0[0], 0.f );
+    }
 }
 
 } // namespace Signal
@@ -19,6 +19,11 @@ namespace Signal {
 typedef DataStorage<float> TimeSeriesData;
 typedef TimeSeriesData::ptr pTimeSeriesData;
 
+class MonoBuffer;
+typedef boost::shared_ptr<MonoBuffer> pMonoBuffer;
+class Buffer;
+typedef boost::shared_ptr<Buffer> pBuffer;
+
 class SignalDll MonoBuffer : public boost::noncopyable {
 public:
     MonoBuffer(Interval I, float sample_rate);
@@ -39,6 +44,16 @@ public:
     float                   length() const;
     Interval                getInterval() const;
 
+    /**
+     * @brief view returns a MonoBuffer that shares the samples in 'I' with
+     * 'this' instead of copying them. The view takes a private copy of its
+     * data before it is written to. 'I' must be within getInterval().
+     */
+    pMonoBuffer             view(Interval I) const;
+
+    /// True if waveform_data() is referenced from somewhere else, i.e by a view.
+    bool                    is_shared() const { return !time_series_.unique (); }
+
     /// element-wise overwrite 'this' with data from 'b' where they overlap
     MonoBuffer&             operator|=(MonoBuffer const& b);
     /// element-wise add 'this' with 'b' where they overlap
@@ -57,23 +72,33 @@ private:
     float           sample_rate_;
 };
 
-typedef boost::shared_ptr<MonoBuffer> pMonoBuffer;
-
 
 /**
 The Signal::Buffer class is _the_ container class for data in the Signal
 namespace. A Buffer can contain an entire song as when created by
 Signal::Audiofile, or a Buffer can contain sound as fractions of a second
 as when created by Signal::MicrophoneRecorder.
+
+With Layout_Planar all channels are slices of one allocation, channel after
+channel, and mergeChannelData doesn't need to copy anything. Channels of a
+planar Buffer are never shared with copy-on-write.
 */
 class SignalDll Buffer : public boost::noncopyable {
 public:
-    Buffer(Interval I, float sample_rate, int number_of_channels);
+    enum Layout {
+        Layout_Separate,
+        Layout_Planar
+    };
+
+    Buffer(Interval I, float sample_rate, int number_of_channels, Layout layout=Layout_Separate);
     Buffer(UnsignedF first_sample,
            IntervalType number_of_samples,
            float sample_rate,
-           int number_of_channels);
+           int number_of_channels,
+           Layout layout=Layout_Separate);
     explicit Buffer(pMonoBuffer b);
+    explicit Buffer(const std::vector<pMonoBuffer>& channels);
+    /// Takes a copy of 'ptr' with one row per channel, the layout is Layout_Planar.
     Buffer(UnsignedF first_sample, pTimeSeriesData ptr, float sample_rate);
     ~Buffer();
 
@@ -92,8 +117,19 @@ public:
     Interval        getInterval() const { return getChannel(0)->getInterval(); }
 
     pMonoBuffer     getChannel(int channel) const { return channels_[channel]; }
+    Layout          layout() const { return planar_ ? Layout_Planar : Layout_Separate; }
+
+    /**
+     * @brief mergeChannelData returns all channels with one row per channel.
+     * Returns a view without copying if the layout is Layout_Planar, the
+     * view takes a private copy before it is written to.
+     */
     pTimeSeriesData mergeChannelData() const;
 
+    /// @see MonoBuffer::view
+    pBuffer         view(Interval I) const;
+    bool            is_shared() const;
+
     /// element-wise overwrite 'this' with data from 'b' where they overlap
     Buffer&         operator|=(const Buffer& b);
     /// element-wise add 'this' with 'b' where they overlap
@@ -105,11 +141,12 @@ public:
 
     static void     test();
 private:
+    void            initPlanar(UnsignedF first_sample, pTimeSeriesData planar, float sample_rate);
+
     std::vector<pMonoBuffer> channels_;
+    pTimeSeriesData planar_;
 };
 
-typedef boost::shared_ptr<Buffer> pBuffer;
-
 } // namespace Signal
 
 #endif // BUFFER_H
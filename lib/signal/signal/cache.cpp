@@ -7,10 +7,183 @@
 #include "timer.h"
 #include "cpumemorystorage.h"
 
+#include <QTemporaryFile>
+#include <QDir>
+
+#include <boost/enable_shared_from_this.hpp>
+
+#include <mutex>
+
 using namespace boost;
 
 namespace Signal {
 
+static std::atomic<size_t> allocated_bytes_(0);
+static std::atomic<unsigned long long> access_counter_(0);
+
+
+/**
+ * @brief releaseChunkData counts the RAM of a cache chunk until the last
+ * reference to it is released, including views from previous reads.
+ */
+static void releaseChunkData(TimeSeriesData* p)
+{
+    allocated_bytes_ -= p->numberOfBytes ();
+    delete p;
+}
+
+
+static pBuffer newChunkBuffer(Interval I, float fs, int num_channels)
+{
+    std::vector<pMonoBuffer> channels(num_channels);
+    for (int i=0; i<num_channels; i++)
+    {
+        pTimeSeriesData data(new TimeSeriesData(I.count ()), releaseChunkData);
+        allocated_bytes_ += data->numberOfBytes ();
+        channels[i].reset (new MonoBuffer(I.first, data, fs));
+    }
+    return pBuffer(new Buffer(channels));
+}
+
+
+/**
+ * @brief The Cache::SpillFile class holds all spilled chunks of a cache in
+ * one temporary file, in slots of equal size. A slot is reused when the last
+ * view of it is released. The file is removed when the last view is released.
+ */
+class Cache::SpillFile: public boost::enable_shared_from_this<Cache::SpillFile>
+{
+public:
+    SpillFile(qint64 slot_bytes)
+        :
+          file_(QDir::tempPath() + QDir::separator() + "sonicawe-cache.XXXXXX"),
+          slot_bytes_(slot_bytes),
+          slots_(0)
+    {}
+
+    bool open()
+    {
+        if (file_.open ())
+            return true;
+
+        TaskInfo(boost::format("!!! Couldn't create a file to spill cache to: %s") % file_.errorString ().toStdString ());
+        return false;
+    }
+
+    qint64 slot_bytes() const { return slot_bytes_; }
+
+    /**
+     * @brief write copies all channels of 'b' to a free slot.
+     * @return views of the mapped slot, or null if writing failed.
+     */
+    pBuffer write(const Buffer& b)
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+
+        qint64 channel_bytes = b.number_of_samples () * sizeof(float);
+        EXCEPTION_ASSERT_EQUALS( channel_bytes*b.number_of_channels (), slot_bytes_ );
+
+        qint64 slot;
+        if (free_slots_.empty ())
+            slot = slots_++;
+        else
+        {
+            slot = free_slots_.back ();
+            free_slots_.pop_back ();
+        }
+
+        // Not all samples are valid but it's faster to write the chunk in one go
+        bool ok = file_.seek (slot*slot_bytes_);
+        for (unsigned i=0; ok && i<b.number_of_channels (); ++i)
+        {
+            const char* p = (const char*)CpuMemoryStorage::ReadOnly<1>( b.getChannel (i)->waveform_data ()).ptr ();
+            ok = channel_bytes == file_.write (p, channel_bytes);
+        }
+
+        uchar* mapped = ok && file_.flush () ? file_.map (slot*slot_bytes_, slot_bytes_) : 0;
+        if (!mapped)
+        {
+            TaskInfo(boost::format("!!! Couldn't spill cache to %s: %s") % file_.fileName ().toStdString () % file_.errorString ().toStdString ());
+            free_slots_.push_back (slot);
+            return pBuffer();
+        }
+
+        // The slot is given back when all channels of all views are released
+        boost::shared_ptr<SpillFile> self = shared_from_this ();
+        boost::shared_ptr<void> owner(mapped, [self, slot](void* p) { self->release (slot, (uchar*)p); });
+
+        std::vector<pMonoBuffer> channels(b.number_of_channels ());
+        for (unsigned i=0; i<b.number_of_channels (); ++i)
+        {
+            pTimeSeriesData data = CpuMemoryStorage::ViewPtr( DataStorageSize(b.number_of_samples ()),
+                                                              (float*)mapped + i*b.number_of_samples (), owner );
+            channels[i].reset (new MonoBuffer(b.sample_offset (), data, b.sample_rate ()));
+        }
+
+        return pBuffer(new Buffer(channels));
+    }
+
+private:
+    void release(qint64 slot, uchar* mapped)
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        file_.unmap (mapped);
+        free_slots_.push_back (slot);
+    }
+
+    std::mutex mutex_;
+    QTemporaryFile file_;
+    const qint64 slot_bytes_;
+    qint64 slots_;
+    std::vector<qint64> free_slots_;
+};
+
+
+Cache::Chunk::
+        Chunk( pBuffer buffer )
+    :
+      buffer(buffer),
+      spilled(false),
+      last_access(0)
+{
+    touch();
+}
+
+
+Cache::Chunk::
+        Chunk( const Chunk& b )
+    :
+      buffer(b.buffer),
+      spilled(b.spilled),
+      last_access(b.last_access.load ())
+{
+}
+
+
+Cache::Chunk& Cache::Chunk::
+        operator=( const Chunk& b )
+{
+    buffer = b.buffer;
+    spilled = b.spilled;
+    last_access = b.last_access.load ();
+    return *this;
+}
+
+
+size_t Cache::Chunk::
+        bytes() const
+{
+    return buffer->number_of_samples () * buffer->number_of_channels () * sizeof(float);
+}
+
+
+void Cache::Chunk::
+        touch() const
+{
+    last_access.store (++access_counter_, std::memory_order_relaxed);
+}
+
+
 Cache::
         Cache( )
 {
@@ -27,11 +200,24 @@ Cache::
 Cache& Cache::
         operator=( const Cache& b)
 {
+    clear();
+
     _cache = b._cache;
+    _valid_samples = b._valid_samples;
+    _stale_samples = b._stale_samples;
+    _spill_file = b._spill_file;
+
     return *this;
 }
 
 
+Cache::
+        ~Cache( )
+{
+    clear();
+}
+
+
 void Cache::
         put( pBuffer bp )
 {
@@ -41,8 +227,33 @@ void Cache::
     allocateCache(b.getInterval(), b.sample_rate(), b.number_of_channels ());
 
     Timer t;
-    for( std::vector<pBuffer>::iterator itr = findBuffer(b.getInterval().first); itr!=_cache.end(); itr++ )
-        **itr |= b;
+    for( std::vector<Chunk>::iterator itr = findBuffer(b.getInterval().first); itr!=_cache.end(); itr++ )
+    {
+        Chunk& c = *itr;
+        Interval chunkI = c.buffer->getInterval ();
+        if (chunkI.first >= b.getInterval().last)
+            break;
+
+        if (c.spilled)
+        {
+            loadChunk(c);
+        }
+        else if (c.buffer->is_shared () && (b.getInterval () & chunkI & (_valid_samples | _stale_samples)))
+        {
+            // Don't modify data that might be viewed by a previous read, copy
+            // the chunk and let the views keep the old data. Views can only
+            // refer to samples that are valid or stale.
+            pBuffer n = newChunkBuffer( chunkI, c.buffer->sample_rate (), c.buffer->number_of_channels ());
+            *n |= *c.buffer;
+            c.buffer = n;
+        }
+
+        if (!c.buffer->is_shared ())
+            _stale_samples -= chunkI;
+
+        *c.buffer |= b;
+        c.touch ();
+    }
 
     _valid_samples |= b.getInterval();
 
@@ -83,12 +294,12 @@ void Cache::
     I.first = align_down(I.first, chunkSize);
     I.last = align_up(I.last, chunkSize);
 
-    for (std::vector<pBuffer>::iterator itr = findBuffer( I.first );
+    for (std::vector<Chunk>::iterator itr = findBuffer( I.first );
          itr != _cache.end() || I; itr++)
     {
         if (itr != _cache.end())
         {
-            Interval J = (*itr)->getInterval();
+            Interval J = itr->buffer->getInterval();
             if (J & Interval(I.first, I.first+1))
             {
                 I.first = J.last;
@@ -98,17 +309,11 @@ void Cache::
 
 //        TaskTimer tt(boost::format("Allocating cache %s") % Interval(I.first, I.first+chunkSize));
 
-        pBuffer n( new Buffer( I.first, chunkSize, fs, num_channels) );
-        for (int i=0; i<num_channels; i++)
-        {
-            // Force allocation here, don't delay it.
-            //
-            // Don't bother clearing the buffer with zeros. _valid_samples keeps
-            // track of what data we can readily use.
-            //CpuMemoryStorage::WriteAll<1>(n->getChannel (i)->waveform_data ());
-        }
+        // Don't bother clearing the buffer with zeros. _valid_samples keeps
+        // track of what data we can readily use.
+        pBuffer n = newChunkBuffer( Interval(I.first, I.first + chunkSize), fs, num_channels );
 
-        itr = _cache.insert(itr, n);
+        itr = _cache.insert(itr, Chunk(n));
         I.first += chunkSize;
     }
 }
@@ -117,6 +322,7 @@ void Cache::
 void Cache::
         invalidate_samples(const Intervals& I)
 {
+    _stale_samples |= _valid_samples & I;
     _valid_samples -= I;
 }
 
@@ -124,14 +330,27 @@ void Cache::
 void Cache::
         clear()
 {
+    // The RAM of chunks that are still viewed is counted until the views are released
     _cache.clear();
     _valid_samples = Intervals();
+    _stale_samples = Intervals();
 }
 
 
 pBuffer Cache::
         read( const Interval& I ) const
 {
+    // Return a view without copying if a single cache chunk covers I
+    if (_valid_samples.contains (I))
+    {
+        std::vector<Chunk>::const_iterator itr = findBuffer(I.first);
+        if (itr != _cache.end() && itr->buffer->getInterval ().contains (I))
+        {
+            itr->touch ();
+            return itr->buffer->view (I);
+        }
+    }
+
     pBuffer r = pBuffer( new Buffer(I, sample_rate(), num_channels ()) );
     read(r);
     return r;
@@ -177,28 +396,18 @@ pBuffer Cache::
     }
 
     // Find the cache chunk for sample I.first
-    std::vector<pBuffer>::const_iterator itr = findBuffer(I.first);
+    std::vector<Chunk>::const_iterator itr = findBuffer(I.first);
 
     EXCEPTION_ASSERT_DBG( itr != _cache.end() );
 
-    pBuffer b = *itr;
+    pBuffer b = itr->buffer;
     Interval bI = b->getInterval ();
     EXCEPTION_ASSERT_DBG( bI.contains (I.first) );
+    itr->touch ();
 
-    // If all of b is ok, return b
-    if ( _valid_samples.contains (bI) )
-    {
-        // TODO: if COW chunks could be created with an offset we could return all
-        // of b that is valid instead of just a copy of the portion that matches I.
-        // Would result in less copying by returning more data right away.
-        return b;
-    }
-
-    validFetch &= bI;
-
-    pBuffer n = pBuffer(new Buffer(validFetch, b->sample_rate(), b->number_of_channels ()));
-    *n |= *b;
-    return n;
+    // Return a view of all valid samples in b that follow I.first
+    validFetch = (Interval(I.first, bI.last) & _valid_samples).fetchFirstInterval ();
+    return b->view (validFetch);
 }
 
 
@@ -208,7 +417,7 @@ float Cache::
     if (_cache.empty())
         return 1;
 
-    return _cache.front()->sample_rate();
+    return _cache.front().buffer->sample_rate();
 }
 
 
@@ -218,7 +427,7 @@ int Cache::
     if (_cache.empty())
         return 0;
 
-    return _cache.front()->number_of_channels();
+    return _cache.front().buffer->number_of_channels();
 }
 
 
@@ -243,36 +452,104 @@ bool Cache::
 }
 
 
+std::vector<Cache::ChunkAccess> Cache::
+        resident_chunks() const
+{
+    std::vector<ChunkAccess> r;
+    for (const Chunk& c : _cache)
+        if (!c.spilled)
+            r.push_back (ChunkAccess(c.last_access.load (std::memory_order_relaxed), c.buffer->getInterval ()));
+    return r;
+}
+
+
+bool Cache::
+        spill( IntervalType sample )
+{
+    std::vector<Chunk>::iterator itr = findBuffer(sample);
+    if (itr == _cache.end() || itr->spilled || !itr->buffer->getInterval ().contains (sample))
+        return false;
+
+    // The RAM of a chunk that is viewed by a previous read wouldn't be
+    // released until the views are
+    Chunk& c = *itr;
+    if (c.buffer->is_shared ())
+        return false;
+
+    if (!_spill_file)
+    {
+        boost::shared_ptr<SpillFile> f(new SpillFile(c.bytes ()));
+        if (!f->open ())
+            return false;
+        _spill_file = f;
+    }
+
+    if (_spill_file->slot_bytes () != (qint64)c.bytes ())
+        return false;
+
+    pBuffer spilled = _spill_file->write (*c.buffer);
+    if (!spilled)
+        return false;
+
+    c.buffer = spilled;
+    c.spilled = true;
+    return true;
+}
+
+
+void Cache::
+        loadChunk( Chunk& c )
+{
+    EXCEPTION_ASSERT( c.spilled );
+
+    pBuffer n = newChunkBuffer( c.buffer->getInterval (), c.buffer->sample_rate (), c.buffer->number_of_channels ());
+    *n |= *c.buffer;
+
+    c.buffer = n;
+    c.spilled = false;
+}
+
+
+size_t Cache::
+        allocated_bytes()
+{
+    return allocated_bytes_;
+}
+
+
 class cache_search
 {
 public:
-    bool operator()( IntervalType t, const pBuffer& b )
+    template<typename Chunk>
+    bool operator()( IntervalType t, const Chunk& c )
     {
-        return t < b->getInterval().last;
+        return t < c.buffer->getInterval().last;
     }
 
 #if defined(_MSC_VER) && defined(_DEBUG)
     // Integrity checks in windows debug mode
-    bool operator()( const pBuffer& b, IntervalType t )
+    template<typename Chunk>
+    bool operator()( const Chunk& c, IntervalType t )
     {
-        return b->getInterval().last < t;
+        return c.buffer->getInterval().last < t;
     }
 
-    bool operator()( const pBuffer& b, const pBuffer& b2 )
+    template<typename Chunk>
+    bool operator()( const Chunk& c, const Chunk& c2 )
     {
-        return b->getInterval().last < b2->getInterval().last;
+        return c.buffer->getInterval().last < c2.buffer->getInterval().last;
     }
 #endif
 };
 
 
-std::vector<pBuffer>::iterator Cache::
+std::vector<Cache::Chunk>::iterator Cache::
         findBuffer( IntervalType sample )
 {
     return upper_bound(_cache.begin(), _cache.end(), sample, cache_search());
 }
 
-std::vector<pBuffer>::const_iterator Cache::
+std::vector<Cache::Chunk>::const_iterator Cache::
         findBuffer( IntervalType sample ) const
 {
     return upper_bound(_cache.begin(), _cache.end(), sample, cache_search());
@@ -344,6 +621,117 @@ void Cache::
     }
 
 
+    // Reading an interval within a single cache chunk should not copy data,
+    // and a view should not change when the cache is updated afterwards
+    {
+        pBuffer v = cache.read (Interval(20, 30));
+        pBuffer e(new Buffer(Interval(20, 30), 5.1, 7));
+        *e |= *v;
+
+        pBuffer chunk = cache.findBuffer (20)->buffer;
+        float* chunkp = CpuMemoryStorage::ReadOnly<1>(chunk->getChannel (0)->waveform_data ()).ptr ();
+        float* viewp = CpuMemoryStorage::ReadOnly<1>(v->getChannel (0)->waveform_data ()).ptr ();
+        EXCEPTION_ASSERT_EQUALS (viewp, chunkp + (20 - chunk->getInterval ().first));
+        chunk.reset ();
+
+        pBuffer ones(new Buffer(Interval(10, 40), 5.1, 7));
+        for (int c=0; c<(int)ones->number_of_channels (); ++c)
+        {
+            float *p = ones->getChannel (c)->waveform_data ()->getCpuMemory ();
+            for (int i=0; i<ones->number_of_samples (); ++i)
+                p[i] = 1;
+        }
+        cache.put (ones);
+        EXCEPTION_ASSERT( *v == *e );
+        EXCEPTION_ASSERT( *cache.read (Interval(20, 30)) != *e );
+        EXCEPTION_ASSERT( *cache.read (Interval(20, 30)) == *ones->view (Interval(20, 30)) );
+
+        // Writing to the view should not modify the cache
+        v->getChannel (0)->waveform_data ()->getCpuMemory ()[0] = -1;
+        EXCEPTION_ASSERT( *cache.read (Interval(20, 30)) == *ones->view (Interval(20, 30)) );
+    }
+
+    // A spilled chunk should be read transparently and be loaded back into RAM
+    // when written to
+    {
+        Cache c;
+        c.put (b);
+        pBuffer before(new Buffer(b->getInterval (), b->sample_rate (), b->number_of_channels ()));
+        *before |= *c.read (b->getInterval ());
+        size_t allocated = Cache::allocated_bytes ();
+        size_t chunk_bytes = (1<<20)*b->number_of_channels ()*sizeof(float);
+
+        // Spilling a chunk that is viewed wouldn't release any RAM
+        {
+            pBuffer v = c.read (b->getInterval ());
+            EXCEPTION_ASSERT( !c.spill (5) );
+        }
+
+        EXCEPTION_ASSERT( c.spill (5) );
+        EXCEPTION_ASSERT( !c.spill (5) );
+        EXCEPTION_ASSERT( c.resident_chunks ().empty () );
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated - chunk_bytes );
+        EXCEPTION_ASSERT( *c.read (b->getInterval ()) == *before );
+
+        c.put (pBuffer(new Buffer(Interval(20, 30), 5.1, 7)));
+        EXCEPTION_ASSERT_EQUALS( c.resident_chunks ().size (), 1u );
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated );
+        EXCEPTION_ASSERT( *c.read (b->getInterval ()) == *before );
+    }
+
+    // All spilled chunks of a cache should share one file
+    {
+        const IntervalType chunk = 1<<20;
+        Cache c;
+        std::vector<pBuffer> d;
+        for (int i=0; i<3; i++)
+        {
+            d.push_back (pBuffer(new Buffer(Interval(i*chunk, i*chunk + 10), 1, 1)));
+            float* p = d[i]->getChannel (0)->waveform_data ()->getCpuMemory ();
+            for (int j=0; j<10; j++)
+                p[j] = i + j;
+            c.put (d[i]);
+        }
+
+        for (int i=0; i<3; i++)
+            EXCEPTION_ASSERT( c.spill (i*chunk) );
+        for (int i=0; i<3; i++)
+            EXCEPTION_ASSERT( *c.read (d[i]->getInterval ()) == *d[i] );
+
+        // A chunk that is loaded back gives its place in the file to the next
+        // spilled chunk
+        c.put (d[1]);
+        EXCEPTION_ASSERT_EQUALS( c.resident_chunks ().size (), 1u );
+        EXCEPTION_ASSERT( c.spill (chunk) );
+        for (int i=0; i<3; i++)
+            EXCEPTION_ASSERT( *c.read (d[i]->getInterval ()) == *d[i] );
+    }
+
+    // It should count the RAM of chunks until the last view of them is
+    // released, and count chunks shared by copies once
+    {
+        size_t allocated = Cache::allocated_bytes ();
+        size_t chunk_bytes = (1<<20)*sizeof(float);
+
+        Cache c;
+        c.put (pBuffer(new Buffer(Interval(0, 10), 1, 1)));
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated + chunk_bytes );
+
+        {
+            Cache copy(c);
+            Cache assigned;
+            assigned = c;
+            EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated + chunk_bytes );
+        }
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated + chunk_bytes );
+
+        pBuffer v = c.read (Interval(0, 10));
+        c.clear ();
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated + chunk_bytes );
+        v.reset ();
+        EXCEPTION_ASSERT_EQUALS( Cache::allocated_bytes (), allocated );
+    }
+
     try {
         cache.put (pBuffer(new Buffer(Interval(14, 25), 5.11, 7)));
         EXCEPTION_ASSERTX( false, "expected an exception to be thrown when supplying a non-consistent sample rate" );
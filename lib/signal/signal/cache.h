@@ -5,6 +5,7 @@
 
 #include <boost/exception/all.hpp>
 
+#include <atomic>
 #include <vector>
 
 namespace Signal {
@@ -22,6 +23,7 @@ public:
     Cache( );
     Cache( const Cache& b);
     Cache& operator=( const Cache& b);
+    ~Cache( );
 
     /**
       'sample_rate' is defined as 0 if _cache is empty.
@@ -35,6 +37,9 @@ public:
     /**
       Extract an exact interval from cache. Samples in
       "I - sampleDesc()" will be returned as zeros.
+
+      If I is covered by a single cache chunk the returned buffer is a view
+      that shares memory with the cache, see Buffer::view.
       */
     pBuffer read( const Interval& I ) const;
 
@@ -47,7 +52,9 @@ public:
     /**
       A slightly more efficient version than read(I) that is only guaranteed to
       return a buffer containing I.first. On a cache miss this method returns a
-      buffer with zeros of the requested interval 'I' or smaller.
+      buffer with zeros of the requested interval 'I' or smaller. On a cache
+      hit this method returns a view of all valid samples in the cache chunk
+      from I.first and onwards, possibly extending beyond I.
      */
     pBuffer readAtLeastFirstSample( const Interval&I ) const;
 
@@ -55,7 +62,8 @@ public:
     void clear();
 
     /**
-      Insert data into Cache
+      Insert data into Cache. Cache chunks that are referenced by views from
+      previous reads are copied before they are modified.
       */
     void put( pBuffer b );
 
@@ -76,8 +84,53 @@ public:
      */
     int num_channels() const;
 
+    /**
+     * @brief resident_chunks describes the cache chunks that are held in RAM
+     * together with when they were last accessed. A higher access value means
+     * a more recent access, the values are comparable between instances.
+     */
+    typedef std::pair<unsigned long long, Interval> ChunkAccess;
+    std::vector<ChunkAccess> resident_chunks() const;
+
+    /**
+     * @brief spill moves the cache chunk containing 'sample' from RAM to a
+     * temporary memory mapped file. The chunk can still be read transparently
+     * and is loaded back into RAM if it is written to by 'put'. All chunks of
+     * an instance are spilled to the same file.
+     * @return false if the chunk couldn't be spilled, was already spilled or
+     * is referenced by a view from a previous read.
+     */
+    bool spill( IntervalType sample );
+
+    /**
+     * @brief allocated_bytes is the total number of bytes held in RAM by the
+     * chunks of all Cache instances, including chunks that are no longer in
+     * a cache but still referenced by views. Chunks shared by copies of a
+     * Cache are counted once. Spilled chunks are not included.
+     */
+    static size_t allocated_bytes();
+
 private:
-    std::vector<pBuffer> _cache;
+    struct Chunk
+    {
+        Chunk( pBuffer buffer=pBuffer() );
+        Chunk( const Chunk& b );
+        Chunk& operator=( const Chunk& b );
+
+        pBuffer buffer;
+        bool spilled;
+
+        // Updated by concurrent reads
+        mutable std::atomic<unsigned long long> last_access;
+
+        size_t bytes() const;
+        void touch() const;
+    };
+
+    class SpillFile;
+
+    std::vector<Chunk> _cache;
+    boost::shared_ptr<SpillFile> _spill_file;
 
     /**
      * @brief _valid_samples explains the samples that can be fetched from
@@ -86,6 +139,12 @@ private:
      */
     Intervals _valid_samples;
 
+    /**
+     * @brief _stale_samples are samples that have been invalidated but might
+     * still be referenced by views returned from read.
+     */
+    Intervals _stale_samples;
+
     void allocateCache( Signal::Interval, float fs, int num_channels );
 
     /**
@@ -94,8 +153,14 @@ private:
      * @return The buffer containing 'sample' or the next following buffer if
      * no buffer contains 'sample'. Might be _cache.end()
      */
-    std::vector<pBuffer>::iterator findBuffer( Signal::IntervalType sample );
-    std::vector<pBuffer>::const_iterator findBuffer( Signal::IntervalType sample ) const;
+    std::vector<Chunk>::iterator findBuffer( Signal::IntervalType sample );
+    std::vector<Chunk>::const_iterator findBuffer( Signal::IntervalType sample ) const;
+
+    /**
+     * @brief loadChunk loads a spilled chunk back into RAM. Assumes that
+     * 'chunk' is spilled.
+     */
+    void loadChunk( Chunk& chunk );
 
 public:
     static void test();
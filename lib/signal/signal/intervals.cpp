@@ -7,6 +7,7 @@
 #include <cfloat>
 #include <sstream>
 #include <limits.h>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 
@@ -109,8 +110,32 @@ Intervals::
 Intervals& Intervals::
         operator |= (const Intervals& b)
 {
-    BOOST_FOREACH (const Interval& r, b)
-        operator |= ( r );
+    if (b.empty())
+        return *this;
+
+    if (1 == b.numSubIntervals())
+        return operator |= ( b.front() );
+
+    if (empty())
+        return *this = b;
+
+    // Merge the two sorted lists in one pass, joining touching intervals
+    base rebuild;
+    rebuild.reserve( base::size() + b.base::size() );
+
+    base::const_iterator i = base::begin(), j = b.base::begin();
+    while (i != base::end() || j != b.base::end())
+    {
+        const Interval& r = (j == b.base::end() || (i != base::end() && i->first < j->first))
+                ? *i++ : *j++;
+
+        if (!rebuild.empty() && r.first <= rebuild.back().last)
+            rebuild.back().last = std::max(rebuild.back().last, r.last);
+        else
+            rebuild.push_back( r );
+    }
+
+    base::swap( rebuild );
     return *this;
 }
 
@@ -121,39 +146,18 @@ Intervals& Intervals::
     if (0==r.count())
         return *this;
 
-    base::iterator first = base::end();
-    for (base::iterator itr = base::begin(); itr!=base::end(); itr++)
-        if ( r.first <= itr->last && itr->first <= r.last )
-        {
-            first = itr;
-            break;
-        }
+    base::iterator first = firstTouching( r );
+    base::iterator last = afterTouching( r );
 
-    if (first==base::end())
+    if (first == last)
     {
-        base::iterator itr = base::begin();
-        // find first after
-        while ( itr!=base::end() && itr->first <= r.last)
-            itr++;
-        base::insert( itr, r );
+        base::insert( first, r );
         return *this;
     }
 
-    base::iterator last = first;
-    last++;
-    // find first after
-    while (last != base::end() && last->first <= r.last)
-        last++;
-
-    Interval b = r;
-
-    for (base::iterator itr=first; itr!=last; itr++)
-    {
-        b = b.spanned(*itr);
-    }
-
-    base::erase( first, last );
-    base::insert( last, b );
+    Interval b = r.spanned( *first ).spanned( *(last-1) );
+    *first = b;
+    base::erase( first+1, last );
 
     return *this;
 }
@@ -162,8 +166,38 @@ Intervals& Intervals::
 Intervals& Intervals::
         operator -= (const Intervals& b)
 {
-    BOOST_FOREACH (const Interval& r,  b)
-        operator-=( r );
+    if (b.empty() || empty())
+        return *this;
+
+    if (1 == b.numSubIntervals())
+        return operator -= ( b.front() );
+
+    base rebuild;
+    rebuild.reserve( base::size() + b.base::size() );
+
+    base::const_iterator j = b.base::begin();
+    for (base::const_iterator i = base::begin(); i != base::end(); ++i)
+    {
+        Interval r = *i;
+
+        // Skip intervals in 'b' that ends before 'r'
+        while (j != b.base::end() && j->last <= r.first)
+            ++j;
+
+        // An interval in 'b' may overlap several intervals in 'this', don't advance 'j' here
+        for (base::const_iterator k = j; k != b.base::end() && k->first < r.last; ++k)
+        {
+            if (k->first > r.first)
+                rebuild.push_back( Interval(r.first, k->first) );
+
+            r.first = std::min(std::max(r.first, k->last), r.last);
+        }
+
+        if (r.count())
+            rebuild.push_back( r );
+    }
+
+    base::swap( rebuild );
     return *this;
 }
 
@@ -174,46 +208,31 @@ Intervals& Intervals::
     if (0==r.count())
         return *this;
 
-    base::iterator itr = firstIntersecting( r );
+    base::iterator first = firstIntersecting( r );
+    base::iterator last = afterIntersecting( r );
+
+    if (first >= last)
+        return *this;
+
+    // Whatever is left of the intervals in [first, last) after removing 'r'
+    Interval head(first->first, std::max(first->first, r.first));
+    Interval tail(std::min(r.last, (last-1)->last), (last-1)->last);
 
-    while (itr!=base::end())
+    if (head.count() && tail.count() && first+1 == last)
     {
-        Interval& i = *itr;
-        // Check if interval 'itr' intersects with 'r'
-        if ((i & r).count()) {
+        // 'r' is in the middle of a single interval, split it
+        first->last = r.first;
+        base::insert( last, tail );
+        return *this;
+    }
 
-            // Check if intersection is over the start of 'itr'
-            if (i.first >= r.first && i.last > r.last) {
-                i.first = r.last;
-                itr++;
-            }
+    if (head.count())
+        *first++ = head;
+    if (tail.count())
+        *first++ = tail;
 
-            // Check if intersection is over the end of 'itr'
-            else if (i.first < r.first && i.last <= r.last) {
-                i.last = r.first;
-                itr++;
-            }
+    base::erase( first, last );
 
-            // Check if intersection is over the entire 'itr'
-            else if (i.first >= r.first && i.last <= r.last)
-                itr = base::erase( itr );
-
-            // Check if intersection is in the middle of 'itr'
-            else if (i.first < r.first && i.last > r.last) {
-                Interval j(r.last, i.last);
-                itr->last = r.first;
-                itr++;
-                base::insert(itr, j);
-
-            // Else, error
-            } else {
-                EXCEPTION_ASSERT( false );
-                throw std::logic_error("Shouldn't reach here");
-            }
-        } else {
-            break;
-        }
-    }
     return *this;
 }
 
@@ -269,20 +288,26 @@ Intervals& Intervals::
 Intervals& Intervals::
         operator &= (const Intervals& b)
 {
-    // TODO optimize
-    Intervals rebuild;
+    if (1 == b.numSubIntervals())
+        return operator &= ( b.front() );
 
-    BOOST_FOREACH (const Interval& r,  b) {
-        Intervals copy = *this;
-        copy &= r;
-        rebuild |= copy;
-    }
+    base rebuild;
 
-    *this = rebuild;
+    base::const_iterator i = base::begin(), j = b.base::begin();
+    while (i != base::end() && j != b.base::end())
+    {
+        IntervalType first = std::max(i->first, j->first);
+        IntervalType last = std::min(i->last, j->last);
+        if (first < last)
+            rebuild.push_back( Interval(first, last) );
 
-    if (b.empty())
-        clear();
+        if (i->last < j->last)
+            ++i;
+        else
+            ++j;
+    }
 
+    base::swap( rebuild );
     return *this;
 }
 
@@ -296,44 +321,15 @@ Intervals& Intervals::
         return *this;
     }
 
-    base::iterator itr = firstIntersecting( r );
-    if (itr != base::begin())
-        itr = base::erase(base::begin(), itr);
+    base::erase( afterIntersecting( r ), base::end() );
+    base::erase( base::begin(), firstIntersecting( r ) );
 
-    while (itr!=base::end())
+    if (!empty())
     {
-        Interval& i = *itr;
-
-        // Check if interval 'itr' does not intersect with 'r'
-        if (0 == (i & r).count()) {
-            itr = base::erase(itr, base::end());
-
-        } else {
-            // Check if intersection is over the start of 'itr'
-            if (i.first >= r.first && i.last > r.last)
-                i.last = r.last;
-
-            // Check if intersection is over the end of 'itr'
-            else if (i.first < r.first && i.last <= r.last)
-                i.first = r.first;
-
-            // Check if intersection is over the entire 'itr'
-            else if (i.first >= r.first && i.last <= r.last)
-            {}
-
-            // Check if intersection is in the middle of 'itr'
-            else if (i.first < r.first && i.last > r.last)
-            {
-                i.first = r.first;
-                i.last = r.last;
-
-            // Else, error
-            } else {
-                throw std::logic_error("Shouldn't reach here");
-            }
-            itr++;
-        }
+        base::front().first = std::max(base::front().first, r.first);
+        base::back().last = std::min(base::back().last, r.last);
     }
+
     return *this;
 }
 
@@ -544,13 +540,35 @@ bool Intervals::
 }
 
 
+Intervals::base::iterator Intervals::
+        firstTouching( const Interval& b )
+{
+    return std::lower_bound(base::begin(), base::end(), b.first,
+        [](const Interval& i, IntervalType t) { return i.last < t; });
+}
+
+
+Intervals::base::iterator Intervals::
+        afterTouching( const Interval& b )
+{
+    return std::upper_bound(base::begin(), base::end(), b.last,
+        [](IntervalType t, const Interval& i) { return t < i.first; });
+}
+
+
 Intervals::base::iterator Intervals::
         firstIntersecting( const Interval& b )
 {
-    for (base::iterator itr = base::begin(); itr!=base::end(); itr++)
-        if ( (*itr & b).count() )
-            return itr;
-    return base::end();
+    return std::upper_bound(base::begin(), base::end(), b.first,
+        [](IntervalType t, const Interval& i) { return t < i.last; });
+}
+
+
+Intervals::base::iterator Intervals::
+        afterIntersecting( const Interval& b )
+{
+    return std::lower_bound(base::begin(), base::end(), b.last,
+        [](const Interval& i, IntervalType t) { return i.first < t; });
 }
 
 
@@ -632,7 +650,9 @@ Intervals  operator |  (const Interval& a, const Interval& b)  { return a|Interv
 
 #include "timer.h"
 #include "exceptionassert.h"
+#include "test/listintervals.h"
 #include <boost/format.hpp>
+#include <random>
 
 using namespace boost;
 
@@ -662,6 +682,68 @@ void Intervals::
         EXCEPTION_ASSERT_LESS(T,0.000004);
     }
 
+    // It should produce the same results as the std::list based implementation
+    // it replaced. The timings of both are logged for comparison.
+    {
+        std::default_random_engine re(1);
+        std::uniform_int_distribution<int> pos(0, 10000), len(1, 200);
+
+        auto randomIntervals = [&](int n) {
+            Intervals I;
+            for (int i=0; i<n; ++i) {
+                IntervalType first = pos(re);
+                I |= Interval(first, first + len(re));
+            }
+            return I;
+        };
+
+        const int N = 200;
+        std::vector<Intervals> A, B;
+        for (int i=0; i<N; ++i) {
+            A.push_back (randomIntervals(1 + i%16));
+            B.push_back (randomIntervals(1 + i%7));
+        }
+
+        std::vector<Test::ListIntervals> LA(A.begin (), A.end ()), LB(B.begin (), B.end ());
+
+        for (int i=0; i<N; ++i) {
+            Intervals a = A[i], b = B[i];
+            Test::ListIntervals la = LA[i], lb = LB[i];
+            Interval r = b.spannedInterval ();
+
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) |= lb).intervals (), a | b );
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) -= lb).intervals (), a - b );
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) &= lb).intervals (), a & b );
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) |= r).intervals (), a | r );
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) -= r).intervals (), a - r );
+            EXCEPTION_ASSERT_EQUALS( (Test::ListIntervals(la) &= r).intervals (), a & r );
+        }
+
+        const int M = 20;
+        Timer t;
+        for (int m=0; m<M; ++m)
+            for (int i=0; i<N; ++i) {
+                Test::ListIntervals u = LA[i], s = LA[i], n = LA[i];
+                u |= LB[i];
+                s -= LB[i];
+                n &= LB[i];
+            }
+        double T_list = t.elapsed ()/(M*N);
+
+        t.restart ();
+        for (int m=0; m<M; ++m)
+            for (int i=0; i<N; ++i) {
+                Intervals u = A[i], s = A[i], n = A[i];
+                u |= B[i];
+                s -= B[i];
+                n &= B[i];
+            }
+        double T_vector = t.elapsed ()/(M*N);
+
+        TaskInfo(boost::format("Intervals: union+subtract+intersect in %s, std::list took %s")
+                 % TaskTimer::timeToString (T_vector) % TaskTimer::timeToString (T_list));
+    }
+
     // It should have neat string representations
     {
         IntervalType n = Interval::IntervalType_MIN;
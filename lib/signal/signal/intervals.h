@@ -3,7 +3,8 @@
 
 #include "signaldll.h"
 
-#include <list>
+#include <boost/container/small_vector.hpp>
+
 #include <string>
 
 namespace Signal {
@@ -63,7 +64,7 @@ public:
 
 #ifdef _MSC_VER
 #pragma warning (push)
-// warning C4251: 'Signal::Intervals::base_' : class 'std::list<_Ty>' needs to
+// warning C4251: 'Signal::Intervals::base_' : class 'boost::container::small_vector<_Ty>' needs to
 // have dll-interface to be used by clients of class 'Signal::Intervals'
 //
 // As long as the .dll is only used internally for testing, this is not a problem.
@@ -78,12 +79,12 @@ public:
 
      I = [first, last)
 
-  Could speed up performance by allocating a limited number of Interval on the
-  stack instead, if performance of Intervals becomes an issue.
+  The intervals are kept sorted in a contiguous array. A few intervals are
+  stored inline without any heap allocation, which is the common case.
   */
-class SignalDll Intervals: private std::list<Interval>
+class SignalDll Intervals: private boost::container::small_vector<Interval, 4>
 {
-    typedef std::list<Interval> base;
+    typedef boost::container::small_vector<Interval, 4> base;
 public:
     static const Intervals Intervals_ALL;
 
@@ -140,7 +141,14 @@ public:
     void                    swap(Intervals& c) { base::swap (c); }
 
 private:
+    /// First interval that overlaps or touches 'b'
+    base::iterator firstTouching( const Interval& b );
+    /// First interval after 'firstTouching' that doesn't touch 'b'
+    base::iterator afterTouching( const Interval& b );
+    /// First interval that overlaps 'b'
     base::iterator firstIntersecting( const Interval& b );
+    /// First interval after 'firstIntersecting' that doesn't overlap 'b'
+    base::iterator afterIntersecting( const Interval& b );
 
 public:
     static void test();
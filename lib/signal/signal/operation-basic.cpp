@@ -72,4 +72,11 @@ QString OperationSetSilent::
     return QString::fromStdString (ss.str());
 }
 
+
+QString OperationSetSilent::
+        persistentId() const
+{
+    return toString ();
+}
+
 } // namespace Signal
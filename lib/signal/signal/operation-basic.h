@@ -35,6 +35,7 @@ public:
     OperationDesc::ptr copy() const;
     Operation::ptr createOperation(ComputingEngine* engine=0) const;
     QString toString() const;
+    QString persistentId() const;
 
     Signal::Interval section() { return section_; }
 private:
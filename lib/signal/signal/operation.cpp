@@ -41,6 +41,20 @@ QString OperationDesc::
 }
 
 
+QString OperationDesc::
+        persistentId() const
+{
+    return QString();
+}
+
+
+OperationDesc::ptr OperationDesc::
+        fuse(const OperationDesc&) const
+{
+    return OperationDesc::ptr();
+}
+
+
 void OperationDesc::
         setInvalidator(Signal::Processing::IInvalidator::ptr invalidator)
 {
@@ -147,6 +147,32 @@ public:
     virtual QString toString() const;
 
 
+    /**
+     * @brief persistentId should describe everything that affects the output
+     * of this operation, except for its sources. Results of operations with
+     * a persistentId may be reused by later sessions, see
+     * Signal::Processing::PersistentCache.
+     * @return An empty string by default, which means that results of this
+     * operation, and of all operations that depend on it, are not kept.
+     */
+    virtual QString persistentId() const;
+
+
+    /**
+     * @brief fuse should describe this operation applied directly to the
+     * output of 'source', without computing the output of 'source' in
+     * between. Signal::Processing::FirstMissAlgorithm uses it to run a chain
+     * of operations as one task.
+     *
+     * The fused operation must have the same requiredInterval and
+     * affectedInterval as this operation. It is kept until the cache of the
+     * step is deprecated, see Step::fusion.
+     * @return An empty pointer by default, which means that this operation
+     * can't be fused with 'source'.
+     */
+    virtual OperationDesc::ptr fuse(const OperationDesc& source) const;
+
+
     /**
      * @brief setInvalidator sets an functor to be used by deprecateCache.
      * @param invalidator
@@ -6,6 +6,9 @@
 
 #include <boost/foreach.hpp>
 
+#include <climits>
+#include <thread>
+
 namespace Signal {
 namespace Processing {
 
@@ -13,17 +16,21 @@ namespace Processing {
 Bedroom::Data::
     Data()
     :
-        sleepers(new Counter::element_type),
-        skip_sleep_marker(new Counter::element_type),
-        is_closed(false)
+        is_closed(false),
+        spin(0)
 {
 }
 
 
 Bedroom::Bed::
-        Bed(shared_state<Data> data)
+        Bed(shared_state<Data> data, std::function<void()> on_wakeup, std::string kind)
     :
-      data_(data)
+      data_(data),
+      on_wakeup_(on_wakeup),
+      kind_(kind),
+      state_(Awake),
+      skip_sleep_(false),
+      latency_(0)
 {
     data_.write ()->beds.insert(this);
 }
@@ -46,49 +53,228 @@ void Bedroom::Bed::
 bool Bedroom::Bed::
         sleep(unsigned long ms_timeout)
 {
+    if (data_.read ()->is_closed) {
+        BOOST_THROW_EXCEPTION(BedroomClosed() << Backtrace::make ());
+    }
+
+    if (spin ())
+        return true;
+
     auto data = data_.write ();
 
     if (data->is_closed) {
+        state_ = Awake;
         BOOST_THROW_EXCEPTION(BedroomClosed() << Backtrace::make ());
     }
 
-    bool r = true;
-
-    // Increment usage count
-    Counter b = data->sleepers;
+    state_ = Sleeping;
 
     // Wait in a while-loop to cope with spurious wakeups
     if (ULONG_MAX == ms_timeout)
         while (!skip_sleep_)
-            data->work.wait ( data_.mutex() );
+            work_.wait ( data_.mutex() );
     else
+    {
+        bool r = true;
         while (r && !skip_sleep_)
-            r = std::cv_status::no_timeout == data->work.wait_for (data_.mutex(), std::chrono::milliseconds(ms_timeout));
+            r = std::cv_status::no_timeout == work_.wait_for (data_.mutex(), std::chrono::milliseconds(ms_timeout));
+    }
 
-    skip_sleep_.reset();
+    bool r = skip_sleep_;
+    skip_sleep_ = false;
+    state_ = Awake;
+    if (r)
+        woken (*data);
+    else
+        latency_ = 0;
 
     return r;
 }
 
 
+bool Bedroom::Bed::
+        park()
+{
+    if (spin ())
+        return true;
+
+    auto data = data_.write ();
+    if (skip_sleep_)
+    {
+        skip_sleep_ = false;
+        state_ = Awake;
+        woken (*data);
+        return true;
+    }
+
+    state_ = Parked;
+    return false;
+}
+
+
+void Bedroom::Bed::
+        awake()
+{
+    auto data = data_.write ();
+    skip_sleep_ = false;
+    state_ = Awake;
+    woken (*data);
+}
+
+
+double Bedroom::Bed::
+        latency() const
+{
+    return latency_;
+}
+
+
+bool Bedroom::Bed::
+        spin()
+{
+    std::chrono::steady_clock::time_point end;
+    {
+        auto data = data_.write ();
+        if (skip_sleep_)
+        {
+            skip_sleep_ = false;
+            woken (*data);
+            return true;
+        }
+
+        state_ = Spinning;
+        end = std::chrono::steady_clock::now () + data->spin;
+    }
+
+    // Only a wakeup call changes state_ from Spinning, check it without locking
+    while (Spinning == state_.load () && std::chrono::steady_clock::now () < end)
+        std::this_thread::yield ();
+
+    auto data = data_.write ();
+    if (!skip_sleep_)
+        return false;
+
+    skip_sleep_ = false;
+    state_ = Awake;
+    woken (*data);
+    return true;
+}
+
+
+void Bedroom::Bed::
+        wake(int state, std::chrono::steady_clock::time_point now)
+{
+    // Called with the bedroom locked
+    skip_sleep_ = true;
+    if (Awake == state)
+        return;
+
+    wakeup_time_ = now;
+    state_ = Awake;
+
+    if (Sleeping == state)
+        work_.notify_one ();
+    if (Parked == state && on_wakeup_)
+        on_wakeup_ ();
+}
+
+
+void Bedroom::Bed::
+        woken(Data& data)
+{
+    if (std::chrono::steady_clock::time_point() == wakeup_time_)
+    {
+        latency_ = 0;
+        return;
+    }
+
+    latency_ = std::chrono::duration<double>(std::chrono::steady_clock::now () - wakeup_time_).count ();
+    wakeup_time_ = std::chrono::steady_clock::time_point();
+
+    data.stats.wakeups++;
+    data.stats.latency += latency_;
+    data.stats.max_latency = std::max(data.stats.max_latency, latency_);
+}
+
+
 Bedroom::
-        Bedroom()
+        Bedroom(std::chrono::microseconds spin)
     :
       data_(new Data)
 {
+    data_->spin = spin;
 }
 
 
 void Bedroom::
         wakeup()
+{
+    wakeup(INT_MAX);
+}
+
+
+void Bedroom::
+        wakeup(int n)
 {
     auto data = data_.write ();
     // no one is going into sleep as long as data_ is locked
 
-    for (Bed* b : data->beds)
-        b->skip_sleep_ = data->skip_sleep_marker;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
 
-    data->work.notify_all ();
+    // Wake spinning beds first, then sleeping and parked beds. Beds that are
+    // awake keep the rest of the wakeup call for their next sleep.
+    for (int pass=0; pass<3 && 0<n; pass++)
+    {
+        for (Bed* b : data->beds)
+        {
+            if (0 == n)
+                break;
+
+            int state = b->state_.load ();
+            bool wake = 0 == pass ? Bed::Spinning == state
+                      : 1 == pass ? Bed::Sleeping == state || Bed::Parked == state
+                      : Bed::Awake == state && !b->skip_sleep_;
+            if (!wake)
+                continue;
+
+            n--;
+            b->wake (state, now);
+        }
+    }
+}
+
+
+void Bedroom::
+        wakeupOthers(const std::string& kind)
+{
+    auto data = data_.write ();
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
+
+    // Same order as wakeup(n), one bed of each kind
+    std::set<std::string> woken_kinds;
+    woken_kinds.insert (kind);
+    for (int pass=0; pass<3; pass++)
+    {
+        for (Bed* b : data->beds)
+        {
+            if (woken_kinds.count (b->kind_))
+                continue;
+
+            int state = b->state_.load ();
+            bool already = Bed::Awake == state && b->skip_sleep_;
+            bool wake = 0 == pass ? Bed::Spinning == state
+                      : 1 == pass ? Bed::Sleeping == state || Bed::Parked == state
+                      : Bed::Awake == state && !b->skip_sleep_;
+            if (already)
+                woken_kinds.insert (b->kind_);
+            if (!wake)
+                continue;
+
+            woken_kinds.insert (b->kind_);
+            b->wake (state, now);
+        }
+    }
 }
 
 
@@ -104,15 +290,32 @@ void Bedroom::
 Bedroom::Bed Bedroom::
         getBed()
 {
-    return Bed(data_);
+    return Bed(data_, std::function<void()>(), std::string());
+}
+
+
+Bedroom::Bed Bedroom::
+        getBed(std::function<void()> on_wakeup, std::string kind)
+{
+    return Bed(data_, on_wakeup, kind);
 }
 
 
 int Bedroom::
         sleepers()
 {
-    // Remove 1 to compensate for the instance used by 'this'
-    return data_->sleepers.use_count() - 1;
+    int n = 0;
+    for (Bed* b : data_.read ()->beds)
+        if (Bed::Awake != b->state_.load ())
+            n++;
+    return n;
+}
+
+
+Bedroom::Stats Bedroom::
+        stats()
+{
+    return data_.read ()->stats;
 }
 
 
@@ -122,6 +325,8 @@ int Bedroom::
 
 #include <QThread>
 
+#include <vector>
+
 namespace Signal {
 namespace Processing {
 
@@ -231,6 +436,116 @@ void Bedroom::
         EXCEPTION_ASSERT(sbm.isFinished ());
         EXCEPTION_ASSERT_EQUALS( sbm.sleep_count (), 3 );
     }
+
+    // It should wake up only as many sleepers as asked for
+    {
+        Bedroom::ptr bedroom(new Bedroom);
+        std::atomic<int> woken(0);
+        std::vector<std::thread> threads;
+        for (int i=0; i<3; i++)
+            threads.push_back (std::thread([bedroom, &woken](){
+                Bedroom::Bed bed = bedroom->getBed();
+                bed.sleep ();
+                woken++;
+            }));
+
+        while (bedroom->sleepers () < 3)
+            std::this_thread::yield ();
+
+        bedroom->wakeup (1);
+        std::this_thread::sleep_for (std::chrono::milliseconds(5));
+        EXCEPTION_ASSERT_EQUALS(woken, 1);
+        EXCEPTION_ASSERT_EQUALS(bedroom->sleepers (), 2);
+
+        bedroom->wakeup (2);
+        for (std::thread& t : threads)
+            t.join ();
+        EXCEPTION_ASSERT_EQUALS(woken, 3);
+        EXCEPTION_ASSERT_EQUALS(bedroom->stats ().wakeups, 3u);
+    }
+
+    // It should not lose a wakeup call made before going to sleep
+    {
+        Bedroom b;
+        Bedroom::Bed bed = b.getBed ();
+        b.wakeup (1);
+
+        Timer t;
+        EXCEPTION_ASSERT(bed.sleep (100));
+        EXCEPTION_ASSERT_LESS(t.elapsed (), 50e-3);
+        EXCEPTION_ASSERT(!bed.sleep (1));
+    }
+
+    // It should let a thread park in an event loop and call it on wakeup
+    {
+        Bedroom b;
+        std::atomic<int> calls(0);
+        Bedroom::Bed bed = b.getBed ([&calls](){ calls++; });
+
+        EXCEPTION_ASSERT(!bed.park ());
+        EXCEPTION_ASSERT_EQUALS(b.sleepers (), 1);
+
+        b.wakeup (1);
+        EXCEPTION_ASSERT_EQUALS(calls, 1);
+        EXCEPTION_ASSERT_EQUALS(b.sleepers (), 0);
+
+        // Awake already, a second call is kept for the next park
+        b.wakeup (1);
+        EXCEPTION_ASSERT_EQUALS(calls, 1);
+        bed.awake ();
+        EXCEPTION_ASSERT_LESS(0, bed.latency ());
+        EXCEPTION_ASSERT(!bed.park ());
+        EXCEPTION_ASSERT_EQUALS(b.stats ().wakeups, 1u);
+    }
+
+    // It should pick up a wakeup call while spinning with a low latency
+    {
+        Bedroom::ptr bedroom(new Bedroom(std::chrono::milliseconds(100)));
+        double latency = -1;
+        std::thread t([bedroom, &latency](){
+            Bedroom::Bed bed = bedroom->getBed();
+            bed.sleep ();
+            latency = bed.latency ();
+        });
+
+        while (bedroom->sleepers () < 1)
+            std::this_thread::yield ();
+        bedroom->wakeup ();
+        t.join ();
+
+        Stats stats = bedroom->stats ();
+        EXCEPTION_ASSERT_EQUALS(stats.wakeups, 1u);
+        EXCEPTION_ASSERT_EQUALS(stats.latency, latency);
+        EXCEPTION_ASSERT_EQUALS(stats.max_latency, latency);
+        EXCEPTION_ASSERT_LESS(latency, 10e-3);
+    }
+
+    // It should wake one sleeper of each other kind
+    {
+        Bedroom b;
+        std::atomic<int> cpu(0), null(0);
+        Bedroom::Bed cpu1 = b.getBed ([&cpu](){ cpu++; }, "cpu");
+        Bedroom::Bed cpu2 = b.getBed ([&cpu](){ cpu++; }, "cpu");
+        Bedroom::Bed null1 = b.getBed ([&null](){ null++; }, "null");
+        Bedroom::Bed null2 = b.getBed ([&null](){ null++; }, "null");
+        for (Bedroom::Bed* bed : {&cpu1, &cpu2, &null1, &null2})
+            EXCEPTION_ASSERT(!bed->park ());
+
+        b.wakeupOthers ("null");
+        EXCEPTION_ASSERT_EQUALS(cpu, 1);
+        EXCEPTION_ASSERT_EQUALS(null, 0);
+        EXCEPTION_ASSERT_EQUALS(b.sleepers (), 3);
+
+        b.wakeupOthers ("cpu");
+        EXCEPTION_ASSERT_EQUALS(cpu, 1);
+        EXCEPTION_ASSERT_EQUALS(null, 1);
+        EXCEPTION_ASSERT_EQUALS(b.sleepers (), 2);
+
+        // The woken cpu bed hasn't run yet, it already has a wakeup call
+        b.wakeupOthers ("null");
+        EXCEPTION_ASSERT_EQUALS(cpu, 1);
+        EXCEPTION_ASSERT_EQUALS(b.sleepers (), 2);
+    }
 }
 
 } // namespace Processing
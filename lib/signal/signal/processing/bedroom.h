@@ -6,7 +6,11 @@
 #include <boost/exception/exception.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <set>
+#include <string>
 #include <condition_variable>
 
 namespace Signal {
@@ -22,14 +26,24 @@ class BedroomClosed: public virtual boost::exception, public virtual std::except
  * It should throw a BedroomClosed exception if someone tries to go to
  * sleep when the bedroom is closed.
  *
+ * It should wake up only as many sleepers as asked for. A wakeup call that
+ * doesn't find enough sleepers is kept by beds that are awake, their next
+ * sleep returns right away. So a wakeup call is never lost between deciding
+ * to sleep and going to sleep.
+ *
+ * Sleepers first spin for 'spin' before they block, a wakeup call during the
+ * spin is picked up without involving the OS.
+ *
+ * Beds may be of different kinds, such as workers of different computing
+ * engines. wakeupOthers() wakes one sleeper of each other kind.
+ *
+ * It should measure the latency from a wakeup call until the sleeper runs,
+ * see stats().
+ *
  * See Bedroom::test for usage example.
  */
 class Bedroom
 {
-private:
-    class Void {};
-    typedef boost::shared_ptr<Void> Counter;
-
 public:
     typedef std::shared_ptr<Bedroom> ptr;
     typedef std::weak_ptr<Bedroom> weak_ptr;
@@ -52,12 +66,54 @@ public:
          */
         bool sleep(unsigned long ms_timeout);
 
+        /**
+         * @brief park is sleep for a thread that waits in an event loop. It
+         * spins like sleep but doesn't block.
+         * @return true if woken up during the spin. false if parked, the
+         * bedroom then calls 'on_wakeup' given to getBed on the next wakeup
+         * call. The thread should call awake() when it runs again.
+         */
+        bool park();
+
+        /**
+         * @brief awake marks a parked bed as awake and measures the latency
+         * of the wakeup call.
+         */
+        void awake();
+
+        /**
+         * @brief latency from the latest wakeup call to the return of sleep,
+         * park or awake, in seconds. 0 if there wasn't any wakeup call.
+         */
+        double latency() const;
+
+        const std::string& kind() const { return kind_; }
+
     private:
         friend class Bedroom;
 
-        Bed(shared_state<Data> data);
+        enum State { Awake, Spinning, Sleeping, Parked };
+
+        Bed(shared_state<Data> data, std::function<void()> on_wakeup, std::string kind);
+        bool spin();
+        void wake(int state, std::chrono::steady_clock::time_point now);
+        void woken(Data& data);
+
         shared_state<Data> data_;
-        Counter skip_sleep_;
+        std::function<void()> on_wakeup_;
+        const std::string kind_;
+        std::condition_variable_any work_;
+        std::atomic<int> state_;
+        bool skip_sleep_;
+        std::chrono::steady_clock::time_point wakeup_time_;
+        double latency_;
+    };
+
+
+    struct Stats {
+        unsigned long long wakeups = 0;
+        double latency = 0;     // total, seconds
+        double max_latency = 0; // seconds
     };
 
 
@@ -69,24 +125,41 @@ public:
 
         Data();
 
-        std::condition_variable_any work;
-
         std::set<Bed*> beds;
-        Counter sleepers;
-        Counter skip_sleep_marker;
         bool is_closed;
+        std::chrono::microseconds spin;
+        Stats stats;
     };
 
 
-    Bedroom();
+    Bedroom(std::chrono::microseconds spin=std::chrono::microseconds(0));
 
     // Wake up sleepers
     void wakeup();
+
+    /**
+     * @brief wakeup wakes up at most 'n' sleepers. Spinning sleepers are
+     * woken first as they are the quickest to respond.
+     */
+    void wakeup(int n);
+
+    /**
+     * @brief wakeupOthers wakes at most one sleeper of each kind other than
+     * 'kind'. Beds without a kind are a kind of their own.
+     */
+    void wakeupOthers(const std::string& kind);
     void close();
 
     Bed getBed();
 
+    /**
+     * @brief getBed creates a bed for park. 'on_wakeup' is called while the
+     * bedroom is locked, it must not block nor use this bedroom.
+     */
+    Bed getBed(std::function<void()> on_wakeup, std::string kind=std::string());
+
     int sleepers();
+    Stats stats();
 
 private:
     shared_state<Data> data_;
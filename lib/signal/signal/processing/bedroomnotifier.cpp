@@ -15,8 +15,9 @@ void BedroomNotifier::
         wakeup() const
 {
     Bedroom::ptr bedroom = bedroom_.lock();
+    // Workers wake up each other as long as they find tasks
     if (bedroom)
-        bedroom->wakeup();
+        bedroom->wakeup(1);
 }
 
 } // namespace Processing
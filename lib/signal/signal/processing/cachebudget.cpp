@@ -0,0 +1,211 @@
+#include "cachebudget.h"
+
+#include "cpuproperties.h"
+#include "tasktimer.h"
+
+#include <algorithm>
+
+//#define DEBUGINFO
+#define DEBUGINFO if(0)
+
+namespace Signal {
+namespace Processing {
+
+
+CacheBudget::
+        CacheBudget(size_t budget)
+    :
+      budget_(budget)
+{
+}
+
+
+CacheBudget& CacheBudget::
+        global()
+{
+    static CacheBudget budget(CpuProperties::cpu_memory_size () > 0
+                              ? CpuProperties::cpu_memory_size ()/2
+                              : (size_t)-1);
+    return budget;
+}
+
+
+size_t CacheBudget::
+        budget() const
+{
+    return budget_;
+}
+
+
+void CacheBudget::
+        set_budget(size_t bytes)
+{
+    budget_ = bytes;
+}
+
+
+void CacheBudget::
+        add_cache(shared_state<Signal::Cache> cache)
+{
+    std::lock_guard<std::mutex> l(caches_mutex_);
+    caches_.push_back (cache);
+}
+
+
+std::vector<shared_state<Signal::Cache> > CacheBudget::
+        caches()
+{
+    std::lock_guard<std::mutex> l(caches_mutex_);
+
+    std::vector<shared_state<Signal::Cache> > r;
+    std::vector<shared_state<Signal::Cache>::weak_ptr> alive;
+    for (const shared_state<Signal::Cache>::weak_ptr& w : caches_)
+    {
+        if (shared_state<Signal::Cache> c = w.lock ())
+        {
+            r.push_back (c);
+            alive.push_back (w);
+        }
+    }
+
+    caches_.swap (alive);
+    return r;
+}
+
+
+int CacheBudget::
+        enforce()
+{
+    size_t budget = budget_;
+    if (Signal::Cache::allocated_bytes () <= budget)
+        return 0;
+
+    std::unique_lock<std::mutex> l(enforce_mutex_, std::try_to_lock);
+    if (!l)
+        return 0; // Another thread is already spilling
+
+    // Find the least recently used chunks among all caches
+    struct Candidate {
+        unsigned long long last_access;
+        Signal::Interval chunk;
+        size_t cache;
+
+        bool operator<(const Candidate& b) const { return last_access < b.last_access; }
+    };
+
+    std::vector<shared_state<Signal::Cache> > C = caches ();
+    std::vector<Candidate> candidates;
+    for (size_t i=0; i<C.size (); i++)
+    {
+        auto cache = C[i].try_read ();
+        if (!cache)
+            continue;
+
+        for (const Signal::Cache::ChunkAccess& a : cache->resident_chunks ())
+            candidates.push_back (Candidate{a.first, a.second, i});
+    }
+
+    std::sort(candidates.begin (), candidates.end ());
+
+    DEBUGINFO TaskTimer tt(boost::format("CacheBudget: %s allocated in caches, budget is %s")
+                           % DataStorageVoid::getMemorySizeText (Signal::Cache::allocated_bytes ())
+                           % DataStorageVoid::getMemorySizeText (budget));
+
+    int spilled = 0;
+    size_t target = budget - budget/10;
+    for (const Candidate& c : candidates)
+    {
+        if (Signal::Cache::allocated_bytes () <= target)
+            break;
+
+        if (auto cache = C[c.cache].try_write ())
+            if (cache->spill (c.chunk.first))
+                spilled++;
+    }
+
+    return spilled;
+}
+
+
+} // namespace Processing
+} // namespace Signal
+
+#include <thread>
+
+namespace Signal {
+namespace Processing {
+
+void CacheBudget::
+        test()
+{
+    // It should limit the amount of RAM used by the caches of all steps.
+    {
+        shared_state<Signal::Cache> a(new Signal::Cache);
+        shared_state<Signal::Cache> b(new Signal::Cache);
+
+        Signal::pBuffer data(new Signal::Buffer(Signal::Interval(0, 100), 1, 2));
+        float* p = data->getChannel (1)->waveform_data ()->getCpuMemory ();
+        for (int i=0; i<data->number_of_samples (); i++)
+            p[i] = i;
+
+        const Signal::IntervalType chunk = 1<<20;
+        size_t chunk_bytes = chunk*2*sizeof(float);
+        size_t other_bytes = Signal::Cache::allocated_bytes ();
+
+        CacheBudget budget(other_bytes + 3*chunk_bytes);
+        budget.add_cache (a);
+        budget.add_cache (b);
+
+        for (int i=0; i<3; i++) {
+            data->set_sample_offset (i*chunk);
+            a->put (data);
+        }
+        EXCEPTION_ASSERT_EQUALS(budget.enforce (), 0);
+
+        // Access the first chunk in 'a' to make the second chunk least recently used
+        a->read (Signal::Interval(0, 100));
+
+        data->set_sample_offset (0);
+        b->put (data);
+        EXCEPTION_ASSERT_EQUALS(Signal::Cache::allocated_bytes (), other_bytes + 4*chunk_bytes);
+
+        // Spill until 10% of the budget is free
+        EXCEPTION_ASSERT_EQUALS(budget.enforce (), 2);
+        EXCEPTION_ASSERT_EQUALS(Signal::Cache::allocated_bytes (), other_bytes + 2*chunk_bytes);
+        std::vector<Signal::Cache::ChunkAccess> resident = a.read ()->resident_chunks ();
+        EXCEPTION_ASSERT_EQUALS(resident.size (), 1u);
+        EXCEPTION_ASSERT_EQUALS(resident[0].second, Signal::Interval(0, chunk));
+        EXCEPTION_ASSERT_EQUALS(b.read ()->resident_chunks ().size (), 1u);
+
+        // Spilled chunks should be read transparently
+        data->set_sample_offset (chunk);
+        EXCEPTION_ASSERT(*a.read ()->read (Signal::Interval(chunk, chunk+100)) == *data);
+
+        // And be loaded back into RAM when written to
+        a->put (data);
+        EXCEPTION_ASSERT_EQUALS(Signal::Cache::allocated_bytes (), other_bytes + 3*chunk_bytes);
+        EXCEPTION_ASSERT(*a.read ()->read (Signal::Interval(chunk, chunk+100)) == *data);
+    }
+
+    // It should skip caches that are currently locked by someone else.
+    {
+        shared_state<Signal::Cache> a(new Signal::Cache);
+        size_t other_bytes = Signal::Cache::allocated_bytes ();
+        CacheBudget budget(other_bytes);
+        budget.add_cache (a);
+
+        a->put (Signal::pBuffer(new Signal::Buffer(Signal::Interval(0, 100), 1, 2)));
+
+        {
+            auto w = a.write ();
+            int spilled = -1;
+            std::thread([&]() { spilled = budget.enforce (); }).join ();
+            EXCEPTION_ASSERT_EQUALS(spilled, 0);
+        }
+        EXCEPTION_ASSERT_EQUALS(budget.enforce (), 1);
+        EXCEPTION_ASSERT_EQUALS(Signal::Cache::allocated_bytes (), other_bytes);
+    }
+}
+
+} // namespace Processing
+} // namespace Signal
@@ -0,0 +1,71 @@
+#ifndef SIGNAL_PROCESSING_CACHEBUDGET_H
+#define SIGNAL_PROCESSING_CACHEBUDGET_H
+
+#include "shared_state.h"
+#include "signal/cache.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace Signal {
+namespace Processing {
+
+/**
+ * @brief The CacheBudget class should limit the amount of RAM used by the
+ * caches of all steps.
+ *
+ * When the budget is exceeded it should spill the least recently used cache
+ * chunks to memory mapped files until the caches are back within budget, see
+ * Signal::Cache::spill. Spilled chunks are read transparently and are loaded
+ * back into RAM when written to.
+ *
+ * It should skip caches that are currently locked by someone else.
+ *
+ * It should be thread-safe.
+ */
+class CacheBudget
+{
+public:
+    explicit CacheBudget(size_t budget);
+
+    /**
+     * @brief global is the instance used by Step. The default budget is half
+     * of the physical memory.
+     */
+    static CacheBudget& global();
+
+    size_t budget() const;
+    void set_budget(size_t bytes);
+
+    void add_cache(shared_state<Signal::Cache> cache);
+
+    /**
+     * @brief enforce spills cache chunks until Cache::allocated_bytes() is
+     * within budget. Once the budget is exceeded, chunks are spilled until
+     * 10% of the budget is free again to not spill on every call.
+     *
+     * Must not be called while the calling thread holds the lock of any cache.
+     * @return the number of spilled chunks.
+     */
+    int enforce();
+
+private:
+    std::atomic<size_t> budget_;
+
+    std::mutex caches_mutex_;
+    std::vector<shared_state<Signal::Cache>::weak_ptr> caches_;
+
+    // Only one thread spills at a time
+    std::mutex enforce_mutex_;
+
+    std::vector<shared_state<Signal::Cache> > caches();
+
+public:
+    static void test();
+};
+
+} // namespace Processing
+} // namespace Signal
+
+#endif // SIGNAL_PROCESSING_CACHEBUDGET_H
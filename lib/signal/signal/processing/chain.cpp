@@ -6,6 +6,7 @@
 #include "graphinvalidator.h"
 #include "bedroomnotifier.h"
 #include "workers.h"
+#include "workstealingschedule.h"
 
 // backtrace
 #include "demangle.h"
@@ -22,15 +23,18 @@ namespace Processing {
 
 
 Chain::ptr Chain::
-        createDefaultChain()
+        createDefaultChain(int batch_size)
 {
     Dag::ptr dag(new Dag);
-    Bedroom::ptr bedroom(new Bedroom);
+    // Workers spin a moment before parking
+    Bedroom::ptr bedroom(new Bedroom(std::chrono::microseconds(50)));
     BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
     Targets::ptr targets(new Targets(notifier));
 
     IScheduleAlgorithm::ptr algorithm(new FirstMissAlgorithm());
     ISchedule::ptr targetSchedule(new TargetSchedule(dag, algorithm, targets));
+    if (0 < batch_size)
+        targetSchedule.reset (new WorkStealingSchedule(targetSchedule, batch_size));
     Workers::ptr workers(new Workers(targetSchedule, bedroom));
 
     // Add the 'single instance engine' thread.
@@ -208,6 +212,15 @@ Workers::ptr Chain::
 }
 
 
+PerfCounters::Snapshot Chain::
+        perfCounters() const
+{
+    auto dag = dag_.read ();
+    auto workers = workers_.read ();
+    return PerfCounters::snapshot (*dag, *workers);
+}
+
+
 Targets::ptr Chain::
         targets() const
 {
@@ -216,7 +229,7 @@ Targets::ptr Chain::
 
 
 void Chain::
-        resetDefaultWorkers()
+        resetDefaultWorkers(int cpu_workers)
 {
     TaskTimer tt("Chain::resetDefaultWorkers");
 
@@ -239,13 +252,15 @@ void Chain::
     if (!engines.count (0))
         workers->addComputingEngine(Signal::ComputingEngine::ptr());
 
-    int cpu_workers = 0;
+    int running_cpu_workers = 0;
     for (auto e : engines)
         if (dynamic_cast<Signal::ComputingEngine*>(e.first.get()))
-            cpu_workers++;
+            running_cpu_workers++;
 
     // Add worker threads to occupy all kernels
-    for (int i=cpu_workers; i<QThread::idealThreadCount (); i++)
+    if (cpu_workers < 0)
+        cpu_workers = QThread::idealThreadCount ();
+    for (int i=running_cpu_workers; i<cpu_workers; i++)
         workers->addComputingEngine(Signal::ComputingEngine::ptr(new Signal::ComputingCpu));
 }
 
@@ -387,6 +402,11 @@ void Chain::
         usleep(4000);
         //target->sleep();
 
+        // It should tell what each step and each worker spends its time on
+        PerfCounters::Snapshot perf = chain.read ()->perfCounters ();
+        EXCEPTION_ASSERT_EQUALS(perf.steps.size (), 2u);
+        EXCEPTION_ASSERT(!perf.engines.empty ());
+
         // This will remove the step used by invalidator
         chain.write ()->removeOperationsAt(target);
 
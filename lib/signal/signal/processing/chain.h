@@ -3,6 +3,7 @@
 
 #include "shared_state.h"
 #include "targets.h"
+#include "perfcounters.h"
 #include "targetmarker.h"
 #include "dag.h"
 #include "iinvalidator.h"
@@ -29,7 +30,14 @@ class Chain
 public:
     typedef shared_state<Chain> ptr;
 
-    static Chain::ptr createDefaultChain();
+    /**
+     * @brief createDefaultChain creates a chain with one worker per hardware
+     * thread.
+     * @param batch_size If larger than 0 the ComputingCpu workers prefetch
+     * this many tasks at a time into per-worker queues and steal tasks from
+     * each other, see WorkStealingSchedule.
+     */
+    static Chain::ptr createDefaultChain(int batch_size=0);
 
     ~Chain();
 
@@ -67,7 +75,18 @@ public:
     shared_state<Workers> workers() const;
     Targets::ptr targets() const;
 
-    void resetDefaultWorkers();
+    /**
+     * @brief perfCounters tells what each step and each worker has spent its
+     * time on, see PerfCounters.
+     */
+    PerfCounters::Snapshot perfCounters() const;
+
+    /**
+     * @brief resetDefaultWorkers restarts all workers.
+     * @param cpu_workers Number of ComputingCpu workers, or -1 for one per
+     * hardware thread.
+     */
+    void resetDefaultWorkers(int cpu_workers=-1);
     // Add jumping around with targets later.
 
 private:
@@ -1,7 +1,9 @@
 #include "firstmissalgorithm.h"
 
 #include "reversegraph.h"
+#include "persistentcache.h"
 #include "signal/buffersource.h"
+#include "test/operationmockups.h"
 
 #include "tasktimer.h"
 #include "expectexception.h"
@@ -10,6 +12,8 @@
 #include <boost/foreach.hpp>
 #include <boost/graph/breadth_first_search.hpp>
 
+#include <QDir>
+
 //#define DEBUGINFO
 #define DEBUGINFO if(0)
 
@@ -29,23 +33,183 @@ struct ScheduleParams {
     Signal::ComputingEngine::ptr engine;
     Signal::IntervalType preferred_size;
     Signal::IntervalType center;
+    bool persistent;
 };
 
 
+/**
+ * Describes the operation in 'u' and all of its sources, see PersistentCache.
+ * Empty if any of them lacks an OperationDesc::persistentId.
+ *
+ * Reuses the key of a previous pass until the step is deprecated, which
+ * happens whenever the operation or any of its sources changes.
+ */
+std::string chainKey(GraphVertex u, const Graph& g)
+{
+    std::string memo = g[u].read ()->chain_key ();
+    if (!memo.empty ())
+        return memo;
+
+    Signal::OperationDesc::ptr o = g[u].raw ()->operation_desc ();
+    if (!o)
+        return std::string();
+
+    std::string key = o.read ()->persistentId ().toStdString ();
+    if (key.empty ())
+        return key;
+
+    BOOST_FOREACH(GraphEdge e, out_edges(u, g))
+      {
+        std::string source = chainKey(target(e,g), g);
+        if (source.empty ())
+            return source;
+
+        key += "\n(" + source + ")";
+      }
+
+    return key;
+}
+
+
+/**
+ * Steps below 'u' that can run in the same task as 'u', see
+ * OperationDesc::fuse.
+ */
+struct Fusion {
+    Signal::OperationDesc::ptr desc;    // Empty if there is nothing to fuse
+    GraphVertex bottom;                 // The sources of 'bottom' are the sources of the task
+    Signal::Intervals missing_input;    // Not computed by the sources of 'bottom'
+    Signal::Intervals required_input;   // Needed from the sources of 'bottom'
+};
+
+
+/**
+ * Deprecates 'what' in all steps that use 'u', like GraphInvalidator.
+ */
+void deprecateUsers(GraphVertex u, const Graph& g, Signal::Intervals what)
+{
+    BOOST_FOREACH(GraphEdge e, in_edges(u, g))
+      {
+        GraphVertex v = source(e,g);
+        Signal::Intervals deprecated = g[v].write ()->deprecateCache (what);
+        if (deprecated)
+            deprecateUsers(v, g, deprecated);
+      }
+}
+
+
+/**
+ * Fuses 'u' with its source as long as the source has no other users.
+ *
+ * The fused operation is kept in the step, see Step::fusion, until its cache
+ * is deprecated or the graph changes. All results in the cache of 'u' are
+ * computed the same way, so the cache of 'u' is deprecated if steps are
+ * fused differently than before. Nothing is fused if 'engine' can't run the
+ * fused operation when it is created.
+ *
+ * Locks the OperationDescs and steps one at a time, must not hold the lock of
+ * any step.
+ */
+Fusion findFusion(GraphVertex u, const Graph& g, Signal::ComputingEngine* engine)
+{
+    Signal::OperationDesc::ptr fused = g[u].raw ()->operation_desc ();
+    if (!fused)
+        return Fusion();
+
+    // The output of a fused source won't be computed, so nothing else may need it
+    std::vector<GraphVertex> candidates;
+    Step::Fusion s;
+    for (GraphVertex v = u; 1 == out_degree(v, g);)
+      {
+        v = target(*out_edges(v, g).first, g);
+        if (1 != in_degree(v, g) || 0 == out_degree(v, g))
+            break;
+
+        candidates.push_back (v);
+        s.candidates.push_back (g[v]);
+      }
+
+    if (candidates.empty ())
+        return Fusion();
+
+    Step::Fusion previous = g[u].read ()->fusion ();
+    if (previous.valid && previous.candidates == s.candidates)
+        s = previous;
+    else
+      {
+        for (GraphVertex v : candidates)
+          {
+            Signal::OperationDesc::ptr source = g[v].raw ()->operation_desc ();
+            if (!source)
+                break;
+
+            Signal::OperationDesc::ptr d = fused.read ()->fuse (*source.read ());
+            if (!d)
+                break;
+
+            fused = d;
+            s.fused++;
+          }
+
+        if (s.fused && fused.read ()->createOperation (engine))
+            s.desc = fused;
+        else
+            s.fused = 0;
+
+        s.valid = true;
+
+        Signal::Intervals deprecated;
+          {
+            auto step = g[u].write ();
+            if (step->fusion ().fused != s.fused && step->not_started () != Signal::Intervals::Intervals_ALL)
+                deprecated = step->deprecateCache (Signal::Intervals::Intervals_ALL);
+            step->fusion (s);
+          }
+
+        if (deprecated)
+          {
+            DEBUGINFO TaskInfo(format("Fusing %d instead of %d steps in %s")
+                               % s.fused % previous.fused
+                               % g[u].raw ()->operation_desc ()->toString ().toStdString ());
+            deprecateUsers(u, g, deprecated);
+          }
+      }
+
+    if (!s.desc)
+        return Fusion();
+
+    Fusion f;
+    f.desc = s.desc;
+    f.bottom = candidates[s.fused-1];
+    BOOST_FOREACH(GraphEdge e, out_edges(f.bottom, g))
+        f.missing_input |= g[target(e,g)].read ()->out_of_date ();
+
+    return f;
+}
+
+
 class find_missing_samples: public default_bfs_visitor {
 public:
-    find_missing_samples(NeededSamples needed, Task* output_task, ScheduleParams schedule_params)
+    find_missing_samples(NeededSamples needed, std::vector<Task>* output_tasks, int max_tasks, ScheduleParams schedule_params, bool* loaded)
         :
           needed(needed),
           params(schedule_params),
-          task(output_task)
+          tasks(output_tasks),
+          max_tasks(max_tasks),
+          loaded(loaded)
+      {
+      }
+
+
+    bool done() const
       {
+        return (int)tasks->size () >= max_tasks;
       }
 
 
     void discover_vertex(GraphVertex u, const Graph & g)
       {
-        if (*task)
+        if (done ())
             return;
 
         // Compute what the sources have available
@@ -56,7 +220,16 @@ public:
             missing_input |= g[v].read ()->out_of_date ();
           }
 
-        Interval required_input = try_create_task(u, g, missing_input);
+        // Locks the OperationDescs of all sources, must not hold the lock of any step
+        std::string chain_key;
+        if (params.persistent)
+            chain_key = chainKey(u, g);
+
+        Fusion fusion;
+        if (needed[u])
+            fusion = findFusion(u, g, params.engine.get ());
+
+        Intervals required_input = try_create_tasks(u, g, missing_input, chain_key, fusion);
 
         // Update sources with needed samples
         BOOST_FOREACH(GraphEdge e, out_edges(u, g))
@@ -73,10 +246,29 @@ public:
             }
             needed[v] |= not_started & required_input;
           }
+
+        // The fused steps are skipped, their sources compute the input instead
+        if (fusion.desc)
+            BOOST_FOREACH(GraphEdge e, out_edges(fusion.bottom, g))
+              {
+                GraphVertex v = target(e,g);
+                needed[v] |= g[v].read ()->not_started () & fusion.required_input;
+              }
       }
 
 
-    Signal::Interval try_create_task(GraphVertex u, const Graph & g, Signal::Intervals missing_input)
+    /**
+     * Creates tasks for adjacent intervals in 'u' until there are max_tasks
+     * tasks. Intervals that lack input from the sources are skipped, at most
+     * as many as there are tasks left to find.
+     *
+     * If there is a 'fusion' all intervals are computed by one task through
+     * all of the fused steps, see OperationDesc::fuse.
+     *
+     * Returns the input required by all intervals that were considered, except
+     * for those added to fusion.required_input.
+     */
+    Signal::Intervals try_create_tasks(GraphVertex u, const Graph & g, Signal::Intervals missing_in_sources, const std::string& chain_key, Fusion& fusion)
       {
         // No other thread is allowed to reach the same conclusion about what needs to be done.
         // So the lock has to be kept from checking what's needed all the way until the task has
@@ -87,61 +279,111 @@ public:
           {
             Signal::Intervals I = needed[u] & step->not_started ();
 
-            // Compute what we need from sources
-            if (!I)
+            // Results stored by a previous session don't need any tasks, nor anything from the sources
+            if (I && params.persistent)
               {
-                // Need to do nothing more here
-                return Signal::Interval();
+                if (step->loadPersistent (chain_key, I))
+                    *loaded = true;
+                I = needed[u] & step->not_started ();
               }
 
             Signal::OperationDesc::const_ptr o = step->operation_desc();
+            Signal::Intervals required_inputs;
+            Signal::Intervals skipped;
 
-            // params.preferred_size is just a preferred update size, not a required update size.
-            // Accept whatever requiredInterval sets as expected_output
-            Signal::Interval wanted_output = I.fetchInterval(params.preferred_size, params.center);
-            Signal::Interval wanted_output2 = I.fetchInterval(clamped_add(params.preferred_size,params.preferred_size), params.center);
-            if (wanted_output.count () > wanted_output2.count ()/2)
-                wanted_output = wanted_output2;
-            Signal::Interval expected_output;
-            Signal::Interval required_input = o->requiredInterval (wanted_output, &expected_output);;
-
-            DEBUGINFO TaskInfo tt(format("Missing %s = %s & %s in %s for %s")
-                                   % I % needed[u] % step->not_started ()
-                                   % o->toString ().toStdString ()
-                                   % (params.engine?vartype(*params.engine.get ()):"ComputingEngine(null)"));
-            DEBUGINFO TaskInfo(boost::format("params.preferred_size = %d, params.center = %d, wanted_output = %s")
-                     % params.preferred_size % params.center % wanted_output);
-            DEBUGINFO TaskInfo(boost::format("expected_output = %s, required_input = %s, missing_input = %s")
-                     % expected_output % required_input % missing_input);
-
-            //check that OperationDesc returned that it needed at least something
-            EXCEPTION_ASSERTX(required_input, o->toString ().toStdString ());
-            // check for valid 'requiredInterval' by making sure that expected_output overlaps I.
-            // Otherwise no work for that interval will be necessary.
-            EXCEPTION_ASSERTX (expected_output & Signal::Interval(wanted_output.first, wanted_output.first+1),
-                               boost::format("actual_output = %1%, x = %2%")
-                               % expected_output % wanted_output);
-
-            // Compare required_input to what's available in the sources
-            missing_input &= required_input;
-
-            // If there are no sources
-            if( !missing_input && 0==out_degree(u, g) )
+            // Compute what we need from sources. I shrinks as tasks are
+            // registered so the next interval is adjacent to the previous
+            // one, as seen from params.center.
+            for (int k = tasks->size (); k < max_tasks && I; k++, I = (needed[u] & step->not_started ()) - skipped)
               {
-                // Then this operation must specify sample rate and number of
-                // samples for this to be a valid read. Otherwise the signal is
-                // undefined.
-                auto x = o->extent ();
-                if (!x.number_of_channels.is_initialized () || !x.sample_rate.is_initialized ())
+                // params.preferred_size is just a preferred update size, not a required update size.
+                // Accept whatever requiredInterval sets as expected_output
+                Signal::Interval wanted_output = I.fetchInterval(params.preferred_size, params.center);
+                Signal::Interval wanted_output2 = I.fetchInterval(clamped_add(params.preferred_size,params.preferred_size), params.center);
+                if (wanted_output.count () > wanted_output2.count ()/2)
+                    wanted_output = wanted_output2;
+
+                if (fusion.desc)
                   {
-                    // "Undefined signal. No sources and no extent"
-                    missing_input = Signal::Interval::Interval_ALL;
+                    Signal::Interval fused_output;
+                    Signal::Interval fused_input = fusion.desc.read ()->requiredInterval (wanted_output, &fused_output);
+                    fusion.required_input |= fused_input;
+
+                    // Let the sources of the fused steps compute the input first
+                    if (fusion.missing_input & fused_input)
+                      {
+                        skipped |= fused_output;
+                        continue;
+                      }
+
+                    Signal::Operation::ptr operation = fusion.desc.read ()->createOperation (params.engine.get ());
+
+                    // If this engine doesn't support the fused operation, leave it to other workers
+                    if (!operation)
+                      {
+                        skipped |= fused_output;
+                        continue;
+                      }
+
+                    std::vector<Step::const_ptr> children;
+
+                    BOOST_FOREACH(GraphEdge e, out_edges(fusion.bottom, g))
+                      {
+                        GraphVertex v = target(e,g);
+                        children.push_back (g[v]);
+                      }
+
+                    DEBUGINFO_TASK TaskInfo(format("Fused %s for %s") % fusion.desc.read ()->toString ().toStdString () % fused_output);
+                    tasks->push_back (Task(step, g[u], children, operation, fused_output, fused_input));
+                    continue;
+                  }
+
+                Signal::Interval expected_output;
+                Signal::Interval required_input = o->requiredInterval (wanted_output, &expected_output);;
+                Signal::Intervals missing_input = missing_in_sources;
+
+                DEBUGINFO TaskInfo tt(format("Missing %s = %s & %s in %s for %s")
+                                       % I % needed[u] % step->not_started ()
+                                       % o->toString ().toStdString ()
+                                       % (params.engine?vartype(*params.engine.get ()):"ComputingEngine(null)"));
+                DEBUGINFO TaskInfo(boost::format("params.preferred_size = %d, params.center = %d, wanted_output = %s")
+                         % params.preferred_size % params.center % wanted_output);
+                DEBUGINFO TaskInfo(boost::format("expected_output = %s, required_input = %s, missing_input = %s")
+                         % expected_output % required_input % missing_input);
+
+                //check that OperationDesc returned that it needed at least something
+                EXCEPTION_ASSERTX(required_input, o->toString ().toStdString ());
+                // check for valid 'requiredInterval' by making sure that expected_output overlaps I.
+                // Otherwise no work for that interval will be necessary.
+                EXCEPTION_ASSERTX (expected_output & Signal::Interval(wanted_output.first, wanted_output.first+1),
+                                   boost::format("actual_output = %1%, x = %2%")
+                                   % expected_output % wanted_output);
+
+                // Compare required_input to what's available in the sources
+                missing_input &= required_input;
+                required_inputs |= required_input;
+
+                // If there are no sources
+                if( !missing_input && 0==out_degree(u, g) )
+                  {
+                    // Then this operation must specify sample rate and number of
+                    // samples for this to be a valid read. Otherwise the signal is
+                    // undefined.
+                    auto x = o->extent ();
+                    if (!x.number_of_channels.is_initialized () || !x.sample_rate.is_initialized ())
+                      {
+                        // "Undefined signal. No sources and no extent"
+                        missing_input = Signal::Interval::Interval_ALL;
+                      }
+                  }
+
+                // Let the sources compute the input first
+                if( missing_input )
+                  {
+                    skipped |= expected_output;
+                    continue;
                   }
-              }
 
-            // If nothing is missing
-            if( !missing_input )
-              {
                 DEBUGINFO_TASK TaskInfo tt(format("Missing %s = %s & %s in %s for %s")
                                        % I % needed[u] % step->not_started ()
                                        % o->toString ().toStdString ()
@@ -153,26 +395,29 @@ public:
 
                 Signal::Operation::ptr operation = o->createOperation (params.engine.get ());
 
-                // If this engine supports this operation
-                if (operation)
+                // If this engine doesn't support this operation, leave it to other workers
+                if (!operation)
                   {
-                    // Create a task
-                    std::vector<Step::const_ptr> children;
+                    skipped |= expected_output;
+                    continue;
+                  }
 
-                    BOOST_FOREACH(GraphEdge e, out_edges(u, g))
-                      {
-                        GraphVertex v = target(e,g);
-                        children.push_back (g[v]);
-                      }
+                // Create a task
+                std::vector<Step::const_ptr> children;
 
-                    *task = Task(step, g[u], children, operation, expected_output, required_input);
+                BOOST_FOREACH(GraphEdge e, out_edges(u, g))
+                  {
+                    GraphVertex v = target(e,g);
+                    children.push_back (g[v]);
                   }
+
+                tasks->push_back (Task(step, g[u], children, operation, expected_output, required_input));
               }
 
             // Even if this engine doesn't support this operation it should
             // still update 'needed' so that it can compute what's
             // needed in the children, who might support this engine.
-            return required_input;
+            return required_inputs;
           }
         catch (const boost::exception& x)
           {
@@ -198,7 +443,9 @@ public:
 
     NeededSamples needed;
     ScheduleParams params;
-    Task* task;
+    std::vector<Task>* tasks;
+    int max_tasks;
+    bool* loaded;   // Set if results were loaded from the PersistentCache
 };
 
 
@@ -208,29 +455,54 @@ Task FirstMissAlgorithm::
                 Signal::Intervals needed,
                 Signal::IntervalType center,
                 Signal::IntervalType preferred_size,
-                Workers::ptr /*workers*/,
+                Workers::ptr workers,
                 Signal::ComputingEngine::ptr engine) const
 {
-    DEBUGINFO TaskTimer tt(boost::format("FirstMissAlgorithm %s %p") % (engine?vartype(*engine):"Signal::ComputingEngine*") % engine.get ());
+    std::vector<Task> tasks = getTasks (straight_g, straight_target, needed, center, preferred_size, workers, engine, 1);
+    if (tasks.empty ())
+        return Task();
+    return std::move(tasks.front ());
+}
+
+
+std::vector<Task> FirstMissAlgorithm::
+        getTasks(const Graph& straight_g,
+                 GraphVertex straight_target,
+                 Signal::Intervals needed,
+                 Signal::IntervalType center,
+                 Signal::IntervalType preferred_size,
+                 Workers::ptr /*workers*/,
+                 Signal::ComputingEngine::ptr engine,
+                 int max_tasks) const
+{
+    DEBUGINFO TaskTimer tt(boost::format("FirstMissAlgorithm %s %p, max %d tasks") % (engine?vartype(*engine):"Signal::ComputingEngine*") % engine.get () % max_tasks);
     DEBUGINFO TaskInfo(boost::format("needed = %s in %s") % needed % straight_g[straight_target]->operation_desc()->toString().toStdString());
     Graph g; ReverseGraph::reverse_graph (straight_g, g);
     GraphVertex target = ReverseGraph::find_first_vertex (g, straight_g[straight_target]);
 
-    ScheduleParams schedule_params = { engine, preferred_size, center };
+    ScheduleParams schedule_params = { engine, preferred_size, center, PersistentCache::global ().enabled () };
 
     NeededSamples needed_samples;
     needed_samples[target] = needed;
 
 
-    Task task;
-    find_missing_samples vis(needed_samples, &task, schedule_params);
+    std::vector<Task> tasks;
 
-    breadth_first_search(g, target, visitor(vis));
+    // Steps above the ones that loaded stored results may be ready now, a
+    // worker that finds nothing to do won't look again until it's woken up
+    bool loaded = true;
+    while (loaded && (int)tasks.size () < max_tasks)
+      {
+        loaded = false;
+        find_missing_samples vis(needed_samples, &tasks, max_tasks, schedule_params, &loaded);
 
-    if (!task)
+        breadth_first_search(g, target, visitor(vis));
+      }
+
+    if (tasks.empty ())
         DEBUGINFO TaskInfo("didn't find anything");
 
-    return task;
+    return tasks;
 }
 
 
@@ -272,7 +544,165 @@ void FirstMissAlgorithm::
         EXCEPTION_ASSERT_EQUALS(step.read ()->out_of_date(), ~Signal::Intervals(10,30));
     }
 
+    // It should find several tasks in one search, adjacent intervals in the
+    // same step first and then along the chain
+    {
+        Signal::pBuffer b(new Buffer(Interval(0,100), 40, 1));
+        Step::ptr source(new Step(Signal::OperationDesc::ptr(new BufferSource(b))));
+        Step::ptr step(new Step(Signal::OperationDesc::ptr(new BufferSource(b))));
+
+        Graph g;
+        GraphVertex v = g.add_vertex (step);
+
+        FirstMissAlgorithm schedule;
+        Signal::ComputingEngine::ptr c(new Signal::ComputingCpu);
+        std::vector<Task> tasks = schedule.getTasks(g, v, Signal::Interval(0,100), 0, 10, Workers::ptr(), c, 3);
+        EXCEPTION_ASSERT_EQUALS(tasks.size (), 3u);
+        EXCEPTION_ASSERT_EQUALS(tasks[0].expected_output(), Interval(0,10));
+        EXCEPTION_ASSERT_EQUALS(tasks[1].expected_output(), Interval(10,20));
+        EXCEPTION_ASSERT_EQUALS(tasks[2].expected_output(), Interval(20,30));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,30));
+
+        Step::ptr target(new Step(Signal::OperationDesc::ptr(new Test::TransparentOperationDesc)));
+        Graph g2;
+        GraphVertex s2 = g2.add_vertex (source);
+        GraphVertex t2 = g2.add_vertex (target);
+        g2.add_edge (s2, t2);
+
+        tasks = schedule.getTasks(g2, t2, Signal::Interval(0,100), 0, 10, Workers::ptr(), c, 3);
+        EXCEPTION_ASSERT_EQUALS(tasks.size (), 3u);
+        EXCEPTION_ASSERT_EQUALS(target.read ()->not_started(), Signal::Intervals::Intervals_ALL);
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started(), ~Signal::Intervals(0,30));
+    }
+
+    // It should run a chain of operations that can be fused as one task,
+    // without computing the output of the fused sources
+    {
+        class FusingOperationDesc: public Test::TransparentOperationDesc {
+        public:
+            FusingOperationDesc(int fused=1) : fused(fused) {}
+
+            OperationDesc::ptr fuse(const OperationDesc& source) const {
+                const FusingOperationDesc* f = dynamic_cast<const FusingOperationDesc*>(&source);
+                if (!f)
+                    return OperationDesc::ptr();
+                return OperationDesc::ptr(new FusingOperationDesc(fused + f->fused));
+            }
+
+            QString toString() const { return QString("Fused %1").arg (fused); }
+
+            int fused;
+        };
+
+        Signal::pBuffer b(new Buffer(Interval(0,100), 40, 1));
+        for (int i=0; i<100; i++)
+            b->getChannel (0)->waveform_data ()->getCpuMemory ()[i] = i;
+
+        Step::ptr source(new Step(Signal::OperationDesc::ptr(new BufferSource(b))));
+        Step::ptr a(new Step(Signal::OperationDesc::ptr(new FusingOperationDesc)));
+        Step::ptr c(new Step(Signal::OperationDesc::ptr(new FusingOperationDesc)));
+        Step::ptr target(new Step(Signal::OperationDesc::ptr(new FusingOperationDesc)));
+
+        Graph g;
+        GraphVertex vs = g.add_vertex (source);
+        GraphVertex va = g.add_vertex (a);
+        GraphVertex vc = g.add_vertex (c);
+        GraphVertex vt = g.add_vertex (target);
+        g.add_edge (vs, va);
+        g.add_edge (va, vc);
+        g.add_edge (vc, vt);
+
+        FirstMissAlgorithm schedule;
+        Signal::ComputingEngine::ptr cpu(new Signal::ComputingCpu);
+
+        // The sources of the fused steps compute the input first
+        Task t = schedule.getTask(g, vt, Signal::Interval(0,100), 0, 10, Workers::ptr(), cpu);
+        EXCEPTION_ASSERT(t);
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started(), ~Signal::Intervals(0,10));
+        t.run ();
+
+        // The fused operation is kept between searches
+        Signal::OperationDesc::ptr fused = target.read ()->fusion ().desc;
+        EXCEPTION_ASSERT(fused);
+        EXCEPTION_ASSERT_EQUALS(target.read ()->fusion ().fused, 2);
+
+        t = schedule.getTask(g, vt, Signal::Interval(0,100), 0, 10, Workers::ptr(), cpu);
+        EXCEPTION_ASSERT(t);
+        EXCEPTION_ASSERT_EQUALS(t.expected_output (), Interval(0,10));
+        EXCEPTION_ASSERT(fused == target.read ()->fusion ().desc);
+        t.run ();
+
+        EXCEPTION_ASSERT_EQUALS(target.read ()->not_started(), ~Signal::Intervals(0,10));
+        EXCEPTION_ASSERT_EQUALS(a.read ()->not_started(), Signal::Intervals::Intervals_ALL);
+        EXCEPTION_ASSERT_EQUALS(c.read ()->not_started(), Signal::Intervals::Intervals_ALL);
+        Signal::pBuffer r = Step::readFixedLengthFromCache (target, Signal::Interval(0,10));
+        EXCEPTION_ASSERT_EQUALS(r->getChannel (0)->waveform_data ()->getCpuMemory ()[7], 7.f);
+
+        // Steps with other users are not fused. The cache of the target is
+        // deprecated when it is fused differently than before, results
+        // computed in different ways don't match exactly
+        GraphVertex vt2 = g.add_vertex (Step::ptr(new Step(Signal::OperationDesc::ptr(new Test::TransparentOperationDesc))));
+        g.add_edge (va, vt2);
+
+        for (int i=0; i<3; i++)
+        {
+            t = schedule.getTask(g, vt, Signal::Interval(10,20), 10, 10, Workers::ptr(), cpu);
+            EXCEPTION_ASSERT(t);
+            t.run ();
+        }
+
+        EXCEPTION_ASSERT_EQUALS(target.read ()->fusion ().fused, 1);
+        EXCEPTION_ASSERT_EQUALS(target.read ()->not_started(), ~Signal::Intervals(10,20));
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started(), ~Signal::Intervals(0,20));
+        EXCEPTION_ASSERT_EQUALS(a.read ()->not_started(), ~Signal::Intervals(10,20));
+        EXCEPTION_ASSERT_EQUALS(c.read ()->not_started(), Signal::Intervals::Intervals_ALL);
+    }
+
     // It should let missing_in_target override out_of_date in the given vertex
+
+    // It should reuse results stored by a previous session
+    {
+        class PersistentBufferSource: public BufferSource {
+        public:
+            PersistentBufferSource(Signal::pBuffer b) : BufferSource(b) {}
+            QString persistentId() const { return "PersistentBufferSource"; }
+        };
+
+        std::string dir = (QDir::tempPath () + QDir::separator () + "sonicawe-firstmiss-test").toStdString ();
+        PersistentCache::global ().set_directory (dir);
+        PersistentCache::global ().clear ();
+
+        Signal::pBuffer b(new Buffer(Interval(60,70), 40, 7));
+        for (unsigned c=0; c<b->number_of_channels (); ++c)
+            b->getChannel (c)->waveform_data ()->getCpuMemory ()[3] = c + 1;
+
+        FirstMissAlgorithm schedule;
+        Signal::ComputingEngine::ptr c(new Signal::ComputingCpu);
+
+        {
+            Graph g;
+            GraphVertex v = g.add_vertex (Step::ptr(new Step(Signal::OperationDesc::ptr(new PersistentBufferSource(b)))));
+            Task t = schedule.getTask(g, v, Signal::Interval(60,70), 60, Interval::IntervalType_MAX, Workers::ptr(), c);
+            EXCEPTION_ASSERT(t);
+            t.run ();
+        }
+
+        EXCEPTION_ASSERT_EQUALS(PersistentCache::global ().stored ("PersistentBufferSource"), Signal::Intervals(60,70));
+
+        {
+            Graph g;
+            Step::ptr step(new Step(Signal::OperationDesc::ptr(new PersistentBufferSource(b))));
+            GraphVertex v = g.add_vertex (step);
+            Task t = schedule.getTask(g, v, Signal::Interval(60,70), 60, Interval::IntervalType_MAX, Workers::ptr(), c);
+            EXCEPTION_ASSERT(!t);
+            EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(60,70));
+            EXCEPTION_ASSERT(*b == *Step::readFixedLengthFromCache (step, Signal::Interval(60,70)));
+        }
+
+        PersistentCache::global ().clear ();
+        PersistentCache::global ().set_directory ("");
+        QDir(QString::fromStdString (dir)).removeRecursively ();
+    }
 }
 
 
@@ -47,6 +47,22 @@ public:
             Workers::ptr workers=Workers::ptr(),
             Signal::ComputingEngine::ptr worker=Signal::ComputingEngine::ptr()) const;
 
+    /**
+     * @brief getTasks finds up to 'max_tasks' tasks in one breadth first
+     * search. It takes adjacent intervals from the same step, around
+     * 'center', as long as their input is available, and then continues
+     * with the sources that are needed for the rest.
+     */
+    std::vector<Task> getTasks(
+            const Graph& g,
+            GraphVertex target,
+            Signal::Intervals needed,
+            Signal::IntervalType center,
+            Signal::IntervalType preferred_size,
+            Workers::ptr workers,
+            Signal::ComputingEngine::ptr worker,
+            int max_tasks) const;
+
 public:
     static void test();
 };
@@ -7,18 +7,108 @@ namespace Signal {
 namespace Processing {
 
 GraphInvalidator::
-        GraphInvalidator(Dag::ptr::weak_ptr dag, INotifier::weak_ptr notifier, Step::ptr::weak_ptr step)
+        GraphInvalidator(Dag::ptr::weak_ptr dag, INotifier::weak_ptr notifier, Step::ptr::weak_ptr step, double window)
     :
       dag_(dag),
       notifier_(notifier),
-      step_(step)
+      step_(step),
+      window_(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(window))),
+      scheduled_(false),
+      quit_(false)
 {
 }
 
 
+GraphInvalidator::
+        ~GraphInvalidator()
+{
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        quit_ = true;
+    }
+
+    wakeup_.notify_all ();
+    if (thread_.joinable ())
+        thread_.join ();
+}
+
+
 void GraphInvalidator::
         deprecateCache(Signal::Intervals what) const
 {
+    // Includes what is waiting to be merged
+    flush (what);
+}
+
+
+void GraphInvalidator::
+        deprecateCacheSoon(Signal::Intervals what) const
+{
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        if (scheduled_)
+        {
+            // Merged into the scheduled flush
+            pending_ |= what;
+            return;
+        }
+
+        if (clock::now () < last_flush_ + window_)
+        {
+            // Wait for more invalidations during the rest of the window
+            pending_ |= what;
+            scheduled_ = true;
+            if (!thread_.joinable ())
+                thread_ = std::thread(&GraphInvalidator::run, this);
+            wakeup_.notify_one ();
+            return;
+        }
+    }
+
+    flush (what);
+}
+
+
+void GraphInvalidator::
+        run() const
+{
+    std::unique_lock<std::mutex> l(lock_);
+    while (!quit_)
+    {
+        if (!scheduled_)
+        {
+            wakeup_.wait (l);
+            continue;
+        }
+
+        clock::time_point next = last_flush_ + window_;
+        if (clock::now () < next)
+        {
+            wakeup_.wait_until (l, next);
+            continue;
+        }
+
+        l.unlock ();
+        flush (Signal::Intervals());
+        l.lock ();
+    }
+}
+
+
+void GraphInvalidator::
+        flush(Signal::Intervals what) const
+{
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        what |= pending_;
+        pending_ = Signal::Intervals();
+        last_flush_ = clock::now ();
+        scheduled_ = false;
+    }
+
+    if (!what)
+        return;
+
     Dag::ptr dagp = dag_.lock ();
     if (!dagp)
         return;
@@ -104,6 +194,52 @@ void GraphInvalidator::
         EXCEPTION_ASSERT_EQUALS(bedroom->sleepers (), 0);
         EXCEPTION_ASSERT(sleeper.isFinished ());
     }
+
+    // It should merge invalidations that are made within 'window' seconds after the previous one
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr step(new Step(Signal::OperationDesc::ptr()));
+        dag.write ()->appendStep(step);
+        step.write ()->registerTask(Signal::Interval(0,100));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100));
+
+        GraphInvalidator graphInvalidator(dag, INotifier::weak_ptr(), step, 0.05);
+
+        // The first invalidation is not delayed
+        graphInvalidator.deprecateCacheSoon (Signal::Intervals(10,20));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100) | Signal::Intervals(10,20));
+
+        graphInvalidator.deprecateCacheSoon (Signal::Intervals(30,40));
+        graphInvalidator.deprecateCacheSoon (Signal::Intervals(50,60));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100) | Signal::Intervals(10,20));
+
+        std::this_thread::sleep_for (std::chrono::milliseconds(100));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100)
+                                | Signal::Intervals(10,20) | Signal::Intervals(30,40) | Signal::Intervals(50,60));
+
+        // deprecateCache is applied right away, together with what is waiting
+        graphInvalidator.deprecateCacheSoon (Signal::Intervals(60,70));
+        graphInvalidator.deprecateCacheSoon (Signal::Intervals(70,80));
+        graphInvalidator.deprecateCache (Signal::Intervals(80,90));
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100)
+                                | Signal::Intervals(10,20) | Signal::Intervals(30,40) | Signal::Intervals(50,90));
+    }
+
+    // It should stop its thread when deleted, also while waiting for the window
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr step(new Step(Signal::OperationDesc::ptr()));
+        dag.write ()->appendStep(step);
+        step.write ()->registerTask(Signal::Interval(0,100));
+
+        {
+            GraphInvalidator graphInvalidator(dag, INotifier::weak_ptr(), step, 10);
+            graphInvalidator.deprecateCacheSoon (Signal::Intervals(10,20));
+            graphInvalidator.deprecateCacheSoon (Signal::Intervals(30,40));
+        }
+
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started(), ~Signal::Intervals(0,100) | Signal::Intervals(10,20));
+    }
 }
 
 
@@ -5,27 +5,60 @@
 #include "iinvalidator.h"
 #include "inotifier.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace Signal {
 namespace Processing {
 
 /**
  * @brief The GraphInvalidator class should invalidate caches and wakeup workers.
  *
+ * deprecateCache invalidates right away. deprecateCacheSoon should merge
+ * invalidations that are made within 'window' seconds after the previous one,
+ * for instance while a parameter is being dragged, and invalidate all of them
+ * at once from a thread of its own when the window has passed. Until then the
+ * previous results are kept as they are. Running tasks whose output is
+ * invalidated are cancelled, see Step::superseded.
+ *
+ * Invalidations that are still waiting for the window are dropped when the
+ * GraphInvalidator is deleted.
+ *
  * It will silently stop doing anything if any of it's dependencies are deleted.
  */
 class GraphInvalidator: public IInvalidator
 {
 public:
-    GraphInvalidator(Dag::ptr::weak_ptr dag, INotifier::weak_ptr notifier, Step::ptr::weak_ptr step);
+    GraphInvalidator(Dag::ptr::weak_ptr dag, INotifier::weak_ptr notifier, Step::ptr::weak_ptr step, double window=1/60.);
+    ~GraphInvalidator();
 
     void deprecateCache(Signal::Intervals what) const;
+    void deprecateCacheSoon(Signal::Intervals what) const;
     static void deprecateCache(const Dag& dag, Step::ptr s, Signal::Intervals what);
 
+    Dag::ptr::weak_ptr dag() const { return dag_; }
+    Step::ptr::weak_ptr step() const { return step_; }
+
 private:
+    typedef std::chrono::steady_clock clock;
 
     Dag::ptr::weak_ptr dag_;
     INotifier::weak_ptr notifier_;
     Step::ptr::weak_ptr step_;
+    clock::duration window_;
+
+    mutable std::mutex lock_;
+    mutable std::condition_variable wakeup_;
+    mutable Signal::Intervals pending_;
+    mutable clock::time_point last_flush_;
+    mutable bool scheduled_;
+    bool quit_;
+    mutable std::thread thread_;    // Started by the first merged invalidation
+
+    void flush(Signal::Intervals what) const;
+    void run() const;
 
 public:
     static void test();
@@ -20,6 +20,13 @@ public:
     virtual ~IInvalidator() {}
 
     virtual void deprecateCache(Signal::Intervals what) const=0;
+
+    /**
+     * @brief deprecateCacheSoon is for invalidations made by user interaction,
+     * such as dragging a parameter. An implementation may merge rapid calls
+     * and apply them a little later. Defaults to deprecateCache.
+     */
+    virtual void deprecateCacheSoon(Signal::Intervals what) const { deprecateCache(what); }
 };
 
 } // namespace Processing
@@ -0,0 +1,24 @@
+#include "ischedule.h"
+#include "task.h"
+
+namespace Signal {
+namespace Processing {
+
+std::vector<Task> ISchedule::
+        getTasks(Signal::ComputingEngine::ptr engine, int max_tasks) const
+{
+    std::vector<Task> tasks;
+
+    for (int i=0; i<max_tasks; i++)
+    {
+        Task task = getTask (engine);
+        if (!task)
+            break;
+        tasks.push_back (std::move(task));
+    }
+
+    return tasks;
+}
+
+} // namespace Processing
+} // namespace Signal
@@ -3,6 +3,8 @@
 
 #include "signal/computingengine.h"
 
+#include <vector>
+
 namespace Signal {
 namespace Processing {
 
@@ -29,6 +31,16 @@ public:
      * @return
      */
     virtual Task getTask(Signal::ComputingEngine::ptr engine) const = 0;
+
+    /**
+     * @brief getTasks finds up to 'max_tasks' independent tasks at once.
+     *
+     * Implementations may override this to find all tasks within the same
+     * locks. The default implementation calls getTask repeatedly.
+     *
+     * @return fewer than 'max_tasks' tasks if there wasn't enough to do.
+     */
+    virtual std::vector<Task> getTasks(Signal::ComputingEngine::ptr engine, int max_tasks) const;
 };
 
 } // namespace Processing
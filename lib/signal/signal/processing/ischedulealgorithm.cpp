@@ -0,0 +1,31 @@
+#include "ischedulealgorithm.h"
+
+namespace Signal {
+namespace Processing {
+
+std::vector<Task> IScheduleAlgorithm::
+        getTasks(const Graph& g,
+                 GraphVertex target,
+                 Signal::Intervals needed,
+                 Signal::IntervalType center,
+                 Signal::IntervalType preferred_size,
+                 Workers::ptr workers,
+                 Signal::ComputingEngine::ptr worker,
+                 int max_tasks) const
+{
+    std::vector<Task> tasks;
+
+    for (int i=0; i<max_tasks && needed; i++)
+    {
+        Task task = getTask (g, target, needed, center, preferred_size, workers, worker);
+        if (!task)
+            break;
+        needed -= task.expected_output ();
+        tasks.push_back (std::move(task));
+    }
+
+    return tasks;
+}
+
+} // namespace Processing
+} // namespace Signal
@@ -6,6 +6,8 @@
 #include "dag.h"
 #include "workers.h"
 
+#include <vector>
+
 namespace Signal {
 namespace Processing {
 
@@ -24,6 +26,24 @@ public:
             Signal::IntervalType preferred_size, //=Interval::IntervalType_MAX,
             Workers::ptr workers, //=Workers::Ptr(),
             Signal::ComputingEngine::ptr worker) const = 0;
+
+    /**
+     * @brief getTasks finds up to 'max_tasks' tasks for 'target' at once.
+     *
+     * Implementations may override this to find all tasks in one pass over
+     * the graph. The default implementation calls getTask repeatedly.
+     *
+     * @return fewer than 'max_tasks' tasks if there wasn't enough to do.
+     */
+    virtual std::vector<Task> getTasks(
+            const Graph& g,
+            GraphVertex target,
+            Signal::Intervals needed,
+            Signal::IntervalType center,
+            Signal::IntervalType preferred_size,
+            Workers::ptr workers,
+            Signal::ComputingEngine::ptr worker,
+            int max_tasks) const;
 };
 
 } // namespace Processing
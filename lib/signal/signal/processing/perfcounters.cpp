@@ -0,0 +1,300 @@
+// Include QObject and Boost.Foreach in that order to prevent conflicts with Qt foreach
+#include <QObject>
+#include <boost/foreach.hpp>
+
+#include "perfcounters.h"
+#include "dag.h"
+#include "workers.h"
+
+#include "demangle.h"
+
+#include <boost/format.hpp>
+
+#include <map>
+
+using namespace std;
+
+namespace Signal {
+namespace Processing {
+
+static unsigned long long ns(double seconds)
+{
+    return seconds > 0 ? (unsigned long long)(seconds*1e9 + 0.5) : 0;
+}
+
+
+PerfCounters::
+        PerfCounters()
+    :
+      tasks_(0),
+      samples_(0),
+      busy_ns_(0),
+      idle_ns_(0),
+      lock_wait_ns_(0),
+      scheduling_ns_(0),
+      cache_hits_(0),
+      cache_misses_(0),
+      bytes_allocated_(0),
+      wakeups_(0),
+      wakeup_latency_ns_(0)
+{
+}
+
+
+void PerfCounters::
+        task(const Signal::Interval& expected_output, double busy)
+{
+    tasks_.fetch_add (1, memory_order_relaxed);
+    samples_.fetch_add (expected_output.count (), memory_order_relaxed);
+    busy_ns_.fetch_add (ns(busy), memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        idle(double seconds)
+{
+    idle_ns_.fetch_add (ns(seconds), memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        lock_wait(double seconds)
+{
+    lock_wait_ns_.fetch_add (ns(seconds), memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        scheduling(double seconds)
+{
+    scheduling_ns_.fetch_add (ns(seconds), memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        cache_read(unsigned long long hits, unsigned long long misses)
+{
+    cache_hits_.fetch_add (hits, memory_order_relaxed);
+    cache_misses_.fetch_add (misses, memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        allocated(unsigned long long bytes)
+{
+    bytes_allocated_.fetch_add (bytes, memory_order_relaxed);
+}
+
+
+void PerfCounters::
+        wakeup(double latency)
+{
+    wakeups_.fetch_add (1, memory_order_relaxed);
+    wakeup_latency_ns_.fetch_add (ns(latency), memory_order_relaxed);
+}
+
+
+PerfCounters::Values PerfCounters::
+        read() const
+{
+    Values v;
+    v.tasks = tasks_.load (memory_order_relaxed);
+    v.samples = samples_.load (memory_order_relaxed);
+    v.busy = busy_ns_.load (memory_order_relaxed)*1e-9;
+    v.idle = idle_ns_.load (memory_order_relaxed)*1e-9;
+    v.lock_wait = lock_wait_ns_.load (memory_order_relaxed)*1e-9;
+    v.scheduling = scheduling_ns_.load (memory_order_relaxed)*1e-9;
+    v.cache_hits = cache_hits_.load (memory_order_relaxed);
+    v.cache_misses = cache_misses_.load (memory_order_relaxed);
+    v.bytes_allocated = bytes_allocated_.load (memory_order_relaxed);
+    v.wakeups = wakeups_.load (memory_order_relaxed);
+    v.wakeup_latency = wakeup_latency_ns_.load (memory_order_relaxed)*1e-9;
+    return v;
+}
+
+
+void PerfCounters::
+        reset()
+{
+    tasks_ = 0;
+    samples_ = 0;
+    busy_ns_ = 0;
+    idle_ns_ = 0;
+    lock_wait_ns_ = 0;
+    scheduling_ns_ = 0;
+    cache_hits_ = 0;
+    cache_misses_ = 0;
+    bytes_allocated_ = 0;
+    wakeups_ = 0;
+    wakeup_latency_ns_ = 0;
+}
+
+
+PerfCounters::Snapshot PerfCounters::
+        snapshot(const Dag& dag, const Workers& workers)
+{
+    Snapshot s;
+
+    const Graph& g = dag.g ();
+    BOOST_FOREACH(GraphVertex u, vertices(g))
+    {
+        Step::ptr step = g[u];
+        Signal::OperationDesc::ptr o = step.raw ()->operation_desc ();
+
+        Snapshot::Entry e;
+        e.name = o ? o.read ()->toString ().toStdString () : "(null)";
+        e.values = step.raw ()->counters ().read ();
+        s.steps.push_back (e);
+    }
+
+    // Number engines of the same type
+    map<string, int> count;
+    for (const auto& w : workers.workers_map ())
+    {
+        if (!w.second)
+            continue;
+
+        string type = w.first ? vartype(*w.first) : "(null)";
+
+        Snapshot::Entry e;
+        e.name = (boost::format("%s %d") % type % count[type]++).str ();
+        e.values = w.second->counters ().read ();
+        s.engines.push_back (e);
+    }
+
+    return s;
+}
+
+
+static string jsonString(const string& s)
+{
+    string r = "\"";
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"': r += "\\\""; break;
+        case '\\': r += "\\\\"; break;
+        case '\n': r += "\\n"; break;
+        case '\t': r += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20)
+                r += (boost::format("\\u%04x") % (int)c).str ();
+            else
+                r += c;
+        }
+    }
+    return r + "\"";
+}
+
+
+static string jsonEntries(const vector<PerfCounters::Snapshot::Entry>& entries)
+{
+    string r = "[";
+    for (size_t i=0; i<entries.size (); i++)
+    {
+        const PerfCounters::Values& v = entries[i].values;
+        r += (boost::format("%s\n    {\"name\": %s, \"tasks\": %u, \"samples\": %u, "
+                            "\"busy\": %.6f, \"idle\": %.6f, \"lock_wait\": %.6f, \"scheduling\": %.6f, "
+                            "\"cache_hits\": %u, \"cache_misses\": %u, \"bytes_allocated\": %u, "
+                            "\"wakeups\": %u, \"wakeup_latency\": %.6f}")
+              % (i ? "," : "")
+              % jsonString (entries[i].name)
+              % v.tasks % v.samples
+              % v.busy % v.idle % v.lock_wait % v.scheduling
+              % v.cache_hits % v.cache_misses % v.bytes_allocated
+              % v.wakeups % v.wakeup_latency).str ();
+    }
+    return r + (entries.empty () ? "]" : "\n  ]");
+}
+
+
+string PerfCounters::Snapshot::
+        toJson() const
+{
+    return "{\n  \"steps\": " + jsonEntries (steps)
+            + ",\n  \"engines\": " + jsonEntries (engines)
+            + "\n}\n";
+}
+
+} // namespace Processing
+} // namespace Signal
+
+#include "timer.h"
+
+#include <thread>
+
+namespace Signal {
+namespace Processing {
+
+void PerfCounters::
+        test()
+{
+    // It should count what a Step or a worker spends its time on.
+    {
+        PerfCounters c;
+        c.task (Signal::Interval(10,20), 0.5);
+        c.task (Signal::Interval(20,25), 0.25);
+        c.idle (1);
+        c.lock_wait (0.125);
+        c.scheduling (0.0625);
+        c.cache_read (7, 3);
+        c.allocated (1024);
+        c.wakeup (0.5);
+        c.wakeup (0.25);
+
+        Values v = c.read ();
+        EXCEPTION_ASSERT_EQUALS(v.tasks, 2u);
+        EXCEPTION_ASSERT_EQUALS(v.samples, 15u);
+        EXCEPTION_ASSERT_EQUALS(v.busy, 0.75);
+        EXCEPTION_ASSERT_EQUALS(v.idle, 1);
+        EXCEPTION_ASSERT_EQUALS(v.lock_wait, 0.125);
+        EXCEPTION_ASSERT_EQUALS(v.scheduling, 0.0625);
+        EXCEPTION_ASSERT_EQUALS(v.cache_hits, 7u);
+        EXCEPTION_ASSERT_EQUALS(v.cache_misses, 3u);
+        EXCEPTION_ASSERT_EQUALS(v.bytes_allocated, 1024u);
+        EXCEPTION_ASSERT_EQUALS(v.wakeups, 2u);
+        EXCEPTION_ASSERT_EQUALS(v.wakeup_latency, 0.75);
+
+        c.reset ();
+        EXCEPTION_ASSERT_EQUALS(c.read ().tasks, 0u);
+        EXCEPTION_ASSERT_EQUALS(c.read ().busy, 0);
+    }
+
+    // Updates should be cheap enough to always be on and be made from many threads.
+    {
+        PerfCounters c;
+        const int N = 100000;
+
+        Timer t;
+        std::vector<std::thread> threads;
+        for (int i=0; i<4; i++)
+            threads.push_back (std::thread([&c](){
+                for (int j=0; j<N; j++)
+                    c.task (Signal::Interval(j,j+1), 1e-6);
+            }));
+        for (std::thread& th : threads)
+            th.join ();
+        double T = t.elapsed ()/(4*N);
+
+        EXCEPTION_ASSERT_EQUALS(c.read ().tasks, 4u*N);
+        EXCEPTION_ASSERT_EQUALS(c.read ().samples, 4u*N);
+        EXCEPTION_ASSERT_LESS(T, 1e-6);
+    }
+
+    // The snapshot should be available as JSON.
+    {
+        Snapshot s;
+        Snapshot::Entry e;
+        e.name = "Step \"a\"";
+        e.values.tasks = 3;
+        s.steps.push_back (e);
+
+        std::string json = s.toJson ();
+        EXCEPTION_ASSERTX(json.find ("\"name\": \"Step \\\"a\\\"\", \"tasks\": 3,") != std::string::npos, json);
+        EXCEPTION_ASSERTX(json.find ("\"engines\": []") != std::string::npos, json);
+    }
+}
+
+} // namespace Processing
+} // namespace Signal
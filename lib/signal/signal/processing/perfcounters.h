@@ -0,0 +1,102 @@
+#ifndef SIGNAL_PROCESSING_PERFCOUNTERS_H
+#define SIGNAL_PROCESSING_PERFCOUNTERS_H
+
+#include "signal/intervals.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace Signal {
+namespace Processing {
+
+class Dag;
+class Workers;
+
+/**
+ * @brief The PerfCounters class should count what a Step or a worker spends
+ * its time on.
+ *
+ * Updates are relaxed atomic additions, cheap enough to always be on and to
+ * be made without holding any lock. A Step counts the tasks that produced
+ * its results, reads from its cache and the time spent waiting for its
+ * locks (lock_wait). A Worker counts the tasks it ran, the time spent running
+ * tasks (busy), sleeping (idle) and finding the next task in the schedule
+ * (scheduling), and the latency from a wakeup call until it runs
+ * (wakeup_latency).
+ *
+ * Use snapshot to read the counters of all steps and workers at once.
+ */
+class PerfCounters
+{
+public:
+    struct Values
+    {
+        unsigned long long tasks = 0;
+        unsigned long long samples = 0;         // expected output of all tasks
+        double busy = 0;                        // seconds
+        double idle = 0;                        // seconds
+        double lock_wait = 0;                   // seconds
+        double scheduling = 0;                  // seconds, including lock waits
+        unsigned long long cache_hits = 0;      // samples read from the cache
+        unsigned long long cache_misses = 0;    // samples read as zeros
+        unsigned long long bytes_allocated = 0; // bytes of results
+        unsigned long long wakeups = 0;
+        double wakeup_latency = 0;              // seconds, total
+    };
+
+    PerfCounters();
+
+    void task(const Signal::Interval& expected_output, double busy);
+    void idle(double seconds);
+    void lock_wait(double seconds);
+    void scheduling(double seconds);
+    void cache_read(unsigned long long hits, unsigned long long misses);
+    void allocated(unsigned long long bytes);
+    void wakeup(double latency);
+
+    Values read() const;
+    void reset();
+
+    struct Snapshot
+    {
+        struct Entry
+        {
+            std::string name;
+            Values values;
+        };
+
+        std::vector<Entry> steps;
+        std::vector<Entry> engines;
+
+        std::string toJson() const;
+    };
+
+    /**
+     * @brief snapshot reads the counters of all steps in 'dag' and all
+     * workers in 'workers'. Takes the lock of each OperationDesc to name the
+     * steps.
+     */
+    static Snapshot snapshot(const Dag& dag, const Workers& workers);
+
+private:
+    std::atomic<unsigned long long> tasks_;
+    std::atomic<unsigned long long> samples_;
+    std::atomic<unsigned long long> busy_ns_;
+    std::atomic<unsigned long long> idle_ns_;
+    std::atomic<unsigned long long> lock_wait_ns_;
+    std::atomic<unsigned long long> scheduling_ns_;
+    std::atomic<unsigned long long> cache_hits_;
+    std::atomic<unsigned long long> cache_misses_;
+    std::atomic<unsigned long long> bytes_allocated_;
+    std::atomic<unsigned long long> wakeups_;
+    std::atomic<unsigned long long> wakeup_latency_ns_;
+
+public:
+    static void test();
+};
+
+} // namespace Processing
+} // namespace Signal
+
+#endif // SIGNAL_PROCESSING_PERFCOUNTERS_H
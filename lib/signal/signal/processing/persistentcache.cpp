@@ -0,0 +1,873 @@
+#include "persistentcache.h"
+
+#include "cpumemorystorage.h"
+#include "tasktimer.h"
+#include "exceptionassert.h"
+#include "neat_math.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+//#define DEBUGINFO
+#define DEBUGINFO if(0)
+
+namespace Signal {
+namespace Processing {
+
+namespace {
+
+const char segment_magic[8] = {'S','A','W','E','P','S','0','1'};
+const char record_magic[8] = {'S','A','W','E','P','R','0','1'};
+const char file_suffix[] = ".segment";
+
+// A new segment is started when the current one is larger than this
+const qint64 max_segment_bytes = qint64(64) << 20;
+
+// Records start at multiples of this, so are the samples
+const int record_alignment = 64;
+
+struct SegmentHeader
+{
+    char magic[8];
+    quint64 last_access;    // milliseconds since epoch
+    char reserved[48];      // pads the header to record_alignment
+};
+
+struct RecordHeader
+{
+    char magic[8];
+    quint32 header_bytes;   // offset from the record to the samples
+    quint32 key_bytes;
+    qint64 first;
+    qint64 last;
+    float sample_rate;
+    qint32 number_of_channels;
+};
+
+
+/**
+ * File names are "<hash>_<segment>.segment".
+ */
+bool parseFileName(const std::string& name, std::string& hash, int& segment)
+{
+    char h[17];
+    int n;
+    char suffix[10];
+    if (3 != sscanf(name.c_str (), "%16[0-9a-f]_%d%9s", h, &n, suffix))
+        return false;
+    if (file_suffix != std::string(suffix) || n < 0)
+        return false;
+
+    hash = h;
+    segment = n;
+    return true;
+}
+
+
+qint64 recordBytes(const RecordHeader& h)
+{
+    qint64 sample_bytes = (h.last - h.first) * h.number_of_channels * (qint64)sizeof(float);
+    return h.header_bytes + int_div_ceil (sample_bytes, record_alignment) * record_alignment;
+}
+
+
+/**
+ * Checks a record header at 'offset' in a segment of 'segment_bytes' bytes.
+ */
+bool validRecord(const RecordHeader& h, qint64 offset, qint64 segment_bytes)
+{
+    return 0 == memcmp (h.magic, record_magic, sizeof(record_magic))
+            && h.first < h.last && h.last - h.first <= segment_bytes
+            && h.number_of_channels > 0 && h.number_of_channels <= segment_bytes
+            && h.sample_rate > 0
+            && h.header_bytes % record_alignment == 0
+            && sizeof(RecordHeader) + h.key_bytes <= h.header_bytes
+            && offset + recordBytes (h) <= segment_bytes;
+}
+
+
+/**
+ * Reads a stored Buffer as views of a memory mapped segment. Returns a null
+ * buffer if there is no result for 'chain_key' in 'I' at 'offset'.
+ */
+pBuffer readRecord(const std::string& path, qint64 offset, qint64 bytes, const std::string& chain_key, const Interval& I)
+{
+    boost::shared_ptr<QFile> file(new QFile(QString::fromStdString (path)));
+    if (!file->open (QIODevice::ReadOnly))
+        return pBuffer();
+
+    qint64 size = file->size ();
+    if (bytes < (qint64)sizeof(RecordHeader) || offset + bytes > size)
+        return pBuffer();
+
+    const uchar* mapped = file->map (offset, bytes);
+    if (!mapped)
+        return pBuffer();
+
+    RecordHeader h;
+    memcpy (&h, mapped, sizeof(RecordHeader));
+    if (!validRecord (h, offset, size) || recordBytes (h) != bytes
+            || h.first != I.first || h.last != I.last)
+    {
+        return pBuffer();
+    }
+
+    if (chain_key.size () != h.key_bytes
+            || 0 != memcmp (mapped + sizeof(RecordHeader), chain_key.data (), h.key_bytes))
+    {
+        return pBuffer();
+    }
+
+    // The mapping stays valid until 'file' is released by the last view,
+    // even if the segment is removed meanwhile
+    qint64 channel_samples = h.last - h.first;
+    float* samples = (float*)(mapped + h.header_bytes);
+    std::vector<pMonoBuffer> channels(h.number_of_channels);
+    for (int i=0; i<h.number_of_channels; ++i)
+    {
+        pTimeSeriesData data = CpuMemoryStorage::ViewPtr( DataStorageSize(channel_samples),
+                                                          samples + i*channel_samples, file );
+        channels[i].reset (new MonoBuffer(I.first, data, h.sample_rate));
+    }
+
+    return pBuffer(new Buffer(channels));
+}
+
+
+bool writeAccess(QFile& file, unsigned long long access)
+{
+    SegmentHeader s;
+    memset (&s, 0, sizeof(s));
+    memcpy (s.magic, segment_magic, sizeof(segment_magic));
+    s.last_access = access;
+
+    return file.seek (0) && (qint64)sizeof(s) == file.write ((const char*)&s, sizeof(s));
+}
+
+
+/**
+ * Keeps the order of use for later sessions.
+ */
+void writeAccess(const std::string& path, unsigned long long access)
+{
+    QFile file(QString::fromStdString (path));
+    if (file.exists () && file.open (QIODevice::ReadWrite))
+        writeAccess (file, access);
+}
+
+
+/**
+ * Appends a record for 'b' at the end, 'offset', of a segment. Returns the
+ * size of the record or 0 if it couldn't be written.
+ */
+qint64 writeRecord(const std::string& path, qint64 offset, const std::string& chain_key, const Buffer& b, unsigned long long access)
+{
+    RecordHeader h;
+    memcpy (h.magic, record_magic, sizeof(record_magic));
+    h.key_bytes = chain_key.size ();
+    h.header_bytes = int_div_ceil (sizeof(RecordHeader) + h.key_bytes, record_alignment) * record_alignment;
+    h.first = b.getInterval ().first;
+    h.last = b.getInterval ().last;
+    h.sample_rate = b.sample_rate ();
+    h.number_of_channels = b.number_of_channels ();
+
+    qint64 bytes = recordBytes (h);
+    std::vector<char> header(h.header_bytes, 0);
+    memcpy (&header[0], &h, sizeof(RecordHeader));
+    memcpy (&header[sizeof(RecordHeader)], chain_key.data (), h.key_bytes);
+
+    QFile file(QString::fromStdString (path));
+    if (!file.open (QIODevice::ReadWrite))
+        return 0;
+
+    bool ok = writeAccess (file, access)
+            && file.seek (offset)
+            && (qint64)header.size () == file.write (&header[0], header.size ());
+
+    qint64 channel_bytes = b.number_of_samples () * sizeof(float);
+    for (unsigned i=0; ok && i<b.number_of_channels (); ++i)
+    {
+        const char* p = (const char*)CpuMemoryStorage::ReadOnly<1>( b.getChannel (i)->waveform_data ()).ptr ();
+        ok = channel_bytes == file.write (p, channel_bytes);
+    }
+
+    std::vector<char> padding(bytes - h.header_bytes - b.number_of_channels ()*channel_bytes, 0);
+    if (ok && !padding.empty ())
+        ok = (qint64)padding.size () == file.write (&padding[0], padding.size ());
+
+    if (!ok || !file.flush ())
+    {
+        // Don't leave a partial record behind
+        file.resize (offset);
+        return 0;
+    }
+
+    return bytes;
+}
+
+} // namespace
+
+
+PersistentCache::
+        PersistentCache(std::string directory)
+    :
+      max_bytes_(size_t(4) << 30),
+      scanned_(false),
+      total_bytes_(0),
+      last_access_(0)
+{
+    set_directory (directory);
+}
+
+
+PersistentCache& PersistentCache::
+        global()
+{
+    static PersistentCache cache;
+    return cache;
+}
+
+
+std::string PersistentCache::
+        directory() const
+{
+    std::lock_guard<std::mutex> l(lock_);
+    return directory_;
+}
+
+
+void PersistentCache::
+        set_directory(std::string directory)
+{
+    if (!directory.empty () && !QDir().mkpath (QString::fromStdString (directory)))
+    {
+        TaskInfo(boost::format("!!! Couldn't create persistent cache directory %s") % directory);
+        directory.clear ();
+    }
+
+    std::lock_guard<std::mutex> w(write_lock_);
+    std::lock_guard<std::mutex> l(lock_);
+    directory_ = directory;
+    index_.clear ();
+    segments_.clear ();
+    lru_.clear ();
+    open_segment_.clear ();
+    next_segment_.clear ();
+    scanned_ = false;
+    total_bytes_ = 0;
+}
+
+
+bool PersistentCache::
+        enabled() const
+{
+    std::lock_guard<std::mutex> l(lock_);
+    return !directory_.empty ();
+}
+
+
+size_t PersistentCache::
+        max_bytes() const
+{
+    std::lock_guard<std::mutex> l(lock_);
+    return max_bytes_;
+}
+
+
+void PersistentCache::
+        set_max_bytes(size_t bytes)
+{
+    std::lock_guard<std::mutex> w(write_lock_);
+    std::lock_guard<std::mutex> l(lock_);
+    max_bytes_ = bytes;
+    evict ();
+}
+
+
+bool PersistentCache::
+        put(const std::string& chain_key, pBuffer b)
+{
+    EXCEPTION_ASSERT( b );
+    EXCEPTION_ASSERT( !chain_key.empty () );
+
+    Interval I = b->getInterval ();
+
+    // One record is appended at a time, without blocking readers
+    std::lock_guard<std::mutex> w(write_lock_);
+
+    std::string p;
+    long long offset;
+    unsigned long long access;
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        if (directory_.empty ())
+            return false;
+
+        scan ();
+
+        Index::const_iterator i = index_.find (chain_key);
+        if (i != index_.end () && !(Intervals(I) - i->second.intervals))
+            return true;
+
+        p = appendSegment (hash (chain_key));
+        offset = segments_[p].bytes;
+        access = touch ();
+    }
+
+    qint64 bytes = writeRecord (p, offset, chain_key, *b, access);
+    if (!bytes)
+    {
+        TaskInfo(boost::format("!!! Couldn't write persistent cache %s") % p);
+        return false;
+    }
+
+    DEBUGINFO TaskInfo(boost::format("PersistentCache: stored %s in %s at %d") % I % p % offset);
+
+    std::lock_guard<std::mutex> l(lock_);
+    Segments::iterator s = segments_.find (p);
+    if (s == segments_.end ())
+        return false;
+
+    Record r = { I, p, offset, bytes };
+    Stored& stored = index_[chain_key];
+    stored.records.push_back (r);
+    stored.intervals |= I;
+
+    s->second.bytes += bytes;
+    s->second.keys.insert (chain_key);
+    total_bytes_ += bytes;
+    touch (s, access);
+
+    evict ();
+    return true;
+}
+
+
+std::vector<pBuffer> PersistentCache::
+        get(const std::string& chain_key, const Intervals& I)
+{
+    std::vector<pBuffer> R;
+    if (chain_key.empty () || !I)
+        return R;
+
+    // Find and touch the records while holding the lock, read them without
+    std::vector<Record> records;
+    std::vector<std::string> touched;
+    unsigned long long access;
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        if (directory_.empty ())
+            return R;
+
+        scan ();
+
+        Index::const_iterator i = index_.find (chain_key);
+        if (i == index_.end ())
+            return R;
+
+        Intervals found;
+        for (const Record& r : i->second.records)
+            if ((I & r.interval) && (r.interval - found))
+            {
+                records.push_back (r);
+                found |= r.interval;
+            }
+
+        access = touch ();
+        for (const Record& r : records)
+        {
+            Segments::iterator s = segments_.find (r.segment);
+            if (s != segments_.end () && s->second.last_access != access)
+            {
+                touch (s, access);
+                touched.push_back (r.segment);
+            }
+        }
+    }
+
+    std::vector<Record> broken;
+    for (const Record& r : records)
+    {
+        pBuffer b = readRecord (r.segment, r.offset, r.bytes, chain_key, r.interval);
+        if (b)
+            R.push_back (b);
+        else
+            broken.push_back (r);
+    }
+
+    for (const std::string& p : touched)
+        writeAccess (p, access);
+
+    if (!broken.empty ())
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        for (const Record& r : broken)
+        {
+            TaskInfo(boost::format("PersistentCache: ignoring %s at %d") % r.segment % r.offset);
+            removeRecord (chain_key, r);
+        }
+    }
+
+    return R;
+}
+
+
+Intervals PersistentCache::
+        stored(const std::string& chain_key)
+{
+    std::lock_guard<std::mutex> l(lock_);
+    if (directory_.empty ())
+        return Intervals();
+
+    scan ();
+
+    Index::const_iterator i = index_.find (chain_key);
+    return i != index_.end () ? i->second.intervals : Intervals();
+}
+
+
+void PersistentCache::
+        clear()
+{
+    std::lock_guard<std::mutex> w(write_lock_);
+    std::lock_guard<std::mutex> l(lock_);
+    if (directory_.empty ())
+        return;
+
+    scan ();
+
+    for (const Segments::value_type& s : segments_)
+        QFile::remove (QString::fromStdString (s.first));
+
+    // next_segment_ is kept, views of removed segments may still be mapped
+    index_.clear ();
+    segments_.clear ();
+    lru_.clear ();
+    open_segment_.clear ();
+    total_bytes_ = 0;
+}
+
+
+std::string PersistentCache::
+        hash(const std::string& s)
+{
+    unsigned long long h = 14695981039346656037ull;
+    for (unsigned char c : s)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+
+    char r[17];
+    snprintf (r, sizeof(r), "%016llx", h);
+    return r;
+}
+
+
+void PersistentCache::
+        scan()
+{
+    if (scanned_)
+        return;
+    scanned_ = true;
+
+    QDir dir(QString::fromStdString (directory_));
+    QStringList names = dir.entryList (QStringList(QString("*") + file_suffix), QDir::Files);
+    for (const QString& name : names)
+    {
+        std::string h;
+        int n;
+        if (!parseFileName (name.toStdString (), h, n))
+            continue;
+
+        std::string p = dir.filePath (name).toStdString ();
+        scanSegment (p, h);
+
+        // Continue appending to the last segment of each hash
+        if (n >= next_segment_[h])
+        {
+            next_segment_[h] = n + 1;
+            if (segments_.count (p))
+                open_segment_[h] = p;
+        }
+    }
+
+    DEBUGINFO TaskInfo(boost::format("PersistentCache: %d segments, %s in %s")
+                       % segments_.size () % DataStorageVoid::getMemorySizeText (total_bytes_) % directory_);
+
+    evict ();
+}
+
+
+void PersistentCache::
+        scanSegment(const std::string& path, const std::string& hash)
+{
+    QFile file(QString::fromStdString (path));
+    SegmentHeader sh;
+    if (!file.open (QIODevice::ReadWrite)
+            || (qint64)sizeof(sh) != file.read ((char*)&sh, sizeof(sh))
+            || 0 != memcmp (sh.magic, segment_magic, sizeof(segment_magic)))
+    {
+        TaskInfo(boost::format("PersistentCache: removing %s") % path);
+        file.close ();
+        QFile::remove (QString::fromStdString (path));
+        return;
+    }
+
+    qint64 size = file.size ();
+    qint64 offset = sizeof(sh);
+    std::set<std::string> keys;
+    std::vector<char> key;
+    while (offset < size)
+    {
+        RecordHeader h;
+        if (!file.seek (offset)
+                || (qint64)sizeof(h) != file.read ((char*)&h, sizeof(h))
+                || !validRecord (h, offset, size))
+            break;
+
+        key.resize (h.key_bytes);
+        if (h.key_bytes == 0 || (qint64)h.key_bytes != file.read (&key[0], h.key_bytes))
+            break;
+
+        std::string k(key.begin (), key.end ());
+        Record r = { Interval(h.first, h.last), path, offset, recordBytes (h) };
+        Stored& stored = index_[k];
+        stored.records.push_back (r);
+        stored.intervals |= r.interval;
+        keys.insert (k);
+        offset += r.bytes;
+    }
+
+    if (keys.empty ())
+    {
+        TaskInfo(boost::format("PersistentCache: removing %s") % path);
+        file.close ();
+        QFile::remove (QString::fromStdString (path));
+        return;
+    }
+
+    if (offset < size)
+    {
+        // Drop the rest of a record that wasn't completely written, and
+        // anything after it
+        TaskInfo(boost::format("PersistentCache: truncating %s at %d") % path % offset);
+        file.resize (offset);
+    }
+
+    Segment& s = segments_[path];
+    s.hash = hash;
+    s.bytes = offset;
+    s.last_access = sh.last_access;
+    s.keys = keys;
+    s.lru = lru_.insert (Lru::value_type(s.last_access, path));
+    total_bytes_ += offset;
+
+    // Accesses in this session are more recent than in earlier sessions
+    last_access_ = std::max(last_access_, s.last_access);
+}
+
+
+unsigned long long PersistentCache::
+        touch()
+{
+    // Strictly increasing, and comparable between sessions
+    unsigned long long t = QDateTime::currentMSecsSinceEpoch ();
+    last_access_ = std::max(last_access_ + 1, t);
+    return last_access_;
+}
+
+
+void PersistentCache::
+        touch(Segments::iterator s, unsigned long long access)
+{
+    lru_.erase (s->second.lru);
+    s->second.last_access = access;
+    s->second.lru = lru_.insert (Lru::value_type(access, s->first));
+}
+
+
+void PersistentCache::
+        evict()
+{
+    // Segments are only removed while holding write_lock_ or before anything
+    // is written, never while a record is appended.
+    while (total_bytes_ > max_bytes_ && !lru_.empty ())
+        removeSegment (segments_.find (lru_.begin ()->second));
+}
+
+
+void PersistentCache::
+        removeSegment(Segments::iterator s)
+{
+    DEBUGINFO TaskInfo(boost::format("PersistentCache: removing %s") % s->first);
+
+    QFile::remove (QString::fromStdString (s->first));
+
+    for (const std::string& k : s->second.keys)
+    {
+        Index::iterator i = index_.find (k);
+        if (i == index_.end ())
+            continue;
+
+        std::vector<Record>& records = i->second.records;
+        records.erase (std::remove_if (records.begin (), records.end (),
+                                       [&s](const Record& r) { return r.segment == s->first; }),
+                       records.end ());
+
+        if (records.empty ())
+        {
+            index_.erase (i);
+            continue;
+        }
+
+        i->second.intervals = Intervals();
+        for (const Record& r : records)
+            i->second.intervals |= r.interval;
+    }
+
+    total_bytes_ -= std::min(total_bytes_, (size_t)s->second.bytes);
+    lru_.erase (s->second.lru);
+    segments_.erase (s);
+}
+
+
+void PersistentCache::
+        removeRecord(const std::string& chain_key, const Record& r)
+{
+    // The bytes stay in the segment until it is removed
+    Index::iterator i = index_.find (chain_key);
+    if (i == index_.end ())
+        return;
+
+    std::vector<Record>& records = i->second.records;
+    records.erase (std::remove_if (records.begin (), records.end (),
+                                   [&r](const Record& x) { return x.segment == r.segment && x.offset == r.offset; }),
+                   records.end ());
+
+    if (records.empty ())
+    {
+        index_.erase (i);
+        return;
+    }
+
+    i->second.intervals = Intervals();
+    for (const Record& x : records)
+        i->second.intervals |= x.interval;
+}
+
+
+std::string PersistentCache::
+        appendSegment(const std::string& hash)
+{
+    std::map<std::string, std::string>::const_iterator o = open_segment_.find (hash);
+    if (o != open_segment_.end ())
+    {
+        Segments::const_iterator s = segments_.find (o->second);
+        if (s != segments_.end () && s->second.bytes < max_segment_bytes)
+            return o->second;
+    }
+
+    std::string p = path (hash, next_segment_[hash]++);
+    Segment& s = segments_[p];
+    s.hash = hash;
+    s.bytes = sizeof(SegmentHeader);
+    s.last_access = touch ();
+    s.lru = lru_.insert (Lru::value_type(s.last_access, p));
+    total_bytes_ += s.bytes;
+    open_segment_[hash] = p;
+    return p;
+}
+
+
+std::string PersistentCache::
+        path(const std::string& hash, int segment) const
+{
+    if (directory_.empty ())
+        return std::string();
+
+    return (boost::format("%s/%s_%d%s") % directory_ % hash % segment % file_suffix).str ();
+}
+
+} // namespace Processing
+} // namespace Signal
+
+namespace Signal {
+namespace Processing {
+
+void PersistentCache::
+        test()
+{
+    QString dir = QDir::tempPath () + QDir::separator () + "sonicawe-persistentcache-test";
+    QDir(dir).removeRecursively ();
+
+    pBuffer b(new Buffer(Interval(10,110), 40, 3));
+    for (unsigned c=0; c<b->number_of_channels (); ++c)
+    {
+        float *p = b->getChannel (c)->waveform_data ()->getCpuMemory ();
+        for (int i=0; i<b->number_of_samples (); ++i)
+            p[i] = c + i/(float)b->number_of_samples ();
+    }
+
+    // It should be disabled until a directory is set.
+    {
+        PersistentCache cache;
+        EXCEPTION_ASSERT( !cache.enabled () );
+        EXCEPTION_ASSERT( !cache.put ("a", b) );
+        EXCEPTION_ASSERT( cache.get ("a", Interval(10,110)).empty () );
+    }
+
+    // It should keep results of processing steps on disk between sessions.
+    {
+        {
+            PersistentCache cache(dir.toStdString ());
+            EXCEPTION_ASSERT( cache.enabled () );
+            EXCEPTION_ASSERT( cache.put ("a", b) );
+            EXCEPTION_ASSERT( cache.put ("a", b) );
+            EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+            EXCEPTION_ASSERT_EQUALS( cache.stored ("b"), Intervals() );
+        }
+
+        PersistentCache cache(dir.toStdString ());
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+        EXCEPTION_ASSERT( cache.get ("a", Interval(0,10)).empty () );
+        EXCEPTION_ASSERT( cache.get ("b", Interval(10,110)).empty () );
+
+        std::vector<pBuffer> r = cache.get ("a", Interval(50,60));
+        EXCEPTION_ASSERT_EQUALS( r.size (), 1u );
+        EXCEPTION_ASSERT( *r[0] == *b );
+
+        // Stored results are views of a memory mapped file that are copied
+        // before they are written to
+        float* p = r[0]->getChannel (1)->waveform_data ()->getCpuMemory ();
+        p[0] = -1;
+        r = cache.get ("a", Interval(50,60));
+        EXCEPTION_ASSERT( *r[0] == *b );
+
+        pBuffer b2(new Buffer(Interval(110,120), 40, 3));
+        *b2 |= *b;
+        EXCEPTION_ASSERT( cache.put ("a", b2) );
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,120) );
+        EXCEPTION_ASSERT_EQUALS( cache.get ("a", Intervals(0,200)).size (), 2u );
+    }
+
+    // It should ignore and remove records that can't be read.
+    {
+        QString segment;
+        long long second;
+        {
+            PersistentCache cache(dir.toStdString ());
+            EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,120) );
+            EXCEPTION_ASSERT_EQUALS( cache.segments_.size (), 1u );
+            segment = QString::fromStdString (cache.segments_.begin ()->first);
+            second = cache.index_["a"].records[1].offset;
+        }
+
+        // A record that wasn't completely written is dropped
+        {
+            QFile f(segment);
+            EXCEPTION_ASSERT( f.open (QIODevice::ReadWrite) );
+            EXCEPTION_ASSERT( f.seek (second) );
+            f.write ("broken", 6);
+        }
+
+        {
+            PersistentCache cache(dir.toStdString ());
+            EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+            EXCEPTION_ASSERT_EQUALS( QFileInfo(segment).size (), second );
+
+            // A record that was truncated by someone else is ignored
+            QFile f(segment);
+            EXCEPTION_ASSERT( f.open (QIODevice::ReadWrite) );
+            EXCEPTION_ASSERT( f.resize (second - 4) );
+            f.close ();
+
+            EXCEPTION_ASSERT_EQUALS( cache.get ("a", Interval(10,110)).size (), 0u );
+            EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals() );
+        }
+
+        // A segment without any readable records is removed
+        PersistentCache cache(dir.toStdString ());
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals() );
+        EXCEPTION_ASSERT( !QFile::exists (segment) );
+
+        // So is a segment with a broken header
+        EXCEPTION_ASSERT( cache.put ("a", b) );
+        segment = QString::fromStdString (cache.segments_.begin ()->first);
+        {
+            QFile f(segment);
+            EXCEPTION_ASSERT( f.open (QIODevice::ReadWrite) );
+            f.write ("broken", 6);
+        }
+
+        EXCEPTION_ASSERT_EQUALS( PersistentCache(dir.toStdString ()).stored ("a"), Intervals() );
+        EXCEPTION_ASSERT( !QFile::exists (segment) );
+    }
+
+    // It should store the results for different keys in different segments,
+    // and append results for the same key to the same segment.
+    {
+        PersistentCache cache(dir.toStdString ());
+        cache.clear ();
+        cache.put ("a", b);
+        cache.put ("b", b);
+        EXCEPTION_ASSERT_EQUALS( cache.segments_.size (), 2u );
+
+        pBuffer b2(new Buffer(Interval(110,120), 40, 3));
+        cache.put ("a", b2);
+        EXCEPTION_ASSERT_EQUALS( cache.segments_.size (), 2u );
+        EXCEPTION_ASSERT_EQUALS( cache.index_["a"].records.size (), 2u );
+    }
+
+    // It should remove the least recently used segments when it holds more
+    // than max_bytes.
+    {
+        PersistentCache cache(dir.toStdString ());
+        cache.clear ();
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals() );
+
+        cache.put ("a", b);
+        cache.put ("b", b);
+        cache.get ("a", Interval(10,110));
+        cache.put ("c", b);
+
+        EXCEPTION_ASSERT_EQUALS( cache.segments_.size (), 3u );
+        size_t segment_bytes = cache.total_bytes_ / 3;
+        cache.set_max_bytes (2*segment_bytes);
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("b"), Intervals() );
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("c"), Intervals(10,110) );
+    }
+
+    // It should remember the order of use between sessions.
+    {
+        {
+            PersistentCache cache(dir.toStdString ());
+            cache.clear ();
+            cache.put ("a", b);
+            cache.put ("b", b);
+            cache.get ("a", Interval(10,110));
+        }
+
+        PersistentCache cache(dir.toStdString ());
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+        cache.set_max_bytes (cache.total_bytes_ / 2);
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("a"), Intervals(10,110) );
+        EXCEPTION_ASSERT_EQUALS( cache.stored ("b"), Intervals() );
+
+        // And continue after the last access of earlier sessions
+        EXCEPTION_ASSERT_LESS( cache.segments_.begin ()->second.last_access, cache.touch () );
+    }
+
+    EXCEPTION_ASSERT_EQUALS( hash (""), "cbf29ce484222325" );
+    EXCEPTION_ASSERT_EQUALS( hash ("a"), "af63dc4c8601ec8c" );
+
+    QDir(dir).removeRecursively ();
+}
+
+} // namespace Processing
+} // namespace Signal
@@ -0,0 +1,151 @@
+#ifndef SIGNAL_PROCESSING_PERSISTENTCACHE_H
+#define SIGNAL_PROCESSING_PERSISTENTCACHE_H
+
+#include "signal/buffer.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Signal {
+namespace Processing {
+
+/**
+ * @brief The PersistentCache class should keep results of processing steps
+ * on disk between sessions.
+ *
+ * Results are identified by a chain key, which describes an operation and all
+ * of its sources, see OperationDesc::persistentId. Results for the same key
+ * are appended to segment files named by a hash of the key, each segment
+ * holds up to 64 MB. Each stored Buffer is a record in a segment with a
+ * header, the key and the samples channel after channel. Stored results are
+ * read back as views of memory mapped files.
+ *
+ * It should be disabled until a directory is set.
+ *
+ * It should remove the least recently used segments when it holds more than
+ * max_bytes, also when the results were used in a previous session.
+ *
+ * It should ignore and remove records that can't be read.
+ *
+ * It should be thread-safe, and not block other threads while reading or
+ * writing files.
+ */
+class PersistentCache
+{
+public:
+    explicit PersistentCache(std::string directory=std::string());
+
+    /**
+     * @brief global is the instance used by Step. Disabled by default.
+     */
+    static PersistentCache& global();
+
+    std::string directory() const;
+
+    /**
+     * @brief set_directory enables the cache with files in 'directory', which
+     * is created if needed. An empty directory disables the cache.
+     */
+    void set_directory(std::string directory);
+    bool enabled() const;
+
+    /**
+     * Defaults to 4 GB.
+     */
+    size_t max_bytes() const;
+    void set_max_bytes(size_t bytes);
+
+    /**
+     * @brief put stores 'b' for 'chain_key'. Does nothing if 'b' is already
+     * covered by stored results.
+     * @return false if the cache is disabled or the file couldn't be written.
+     */
+    bool put(const std::string& chain_key, pBuffer b);
+
+    /**
+     * @brief get returns stored results for 'chain_key' that overlap 'I'.
+     * The returned buffers may extend beyond 'I'.
+     */
+    std::vector<pBuffer> get(const std::string& chain_key, const Intervals& I);
+
+    /**
+     * @brief stored describes which samples are stored for 'chain_key'.
+     */
+    Intervals stored(const std::string& chain_key);
+
+    /// Removes all stored results
+    void clear();
+
+    /**
+     * @brief hash is a 64 bit FNV-1a hash of 's' as 16 hex digits. Unlike
+     * std::hash it is the same in every session and on every platform.
+     */
+    static std::string hash(const std::string& s);
+
+private:
+    /**
+     * A file with records for one or more keys with the same hash.
+     */
+    struct Segment
+    {
+        std::string hash;
+        long long bytes;                // Size of the segment file
+        unsigned long long last_access; // Also written to the file
+        std::set<std::string> keys;     // Keys with records in this segment
+        std::multimap<unsigned long long, std::string>::iterator lru;
+    };
+
+    struct Record
+    {
+        Interval interval;
+        std::string segment;
+        long long offset;
+        long long bytes;
+    };
+
+    struct Stored
+    {
+        std::vector<Record> records;
+        Intervals intervals;
+    };
+
+    typedef std::map<std::string, Stored> Index;        // by chain key
+    typedef std::map<std::string, Segment> Segments;    // by path
+    typedef std::multimap<unsigned long long, std::string> Lru; // path by last_access
+
+    mutable std::mutex lock_;
+    std::mutex write_lock_;     // Taken before lock_ by anything that writes or removes files
+    std::string directory_;
+    size_t max_bytes_;
+
+    // All records in directory_, read when first needed
+    Index index_;
+    Segments segments_;
+    Lru lru_;
+    std::map<std::string, std::string> open_segment_;  // Segment to append to by hash
+    std::map<std::string, int> next_segment_;           // Next segment number by hash
+    bool scanned_;
+    size_t total_bytes_;
+    unsigned long long last_access_;
+
+    void scan();
+    void scanSegment(const std::string& path, const std::string& hash);
+    unsigned long long touch();
+    void touch(Segments::iterator s, unsigned long long access);
+    void evict();
+    void removeSegment(Segments::iterator s);
+    void removeRecord(const std::string& chain_key, const Record& r);
+    std::string appendSegment(const std::string& hash);
+    std::string path(const std::string& hash, int segment) const;
+
+public:
+    static void test();
+};
+
+} // namespace Processing
+} // namespace Signal
+
+#endif // SIGNAL_PROCESSING_PERSISTENTCACHE_H
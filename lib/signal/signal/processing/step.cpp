@@ -1,7 +1,10 @@
 #include "step.h"
+#include "cachebudget.h"
+#include "persistentcache.h"
 #include "test/operationmockups.h"
 
 #include "tasktimer.h"
+#include "timer.h"
 #include "log.h"
 
 #include <boost/foreach.hpp>
@@ -24,6 +27,7 @@ Step::Step(OperationDesc::ptr operation_desc)
         not_started_(Intervals::Intervals_ALL),
         operation_desc_(operation_desc)
 {
+    CacheBudget::global ().add_cache (cache_);
 }
 
 
@@ -93,6 +97,19 @@ Intervals Step::
 
     not_started_ |= deprecated;
 
+    // Results of running tasks may be based on deprecated data
+    if (deprecated)
+    {
+        chain_key_.clear ();
+        task_chain_keys_.clear ();
+        fusion_.valid = false;
+    }
+
+    // Output of running tasks that has been deprecated, in one or more calls, is in not_started_
+    for (const RunningTaskMap::value_type& t : running_tasks)
+        if (!(Intervals(t.second) - not_started_))
+            superseded_tasks_.insert (t.first);
+
     return deprecated;
 }
 
@@ -121,6 +138,29 @@ OperationDesc::ptr Step::
 }
 
 
+Intervals Step::
+        loadPersistent(const std::string& chain_key, Intervals I)
+{
+    chain_key_ = chain_key;
+    if (chain_key_.empty ())
+        return Intervals();
+
+    Intervals loaded;
+    for (pBuffer b : PersistentCache::global ().get (chain_key_, I & not_started_))
+    {
+        cache_->put (b);
+        loaded |= b->getInterval ();
+    }
+
+    DEBUGINFO if (loaded) TaskInfo(format("Step::loadPersistent %2% on %1%")
+              % operation_name()
+              % loaded);
+
+    not_started_ -= loaded;
+    return loaded;
+}
+
+
 int Step::
         registerTask(Interval expected_output)
 {
@@ -134,6 +174,8 @@ int Step::
     int taskid = task_counter_;
 
     running_tasks[taskid] = expected_output;
+    if (!chain_key_.empty ())
+        task_chain_keys_[taskid] = chain_key_;
     not_started_ -= expected_output;
     return taskid;
 }
@@ -154,9 +196,16 @@ void Step::
         // Result must have the same number of channels and sample rate as previous cache.
         // Call deprecateCache(Interval::Interval_ALL) to erase the cache when chainging number of channels or sample rate.
         step.raw ()->cache_->put (result);
+        step.raw ()->counters_.allocated (result->number_of_samples () * result->number_of_channels () * sizeof(float));
+
+        // Spill least recently used cache chunks to disk if needed
+        CacheBudget::global ().enforce ();
     }
 
+    Timer lock_timer;
     auto self = step.write ();
+    self->counters_.lock_wait (lock_timer.elapsed ());
+
     int matched_task = self->running_tasks.count (taskid);
     if (1 != matched_task) {
         Log("C = %d, taskid = %x on %s") % matched_task % taskid % self->operation_name ();
@@ -194,10 +243,38 @@ void Step::
         }
     }
 
+    std::string chain_key;
+    auto k = self->task_chain_keys_.find (taskid);
+    if (k != self->task_chain_keys_.end ())
+    {
+        chain_key.swap (k->second);
+        self->task_chain_keys_.erase (k);
+    }
+
     self->running_tasks.erase ( taskid );
+    self->superseded_tasks_.erase ( taskid );
     self.unlock ();
 
     step.raw ()->wait_for_tasks_.notify_all ();
+
+    if (result && !chain_key.empty ())
+        PersistentCache::global ().put (chain_key, result);
+}
+
+
+bool Step::
+        superseded(int taskid) const
+{
+    return 0 < superseded_tasks_.count (taskid);
+}
+
+
+bool Step::
+        deprecated(int taskid) const
+{
+    // registerTask removed the expected output from not_started_
+    RunningTaskMap::const_iterator i = running_tasks.find (taskid);
+    return i != running_tasks.end () && (Intervals(i->second) & not_started_);
 }
 
 
@@ -236,7 +313,23 @@ bool Step::
 pBuffer Step::
         readFixedLengthFromCache(Step::const_ptr ptr, Interval I)
 {
-    return ptr.raw ()->cache_.read ()->read (I);
+    const Step* step = ptr.raw ();
+
+    Timer lock_timer;
+    auto cache = step->cache_.read ();
+    step->counters_.lock_wait (lock_timer.elapsed ());
+
+    UnsignedIntervalType hits = (cache->samplesDesc () & I).count ();
+    step->counters_.cache_read (hits, I.count () - hits);
+
+    return cache->read (I);
+}
+
+
+PerfCounters& Step::
+        counters() const
+{
+    return counters_;
 }
 
 } // namespace Processing
@@ -280,6 +373,22 @@ void Step::
         EXCEPTION_ASSERT( *b == *Step::readFixedLengthFromCache (s, b->getInterval ()) );
     }
 
+    // It should tell which running tasks that have all of their output deprecated.
+    {
+        Step s(OperationDesc::ptr(new Test::TransparentOperationDesc));
+        int task1 = s.registerTask (Interval(0,10));
+        int task2 = s.registerTask (Interval(10,20));
+        EXCEPTION_ASSERT( !s.superseded (task1) );
+
+        s.deprecateCache (Interval(5,15));
+        EXCEPTION_ASSERT( !s.superseded (task1) );
+        EXCEPTION_ASSERT( !s.superseded (task2) );
+
+        s.deprecateCache (Interval(0,5));
+        EXCEPTION_ASSERT( s.superseded (task1) );
+        EXCEPTION_ASSERT( !s.superseded (task2) );
+    }
+
     // A crashed signal processing step should behave as a transparent operation.
     {
         OperationDesc::ptr silence(new Signal::OperationSetSilent(Signal::Interval(2,3)));
@@ -5,8 +5,11 @@
 #include "signal/computingengine.h"
 #include "signal/operation.h"
 #include "signal/cache.h"
+#include "perfcounters.h"
 
 #include <condition_variable>
+#include <set>
+#include <vector>
 
 namespace Signal {
 namespace Processing {
@@ -21,6 +24,13 @@ class Task;
  * and what's currently being updated.
  *
  * A crashed signal processing step should behave as a transparent operation.
+ *
+ * The memory used by the cache is limited by CacheBudget::global().
+ *
+ * Results can be kept between sessions by PersistentCache::global(), see
+ * loadPersistent.
+ *
+ * It should count the work done for it, see counters.
  */
 class Step
 {
@@ -54,9 +64,57 @@ public:
 
     Signal::OperationDesc::ptr  operation_desc() const; // Safe to call without lock
 
+    /**
+     * @brief loadPersistent fills the cache with results that were stored in
+     * PersistentCache::global() for 'chain_key' and marks them as up to date.
+     * Results of tasks registered after this call are stored under
+     * 'chain_key' when they finish, unless the cache is deprecated before.
+     * @param chain_key Describes the operation of this step and all of its
+     * sources. An empty key means that results of this step aren't kept.
+     * @param I The samples that are needed.
+     * @return the samples that were loaded.
+     */
+    Signal::Intervals           loadPersistent(const std::string& chain_key, Signal::Intervals I);
+
+    /**
+     * @brief chain_key is the key given to loadPersistent, or empty if the
+     * cache has been deprecated since. Lets FirstMissAlgorithm skip
+     * describing the whole chain again.
+     */
+    const std::string&          chain_key() const { return chain_key_; }
+
+    /**
+     * @brief The Fusion struct describes how FirstMissAlgorithm computes the
+     * results of this step, see OperationDesc::fuse. Fused and unfused
+     * results don't match exactly so the cache should only hold results that
+     * were computed the same way.
+     */
+    struct Fusion {
+        std::vector<Step::ptr> candidates;  // Sources that could be fused, the nearest first
+        int fused = 0;                      // Number of candidates in 'desc'
+        Signal::OperationDesc::ptr desc;    // Empty if nothing is fused
+        bool valid = false;                 // Cleared when the cache is deprecated
+    };
+
+    const Fusion&               fusion() const { return fusion_; }
+    void                        fusion(const Fusion& f) { fusion_ = f; }
+
     int                         registerTask(Signal::Interval expected_output);
     static void                 finishTask(Step::ptr, int taskid, Signal::pBuffer result);
 
+    /**
+     * @brief superseded is true if all of the expected output of task
+     * 'taskid' has been deprecated since the task was registered. The result
+     * would be thrown away so the task should be cancelled.
+     */
+    bool                        superseded(int taskid) const;
+
+    /**
+     * @brief deprecated is true if any of the expected output of task
+     * 'taskid' has been deprecated since the task was registered.
+     */
+    bool                        deprecated(int taskid) const;
+
     /**
      * @brief sleepWhileTasks wait until all created tasks for this step has been finished.
      * @param sleep_ms Sleep indefinitely if sleep_ms < 0.
@@ -70,10 +128,18 @@ public:
      * @param I
      * @return If no task has finished yet, a null buffer. Otherwise the data
      *         that is stored in the cache for given interval. Cache misses are
-     *         returned as 0 values.
+     *         returned as 0 values. The data is not copied if the interval is
+     *         covered by a single cache chunk, see Cache::read.
      */
     static Signal::pBuffer      readFixedLengthFromCache(Step::const_ptr, Signal::Interval I);
 
+    /**
+     * @brief counters of tasks that produced results for this step, reads
+     * from its cache and time spent waiting for its locks. Safe to use
+     * without lock.
+     */
+    PerfCounters&               counters() const;
+
 private:
     typedef std::map<int, Signal::Interval> RunningTaskMap;
 
@@ -83,10 +149,16 @@ private:
     int                         task_counter_ = 0;
 
     RunningTaskMap              running_tasks;
+    std::set<int>               superseded_tasks_;
+
+    std::string                 chain_key_;
+    std::map<int, std::string>  task_chain_keys_;
+    Fusion                      fusion_;
 
     Signal::OperationDesc::ptr  operation_desc_;
 
     mutable std::condition_variable_any wait_for_tasks_;
+    mutable PerfCounters        counters_;
 
     std::string                 operation_name() const;
     Signal::Intervals           currently_processing() const; // from running_tasks
@@ -23,6 +23,7 @@ TargetNeeds::
       notifier_(notifier)
 {
     auto state = state_.write ();
+    state->prio = 0;
     state->work_center = Interval::IntervalType_MIN;
     state->preferred_update_size = Interval::IntervalType_MAX;
 }
@@ -47,8 +48,8 @@ void TargetNeeds::
 
     auto state = state_.write ();
     Intervals new_samples = needed_samples - state->needed_samples;
-    ptime now = microsec_clock::local_time();
-    state->last_request = now + time_duration(0,0,prio);
+    state->last_request = microsec_clock::local_time();
+    state->prio = prio;
     state->needed_samples = needed_samples;
     state->work_center = center;
     state->preferred_update_size = preferred_update_size;
@@ -68,6 +69,27 @@ void TargetNeeds::
 }
 
 
+void TargetNeeds::
+        updatePrefetch(const Signal::Intervals& prefetch_samples)
+{
+    auto state = state_.write ();
+    Intervals new_samples = prefetch_samples - state->prefetch_samples;
+    state->prefetch_samples = prefetch_samples;
+
+    state.unlock ();
+
+    DEBUG_INFO TaskInfo(boost::format("prefetch_samples = %s") % prefetch_samples);
+
+    Step::const_ptr step = step_.lock ();
+    INotifier::ptr notifier = notifier_.lock ();
+    if (new_samples && step && notifier)
+    {
+        if (new_samples & step.read ()->not_started ())
+            notifier->wakeup();
+    }
+}
+
+
 void TargetNeeds::
         deprecateCache(const Intervals& invalidate) const
 {
@@ -99,6 +121,13 @@ boost::posix_time::ptime TargetNeeds::
 }
 
 
+int TargetNeeds::
+        prio() const
+{
+    return state_->prio;
+}
+
+
 Signal::IntervalType TargetNeeds::
         work_center() const
 {
@@ -132,6 +161,13 @@ Signal::Intervals TargetNeeds::
 }
 
 
+Signal::Intervals TargetNeeds::
+        prefetch() const
+{
+    return state_->prefetch_samples;
+}
+
+
 TargetNeeds::State TargetNeeds::
         state() const
 {
@@ -329,6 +365,37 @@ void TargetNeeds::
             bed.sleep (2);
         }
     }
+
+    // It should keep a prefetch apart from what's needed and wake up workers
+    // when the prefetch has something new to compute
+    {
+        Bedroom::ptr bedroom(new Bedroom);
+        BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
+        Step::ptr step(new Step(Signal::OperationDesc::ptr()));
+        TargetNeeds::ptr target_needs( new TargetNeeds(step, notifier) );
+
+        target_needs->updateNeeds(Interval(0,10));
+        target_needs->updatePrefetch(Interval(10,30));
+        EXCEPTION_ASSERT_EQUALS( target_needs->needed (), Interval(0,10) );
+        EXCEPTION_ASSERT_EQUALS( target_needs->prefetch (), Interval(10,30) );
+        EXCEPTION_ASSERT_EQUALS( target_needs->not_started (), Interval(0,10) );
+
+        {
+            Timer t;
+            Bedroom::Bed bed = bedroom->getBed();
+            target_needs->updatePrefetch(Interval(10,20));
+            bed.sleep (2);
+            EXCEPTION_ASSERT_LESS(2e-3, t.elapsed ()); // Nothing new
+        }
+
+        {
+            Timer t;
+            Bedroom::Bed bed = bedroom->getBed();
+            target_needs->updatePrefetch(Interval(-10,0));
+            bed.sleep (2);
+            EXCEPTION_ASSERT_LESS(t.elapsed (), 2e-3); // Changed direction
+        }
+    }
 }
 
 } // namespace Processing
@@ -29,9 +29,11 @@ public:
         };
 
         boost::posix_time::ptime last_request;
+        int prio;
         Signal::IntervalType work_center;
         Signal::IntervalType preferred_update_size;
         Signal::Intervals needed_samples;
+        Signal::Intervals prefetch_samples;
     };
 
     TargetNeeds(shared_state<Step>::weak_ptr step_, INotifier::weak_ptr notifier);
@@ -45,8 +47,11 @@ public:
      * calculation (as returned by TargetNeeds::not_started()).
      *
      * @arg needed_samples Which portion that is actually needed by the target.
-     * @arg prio A higher number makes sure this TargetNeed is computed before
-     *           others.
+     * @arg prio A higher number gives this TargetNeed a larger share of the
+     *           workers, each step up doubles the share. A positive prio means
+     *           that the target has a deadline (such as playback) and is
+     *           computed before any target with prio <= 0.
+     *           See TargetSchedule.
      * @arg center From where to work off intervals from this->not_started()
      */
     void updateNeeds(
@@ -55,6 +60,17 @@ public:
             Signal::IntervalType preferred_update_size=Signal::Interval::IntervalType_MAX,
             int prio=0 );
 
+    /**
+     * Samples that the target will likely need soon, such as ahead of where
+     * the user is scrolling. They are computed in the steps below the target,
+     * not in the target step itself, and only by workers that can't start
+     * anything in 'needed_samples' of any target. See VelocityPrefetch.
+     *
+     * Replaces the previous prefetch, whatever isn't started by then is
+     * dropped.
+     */
+    void updatePrefetch( const Signal::Intervals& prefetch_samples );
+
     /**
      * @brief deprecateCache invalidates
      * @arg invalidate Samples to invalidate in the step cache.
@@ -75,11 +91,13 @@ public:
      */
     shared_state<Step>::weak_ptr step() const;
     boost::posix_time::ptime last_request() const;
+    int prio() const;
     Signal::IntervalType work_center() const;
     Signal::IntervalType preferred_update_size() const;
     Signal::Intervals out_of_date() const;
     Signal::Intervals not_started() const;
     Signal::Intervals needed() const;
+    Signal::Intervals prefetch() const;
     State state() const;
 
     /**
@@ -4,12 +4,14 @@
 
 #include "targetschedule.h"
 #include "tasktimer.h"
+#include "timer.h"
+
+#include <climits>
+#include <cmath>
 
 //#define DEBUGINFO
 #define DEBUGINFO if(0)
 
-using namespace boost::posix_time;
-
 namespace Signal {
 namespace Processing {
 
@@ -19,7 +21,8 @@ TargetSchedule::
     :
       targets(targets),
       g(g),
-      algorithm(algorithm)
+      algorithm(algorithm),
+      scheduling_(new SchedulingState)
 {
     BOOST_ASSERT(g);
     BOOST_ASSERT(algorithm);
@@ -29,45 +32,129 @@ TargetSchedule::
 Task TargetSchedule::
         getTask(Signal::ComputingEngine::ptr engine) const
 {
+    std::vector<Task> tasks = getTasks(engine, 1);
+    if (tasks.empty ())
+        return Task();
+    return std::move(tasks.front ());
+}
+
+
+std::vector<Task> TargetSchedule::
+        getTasks(Signal::ComputingEngine::ptr engine, int max_tasks) const
+{
+    std::vector<Task> tasks;
+
     // Lock this from writing during getTask
     // Lock the graph from writing during getTask
     auto dag = g.read();
 
-    TargetState targetstate = prioritizedTarget();
-    TargetNeeds::State& state = targetstate.second;
-    Step::ptr& step = targetstate.first;
-    if (!step) {
+    std::vector<TargetState> targetstates = prioritizedTargets();
+    if (targetstates.empty ()) {
         DEBUGINFO TaskInfo("No target needs anything right now");
-        return Task();
+        return tasks;
     }
 
-    DEBUGINFO TaskTimer tt(boost::format("getTask(%s,%g)") % state.needed_samples % state.work_center);
+    while ((int)tasks.size () < max_tasks)
+    {
+        // The algorithm might not find anything to do for the first target,
+        // continue with the next one in that case
+        bool found = false;
+        for (size_t i=0; i<targetstates.size () && !found; i++)
+        {
+            TargetState& targetstate = targetstates[i];
+            const TargetNeeds::State& state = targetstate.state;
+            if (!state.needed_samples)
+                continue;
+
+            // Take as many tasks as this target gets before the next one is in line
+            int n = max_tasks - (int)tasks.size ();
+            if (i+1 < targetstates.size ())
+                n = std::min(n, share (targetstate, targetstates[i+1]));
+
+            DEBUGINFO TaskTimer tt(boost::format("getTasks(%s,%g,%d,%d)") % state.needed_samples % state.work_center % state.prio % n);
+
+            GraphVertex vertex = dag->getVertex(targetstate.step);
+            EXCEPTION_ASSERT(vertex);
+
+            std::vector<Task> found_tasks = algorithm.read ()->getTasks(
+                    dag->g(),
+                    vertex,
+                    state.needed_samples,
+                    state.work_center,
+                    state.preferred_update_size,
+                    Workers::ptr(),
+                    engine,
+                    n);
+
+            for (Task& task : found_tasks)
+            {
+                DEBUGINFO TaskInfo(boost::format("task->expected_output() = %s") % task.expected_output());
+
+                targetstate.pass = charge (targetstate);
+                targetstate.state.needed_samples -= task.expected_output ();
+                tasks.push_back (std::move(task));
+                found = true;
+            }
+        }
 
-    GraphVertex vertex = dag->getVertex(step);
-    EXCEPTION_ASSERT(vertex);
+        if (!found)
+            break;
 
-    Task task = algorithm.read ()->getTask(
-            dag->g(),
-            vertex,
-            state.needed_samples,
-            state.work_center,
-            state.preferred_update_size,
-            Workers::ptr(),
-            engine);
+        // Take the next task from whichever target that is next in line now
+        std::stable_sort(targetstates.begin (), targetstates.end (), &TargetSchedule::inLine);
+    }
 
-    DEBUGINFO if (task)
-        TaskInfo(boost::format("task->expected_output() = %s") % task.expected_output());
+    // Nothing more that is needed can be started, prefetch with the rest.
+    // A target may only keep what it has asked for, the heightmap drops
+    // chunks for blocks that don't exist yet. So the prefetch computes the
+    // steps below the target, whose results are kept in their caches, for
+    // the input the target will need to compute the prefetched samples.
+    for (TargetState& targetstate : targetstates)
+    {
+        if (!targetstate.state.prefetch_samples || (int)tasks.size () >= max_tasks)
+            continue;
+
+        Signal::Intervals required = requiredIntervals (
+                    targetstate.step.raw ()->operation_desc (),
+                    targetstate.state.prefetch_samples);
 
-    return task;
+        for (Step::ptr source : dag->sourceSteps (targetstate.step))
+        {
+            if ((int)tasks.size () >= max_tasks)
+                break;
+
+            Signal::Intervals prefetch = required & source.read ()->not_started ();
+            if (!prefetch)
+                continue;
+
+            DEBUGINFO TaskTimer tt(boost::format("prefetch getTasks(%s,%g)") % prefetch % targetstate.state.work_center);
+
+            GraphVertex vertex = dag->getVertex(source);
+            EXCEPTION_ASSERT(vertex);
+
+            std::vector<Task> found_tasks = algorithm.read ()->getTasks(
+                    dag->g(),
+                    vertex,
+                    prefetch,
+                    targetstate.state.work_center,
+                    targetstate.state.preferred_update_size,
+                    Workers::ptr(),
+                    engine,
+                    max_tasks - (int)tasks.size ());
+
+            for (Task& task : found_tasks)
+                tasks.push_back (std::move(task));
+        }
+    }
+
+    return tasks;
 }
 
 
-TargetSchedule::TargetState TargetSchedule::
-        prioritizedTarget() const
+std::vector<TargetSchedule::TargetState> TargetSchedule::
+        prioritizedTargets() const
 {
-    TargetState r;
-
-    r.second.last_request = neg_infin;
+    std::vector<TargetState> r;
 
     for (const TargetNeeds::ptr& t: targets->getTargets())
     {
@@ -81,21 +168,123 @@ TargetSchedule::TargetState TargetSchedule::
 
         TargetNeeds::State state = t->state ();
         state.needed_samples &= step_needed;
+        state.prefetch_samples &= step_needed;
+        state.prefetch_samples -= state.needed_samples;
+        if (!state.needed_samples && !state.prefetch_samples)
+            continue;
 
-        if (r.second.last_request < state.last_request && state.needed_samples)
+        r.push_back (TargetState{t.get (), step, state, 0});
+    }
+
+    {
+        auto scheduling = scheduling_.write ();
+
+        // Targets that doesn't need anything are forgotten, they will start
+        // at the current virtual time when they need something again instead
+        // of having saved up a share of the workers while idle.
+        std::map<const TargetNeeds*, double> pass;
+        for (TargetState& t : r)
         {
-            r.first = step;
-            r.second = state;
+            auto i = scheduling->pass.find (t.target);
+            t.pass = i == scheduling->pass.end ()
+                    ? scheduling->virtual_time
+                    : std::max(i->second, scheduling->virtual_time);
+            pass[t.target] = t.pass;
         }
+        scheduling->pass.swap (pass);
     }
 
+    std::sort(r.begin (), r.end (), &TargetSchedule::inLine);
+
     return r;
 }
 
+
+bool TargetSchedule::
+        inLine(const TargetState& a, const TargetState& b)
+{
+    // Targets that only have something to prefetch are last
+    bool needs_a = a.state.needed_samples, needs_b = b.state.needed_samples;
+    if (needs_a != needs_b)
+        return needs_a;
+    bool deadline_a = a.state.prio > 0, deadline_b = b.state.prio > 0;
+    if (deadline_a != deadline_b)
+        return deadline_a;
+    if (a.pass != b.pass)
+        return a.pass < b.pass;
+    if (a.state.prio != b.state.prio)
+        return a.state.prio > b.state.prio;
+    return a.state.last_request > b.state.last_request;
+}
+
+
+double TargetSchedule::
+        weight(const TargetState& t)
+{
+    // Each step up in prio doubles the share of the workers
+    return std::ldexp(1.0, std::max(-16, std::min(16, t.state.prio)));
+}
+
+
+int TargetSchedule::
+        share(const TargetState& t, const TargetState& next)
+{
+    // Targets with a deadline are served first until they don't need anything
+    if (t.state.prio > 0 || next.state.prio > 0)
+        return t.state.prio > 0 ? INT_MAX : 1;
+
+    // Number of charges until 't' is no longer before 'next'
+    double n = std::ceil((next.pass - t.pass) * weight (t));
+    return (int)std::max(1.0, std::min(n, (double)INT_MAX));
+}
+
+
+double TargetSchedule::
+        charge(const TargetState& t) const
+{
+    double weight = TargetSchedule::weight (t);
+
+    auto scheduling = scheduling_.write ();
+    double& pass = scheduling->pass[t.target];
+    pass = std::max(pass, scheduling->virtual_time);
+
+    // Targets with a deadline are served outside of the shares of the others
+    if (t.state.prio <= 0)
+        scheduling->virtual_time = pass;
+
+    pass += 1.0 / weight;
+    return pass;
+}
+
+Signal::Intervals TargetSchedule::
+        requiredIntervals(Signal::OperationDesc::ptr desc, const Signal::Intervals& I)
+{
+    if (!desc)
+        return I;
+
+    auto o = desc.read ();
+    Signal::Intervals required;
+    for (Signal::Interval i : I)
+    {
+        // Each call covers a part of 'i' starting at 'i.first'
+        while (i)
+        {
+            Signal::Interval expected_output;
+            required |= o->requiredInterval (i, &expected_output);
+            if (expected_output.last <= i.first)
+                break;
+            i.first = expected_output.last;
+        }
+    }
+
+    return required;
+}
+
 } // namespace Processing
 } // namespace Signal
 
 #include "bedroomnotifier.h"
+#include "neat_math.h"
 
 namespace Signal {
 namespace Processing {
@@ -122,6 +311,53 @@ public:
 };
 
 
+class TakeFirstAlgorithmMockup: public IScheduleAlgorithm
+{
+public:
+    virtual Task getTask(
+            const Graph& g,
+            GraphVertex vertex,
+            Signal::Intervals needed,
+            Signal::IntervalType center,
+            Signal::IntervalType preferred_size,
+            Workers::ptr,
+            Signal::ComputingEngine::ptr) const
+    {
+        Step::ptr step = g[vertex];
+        return Task(step.write(), step,
+                                  std::vector<Step::const_ptr>(),
+                                  Signal::Operation::ptr(),
+                                  needed.fetchInterval (preferred_size, center),
+                                  Signal::Interval());
+    }
+};
+
+
+// Computes chunks of 10 samples from 5 samples more on each side
+class OverlappingChunksDescMockup: public Signal::OperationDesc
+{
+public:
+    Signal::Interval requiredInterval( const Signal::Interval& I, Signal::Interval* expectedOutput ) const
+    {
+        Signal::IntervalType first = align_down(I.first, chunk);
+        if (expectedOutput)
+            *expectedOutput = Signal::Interval(first, first + chunk);
+        return Signal::Interval(first - overlap, first + chunk + overlap);
+    }
+
+    Signal::Interval affectedInterval( const Signal::Interval& I ) const
+    {
+        return Signal::Interval(align_down(I.first - overlap, chunk), align_up(I.last + overlap, chunk));
+    }
+
+    Signal::Operation::ptr createOperation(Signal::ComputingEngine*) const { return Signal::Operation::ptr(); }
+    OperationDesc::ptr copy() const { return OperationDesc::ptr(new OverlappingChunksDescMockup); }
+
+private:
+    const Signal::IntervalType chunk = 10, overlap = 5;
+};
+
+
 void TargetSchedule::
         test()
 {
@@ -184,6 +420,178 @@ void TargetSchedule::
         EXCEPTION_ASSERT(task);
         EXCEPTION_ASSERT_EQUALS(task.expected_output(), Signal::Interval(5,6));
     }
+
+    // It should spread workers across targets by weight and let targets with
+    // a deadline preempt other targets
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr heightmap(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr exporter(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr playback(new Step(Signal::OperationDesc::ptr()));
+        dag.write ()->appendStep(heightmap);
+        dag.write ()->appendStep(exporter);
+        dag.write ()->appendStep(playback);
+        IScheduleAlgorithm::ptr algorithm(new TakeFirstAlgorithmMockup);
+        Bedroom::ptr bedroom(new Bedroom);
+        BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
+        Targets::ptr targets(new Targets(notifier));
+        Signal::ComputingEngine::ptr engine;
+
+        TargetNeeds::ptr heightmap_needs ( targets->addTarget(heightmap) );
+        TargetNeeds::ptr exporter_needs ( targets->addTarget(exporter) );
+        TargetNeeds::ptr playback_needs ( targets->addTarget(playback) );
+        heightmap_needs->updateNeeds(Signal::Interval(0,1000),0,10,0);
+        exporter_needs->updateNeeds(Signal::Interval(0,1000),0,10,-1);
+
+        TargetSchedule targetschedule(dag, algorithm, targets);
+
+        // Keep the tasks to keep them from being cancelled
+        std::vector<Task> tasks;
+        for (int i=0; i<30; i++)
+            tasks.push_back (targetschedule.getTask (engine));
+
+        // prio 0 has twice the weight of prio -1
+        EXCEPTION_ASSERT_EQUALS(heightmap_needs->not_started ().count (), 1000u - 200u);
+        EXCEPTION_ASSERT_EQUALS(exporter_needs->not_started ().count (), 1000u - 100u);
+
+        // A target with a deadline should get the very next task
+        Timer t;
+        playback_needs->updateNeeds(Signal::Interval(0,50),Signal::Interval::IntervalType_MIN,10,1);
+        Task task = targetschedule.getTask (engine);
+        double latency = t.elapsed ();
+        EXCEPTION_ASSERT(task);
+        EXCEPTION_ASSERT_EQUALS(task.expected_output(), Signal::Interval(0,10));
+        EXCEPTION_ASSERT_EQUALS(playback_needs->not_started (), Signal::Interval(10,50));
+        tasks.push_back (std::move(task));
+
+        TaskInfo(boost::format("Latency to first playback task with %d tasks in flight: %s")
+                 % (tasks.size ()-1) % TaskTimer::timeToString (latency));
+
+        // And keep getting all tasks until it doesn't need anything more
+        for (int i=0; i<4; i++)
+            tasks.push_back (targetschedule.getTask (engine));
+        EXCEPTION_ASSERT(!playback_needs->not_started ());
+        EXCEPTION_ASSERT_EQUALS(heightmap_needs->not_started ().count (), 1000u - 200u);
+        EXCEPTION_ASSERT_EQUALS(exporter_needs->not_started ().count (), 1000u - 100u);
+
+        // After which the others continue where they were
+        for (int i=0; i<3; i++)
+            tasks.push_back (targetschedule.getTask (engine));
+        EXCEPTION_ASSERT_EQUALS(heightmap_needs->not_started ().count (), 1000u - 220u);
+        EXCEPTION_ASSERT_EQUALS(exporter_needs->not_started ().count (), 1000u - 110u);
+    }
+
+    // It should spread a batch of tasks across targets in the same way
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr heightmap(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr exporter(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr playback(new Step(Signal::OperationDesc::ptr()));
+        dag.write ()->appendStep(heightmap);
+        dag.write ()->appendStep(exporter);
+        dag.write ()->appendStep(playback);
+        IScheduleAlgorithm::ptr algorithm(new TakeFirstAlgorithmMockup);
+        Bedroom::ptr bedroom(new Bedroom);
+        BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
+        Targets::ptr targets(new Targets(notifier));
+        Signal::ComputingEngine::ptr engine;
+
+        TargetNeeds::ptr heightmap_needs ( targets->addTarget(heightmap) );
+        TargetNeeds::ptr exporter_needs ( targets->addTarget(exporter) );
+        TargetNeeds::ptr playback_needs ( targets->addTarget(playback) );
+        heightmap_needs->updateNeeds(Signal::Interval(0,1000),0,10,0);
+        exporter_needs->updateNeeds(Signal::Interval(0,1000),0,10,-1);
+
+        TargetSchedule targetschedule(dag, algorithm, targets);
+
+        std::vector<Task> tasks = targetschedule.getTasks (engine, 30);
+        EXCEPTION_ASSERT_EQUALS(tasks.size (), 30u);
+        EXCEPTION_ASSERT_EQUALS(heightmap_needs->not_started ().count (), 1000u - 200u);
+        EXCEPTION_ASSERT_EQUALS(exporter_needs->not_started ().count (), 1000u - 100u);
+
+        // A target with a deadline should get all of the next batch
+        playback_needs->updateNeeds(Signal::Interval(0,50),Signal::Interval::IntervalType_MIN,10,1);
+        std::vector<Task> tasks2 = targetschedule.getTasks (engine, 4);
+        EXCEPTION_ASSERT_EQUALS(tasks2.size (), 4u);
+        EXCEPTION_ASSERT_EQUALS(playback_needs->not_started (), Signal::Interval(40,50));
+        EXCEPTION_ASSERT_EQUALS(heightmap_needs->not_started ().count (), 1000u - 200u);
+    }
+
+    // It should prefetch only when nothing needed can be started, in the
+    // step below the target
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr source(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr heightmap(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr exporter(new Step(Signal::OperationDesc::ptr()));
+        GraphVertex v = dag.write ()->appendStep(source);
+        dag.write ()->appendStep(heightmap, v);
+        dag.write ()->appendStep(exporter);
+        IScheduleAlgorithm::ptr algorithm(new TakeFirstAlgorithmMockup);
+        Bedroom::ptr bedroom(new Bedroom);
+        BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
+        Targets::ptr targets(new Targets(notifier));
+        Signal::ComputingEngine::ptr engine;
+
+        TargetNeeds::ptr heightmap_needs ( targets->addTarget(heightmap) );
+        TargetNeeds::ptr exporter_needs ( targets->addTarget(exporter) );
+        heightmap_needs->updateNeeds(Signal::Interval(0,20),0,10,0);
+        heightmap_needs->updatePrefetch(Signal::Interval(0,50));
+        exporter_needs->updateNeeds(Signal::Interval(0,10),0,10,-1);
+
+        TargetSchedule targetschedule(dag, algorithm, targets);
+
+        std::vector<Task> tasks = targetschedule.getTasks (engine, 3);
+        EXCEPTION_ASSERT_EQUALS(tasks.size (), 3u);
+        EXCEPTION_ASSERT(!heightmap_needs->not_started ());
+        EXCEPTION_ASSERT(!exporter_needs->not_started ());
+        EXCEPTION_ASSERT_EQUALS(heightmap.read ()->not_started (), ~Signal::Intervals(0,20));
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started (), Signal::Intervals::Intervals_ALL);
+
+        std::vector<Task> tasks2 = targetschedule.getTasks (engine, 2);
+        EXCEPTION_ASSERT_EQUALS(tasks2.size (), 2u);
+        EXCEPTION_ASSERT_EQUALS(tasks2[0].expected_output (), Signal::Interval(20,30));
+        EXCEPTION_ASSERT_EQUALS(tasks2[1].expected_output (), Signal::Interval(30,40));
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started (), ~Signal::Intervals(20,40));
+        EXCEPTION_ASSERT_EQUALS(heightmap.read ()->not_started (), ~Signal::Intervals(0,20));
+
+        // A new prefetch replaces the old one
+        heightmap_needs->updatePrefetch(Signal::Interval(-30,0));
+        Task task = targetschedule.getTask (engine);
+        EXCEPTION_ASSERT(task);
+        EXCEPTION_ASSERT_EQUALS(task.expected_output (), Signal::Interval(-10,0));
+    }
+
+    // It should prefetch the input that the target needs to compute the
+    // prefetched samples
+    {
+        Dag::ptr dag(new Dag);
+        Step::ptr source(new Step(Signal::OperationDesc::ptr()));
+        Step::ptr heightmap(new Step(Signal::OperationDesc::ptr(new OverlappingChunksDescMockup)));
+        GraphVertex v = dag.write ()->appendStep(source);
+        dag.write ()->appendStep(heightmap, v);
+        IScheduleAlgorithm::ptr algorithm(new TakeFirstAlgorithmMockup);
+        Bedroom::ptr bedroom(new Bedroom);
+        BedroomNotifier::ptr notifier(new BedroomNotifier(bedroom));
+        Targets::ptr targets(new Targets(notifier));
+        Signal::ComputingEngine::ptr engine;
+
+        TargetNeeds::ptr heightmap_needs ( targets->addTarget(heightmap) );
+        heightmap_needs->updateNeeds(Signal::Interval(0,10),0,10,0);
+        heightmap_needs->updatePrefetch(Signal::Interval(20,40));
+
+        TargetSchedule targetschedule(dag, algorithm, targets);
+
+        std::vector<Task> tasks = targetschedule.getTasks (engine, 1);
+        EXCEPTION_ASSERT_EQUALS(tasks.size (), 1u);
+        EXCEPTION_ASSERT_EQUALS(tasks[0].expected_output (), Signal::Interval(0,10));
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started (), Signal::Intervals::Intervals_ALL);
+
+        std::vector<Task> tasks2 = targetschedule.getTasks (engine, 10);
+        EXCEPTION_ASSERT_LESS_OR_EQUAL(1u, tasks2.size ());
+        EXCEPTION_ASSERT_EQUALS(source.read ()->not_started (), ~Signal::Intervals(15,45));
+        EXCEPTION_ASSERT_EQUALS(heightmap.read ()->not_started (), ~Signal::Intervals(0,10));
+    }
 }
 
 
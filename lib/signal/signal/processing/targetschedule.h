@@ -5,11 +5,22 @@
 #include "ischedule.h"
 #include "targets.h"
 
+#include <map>
+
 namespace Signal {
 namespace Processing {
 
 /**
  * @brief The GetDagTask class should provide tasks to keep a Dag up-to-date with respect to all targets.
+ *
+ * Workers are spread across all targets that need something by weight
+ * (stride scheduling). A target with TargetNeeds::prio() p has the weight
+ * 2^p. Targets with a positive prio have a deadline (such as playback) and
+ * preempt all other targets: the next task is taken from them whenever they
+ * need anything.
+ *
+ * Workers that can't start anything needed by any target take tasks from the
+ * prefetch of the targets instead, see TargetNeeds::updatePrefetch.
  */
 class TargetSchedule: public ISchedule {
 public:
@@ -18,14 +29,40 @@ public:
 
     virtual Task getTask(Signal::ComputingEngine::ptr engine) const;
 
+    // Takes the lock of the Dag once for all tasks
+    virtual std::vector<Task> getTasks(Signal::ComputingEngine::ptr engine, int max_tasks) const;
+
 private:
     Targets::ptr targets;
 
     Dag::ptr g;
     IScheduleAlgorithm::ptr algorithm;
 
-    typedef std::pair<Step::ptr, TargetNeeds::State> TargetState;
-    TargetState prioritizedTarget() const;
+    struct TargetState {
+        const TargetNeeds* target;
+        Step::ptr step;
+        TargetNeeds::State state;
+        double pass;
+    };
+
+    struct SchedulingState {
+        struct shared_state_traits : shared_state_traits_backtrace {
+            typedef shared_state_mutex_notimeout_noshared shared_state_mutex;
+        };
+
+        // Virtual time at which each target is next in line
+        std::map<const TargetNeeds*, double> pass;
+        double virtual_time = 0;
+    };
+
+    shared_state<SchedulingState> scheduling_;
+
+    std::vector<TargetState> prioritizedTargets() const;
+    double charge(const TargetState& t) const;
+    static double weight(const TargetState& t);
+    static int share(const TargetState& t, const TargetState& next);
+    static bool inLine(const TargetState& a, const TargetState& b);
+    static Signal::Intervals requiredIntervals(Signal::OperationDesc::ptr desc, const Signal::Intervals& I);
 
 public:
     static void test();
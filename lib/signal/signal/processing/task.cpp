@@ -4,10 +4,13 @@
 #include "demangle.h"
 #include "expectexception.h"
 #include "log.h"
+#include "timer.h"
+#include "tracerecorder.h"
 
 #include <boost/foreach.hpp>
 
 #include <algorithm>
+#include <memory>
 
 //#define TIME_TASK
 #define TIME_TASK if(0)
@@ -118,9 +121,22 @@ void Task::
     TIME_TASK TaskTimer tt(boost::format("Task::run %1%")
                            % od.raw ()->toString ().toStdString ());
 
+    std::unique_ptr<TraceScope> trace;
+    if (TraceRecorder::enabled ())
+        trace.reset (new TraceScope((boost::format("%s %s")
+                                     % od.raw ()->toString ().toStdString ()
+                                     % expected_output_).str ()));
+
     Signal::Operation::ptr o = this->operation_;
 
     Signal::pBuffer input_buffer, output_buffer;
+    Timer busy;
+
+    if (superseded ())
+    {
+        cancel ();
+        return;
+    }
 
     {
         TIME_TASK TaskTimer tt(boost::format("expect  %s")
@@ -128,14 +144,36 @@ void Task::
         input_buffer = get_input();
     }
 
+    // The output might have been deprecated while reading the input
+    if (superseded ())
+    {
+        cancel ();
+        return;
+    }
+
     {
         TIME_TASK TaskTimer tt(boost::format("process %s") % input_buffer->getInterval ());
         output_buffer = o->process (input_buffer);
+        step_.raw ()->counters ().task (expected_output_, busy.elapsed ());
         finish(output_buffer);
     }
 }
 
 
+bool Task::
+        superseded() const
+{
+    return step_.read ()->superseded (task_id_);
+}
+
+
+bool Task::
+        deprecated() const
+{
+    return step_.read ()->deprecated (task_id_);
+}
+
+
 Signal::pBuffer Task::
         get_input() const
 {
@@ -250,6 +288,29 @@ void Task::
 
         EXCEPTION_ASSERT(expected_r == *r);
     }
+
+    // It should cancel itself if its output is deprecated before it is computed
+    {
+        class ProcessCounter: public Signal::Operation {
+        public:
+            int processed = 0;
+            Signal::pBuffer process(Signal::pBuffer b) { processed++; return b; }
+        };
+
+        Signal::OperationDesc::ptr od(new BufferSource(Test::RandomBuffer::smallBuffer ()));
+        Step::ptr step (new Step(od));
+        Signal::Interval expected_output(60,70);
+        std::shared_ptr<ProcessCounter> o(new ProcessCounter);
+
+        Task t(step.write (), step, std::vector<Step::const_ptr>(), o, expected_output, expected_output);
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started (), ~Signal::Intervals(expected_output));
+
+        step.write ()->deprecateCache (Signal::Intervals::Intervals_ALL);
+        t.run ();
+
+        EXCEPTION_ASSERT_EQUALS(o->processed, 0);
+        EXCEPTION_ASSERT_EQUALS(step.read ()->not_started (), Signal::Intervals::Intervals_ALL);
+    }
 }
 
 
@@ -17,6 +17,9 @@ namespace Processing {
  *
  * If the Task fails, the section of the cache that was supposed to be filled
  * by this Task should be invalidated.
+ *
+ * It should cancel itself if its output is deprecated before it is computed,
+ * see Step::superseded.
  */
 class Task
 {
@@ -42,6 +45,12 @@ public:
 
     Signal::Interval        expected_output() const;
 
+    /**
+     * @brief deprecated is true if any of the expected output has been
+     * deprecated since the task was created, see Step::deprecated.
+     */
+    bool                    deprecated() const;
+
     virtual void run();
 
 private:
@@ -53,6 +62,7 @@ private:
     Signal::Interval        required_input_;
 
     void                    run_private();
+    bool                    superseded() const;
     Signal::pBuffer         get_input() const;
     void                    finish(Signal::pBuffer);
     void                    cancel();
@@ -0,0 +1,112 @@
+#include "velocityprefetch.h"
+
+#include "exceptionassert.h"
+
+#include <cmath>
+
+namespace Signal {
+namespace Processing {
+
+VelocityPrefetch::
+        VelocityPrefetch(double lookahead, double smoothing)
+    :
+      lookahead_(lookahead),
+      smoothing_(smoothing),
+      velocity_(0),
+      has_last_(false),
+      last_center_(0),
+      last_t_(0)
+{
+}
+
+
+Signal::Interval VelocityPrefetch::
+        update(Signal::IntervalType center, double t)
+{
+    if (!has_last_)
+    {
+        has_last_ = true;
+        last_center_ = center;
+        last_t_ = t;
+        return Signal::Interval();
+    }
+
+    double dt = t - last_t_;
+    if (dt > 0)
+    {
+        double v = (center - last_center_) / dt;
+
+        if (v * velocity_ < 0)
+            velocity_ = v; // Changed direction, start over
+        else
+            velocity_ += (1 - std::exp(-dt/smoothing_)) * (v - velocity_);
+
+        last_center_ = center;
+        last_t_ = t;
+    }
+
+    double distance = velocity_ * lookahead_;
+    if (std::fabs(distance) < 1)
+        return Signal::Interval();
+
+    double end = std::max((double)Signal::Interval::IntervalType_MIN,
+                 std::min((double)Signal::Interval::IntervalType_MAX,
+                          center + distance));
+
+    if (distance > 0)
+        return Signal::Interval(center, (Signal::IntervalType)end);
+    else
+        return Signal::Interval((Signal::IntervalType)end, center);
+}
+
+
+double VelocityPrefetch::
+        velocity() const
+{
+    return velocity_;
+}
+
+
+void VelocityPrefetch::
+        test()
+{
+    // It should predict which samples a target will need next from how its
+    // work center moves.
+    {
+        VelocityPrefetch p(2, 0.25);
+        EXCEPTION_ASSERT_EQUALS(p.update (1000, 0), Signal::Interval());
+
+        // Scrolling forwards at 600 samples per second
+        Signal::Interval I;
+        for (int i=1; i<=120; i++)
+            I = p.update (1000 + 10*i, i/60.);
+        EXCEPTION_ASSERT_LESS(590, p.velocity ());
+        EXCEPTION_ASSERT_LESS(p.velocity (), 610);
+        EXCEPTION_ASSERT_EQUALS(I.first, 2200);
+        EXCEPTION_ASSERT_LESS(2200 + 1180, I.last);
+        EXCEPTION_ASSERT_LESS(I.last, 2200 + 1220);
+
+        // Turning around should drop the prefetch ahead at once
+        I = p.update (2190, 121/60.);
+        EXCEPTION_ASSERT_LESS(p.velocity (), 0);
+        EXCEPTION_ASSERT_EQUALS(I.last, 2190);
+        EXCEPTION_ASSERT_LESS(I.first, 2190 - 1000);
+
+        // Standing still should end the prefetch
+        for (int i=122; i<=240; i++)
+            I = p.update (2190, i/60.);
+        EXCEPTION_ASSERT_EQUALS(I, Signal::Interval());
+    }
+
+    // It should not prefetch without motion
+    {
+        VelocityPrefetch p;
+        EXCEPTION_ASSERT_EQUALS(p.update (-5, 1), Signal::Interval());
+        EXCEPTION_ASSERT_EQUALS(p.update (-5, 2), Signal::Interval());
+        EXCEPTION_ASSERT_EQUALS(p.update (-5, 2), Signal::Interval());
+        EXCEPTION_ASSERT_EQUALS(p.velocity (), 0);
+    }
+}
+
+} // namespace Processing
+} // namespace Signal
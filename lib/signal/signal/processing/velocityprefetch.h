@@ -0,0 +1,53 @@
+#ifndef SIGNAL_PROCESSING_VELOCITYPREFETCH_H
+#define SIGNAL_PROCESSING_VELOCITYPREFETCH_H
+
+#include "signal/intervals.h"
+
+namespace Signal {
+namespace Processing {
+
+/**
+ * @brief The VelocityPrefetch class should predict which samples a target
+ * will need next from how its work center moves.
+ *
+ * The velocity of the work center is smoothed over time constant 'smoothing'
+ * and the samples it is expected to pass within 'lookahead' seconds are
+ * returned as prefetch. When the direction changes the velocity starts over
+ * from the latest motion, so the prefetch never points backwards.
+ *
+ * Give the prefetch to TargetNeeds::updatePrefetch.
+ */
+class VelocityPrefetch
+{
+public:
+    VelocityPrefetch(double lookahead=2, double smoothing=0.25);
+
+    /**
+     * @arg center The current work center.
+     * @arg t Wall time in seconds, increasing.
+     * @return Samples ahead of 'center' that will be needed soon. Empty if
+     *         the work center doesn't move.
+     */
+    Signal::Interval update(Signal::IntervalType center, double t);
+
+    /**
+     * @brief velocity in samples per second, positive forwards.
+     */
+    double velocity() const;
+
+private:
+    double lookahead_;
+    double smoothing_;
+    double velocity_;
+    bool has_last_;
+    Signal::IntervalType last_center_;
+    double last_t_;
+
+public:
+    static void test();
+};
+
+} // namespace Processing
+} // namespace Signal
+
+#endif // SIGNAL_PROCESSING_VELOCITYPREFETCH_H
@@ -2,6 +2,7 @@
 #include "task.h"
 #include "tasktimer.h"
 #include "demangle.h"
+#include "tracerecorder.h"
 
 //#define UNITTEST_STEPS
 #define UNITTEST_STEPS if(0)
@@ -15,6 +16,7 @@ namespace Processing {
 class QTerminatableThread : public QThread {
 public:
     void run() {
+        TraceRecorder::setThreadName (objectName ().toStdString ());
         setTerminationEnabled ();
         QThread::run ();
     }
@@ -22,10 +24,12 @@ public:
 
 
 Worker::
-        Worker (Signal::ComputingEngine::ptr computing_engine, ISchedule::ptr schedule)
+        Worker (Signal::ComputingEngine::ptr computing_engine, ISchedule::ptr schedule, Bedroom::ptr bedroom)
     :
       computing_engine_(computing_engine),
       schedule_(schedule),
+      bedroom_(bedroom),
+      wakeup_dispatched_(false),
       thread_(new QTerminatableThread),
       exception_(new std::exception_ptr())
 {
@@ -47,14 +51,17 @@ Worker::
 
     // Start the worker thread as an event based background thread
     thread_->setParent (this);
-    thread_->setObjectName (QString("Worker %1").arg (computing_engine
-                            ? vartype(*computing_engine).c_str ()
-                            : "(null)"));
+    std::string kind = computing_engine ? vartype(*computing_engine) : "(null)";
+    thread_->setObjectName (QString("Worker %1").arg (kind.c_str ()));
     thread_->start (QThread::IdlePriority);
     moveToThread (thread_);
 
     connect (thread_, SIGNAL(finished()), SLOT(finished()));
 
+    // Called with the bedroom locked, only dispatch
+    if (bedroom_)
+        bed_.reset (new Bedroom::Bed(bedroom_->getBed ([this](){ dispatch_wakeup (); }, kind)));
+
     // Initial check to see if work can begin right away
     wakeup (); // will be dispatched to execute in thread_
 }
@@ -68,6 +75,8 @@ Worker::
     terminate ();
     if (!wait (100))
         TaskInfo("Worker didn't respond to quitting");
+
+    bed_.reset ();
 }
 
 
@@ -109,18 +118,34 @@ std::exception_ptr Worker::
 }
 
 
+const PerfCounters& Worker::
+        counters() const
+{
+    return counters_;
+}
+
+
 void Worker::
         wakeup()
   {
     if (QThread::currentThread () != this->thread ())
       {
-        // Dispatch
-        QMetaObject::invokeMethod (this, "wakeup");
+        dispatch_wakeup ();
         return;
       }
 
     DEBUGINFO TaskInfo("worker: wakeup");
 
+    wakeup_dispatched_ = false;
+    counters_.idle (idle_timer_.elapsed ());
+
+    if (bed_)
+      {
+        bed_->awake ();
+        if (0 < bed_->latency ())
+            counters_.wakeup (bed_->latency ());
+      }
+
     try
       {
         // Let exception_ mark unexpected termination.
@@ -137,6 +162,8 @@ void Worker::
         QThread::currentThread ()->requestInterruption ();
       }
 
+    idle_timer_.restart ();
+
     if (QThread::currentThread ()->isInterruptionRequested ())
       {
         QThread::currentThread ()->quit ();
@@ -144,10 +171,24 @@ void Worker::
   }
 
 
+void Worker::
+        dispatch_wakeup()
+  {
+    // Queue one call at a time, the loop in that call finds all tasks
+    if (!wakeup_dispatched_.exchange (true))
+        QMetaObject::invokeMethod (this, "wakeup");
+  }
+
+
 void Worker::
         finished()
   {
     DEBUGINFO TaskInfo("worker: finished");
+
+    // Let the other workers take over
+    if (bedroom_)
+        bedroom_->wakeup ();
+
     moveToThread (0); // important. otherwise 'thread_' will try to delete 'this', but 'this' owns 'thread_' -> crash.
     emit finished(*exception_.read (), computing_engine_);
   }
@@ -162,15 +203,37 @@ void Worker::
 
         {
             DEBUGINFO TaskTimer tt(boost::format("worker: get task %s %s") % vartype(*schedule_.get ()) % (computing_engine_?vartype(*computing_engine_):"(null)") );
+            Timer t;
             task = schedule_->getTask(computing_engine_);
+            counters_.scheduling (t.elapsed ());
         }
 
         if (task)
           {
+            // There might be more tasks, let one more worker have a look
+            if (bedroom_)
+                bedroom_->wakeup (1);
+
             DEBUGINFO TaskTimer tt(boost::format("worker: running task %s") % task.expected_output());
+            Signal::Interval expected_output = task.expected_output ();
+            Timer t;
             task.run();
+            counters_.task (expected_output, t.elapsed ());
+
+            // The result may let other engines start something that this
+            // engine can't compute, such as ComputingCpu after the null
+            // engine has read a file. This worker looks for more tasks for
+            // its own engine, let one worker of each other engine have a look.
+            if (bed_)
+                bedroom_->wakeupOthers (bed_->kind ());
+
             emit oneTaskDone();
           }
+        else if (bed_ && bed_->park ())
+          {
+            // Woken up while spinning
+            counters_.wakeup (bed_->latency ());
+          }
         else
           {
             DEBUGINFO TaskInfo("worker: back to sleep");
@@ -2,6 +2,8 @@
 #define SIGNAL_PROCESSING_WORKER_H
 
 #include "ischedule.h"
+#include "bedroom.h"
+#include "perfcounters.h"
 #include "signal/computingengine.h"
 
 #include "shared_state.h"
@@ -9,9 +11,14 @@
 #include <QThread>
 #include <QPointer>
 
+#include "timer.h"
+
 #include <boost/exception/all.hpp>
 #include <boost/exception_ptr.hpp>
 
+#include <atomic>
+#include <memory>
+
 namespace Signal {
 namespace Processing {
 
@@ -27,6 +34,11 @@ namespace Processing {
  * In the sense that Worker.terminate () still works;
  *
  * It should announce when tasks are finished.
+ *
+ * It should count the tasks it runs and how its time is spent, see counters.
+ *
+ * With a bedroom it should park in the bedroom when there are no tasks, and
+ * wake up one more worker from the bedroom when it finds a task.
  */
 class Worker: public QObject
 {
@@ -36,7 +48,7 @@ public:
 
     class TerminatedException: virtual public boost::exception, virtual public std::exception {};
 
-    Worker (Signal::ComputingEngine::ptr computing_eninge, ISchedule::ptr schedule);
+    Worker (Signal::ComputingEngine::ptr computing_eninge, ISchedule::ptr schedule, Bedroom::ptr bedroom=Bedroom::ptr());
     ~Worker ();
 
     void abort();
@@ -57,6 +69,14 @@ public:
     //     }
     std::exception_ptr caught_exception() const;
 
+    /**
+     * @brief counters of tasks run by this worker. busy is time spent
+     * running tasks, idle is time spent sleeping and scheduling is time spent
+     * in ISchedule::getTask, including waiting for its locks. Safe to use
+     * from any thread.
+     */
+    const PerfCounters& counters() const;
+
 signals:
     void oneTaskDone();
     void finished(std::exception_ptr, Signal::ComputingEngine::ptr);
@@ -69,14 +89,21 @@ private slots:
 
 private:
     void loop_while_tasks();
+    void dispatch_wakeup();
 
     Signal::ComputingEngine::ptr            computing_engine_;
     ISchedule::ptr                          schedule_;
+    Bedroom::ptr                            bedroom_;
+    std::unique_ptr<Bedroom::Bed>           bed_;
+    std::atomic<bool>                       wakeup_dispatched_;
 
     QThread*                                thread_;
     shared_state<std::exception_ptr>        exception_;
     std::exception_ptr                      terminated_exception_;
 
+    PerfCounters                            counters_;
+    Timer                                   idle_timer_;
+
 public:
     static void test ();
 };
@@ -5,7 +5,6 @@
 #include "workers.h"
 #include "targetschedule.h"
 #include "timer.h"
-#include "bedroomsignaladapter.h"
 #include "demangle.h"
 #include "tasktimer.h"
 
@@ -23,7 +22,7 @@ Workers::
         Workers(ISchedule::ptr schedule, Bedroom::ptr bedroom)
     :
       schedule_(schedule),
-      notifier_(new BedroomSignalAdapter(bedroom, this))
+      bedroom_(bedroom)
 {
 }
 
@@ -33,7 +32,6 @@ Workers::
 {
     try {
         schedule_.reset ();
-        notifier_->quit_and_wait ();
 
         //terminate_workers ();
         remove_all_engines ();
@@ -63,21 +61,15 @@ Worker::ptr Workers::
     if (workers_map_.find (ce) != workers_map_.end ())
         EXCEPTION_ASSERTX(false, "Engine already added");
 
-    Worker::ptr w(new Worker(ce, schedule_));
+    Worker::ptr w(new Worker(ce, schedule_, bedroom_));
     workers_map_[ce] = w;
 
     updateWorkers();
     bool a = connect(&*w,
             SIGNAL(finished(std::exception_ptr,Signal::ComputingEngine::ptr)),
             SIGNAL(worker_quit(std::exception_ptr,Signal::ComputingEngine::ptr)));
-    bool b = connect(notifier_, SIGNAL(wakeup()), &*w, SLOT(wakeup()));
-    bool c = connect(&*w, SIGNAL(oneTaskDone()), notifier_, SIGNAL(wakeup()));
-    bool d = connect((Worker*)&*w, SIGNAL(finished(std::exception_ptr,Signal::ComputingEngine::ptr)), notifier_, SIGNAL(wakeup()));
 
     EXCEPTION_ASSERT(a);
-    EXCEPTION_ASSERT(b);
-    EXCEPTION_ASSERT(c);
-    EXCEPTION_ASSERT(d);
 
     return w;
 }
@@ -335,6 +327,10 @@ void Workers::
 
 #include "expectexception.h"
 #include "bedroom.h"
+#include "bedroomnotifier.h"
+#include "firstmissalgorithm.h"
+#include "targets.h"
+#include "test/operationmockups.h"
 
 #include <QApplication>
 #include <atomic>
@@ -397,6 +393,29 @@ class LockScheduleMock: public BlockScheduleMock {
 };
 
 
+// Only the null engine can compute this source, like Signal::AudiofileDesc
+class NullEngineSourceMock: public Signal::BufferSource {
+public:
+    NullEngineSourceMock(Signal::pBuffer b) : Signal::BufferSource(b) {}
+
+    Signal::Operation::ptr createOperation(Signal::ComputingEngine* engine) const override {
+        return engine ? Signal::Operation::ptr() : Signal::BufferSource::createOperation (engine);
+    }
+};
+
+
+// Only ComputingCpu can compute this operation, like the block filters of
+// MergeChunk
+class CpuOperationDescMock: public Test::TransparentOperationDesc {
+public:
+    Signal::Operation::ptr createOperation(Signal::ComputingEngine* engine) const override {
+        return dynamic_cast<Signal::ComputingCpu*>(engine)
+                ? Test::TransparentOperationDesc::createOperation (engine)
+                : Signal::Operation::ptr();
+    }
+};
+
+
 class BusyScheduleMock: public BlockScheduleMock {
     virtual void dont_return() const override {
         for(;;) usleep(0); // Allow OS scheduling to kill the thread (just "for(;;);" would not)
@@ -511,7 +530,35 @@ void Workers::
     // It should wake up sleeping workers when any work is done to see if they can
     // help out on what's left.
     {
+        UNITTEST_STEPS TaskInfo("It should wake up sleeping workers when any work is done");
 
+        // Workers aren't interchangeable. Only the null engine can compute
+        // the source and only ComputingCpu the step after it, so each task
+        // depends on a task that only the other worker can run.
+        for (int j=0; j<20; j++)
+        {
+            Signal::pBuffer b(new Signal::Buffer(Signal::Interval(0,1000), 1, 1));
+            Dag::ptr dag(new Dag);
+            Step::ptr source(new Step(Signal::OperationDesc::ptr(new NullEngineSourceMock(b))));
+            Step::ptr cpu(new Step(Signal::OperationDesc::ptr(new CpuOperationDescMock)));
+            GraphVertex v = dag.write ()->appendStep(source);
+            dag.write ()->appendStep(cpu, v);
+
+            Bedroom::ptr bedroom(new Bedroom);
+            INotifier::ptr notifier(new BedroomNotifier(bedroom));
+            Targets::ptr targets(new Targets(notifier));
+            TargetNeeds::ptr needs = targets->addTarget(cpu);
+            IScheduleAlgorithm::ptr algorithm(new FirstMissAlgorithm);
+            ISchedule::ptr schedule(new TargetSchedule(dag, algorithm, targets));
+
+            Workers workers(schedule, bedroom);
+            workers.addComputingEngine(Signal::ComputingEngine::ptr());
+            workers.addComputingEngine(Signal::ComputingEngine::ptr(new Signal::ComputingCpu));
+
+            needs->updateNeeds(Signal::Interval(0,1000), 0, 100);
+            EXCEPTION_ASSERT(needs->sleep (1000));
+            EXCEPTION_ASSERT_EQUALS(cpu.read ()->out_of_date () & Signal::Interval(0,1000), Signal::Intervals());
+        }
     }
 }
 
@@ -12,8 +12,6 @@
 namespace Signal {
 namespace Processing {
 
-class BedroomSignalAdapter;
-
 /**
  * @brief The Schedule class should start and stop computing engines as they
  * are added and removed.
@@ -24,7 +22,9 @@ class BedroomSignalAdapter;
  * It should terminate all threads when it's closed.
  *
  * It should wake up sleeping workers when any work is done to see if they can
- * help out on what's left.
+ * help out on what's left. Workers park in 'bedroom' and a worker that finds
+ * a task wakes up one more, so only as many workers as there are tasks to
+ * start are woken up.
  */
 class Workers: public QObject
 {
@@ -101,7 +101,7 @@ signals:
 
 private:
     ISchedule::ptr schedule_;
-    BedroomSignalAdapter* notifier_;
+    Bedroom::ptr bedroom_;
 
     Engines workers_;
 
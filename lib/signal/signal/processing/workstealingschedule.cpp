@@ -0,0 +1,318 @@
+#include "workstealingschedule.h"
+
+#include "tasktimer.h"
+
+//#define DEBUGINFO
+#define DEBUGINFO if(0)
+
+namespace Signal {
+namespace Processing {
+
+WorkStealingSchedule::
+        WorkStealingSchedule(ISchedule::ptr schedule, int batch_size)
+    :
+      schedule_(schedule),
+      batch_size_(batch_size)
+{
+    EXCEPTION_ASSERT(schedule_);
+    EXCEPTION_ASSERT_LESS(0, batch_size_);
+}
+
+
+Task WorkStealingSchedule::
+        getTask(Signal::ComputingEngine::ptr engine) const
+{
+    if (!dynamic_cast<Signal::ComputingCpu*>(engine.get ()))
+        return schedule_->getTask (engine);
+
+    TaskQueuePtr own = queue(engine);
+
+    while (Task task = take(own))
+    {
+        // Cancel tasks that would compute samples that have been deprecated
+        // while the task was waiting in the queue
+        if (!task.deprecated ())
+            return task;
+
+        DEBUGINFO TaskInfo(boost::format("WorkStealingSchedule: dropped deprecated task %s") % task.expected_output ());
+    }
+
+    std::vector<Task> tasks = schedule_->getTasks (engine, batch_size_);
+    DEBUGINFO TaskInfo(boost::format("WorkStealingSchedule: fetched %d tasks") % tasks.size ());
+
+    if (tasks.empty ())
+        return Task();
+
+    std::lock_guard<std::mutex> l(own->lock);
+    for (size_t i=1; i<tasks.size (); i++)
+        own->tasks.push_back (std::move(tasks[i]));
+
+    return std::move(tasks.front ());
+}
+
+
+size_t WorkStealingSchedule::
+        prefetched_tasks() const
+{
+    std::lock_guard<std::mutex> l(queues_mutex_);
+
+    size_t n = 0;
+    for (const auto& q : queues_)
+    {
+        std::lock_guard<std::mutex> ql(q.second->lock);
+        n += q.second->tasks.size ();
+    }
+    return n;
+}
+
+
+WorkStealingSchedule::TaskQueuePtr WorkStealingSchedule::
+        queue(const Signal::ComputingEngine::ptr& engine) const
+{
+    // Tasks in queues of released engines are cancelled when 'released' goes
+    // out of scope, after queues_mutex_ is unlocked
+    std::vector<TaskQueuePtr> released;
+
+    std::lock_guard<std::mutex> l(queues_mutex_);
+
+    for (Queues::iterator i = queues_.begin (); i != queues_.end ();)
+    {
+        if (i->first.expired ())
+        {
+            released.push_back (i->second);
+            i = queues_.erase (i);
+        }
+        else
+            i++;
+    }
+
+    TaskQueuePtr& q = queues_[engine];
+    if (!q)
+        q.reset (new TaskQueue);
+    return q;
+}
+
+
+Task WorkStealingSchedule::
+        take(const TaskQueuePtr& own) const
+{
+    {
+        std::lock_guard<std::mutex> l(own->lock);
+        if (!own->tasks.empty ())
+        {
+            Task task = std::move(own->tasks.front ());
+            own->tasks.pop_front ();
+            return task;
+        }
+    }
+
+    return steal(own);
+}
+
+
+Task WorkStealingSchedule::
+        steal(const TaskQueuePtr& own) const
+{
+    std::vector<TaskQueuePtr> victims;
+    {
+        std::lock_guard<std::mutex> l(queues_mutex_);
+        for (const auto& q : queues_)
+            if (q.second != own)
+                victims.push_back (q.second);
+    }
+
+    // Take from the back, the owner takes from the front. Don't wait for a
+    // busy queue, whoever holds the lock is about to take a task anyway.
+    for (const TaskQueuePtr& q : victims)
+    {
+        std::unique_lock<std::mutex> l(q->lock, std::try_to_lock);
+        if (l && !q->tasks.empty ())
+        {
+            Task task = std::move(q->tasks.back ());
+            q->tasks.pop_back ();
+            return task;
+        }
+    }
+
+    return Task();
+}
+
+} // namespace Processing
+} // namespace Signal
+
+#include "timer.h"
+
+#include <atomic>
+#include <thread>
+
+namespace Signal {
+namespace Processing {
+
+class NumberedTasksScheduleMock: public ISchedule
+{
+public:
+    NumberedTasksScheduleMock(int number_of_tasks)
+        :
+          step(new Step(Signal::OperationDesc::ptr())),
+          number_of_tasks(number_of_tasks),
+          next_task(0),
+          get_tasks_count(0)
+    {}
+
+    virtual Task getTask(Signal::ComputingEngine::ptr) const override {
+        auto s = step.write ();
+        return nextTask(s);
+    }
+
+    virtual std::vector<Task> getTasks(Signal::ComputingEngine::ptr, int max_tasks) const override {
+        get_tasks_count++;
+
+        std::vector<Task> tasks;
+        auto s = step.write ();
+        for (int i=0; i<max_tasks; i++)
+        {
+            Task task = nextTask(s);
+            if (!task)
+                break;
+            tasks.push_back (std::move(task));
+        }
+        return tasks;
+    }
+
+    Step::ptr step;
+    const int number_of_tasks;
+    mutable int next_task;
+    mutable std::atomic<int> get_tasks_count;
+
+private:
+    Task nextTask(const shared_state<Step>::write_ptr& s) const {
+        if (next_task >= number_of_tasks)
+            return Task();
+
+        Signal::Interval I(next_task, next_task+1);
+        next_task++;
+        return Task(s, step, std::vector<Step::const_ptr>(), Signal::Operation::ptr(), I, Signal::Interval());
+    }
+};
+
+
+void WorkStealingSchedule::
+        test()
+{
+    // It should let ComputingCpu workers take tasks from per-worker queues of
+    // prefetched tasks instead of querying the scheduler for each task.
+    {
+        auto mock = new NumberedTasksScheduleMock(100);
+        ISchedule::ptr inner(mock);
+        WorkStealingSchedule schedule(inner, 4);
+        Signal::ComputingEngine::ptr a(new Signal::ComputingCpu);
+        Signal::ComputingEngine::ptr b(new Signal::ComputingCpu);
+
+        Task t1 = schedule.getTask (a);
+        EXCEPTION_ASSERT_EQUALS(t1.expected_output (), Signal::Interval(0,1));
+        EXCEPTION_ASSERT_EQUALS(mock->get_tasks_count, 1);
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 3u);
+
+        Task t2 = schedule.getTask (a);
+        EXCEPTION_ASSERT_EQUALS(t2.expected_output (), Signal::Interval(1,2));
+
+        // It should steal a task from another ComputingCpu worker before it
+        // asks the scheduler for more
+        Task t3 = schedule.getTask (b);
+        EXCEPTION_ASSERT_EQUALS(t3.expected_output (), Signal::Interval(3,4));
+        EXCEPTION_ASSERT_EQUALS(mock->get_tasks_count, 1);
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 1u);
+
+        // Other computing engines should ask the scheduler directly
+        Task t4 = schedule.getTask (Signal::ComputingEngine::ptr());
+        EXCEPTION_ASSERT_EQUALS(t4.expected_output (), Signal::Interval(4,5));
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 1u);
+    }
+
+    // It should drop prefetched tasks whose output has been deprecated since
+    // they were fetched.
+    {
+        auto mock = new NumberedTasksScheduleMock(100);
+        ISchedule::ptr inner(mock);
+        WorkStealingSchedule schedule(inner, 4);
+        Signal::ComputingEngine::ptr a(new Signal::ComputingCpu);
+
+        Task t1 = schedule.getTask (a);
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 3u);
+
+        mock->step.write ()->deprecateCache (Signal::Interval(1,2));
+        Task t2 = schedule.getTask (a);
+        EXCEPTION_ASSERT_EQUALS(t2.expected_output (), Signal::Interval(2,3));
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 1u);
+        EXCEPTION_ASSERT(mock->step.read ()->not_started ().contains (Signal::Interval(1,2)));
+    }
+
+    // It should drop the queue of a computing engine that has been released.
+    {
+        auto mock = new NumberedTasksScheduleMock(100);
+        ISchedule::ptr inner(mock);
+        WorkStealingSchedule schedule(inner, 4);
+        Signal::ComputingEngine::ptr a(new Signal::ComputingCpu);
+        Signal::ComputingEngine::ptr b(new Signal::ComputingCpu);
+
+        Task t1 = schedule.getTask (a);
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 3u);
+        a.reset ();
+
+        // The prefetched tasks of 'a' are cancelled instead of stolen
+        Task t2 = schedule.getTask (b);
+        EXCEPTION_ASSERT_EQUALS(t2.expected_output (), Signal::Interval(4,5));
+        EXCEPTION_ASSERT_EQUALS(schedule.prefetched_tasks (), 3u);
+        EXCEPTION_ASSERT(mock->step.read ()->not_started ().contains (Signal::Interval(1,4)));
+    }
+
+    // It should hand out each task exactly once and scale with the number of
+    // workers.
+    {
+        const int N = 20000;
+        int max_threads = std::min(64, 2*(int)std::max(1u, std::thread::hardware_concurrency ()));
+
+        for (int threads=1; threads<=max_threads; threads*=2)
+        {
+            double T[2];
+            for (int batch_size : {1, 16})
+            {
+                ISchedule::ptr inner(new NumberedTasksScheduleMock(N));
+                WorkStealingSchedule schedule(inner, batch_size);
+                std::vector<Signal::Intervals> done(threads);
+                std::vector<int> count(threads, 0);
+                std::vector<std::thread> workers;
+
+                Timer t;
+                for (int i=0; i<threads; i++)
+                    workers.push_back (std::thread([&schedule, &done, &count, i]() {
+                        Signal::ComputingEngine::ptr engine(new Signal::ComputingCpu);
+                        while (Task task = schedule.getTask (engine))
+                        {
+                            done[i] |= task.expected_output ();
+                            count[i]++;
+                        }
+                    }));
+                for (std::thread& w : workers)
+                    w.join ();
+                T[batch_size > 1] = t.elapsed ();
+
+                Signal::Intervals all;
+                int total = 0;
+                for (int i=0; i<threads; i++)
+                {
+                    all |= done[i];
+                    total += count[i];
+                }
+                EXCEPTION_ASSERT_EQUALS(all, Signal::Intervals(0,N));
+                EXCEPTION_ASSERT_EQUALS(total, N);
+            }
+
+            TaskInfo(boost::format("%d workers: %s tasks/s in batches of 16, %s tasks/s one at a time")
+                     % threads % int(N/T[1]) % int(N/T[0]));
+        }
+    }
+}
+
+} // namespace Processing
+} // namespace Signal
@@ -0,0 +1,74 @@
+#ifndef SIGNAL_PROCESSING_WORKSTEALINGSCHEDULE_H
+#define SIGNAL_PROCESSING_WORKSTEALINGSCHEDULE_H
+
+#include "ischedule.h"
+#include "task.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Signal {
+namespace Processing {
+
+/**
+ * @brief The WorkStealingSchedule class should let ComputingCpu workers take
+ * tasks from per-worker queues of prefetched tasks instead of querying the
+ * scheduler for each task.
+ *
+ * When a worker runs out of tasks it should steal a task from another
+ * ComputingCpu worker before it asks the scheduler for a new batch of
+ * 'batch_size' tasks. The scheduler takes the lock of the Dag once per batch
+ * instead of once per task.
+ *
+ * Other computing engines should ask the scheduler directly as tasks can only
+ * run on the kind of engine they were created for.
+ *
+ * Prefetched tasks are already registered in their Step, so targets with a
+ * deadline may have to wait for up to 'batch_size' tasks per worker.
+ *
+ * It should drop prefetched tasks whose output has been deprecated since they
+ * were fetched, the scheduler finds new tasks for that output. It should drop
+ * the queue of a computing engine that has been released.
+ */
+class WorkStealingSchedule: public ISchedule
+{
+public:
+    WorkStealingSchedule(ISchedule::ptr schedule, int batch_size=4);
+
+    virtual Task getTask(Signal::ComputingEngine::ptr engine) const override;
+
+    /**
+     * @brief prefetched_tasks is the number of tasks currently waiting in any queue.
+     */
+    size_t prefetched_tasks() const;
+
+private:
+    struct TaskQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    typedef std::shared_ptr<TaskQueue> TaskQueuePtr;
+
+    ISchedule::ptr schedule_;
+    const int batch_size_;
+
+    typedef std::weak_ptr<Signal::ComputingEngine> EngineKey;
+    typedef std::map<EngineKey, TaskQueuePtr, std::owner_less<EngineKey> > Queues;
+
+    mutable std::mutex queues_mutex_;
+    mutable Queues queues_;
+
+    TaskQueuePtr queue(const Signal::ComputingEngine::ptr& engine) const;
+    Task take(const TaskQueuePtr& own) const;
+    Task steal(const TaskQueuePtr& own) const;
+
+public:
+    static void test();
+};
+
+} // namespace Processing
+} // namespace Signal
+
+#endif // SIGNAL_PROCESSING_WORKSTEALINGSCHEDULE_H
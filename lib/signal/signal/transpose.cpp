@@ -67,4 +67,33 @@ void transpose(DataStorage<float>* dest, DataStorage<float>* src)
     }
 }
 
+
+void deinterleave(float* const* dest, const float* src, int channels, int frames)
+{
+    switch(channels)
+    {
+    case 1:
+        memcpy(dest[0], src, sizeof(float)*frames);
+        break;
+    case 2:
+    {
+        float* __restrict a = dest[0];
+        float* __restrict b = dest[1];
+        for (int i=0; i<frames; i++) {
+            a[i] = src[2*i];
+            b[i] = src[2*i + 1];
+        }
+        break;
+    }
+    default:
+        for (int c=0; c<channels; c++) {
+            float* __restrict t = dest[c];
+            const float* d = src + c;
+            for (int i=0; i<frames; i++)
+                t[i] = d[i*channels];
+        }
+        break;
+    }
+}
+
 } // namespace Signal
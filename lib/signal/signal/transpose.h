@@ -7,6 +7,12 @@ namespace Signal {
 
     void transpose(DataStorage<float>* dest, DataStorage<float>* src);
 
+    /**
+     * @brief deinterleave copies 'frames' frames of 'channels' interleaved
+     * samples in 'src' to the separate arrays dest[0] ... dest[channels-1].
+     */
+    void deinterleave(float* const* dest, const float* src, int channels, int frames);
+
 } // namespace Signal
 
 #endif // TRANSPOSE_H
@@ -3,18 +3,23 @@
 #include "signal/buffer.h"
 #include "signal/cache.h"
 #include "signal/processing/bedroom.h"
+#include "signal/processing/cachebudget.h"
 #include "signal/processing/chain.h"
 #include "signal/processing/dag.h"
 #include "signal/processing/firstmissalgorithm.h"
 #include "signal/processing/graphinvalidator.h"
+#include "signal/processing/perfcounters.h"
+#include "signal/processing/persistentcache.h"
 #include "signal/processing/step.h"
 #include "signal/processing/targetmarker.h"
 #include "signal/processing/targetneeds.h"
 #include "signal/processing/targets.h"
 #include "signal/processing/targetschedule.h"
 #include "signal/processing/task.h"
+#include "signal/processing/velocityprefetch.h"
 #include "signal/processing/worker.h"
 #include "signal/processing/workers.h"
+#include "signal/processing/workstealingschedule.h"
 #include "signal/operationwrapper.h"
 
 // common backtrace tools
@@ -48,19 +53,24 @@ int UnitTest::
         TaskTimer tt("Running tests");
 
         RUNTEST(Signal::Cache);
+        RUNTEST(Signal::Processing::CacheBudget);
         RUNTEST(Signal::Intervals);
         RUNTEST(Signal::Processing::Bedroom);
         RUNTEST(Signal::Processing::Dag);
         RUNTEST(Signal::Processing::FirstMissAlgorithm);
         RUNTEST(Signal::Processing::GraphInvalidator);
+        RUNTEST(Signal::Processing::PerfCounters);
+        RUNTEST(Signal::Processing::PersistentCache);
         RUNTEST(Signal::Processing::Step);
         RUNTEST(Signal::Processing::TargetMarker);
         RUNTEST(Signal::Processing::TargetNeeds);
         RUNTEST(Signal::Processing::Targets);
         RUNTEST(Signal::Processing::TargetSchedule);
         RUNTEST(Signal::Processing::Task);
+        RUNTEST(Signal::Processing::VelocityPrefetch);
         RUNTEST(Signal::Processing::Worker);
         RUNTEST(Signal::Processing::Workers);
+        RUNTEST(Signal::Processing::WorkStealingSchedule);
         RUNTEST(Signal::Processing::Chain); // Chain last
         RUNTEST(Signal::OperationDescWrapper);
 
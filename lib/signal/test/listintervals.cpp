@@ -0,0 +1,221 @@
+#include "listintervals.h"
+
+#include "exceptionassert.h"
+
+#include <boost/foreach.hpp>
+
+using namespace Signal;
+
+namespace Test {
+
+ListIntervals::
+        ListIntervals()
+{
+}
+
+
+ListIntervals::
+        ListIntervals(const Intervals& I)
+    :
+      base(I.begin (), I.end ())
+{
+}
+
+
+ListIntervals& ListIntervals::
+        operator |= (const ListIntervals& b)
+{
+    BOOST_FOREACH (const Interval& r, b)
+        operator |= ( r );
+    return *this;
+}
+
+
+ListIntervals& ListIntervals::
+        operator |= (const Interval& r)
+{
+    if (0==r.count())
+        return *this;
+
+    base::iterator first = base::end();
+    for (base::iterator itr = base::begin(); itr!=base::end(); itr++)
+        if ( r.first <= itr->last && itr->first <= r.last )
+        {
+            first = itr;
+            break;
+        }
+
+    if (first==base::end())
+    {
+        base::iterator itr = base::begin();
+        // find first after
+        while ( itr!=base::end() && itr->first <= r.last)
+            itr++;
+        base::insert( itr, r );
+        return *this;
+    }
+
+    base::iterator last = first;
+    last++;
+    // find first after
+    while (last != base::end() && last->first <= r.last)
+        last++;
+
+    Interval b = r;
+
+    for (base::iterator itr=first; itr!=last; itr++)
+    {
+        b = b.spanned(*itr);
+    }
+
+    base::erase( first, last );
+    base::insert( last, b );
+
+    return *this;
+}
+
+
+ListIntervals& ListIntervals::
+        operator -= (const ListIntervals& b)
+{
+    BOOST_FOREACH (const Interval& r,  b)
+        operator-=( r );
+    return *this;
+}
+
+
+ListIntervals& ListIntervals::
+        operator -= (const Interval& r)
+{
+    if (0==r.count())
+        return *this;
+
+    base::iterator itr = firstIntersecting( r );
+
+    while (itr!=base::end())
+    {
+        Interval& i = *itr;
+        // Check if interval 'itr' intersects with 'r'
+        if ((i & r).count()) {
+
+            // Check if intersection is over the start of 'itr'
+            if (i.first >= r.first && i.last > r.last) {
+                i.first = r.last;
+                itr++;
+            }
+
+            // Check if intersection is over the end of 'itr'
+            else if (i.first < r.first && i.last <= r.last) {
+                i.last = r.first;
+                itr++;
+            }
+
+            // Check if intersection is over the entire 'itr'
+            else if (i.first >= r.first && i.last <= r.last)
+                itr = base::erase( itr );
+
+            // Check if intersection is in the middle of 'itr'
+            else if (i.first < r.first && i.last > r.last) {
+                Interval j(r.last, i.last);
+                itr->last = r.first;
+                itr++;
+                base::insert(itr, j);
+
+            // Else, error
+            } else {
+                EXCEPTION_ASSERT( false );
+            }
+        } else {
+            break;
+        }
+    }
+    return *this;
+}
+
+
+ListIntervals& ListIntervals::
+        operator &= (const ListIntervals& b)
+{
+    ListIntervals rebuild;
+
+    BOOST_FOREACH (const Interval& r,  b) {
+        ListIntervals copy = *this;
+        copy &= r;
+        rebuild |= copy;
+    }
+
+    *this = rebuild;
+
+    if (b.empty())
+        clear();
+
+    return *this;
+}
+
+
+ListIntervals& ListIntervals::
+        operator &= (const Interval& r)
+{
+    if (0==r.count())
+    {
+        clear();
+        return *this;
+    }
+
+    base::iterator itr = firstIntersecting( r );
+    if (itr != base::begin())
+        itr = base::erase(base::begin(), itr);
+
+    while (itr!=base::end())
+    {
+        Interval& i = *itr;
+
+        // Check if interval 'itr' does not intersect with 'r'
+        if (0 == (i & r).count()) {
+            itr = base::erase(itr, base::end());
+
+        } else {
+            i &= r;
+            itr++;
+        }
+    }
+    return *this;
+}
+
+
+Intervals ListIntervals::
+        intervals() const
+{
+    Intervals I;
+    BOOST_FOREACH (const Interval& r, *this)
+        I |= r;
+    return I;
+}
+
+
+ListIntervals::base::iterator ListIntervals::
+        firstIntersecting( const Interval& b )
+{
+    for (base::iterator itr = base::begin(); itr!=base::end(); itr++)
+        if ( (*itr & b).count() )
+            return itr;
+    return base::end();
+}
+
+
+void ListIntervals::
+        test()
+{
+    // It should behave as Signal::Intervals
+    {
+        ListIntervals L(Intervals(10,20) | Interval(30,40));
+        L |= Interval(20,25);
+        L -= Interval(12,14);
+        L &= Interval(11,35);
+
+        Intervals I = Intervals(11,12) | Interval(14,25) | Interval(30,35);
+        EXCEPTION_ASSERT_EQUALS( L.intervals (), I );
+    }
+}
+
+} // namespace Test
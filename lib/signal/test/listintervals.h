@@ -0,0 +1,48 @@
+#ifndef TEST_LISTINTERVALS_H
+#define TEST_LISTINTERVALS_H
+
+#include "signal/intervals.h"
+
+#include <list>
+
+namespace Test {
+
+/**
+ * @brief The ListIntervals class should keep the previous std::list based
+ * implementation of Signal::Intervals as a reference to verify and benchmark
+ * Signal::Intervals against.
+ */
+class ListIntervals: private std::list<Signal::Interval>
+{
+    typedef std::list<Signal::Interval> base;
+public:
+    ListIntervals();
+    ListIntervals(const Signal::Intervals&);
+
+    ListIntervals& operator |= (const ListIntervals&);
+    ListIntervals& operator |= (const Signal::Interval&);
+    ListIntervals& operator -= (const ListIntervals&);
+    ListIntervals& operator -= (const Signal::Interval&);
+    ListIntervals& operator &= (const ListIntervals&);
+    ListIntervals& operator &= (const Signal::Interval&);
+
+    Signal::Intervals intervals() const;
+
+    // STL compliant container
+    typedef base::const_iterator const_iterator;
+    typedef base::const_iterator iterator;
+    const_iterator begin() const { return base::begin(); }
+    const_iterator end() const { return base::end(); }
+    bool empty() const { return base::empty(); }
+    void clear() { base::clear(); }
+
+private:
+    base::iterator firstIntersecting( const Signal::Interval& b );
+
+public:
+    static void test();
+};
+
+} // namespace Test
+
+#endif // TEST_LISTINTERVALS_H
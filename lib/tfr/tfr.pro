@@ -23,6 +23,13 @@ win32: INCLUDEPATH += ../sonicawe-winlib
 macx:exists(/opt/local/include/): INCLUDEPATH += /opt/local/include/ # macports
 macx:exists(/usr/local/include/): INCLUDEPATH += /usr/local/include/ # homebrew
 
+# Build with 'qmake CONFIG+=usefftw' to use FFTW instead of the builtin Ooura fft
+usefftw {
+    SOURCES += tfr/fftw/*.cpp
+    HEADERS += tfr/fftw/*.h
+    CONFIG += fftw
+}
+
 OTHER_FILES += \
     LICENSE \
     *.pro \
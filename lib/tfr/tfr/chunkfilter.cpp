@@ -25,6 +25,13 @@ pTransformDesc ChunkFilterDesc::
 }
 
 
+QString ChunkFilterDesc::
+        persistentId() const
+{
+    return QString();
+}
+
+
 ChunkFilterDesc::ptr ChunkFilterDesc::
         copy() const
 {
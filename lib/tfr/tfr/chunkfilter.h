@@ -76,6 +76,35 @@ public:
     };
 
 
+    /**
+     * @brief The NoFusionTag class describes that 'ChunkFilter::operator ()'
+     * sets ChunkAndInverse::inverse to something else than the inverse of
+     * ChunkAndInverse::chunk. Other filters then can't be applied to the
+     * chunk afterwards, see TransformOperationDesc::fuse.
+     *
+     * Inherit from this class as well as from ChunkFilter.
+     */
+    class NoFusionTag
+    {
+    public:
+        virtual ~NoFusionTag() {}
+    };
+
+
+    /**
+     * @brief The ParallelChannelsTag class describes that 'ChunkFilter::operator ()'
+     * may be called concurrently for different channels of the same buffer.
+     * TransformOperationDesc then processes the channels in parallel.
+     *
+     * Inherit from this class as well as from ChunkFilter.
+     */
+    class ParallelChannelsTag
+    {
+    public:
+        virtual ~ParallelChannelsTag() {}
+    };
+
+
     virtual ~ChunkFilter() {}
 
     /**
@@ -87,6 +116,11 @@ public:
     /**
       Set the number of channels that will get this filter applied.
       May be ignored by the filter if it doesn't matter.
+
+      Called before the filter is applied to any channel of a buffer and
+      never concurrently with operator(). So a filter with
+      ParallelChannelsTag can allocate per-channel state here and then only
+      touch the state of 'chunk.channel' in operator().
       */
     virtual void set_number_of_channels( unsigned ) {}
 };
@@ -109,6 +143,15 @@ public:
     virtual void                            transformDesc(pTransformDesc d);
     virtual ChunkFilterDesc::ptr            copy() const;
 
+    /**
+     * @brief persistentId should describe everything that affects the output
+     * of the filter, except for the transform which is described by
+     * TransformOperationDesc::persistentId.
+     * @return An empty string by default, which means that results of this
+     * filter aren't kept, see Signal::OperationDesc::persistentId.
+     */
+    virtual QString                         persistentId() const;
+
     pTransformDesc                          transformDesc() const;
 
 private:
@@ -0,0 +1,796 @@
+#include "constantq.h"
+
+#include "signal/buffer.h"
+
+#include "demangle.h"
+#include "exceptionassert.h"
+#include "neat_math.h"
+#include "tasktimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+//#define TIME_CONSTANTQ
+#define TIME_CONSTANTQ if(0)
+
+namespace Tfr {
+
+namespace {
+
+/**
+  Largest number of valid samples per chunk, a multiple of 'alignment'.
+  */
+Signal::IntervalType max_chunk_size(Signal::IntervalType alignment)
+{
+    return std::max(alignment, align_down(Signal::IntervalType(1)<<22, alignment));
+}
+
+} // namespace
+
+
+ConstantQDesc::
+        ConstantQDesc(int bins_per_octave, int number_of_octaves)
+    :
+      _bins_per_octave(1),
+      _number_of_octaves(1)
+{
+    this->bins_per_octave (bins_per_octave);
+    this->number_of_octaves (number_of_octaves);
+}
+
+
+TransformDesc::ptr ConstantQDesc::
+        copy() const
+{
+    return TransformDesc::ptr(new ConstantQDesc(*this));
+}
+
+
+pTransform ConstantQDesc::
+        createTransform() const
+{
+    return pTransform(new ConstantQ(*this));
+}
+
+
+float ConstantQDesc::
+        displayedTimeResolution( float /*FS*/, float hz ) const
+{
+    // Standard deviation of a Hann window is about 0.1414 of its length
+    return 0.1414f*q()/hz;
+}
+
+
+FreqAxis ConstantQDesc::
+        freqAxis( float FS ) const
+{
+    FreqAxis fa;
+    fa.setLogarithmic(
+            get_min_hz( FS ),
+            get_max_hz( FS ),
+            nScales() - 1 );
+    return fa;
+}
+
+
+unsigned ConstantQDesc::
+        next_good_size( unsigned current_valid_samples_per_chunk, float /*sample_rate*/ ) const
+{
+    Signal::IntervalType A = alignment ();
+    Signal::IntervalType c = current_valid_samples_per_chunk;
+    return std::min(max_chunk_size (A), A*(c/A + 1));
+}
+
+
+unsigned ConstantQDesc::
+        prev_good_size( unsigned current_valid_samples_per_chunk, float /*sample_rate*/ ) const
+{
+    Signal::IntervalType A = alignment ();
+    Signal::IntervalType c = current_valid_samples_per_chunk;
+    return std::min(max_chunk_size (A), c > A ? A*((c - 1)/A) : A);
+}
+
+
+Signal::Interval ConstantQDesc::
+        requiredInterval( const Signal::Interval& I, Signal::Interval* expectedOutput ) const
+{
+    Signal::IntervalType
+            A = alignment (),
+            S = support (),
+            first = align_down(I.first, A),
+            last = align_up(std::min(I.last, clamped_add(first, max_chunk_size (A))), A);
+
+    if (last <= first)
+        last = first + A;
+
+    if (expectedOutput)
+        *expectedOutput = Signal::Interval(first, last);
+
+    return Signal::Interval(clamped_sub(first, S), clamped_add(last, S));
+}
+
+
+Signal::Interval ConstantQDesc::
+        affectedInterval( const Signal::Interval& I ) const
+{
+    Signal::IntervalType
+            A = alignment (),
+            S = support ();
+
+    return Signal::Interval(
+            align_down(clamped_sub(I.first, S), A),
+            align_up(clamped_add(I.last, S), A));
+}
+
+
+std::string ConstantQDesc::
+        toString() const
+{
+    std::stringstream ss;
+    ss << vartype(*this) << ", "
+       << "bins_per_octave=" << bins_per_octave()
+       << ", number_of_octaves=" << number_of_octaves();
+    return ss.str();
+}
+
+
+bool ConstantQDesc::
+        operator==(const TransformDesc& b) const
+{
+    if (typeid(b)!=typeid(*this))
+        return false;
+
+    const ConstantQDesc* p = dynamic_cast<const ConstantQDesc*>(&b);
+
+    return _bins_per_octave == p->_bins_per_octave &&
+            _number_of_octaves == p->_number_of_octaves;
+}
+
+
+void ConstantQDesc::
+        bins_per_octave( int value )
+{
+    EXCEPTION_ASSERT_LESS( 0, value );
+    _bins_per_octave = value;
+}
+
+
+void ConstantQDesc::
+        number_of_octaves( int value )
+{
+    EXCEPTION_ASSERT_LESS( 0, value );
+    _number_of_octaves = value;
+}
+
+
+float ConstantQDesc::
+        get_min_hz( float fs ) const
+{
+    return get_max_hz( fs )*exp2f( (1.f - nScales())/_bins_per_octave );
+}
+
+
+void ConstantQDesc::
+        set_wanted_min_hz( float min_hz, float fs )
+{
+    float octaves = log2f( get_max_hz( fs )/min_hz ) + 1.f/_bins_per_octave;
+    number_of_octaves( std::max(1, (int)std::ceil( octaves - 1e-4f )) );
+}
+
+
+float ConstantQDesc::
+        q() const
+{
+    return 1.f/(exp2f( 1.f/_bins_per_octave ) - 1.f);
+}
+
+
+float ConstantQDesc::
+        bin_nf( int i ) const
+{
+    return 0.4f*exp2f( float(i - (_bins_per_octave - 1))/_bins_per_octave );
+}
+
+
+int ConstantQDesc::
+        fft_size() const
+{
+    // Fits the window of the lowest bin
+    unsigned n = std::ceil( q()/bin_nf( 0 ) );
+    return spo2g( n - 1 );
+}
+
+
+int ConstantQDesc::
+        increment() const
+{
+    // The main lobe of the shortest window is 4/shortest_window wide. Half of
+    // it within 1/increment keeps the frame operator close to diagonal,
+    // which the inverse depends on.
+    float shortest_window = q()/bin_nf( _bins_per_octave - 1 );
+    return 1 << std::max(0, floor_log2( shortest_window/2 ));
+}
+
+
+int ConstantQDesc::
+        margin_frames() const
+{
+    return int_div_ceil( fft_size ()/2 + 2*decimation_radius () + 2, increment () );
+}
+
+
+Signal::IntervalType ConstantQDesc::
+        alignment() const
+{
+    return Signal::IntervalType(increment ()) << (_number_of_octaves - 1);
+}
+
+
+Signal::IntervalType ConstantQDesc::
+        support() const
+{
+    Signal::IntervalType frame_support = margin_frames ()*increment () + fft_size ()/2;
+    return (Signal::IntervalType(1) << (_number_of_octaves - 1)) * (frame_support + decimation_radius () + 2);
+}
+
+
+ConstantQ::
+        ConstantQ(const ConstantQDesc& desc)
+    :
+      desc_(desc),
+      fft_(FftImplementation::newInstance ())
+{
+    const int N = desc_.fft_size (),
+              B = desc_.bins_per_octave (),
+              D = desc_.decimation_radius ();
+    const float q = desc_.q ();
+
+    TIME_CONSTANTQ TaskTimer tt(boost::format("ConstantQ kernel, %d bins, fft size %d") % B % N);
+
+    kernel_.resize (B);
+    kernel_power_.resize (N/2 + 1, 0.f);
+
+    ChunkData::ptr atom(new ChunkData(N));
+    ChunkData::ptr spectrum(new ChunkData(N));
+    for (int i=0; i<B; i++)
+    {
+        // A Hann windowed complex exponential centered in the frame, scaled
+        // to give the amplitude of a sinusoid
+        float nf = desc_.bin_nf (i);
+        int n = std::min(N, std::max(2, (int)(q/nf + 0.5f)));
+        int start = N/2 - n/2;
+
+        std::vector<float> w(n);
+        float sum = 0;
+        for (int j=0; j<n; j++)
+            sum += w[j] = 0.5f - 0.5f*cos(2*M_PI*(j + 1)/(n + 1));
+
+        ChunkElement* a = atom->getCpuMemory ();
+        std::fill(a, a + N, ChunkElement(0));
+        for (int j=0; j<n; j++)
+            a[start + j] = std::polar(2.f*w[j]/sum, float(2*M_PI*nf*(start + j - N/2)));
+
+        fft_->compute (atom, spectrum, FftDirection_Forward);
+
+        // Keep the significant elements of the positive frequencies
+        const ChunkElement* A = spectrum->getCpuMemory ();
+        float max_abs = 0;
+        for (int m=0; m<=N/2; m++)
+            max_abs = std::max(max_abs, std::abs(A[m]));
+
+        for (int m=0; m<=N/2; m++)
+            if (std::abs(A[m]) > 1e-3f*max_abs)
+            {
+                kernel_[i].push_back (std::make_pair(m, std::conj(A[m])/float(N)));
+                kernel_power_[m] += std::norm(A[m]);
+            }
+    }
+
+    // Half band lowpass filter for decimation by two, a Blackman windowed sinc
+    lowpass_.resize (2*D + 1);
+    float sum = 0;
+    for (int j=-D; j<=D; j++)
+    {
+        double x = M_PI*0.5*j;
+        double sinc = j ? sin(x)/x : 1;
+        double blackman = 0.42 + 0.5*cos(M_PI*j/(D + 1)) + 0.08*cos(2*M_PI*j/(D + 1));
+        sum += lowpass_[j + D] = 0.5*sinc*blackman;
+    }
+    for (float& v : lowpass_)
+        v /= sum;
+}
+
+
+pChunk ConstantQ::
+        operator()( Signal::pMonoBuffer buffer )
+{
+    const int N = desc_.fft_size (),
+              h = desc_.increment (),
+              B = desc_.bins_per_octave (),
+              L = desc_.number_of_octaves (),
+              M = desc_.margin_frames ();
+    const Signal::IntervalType A = desc_.alignment ();
+    const float fs = buffer->sample_rate ();
+    const Signal::Interval I = buffer->getInterval ();
+
+    TIME_CONSTANTQ TaskTimer tt(boost::format("ConstantQ %s, %d octaves") % I % L);
+
+    // Decimate the signal once per octave, octave 'o' holds the samples
+    // [x_first[o], x_last[o]) at its own sample rate
+    std::vector<std::vector<float> > decimated(L);
+    std::vector<const float*> x(L);
+    std::vector<Signal::IntervalType> x_first(L), x_last(L);
+    {
+        TIME_CONSTANTQ TaskTimer tt("Decimating");
+        x[0] = buffer->waveform_data ()->getCpuMemory ();
+        x_first[0] = I.first;
+        x_last[0] = I.last;
+        for (int o=1; o<L; o++)
+        {
+            decimated[o] = decimate (x[o-1], x_first[o-1], x_last[o-1], x_first[o]);
+            x[o] = decimated[o].data ();
+            x_last[o] = x_first[o] + (Signal::IntervalType)decimated[o].size ();
+        }
+    }
+
+    // The output is valid where all octaves have frames with full support.
+    // Don't compute more than requiredInterval asked for.
+    Signal::IntervalType first = clamped_add(I.first, desc_.support ()),
+                         last = clamped_sub(I.last, desc_.support ());
+    for (int o=0; o<L; o++)
+    {
+        Signal::IntervalType scale = Signal::IntervalType(1) << o;
+        first = std::max(first, (x_first[o] + N/2 + M*h)*scale);
+        last = std::min(last, (x_last[o] - N/2 - M*h + h)*scale);
+    }
+    first = align_up(first, A);
+    last = align_down(last, A);
+    EXCEPTION_ASSERT_LESS( first, last );
+    Signal::Interval E(first, last);
+
+    ConstantQChunk* chunk;
+    pChunk r(chunk = new ConstantQChunk);
+
+    for (int o=0; o<L; o++)
+    {
+        Signal::IntervalType step = Signal::IntervalType(h) << o;
+        Signal::IntervalType i0 = E.first/step - M;
+        int F = E.count ()/step + 2*M;
+
+        TIME_CONSTANTQ TaskTimer tt(boost::format("Octave %d, %d frames") % o % F);
+
+        // Two real frames per complex fft, even frames in the real part and
+        // odd frames in the imaginary part
+        int F2 = (F + 1)/2;
+        ChunkData::ptr frames(new ChunkData(N, F2));
+        ChunkElement* f = frames->getCpuMemory ();
+        const float* xo = x[o] - x_first[o];
+        for (int k=0; k<F; k++)
+        {
+            const float* s = xo + (i0 + k)*h - N/2;
+            ChunkElement* d = f + (k/2)*N;
+            if (k%2)
+                for (int n=0; n<N; n++)
+                    d[n].imag (s[n]);
+            else
+                for (int n=0; n<N; n++)
+                    d[n] = ChunkElement(s[n], 0);
+        }
+
+        ChunkData::ptr spectra(new ChunkData(N, F2));
+        fft_->compute (frames, spectra, DataStorageSize(N, F2), FftDirection_Forward);
+
+        pChunk part(new ConstantQChunkPart(o));
+        part->transform_data.reset (new ChunkData(F, B));
+        const ChunkElement* X = spectra->getCpuMemory ();
+        ChunkElement* out = part->transform_data->getCpuMemory ();
+
+#pragma omp parallel for
+        for (int k=0; k<F2; k++)
+        {
+            // Separate the spectra of the two frames while applying the
+            // kernel. even = (z + conj(w))/2, odd = (z - conj(w))/2i with
+            // w = Z[N-m]. Written out to avoid the nan checks of complex
+            // multiplication.
+            const ChunkElement* Z = X + k*N;
+            for (int i=0; i<B; i++)
+            {
+                float er = 0, ei = 0, odr = 0, odi = 0;
+                for (const auto& e : kernel_[i])
+                {
+                    const ChunkElement& z = Z[e.first];
+                    const ChunkElement& w = Z[(N - e.first) & (N - 1)];
+                    float ar = z.real () + w.real (), ai = z.imag () - w.imag ();
+                    float br = z.real () - w.real (), bi = z.imag () + w.imag ();
+                    float kr = e.second.real (), ki = e.second.imag ();
+                    er += ar*kr - ai*ki;
+                    ei += ar*ki + ai*kr;
+                    odr += br*kr - bi*ki;
+                    odi += br*ki + bi*kr;
+                }
+                out[i*F + 2*k] = ChunkElement(0.5f*er, 0.5f*ei);
+                if (2*k + 1 < F)
+                    out[i*F + 2*k + 1] = ChunkElement(0.5f*odi, -0.5f*odr);
+            }
+        }
+
+        float max_hz = ldexpf(desc_.get_max_hz (fs), -o);
+        part->freqAxis.setLogarithmic(
+                max_hz*exp2f( (1.f - B)/B ),
+                max_hz,
+                B - 1 );
+        part->chunk_offset = i0;
+        part->first_valid_sample = M;
+        part->n_valid_samples = F - 2*M;
+        part->sample_rate = fs/step;
+        part->original_sample_rate = fs;
+
+        EXCEPTION_ASSERT_EQUALS( part->getInterval (), E );
+
+        chunk->chunks.push_back (part);
+    }
+
+    chunk->freqAxis = desc_.freqAxis (fs);
+    chunk->chunk_offset = E.first;
+    chunk->first_valid_sample = 0;
+    chunk->n_valid_samples = E.count ();
+    chunk->sample_rate = fs;
+    chunk->original_sample_rate = fs;
+
+    return r;
+}
+
+
+Signal::pMonoBuffer ConstantQ::
+        inverse( pChunk pchunk )
+{
+    ConstantQChunk* chunk = dynamic_cast<ConstantQChunk*>(pchunk.get ());
+    EXCEPTION_ASSERT( chunk );
+
+    const int N = desc_.fft_size (),
+              h = desc_.increment (),
+              B = desc_.bins_per_octave (),
+              L = desc_.number_of_octaves (),
+              D = desc_.decimation_radius (),
+              W = N/2 + 1;
+    EXCEPTION_ASSERT_EQUALS( chunk->chunks.size (), (size_t)L );
+
+    TIME_CONSTANTQ TaskTimer tt(boost::format("ConstantQ::inverse %s") % chunk->getInterval ());
+
+    // Synthesize each octave at its own sample rate
+    std::vector<std::vector<float> > y(L);
+    std::vector<Signal::IntervalType> y_first(L);
+    for (int o=0; o<L; o++)
+    {
+        ConstantQChunkPart* part = dynamic_cast<ConstantQChunkPart*>(chunk->chunks[o].get ());
+        EXCEPTION_ASSERT( part );
+        EXCEPTION_ASSERT_EQUALS( part->octave, o );
+        EXCEPTION_ASSERT_EQUALS( (int)part->nScales (), B );
+
+        // The dual frame is the kernel divided by the frame operator. The
+        // frame operator sums the kernel power of all octaves at the same
+        // frequency, weighted by their frame rate relative to this octave.
+        std::vector<float> gain(W);
+        float max_power = 0;
+        for (int m=0; m<W; m++)
+        {
+            float p = kernel_power_[m];
+            if (o + 1 < L && 2*m < W)
+                p += 0.5f*kernel_power_[2*m];
+            if (0 < o)
+                p += 2.f*0.5f*(kernel_power_[m/2] + kernel_power_[(m+1)/2]);
+            gain[m] = p;
+            max_power = std::max(max_power, p);
+        }
+        for (float& g : gain)
+            g = g > 1e-3f*max_power ? h/g : 0.f;
+
+        int F = part->nSamples ();
+        const ChunkElement* in = part->transform_data->getCpuMemory ();
+        ChunkData::ptr spectra(new ChunkData(W, F));
+        ChunkElement* Z = spectra->getCpuMemory ();
+
+#pragma omp parallel for
+        for (int k=0; k<F; k++)
+        {
+            ChunkElement* Zk = Z + k*W;
+            std::fill (Zk, Zk + W, ChunkElement(0));
+            for (int i=0; i<B; i++)
+            {
+                ChunkElement c = in[i*F + k];
+                for (const auto& e : kernel_[i])
+                    Zk[e.first] += c * std::conj(e.second);
+            }
+            for (int m=0; m<W; m++)
+                Zk[m] *= gain[m];
+        }
+
+        DataStorage<float>::ptr frames(new DataStorage<float>(N, F));
+        fft_->inverse (spectra, frames, DataStorageSize(N, F));
+
+        // Overlap-add
+        const float* f = frames->getCpuMemory ();
+        y_first[o] = part->chunk_offset.asInteger ()*h - N/2;
+        y[o].assign ((F - 1)*h + N, 0.f);
+        for (int k=0; k<F; k++)
+        {
+            float* yk = &y[o][k*h];
+            for (int n=0; n<N; n++)
+                yk[n] += f[k*N + n];
+        }
+    }
+
+    // Interpolate and add the octaves, from the lowest one and up
+    const float* lp = &lowpass_[D];
+    for (int o=L-2; o>=0; o--)
+    {
+        const std::vector<float>& lower = y[o+1];
+        Signal::IntervalType lower_first = y_first[o+1],
+                             lower_last = lower_first + (Signal::IntervalType)lower.size ();
+
+#pragma omp parallel for
+        for (int n=0; n<(int)y[o].size (); n++)
+        {
+            Signal::IntervalType t = y_first[o] + n;
+            float v = 0;
+            for (int j = t%2 ? -(D-1) : 0; j <= (t%2 ? D-1 : 0); j += 2)
+            {
+                Signal::IntervalType m = (t - j)/2;
+                if (lower_first <= m && m < lower_last)
+                    v += 2.f*lp[j]*lower[m - lower_first];
+            }
+            y[o][n] += v;
+        }
+    }
+
+    Signal::Interval E = chunk->getInterval ();
+    EXCEPTION_ASSERT_LESS( y_first[0], E.first + 1 );
+    EXCEPTION_ASSERT_LESS( E.last, y_first[0] + (Signal::IntervalType)y[0].size () + 1 );
+
+    Signal::pMonoBuffer b(new Signal::MonoBuffer(E, chunk->original_sample_rate));
+    const float* y0 = &y[0][E.first - y_first[0]];
+    std::copy (y0, y0 + E.count (), b->waveform_data ()->getCpuMemory ());
+    return b;
+}
+
+
+std::vector<float> ConstantQ::
+        decimate( const float* x, Signal::IntervalType first, Signal::IntervalType last, Signal::IntervalType& first_out ) const
+{
+    const Signal::IntervalType D = desc_.decimation_radius ();
+
+    // Only outputs where the filter has full support
+    first_out = align_up(first + D, Signal::IntervalType(2))/2;
+    Signal::IntervalType last_out = align_down(last - 1 - D, Signal::IntervalType(2))/2 + 1;
+
+    std::vector<float> y(std::max(Signal::IntervalType(0), last_out - first_out));
+    if (y.empty ())
+        return y;
+
+    // Every other tap of a half band filter is zero, and it is symmetric. So
+    // the output is the center tap times the even samples plus a symmetric
+    // filter of the odd samples.
+    const int n = y.size (), R = D/2;
+    const float* lp = &lowpass_[D];
+    const float* center = &x[2*first_out - first];
+    std::vector<float> odd(n + 2*R - 1); // center[2*i + 1] for i in [-R, n + R - 1)
+    for (int i=0; i<(int)odd.size (); i++)
+        odd[i] = center[2*(i - R) + 1];
+
+    const int block = 1<<12;
+#pragma omp parallel for
+    for (int b=0; b<n; b+=block)
+    {
+        float* yb = &y[b];
+        int end = std::min(block, n - b);
+        for (int m=0; m<end; m++)
+            yb[m] = lp[0]*center[2*(b + m)];
+
+        for (int r=0; r<R; r++)
+        {
+            float c = lp[2*r + 1];
+            const float* after = &odd[b + R + r];
+            const float* before = &odd[b + R - r - 1];
+            for (int m=0; m<end; m++)
+                yb[m] += c*(after[m] + before[m]);
+        }
+    }
+
+    return y;
+}
+
+} // namespace Tfr
+
+#include "cwt.h"
+#include "timer.h"
+
+namespace Tfr {
+
+void ConstantQDesc::
+        test()
+{
+    // It should describe a logarithmic frequency axis.
+    {
+        float fs = 44100;
+        ConstantQDesc d;
+        EXCEPTION_ASSERT_EQUALS( d.nScales (), 240u );
+        EXCEPTION_ASSERT_EQUALS( d.get_max_hz (fs), 0.4f*fs );
+
+        FreqAxis fa = d.freqAxis (fs);
+        EXCEPTION_ASSERT_LESS( std::fabs(fa.getFrequency (0u) - d.get_min_hz (fs)), 1e-3f );
+        EXCEPTION_ASSERT_LESS( std::fabs(fa.getFrequency (239u) - d.get_max_hz (fs)), 1e-1f );
+        EXCEPTION_ASSERT_LESS( std::fabs(fa.getFrequency (24u)/fa.getFrequency (0u) - 2), 1e-4f );
+
+        d.set_wanted_min_hz (20, fs);
+        EXCEPTION_ASSERT_LESS( d.get_min_hz (fs), 20.001f );
+        EXCEPTION_ASSERT_LESS( 10.f, d.get_min_hz (fs) );
+
+        // The windows of the highest and lowest bin fit in a frame
+        EXCEPTION_ASSERT_LESS( d.q ()/d.bin_nf (0), d.fft_size () + 1.f );
+        EXCEPTION_ASSERT_LESS( 2*d.increment (), d.q ()/d.bin_nf (23) );
+    }
+
+    // It should be copyable and stringable.
+    {
+        ConstantQDesc d(36, 7);
+        TransformDesc::ptr c = d.copy ();
+        EXCEPTION_ASSERT( *c == d );
+        EXCEPTION_ASSERT( *c != ConstantQDesc(36, 8) );
+        EXCEPTION_ASSERT( *c != ConstantQDesc(24, 7) );
+        EXCEPTION_ASSERT_EQUALS( c->toString (), "Tfr::ConstantQDesc, bins_per_octave=36, number_of_octaves=7" );
+    }
+
+    // It should align chunks to the time step of the lowest octave and require
+    // support around them.
+    {
+        ConstantQDesc d(24, 6);
+        Signal::IntervalType A = d.alignment ();
+        EXCEPTION_ASSERT_EQUALS( A, Signal::IntervalType(d.increment ()) << 5 );
+
+        Signal::Interval I(5, 7), expected;
+        Signal::Interval J = d.requiredInterval (I, &expected);
+        EXCEPTION_ASSERT_EQUALS( expected, Signal::Interval(0, A) );
+        EXCEPTION_ASSERT_EQUALS( J, Signal::Interval(-d.support (), A + d.support ()) );
+
+        J = d.requiredInterval (Signal::Interval(-3*A + 1, 5*A - 1), &expected);
+        EXCEPTION_ASSERT_EQUALS( expected, Signal::Interval(-3*A, 5*A) );
+
+        // Large intervals are split
+        J = d.requiredInterval (Signal::Interval::Interval_ALL, &expected);
+        EXCEPTION_ASSERT_EQUALS( (Signal::IntervalType)expected.count (), (Signal::IntervalType)d.next_good_size (1<<30, 1) );
+
+        // The first output depends on the first required sample
+        J = d.requiredInterval (I, &expected);
+        Signal::Interval affected = d.affectedInterval (Signal::Interval(J.first, J.first + 1));
+        EXCEPTION_ASSERT( (affected & expected) == expected );
+        EXCEPTION_ASSERT( (d.affectedInterval (I) & expected) == expected );
+
+        EXCEPTION_ASSERT_EQUALS( d.next_good_size (1, 1), A );
+        EXCEPTION_ASSERT_EQUALS( d.next_good_size (A, 1), 2*A );
+        EXCEPTION_ASSERT_EQUALS( d.prev_good_size (2*A, 1), A );
+        EXCEPTION_ASSERT_EQUALS( d.prev_good_size (A, 1), A );
+    }
+}
+
+
+void ConstantQ::
+        test()
+{
+    // It should compute a chunk with the interval given by requiredInterval.
+    // A sinusoid should give its amplitude in its bin.
+    {
+        float fs = 44100;
+        ConstantQDesc d(24, 6);
+        ConstantQ cq(d);
+
+        Signal::Interval expected;
+        Signal::Interval J = d.requiredInterval (Signal::Interval(0, 1<<14), &expected);
+
+        unsigned scale = 100;
+        float hz = d.freqAxis (fs).getFrequency (scale);
+        Signal::pMonoBuffer b(new Signal::MonoBuffer(J, fs));
+        float* p = b->waveform_data ()->getCpuMemory ();
+        for (int i=0; i<(int)J.count (); i++)
+            p[i] = 0.5f*cos(2*M_PI*hz*(J.first + i)/fs);
+
+        pChunk c = cq( b );
+        EXCEPTION_ASSERT_EQUALS( c->getInterval (), expected );
+
+        ConstantQChunk* chunk = dynamic_cast<ConstantQChunk*>(c.get ());
+        EXCEPTION_ASSERT( chunk );
+        EXCEPTION_ASSERT_EQUALS( chunk->chunks.size (), 6u );
+
+        int o = 5 - scale/24, bin = scale%24;
+        pChunk part = chunk->chunks[o];
+        EXCEPTION_ASSERT_EQUALS( part->getInterval (), expected );
+        EXCEPTION_ASSERT_LESS( std::fabs(part->freqAxis.getFrequency ((unsigned)bin) - hz), 1e-2f );
+
+        int F = part->nSamples ();
+        const ChunkElement* data = part->transform_data->getCpuMemory ();
+        for (int k=part->first_valid_sample; k<part->first_valid_sample + part->n_valid_samples; k++)
+        {
+            EXCEPTION_ASSERT_LESS( std::fabs(std::abs(data[bin*F + k]) - 0.5f), 0.01f );
+            EXCEPTION_ASSERT_LESS( std::abs(data[(bin - 4)*F + k]), 0.05f );
+            EXCEPTION_ASSERT_LESS( std::abs(data[(bin + 4)*F + k]), 0.05f );
+        }
+    }
+
+    // It should reconstruct signals between get_min_hz and get_max_hz.
+    {
+        float fs = 44100;
+        ConstantQDesc d(24, 6);
+        ConstantQ cq(d);
+
+        Signal::Interval expected;
+        Signal::Interval J = d.requiredInterval (Signal::Interval(0, 1<<14), &expected);
+
+        float hz[] = {2*d.get_min_hz (fs), 1000, 3333, 0.8f*d.get_max_hz (fs)};
+        Signal::pMonoBuffer b(new Signal::MonoBuffer(J, fs));
+        float* p = b->waveform_data ()->getCpuMemory ();
+        for (int i=0; i<(int)J.count (); i++)
+        {
+            p[i] = 0;
+            for (float f : hz)
+                p[i] += 0.25f*cos(2*M_PI*f*(J.first + i)/fs + f);
+        }
+
+        Signal::pMonoBuffer r = cq.inverse (cq( b ));
+        EXCEPTION_ASSERT_EQUALS( r->getInterval (), expected );
+
+        const float* q = r->waveform_data ()->getCpuMemory ();
+        double err = 0, sum = 0;
+        for (int i=0; i<(int)expected.count (); i++)
+        {
+            float v = p[expected.first - J.first + i];
+            err += (q[i] - v)*(q[i] - v);
+            sum += v*v;
+        }
+        EXCEPTION_ASSERT_LESS( sqrt(err/sum), 0.05 );
+    }
+}
+
+
+void ConstantQ::
+        benchmark()
+{
+    // It should be an order of magnitude faster than Cwt at a similar
+    // resolution.
+    {
+        float fs = 44100;
+        ConstantQDesc d(24, 10);
+        Cwt cwt(24);
+        cwt.set_wanted_min_hz (d.get_min_hz (fs), fs);
+
+        Signal::Interval I(0, 1<<16);
+        Signal::pMonoBuffer bcq(new Signal::MonoBuffer(d.requiredInterval (I, 0), fs));
+        Signal::pMonoBuffer bcwt(new Signal::MonoBuffer(cwt.requiredInterval (I, 0), fs));
+        for (Signal::pMonoBuffer b : {bcq, bcwt})
+        {
+            float* p = b->waveform_data ()->getCpuMemory ();
+            for (int i=0; i<b->number_of_samples (); i++)
+                p[i] = sin(i*0.1f);
+        }
+
+        ConstantQ cq(d);
+        cq( bcq ); // warm up
+        Timer t;
+        pChunk c = cq( bcq );
+        double T_cq = t.elapsed ();
+
+        cwt( bcwt ); // warm up
+        t.restart ();
+        pChunk w = cwt( bcwt );
+        double T_cwt = t.elapsed ();
+
+        double cq_per_sample = T_cq/c->getInterval ().count ();
+        double cwt_per_sample = T_cwt/w->getInterval ().count ();
+
+        TaskInfo(boost::format("ConstantQ with %d scales: %s, Cwt with %u scales: %s per %d samples")
+                 % d.nScales () % TaskTimer::timeToString (cq_per_sample*I.count ())
+                 % cwt.nScales () % TaskTimer::timeToString (cwt_per_sample*I.count ())
+                 % I.count ());
+    }
+}
+
+} // namespace Tfr
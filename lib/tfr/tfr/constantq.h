@@ -0,0 +1,180 @@
+#ifndef TFR_CONSTANTQ_H
+#define TFR_CONSTANTQ_H
+
+#include "transform.h"
+#include "chunk.h"
+#include "fftimplementation.h"
+
+#include <vector>
+
+namespace Tfr {
+
+/**
+ * @brief The ConstantQDesc class should create constant-Q transforms.
+ *
+ * It should describe a logarithmic frequency axis with 'bins_per_octave'
+ * bins in each of 'number_of_octaves' octaves, like Cwt but much cheaper to
+ * compute.
+ *
+ * All octaves share the same sparse spectral kernel, the signal is decimated
+ * by two for each octave. The top frequency is 0.4*fs to leave room for the
+ * transition band of the decimation filter.
+ *
+ * It should be copyable and stringable.
+ */
+class ConstantQDesc: public TransformDesc
+{
+public:
+    ConstantQDesc(int bins_per_octave=24, int number_of_octaves=10);
+
+    // overloaded from TransformDesc
+    TransformDesc::ptr copy() const override;
+    pTransform createTransform() const override;
+    float displayedTimeResolution( float FS, float hz ) const override;
+    FreqAxis freqAxis( float FS ) const override;
+    unsigned next_good_size( unsigned current_valid_samples_per_chunk, float sample_rate ) const override;
+    unsigned prev_good_size( unsigned current_valid_samples_per_chunk, float sample_rate ) const override;
+    Signal::Interval requiredInterval( const Signal::Interval& I, Signal::Interval* expectedOutput ) const override;
+    Signal::Interval affectedInterval( const Signal::Interval& I ) const override;
+    std::string toString() const override;
+    bool operator==(const TransformDesc& b) const override;
+
+
+    int       bins_per_octave() const { return _bins_per_octave; }
+    void      bins_per_octave( int );
+    int       number_of_octaves() const { return _number_of_octaves; }
+    void      number_of_octaves( int );
+    unsigned  nScales() const { return _bins_per_octave*_number_of_octaves; }
+
+    float     get_max_hz( float fs ) const { return 0.4f*fs; }
+    float     get_min_hz( float fs ) const;
+    void      set_wanted_min_hz( float min_hz, float fs );
+
+    /**
+      Quality factor, frequency divided by bandwidth.
+      */
+    float     q() const;
+
+    /**
+      Frequency of bin 'i' in the top octave, normalized to the sample rate of
+      the octave. Bin 0 is the lowest frequency.
+      */
+    float     bin_nf( int i ) const;
+
+    /**
+      Size of the ffts. Same for all octaves.
+      */
+    int       fft_size() const;
+
+    /**
+      Number of samples between two frames in the top octave. The time step of
+      octave 'o' is increment() << o samples.
+      */
+    int       increment() const;
+
+    /**
+      Radius of the lowpass filter used to decimate the signal between octaves.
+      */
+    int       decimation_radius() const { return 32; }
+
+    /**
+      Number of frames before and after the valid frames of each octave. They
+      give all valid samples full support in the inverse.
+      */
+    int       margin_frames() const;
+
+    /**
+      Alignment of the output, the time step of the lowest octave.
+      */
+    Signal::IntervalType alignment() const;
+
+    /**
+      Number of samples needed before and after the output.
+      */
+    Signal::IntervalType support() const;
+
+private:
+    int _bins_per_octave;
+    int _number_of_octaves;
+
+public:
+    static void test();
+};
+
+
+/**
+ * @brief The ConstantQChunkPart class holds the bins of one octave, sampled
+ * at the time step of that octave. Bin 0 is the lowest frequency.
+ */
+class ConstantQChunkPart: public Chunk
+{
+public:
+    ConstantQChunkPart(int octave) : Chunk( Order_row_major ), octave(octave) {}
+
+    const int octave;
+};
+
+
+/**
+ * @brief The ConstantQChunk class is the collection of all octaves computed
+ * by ConstantQ, the highest octave first.
+ */
+class ConstantQChunk: public Chunk
+{
+public:
+    ConstantQChunk() : Chunk( Order_row_major ) {}
+
+    /**
+      Collection of ConstantQChunkPart.
+      */
+    std::vector<pChunk> chunks;
+};
+
+
+/**
+ * @brief The ConstantQ class should compute a constant-Q transform with a
+ * sparse spectral kernel.
+ *
+ * Each octave is computed from frames of fft_size() samples of the decimated
+ * signal. The bins are inner products between the spectrum of a frame and the
+ * spectra of Hann windowed complex exponentials, of which only a few elements
+ * are non-zero. The cost per sample is thus independent of bins_per_octave
+ * and lower than for Cwt, which needs one inverse fft per scale.
+ *
+ * The inverse is an approximation of the dual frame that holds for signals
+ * between get_min_hz() and get_max_hz().
+ */
+class ConstantQ: public Transform
+{
+public:
+    ConstantQ(const ConstantQDesc& desc = ConstantQDesc());
+
+    const ConstantQDesc& desc() const { return desc_; }
+    const TransformDesc* transformDesc() const override { return &desc_; }
+
+    pChunk operator()( Signal::pMonoBuffer b ) override;
+    Signal::pMonoBuffer inverse( pChunk chunk ) override;
+
+private:
+    typedef std::vector<std::pair<int, ChunkElement> > SparseKernel;
+
+    /**
+      Decimates the samples [first, last) in 'x' by two. The output starts at
+      'first_out'.
+      */
+    std::vector<float> decimate( const float* x, Signal::IntervalType first, Signal::IntervalType last, Signal::IntervalType& first_out ) const;
+
+    const ConstantQDesc desc_;
+    Tfr::FftImplementation::ptr fft_;
+    std::vector<SparseKernel> kernel_;  // conjugated spectra of the bins in the top octave, divided by fft_size
+    std::vector<float> kernel_power_;   // sum over all bins of |kernel|^2
+    std::vector<float> lowpass_;        // 2*decimation_radius()+1 taps
+
+public:
+    static void test();
+    static void benchmark();
+};
+
+} // namespace Tfr
+
+#endif // TFR_CONSTANTQ_H
@@ -21,8 +21,13 @@
 
 // std
 #include <cmath>
+#include <exception>
 #include <float.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // boost
 #include <boost/lambda/lambda.hpp>
 #include <boost/foreach.hpp>
@@ -170,6 +175,10 @@ pChunk Cwt::
         }
     }
 
+    // Plan the chunk parts of all octave bands, parts with the same interval
+    // share the forward fft
+    std::vector<ChunkPartPlan> parts;
+
     unsigned max_bin = find_bin( nScales() - 1 );
     for( unsigned c=0; prev_j<n_j; ++c )
     {
@@ -271,21 +280,46 @@ pChunk Cwt::
             ComputationSynchronize();
         }
 
-        // downsample the signal by shortening the fourier transform
-        ((StftChunk*)ft.get())->setHalfs( c );
-        pChunk chunkpart = computeChunkPart( ft, prev_j, n_scales );
+        // downsample the signal by shortening the fourier transform, each
+        // part gets its own view of ft
+        ChunkPartPlan part;
+        part.c = c;
+        part.ft.reset( new StftChunk(*(StftChunk*)ft.get()) );
+        ((StftChunk*)part.ft.get())->setHalfs( c );
+        part.first_scale = prev_j;
+        part.n_scales = n_scales;
+        part.first_valid_sample = (offset + first_valid_sample - subinterval.first) >> c;
+        part.cost = (double)((StftChunk*)part.ft.get())->transformSize() * n_scales;
+        parts.push_back( part );
+
+        prev_j = next_j;
+    }
+
+    // Each part has its own inverse fft, kept between calls
+    if (part_fft.v.size() < parts.size())
+        part_fft.v.resize( parts.size() );
+    for (size_t i=0; i<parts.size(); ++i)
+        if (!part_fft.v[i])
+            part_fft.v[i] = Tfr::FftImplementation::newInstance();
+
+    std::vector<pChunk> chunkparts = computeChunkParts( parts );
+
+    for (size_t i=0; i<parts.size(); ++i)
+    {
+        unsigned c = parts[i].c;
+        pChunk chunkpart = chunkparts[i];
 
         // The fft is most often bigger than strictly needed because it is
         // faster to compute lengths that are powers of 2.
         // However, to do proper merging we want to guarantee that all
         // chunkparts describe the exact same region. Thus we discard the extra
         // samples we added when padding to a power of 2
-        chunkpart->first_valid_sample = (offset + first_valid_sample - subinterval.first) >> c;
+        chunkpart->first_valid_sample = parts[i].first_valid_sample;
         chunkpart->n_valid_samples = valid_samples >> c;
 
         DEBUG_CWT {
             TaskTimer tt("Intervals");
-            TaskInfo(boost::format("ft(c)=%s") % ft->getInterval());
+            TaskInfo(boost::format("ft(c)=%s") % parts[i].ft->getInterval());
             TaskInfo(boost::format(" adjusted chunkpart=%s") % chunkpart->getInterval());
             TaskInfo(boost::format(" units=[%s, %s), count=%s") % (chunkpart->getInterval().first >> (max_bin-c)) %
                            (chunkpart->getInterval().last >> (max_bin-c)) %
@@ -293,11 +327,6 @@ pChunk Cwt::
         }
 
         ((CwtChunk*)wt.get())->chunks.push_back( chunkpart );
-
-        // reset halfs if ft can be used for the next bin
-        ((StftChunk*)ft.get())->setHalfs( 0 );
-
-        prev_j = next_j;
     }
 
 
@@ -474,8 +503,62 @@ bool Cwt::
 }
 
 
+std::vector<pChunk> Cwt::
+        computeChunkParts( const std::vector<ChunkPartPlan>& parts )
+{
+    std::vector<pChunk> chunkparts( parts.size() );
+
+    int threads = 1;
+#if defined(_OPENMP) && !defined(USE_CUDA) && !defined(USE_OPENCL)
+    threads = omp_get_max_threads();
+#endif
+
+    double total_cost = 0;
+    for (const ChunkPartPlan& part : parts)
+        total_cost += part.cost;
+
+    // The parts of the highest octaves are the biggest. A part that has
+    // enough work to keep all threads busy is computed on its own, with the
+    // kernels running in parallel. The rest are computed concurrently, one
+    // part per thread.
+    std::vector<int> concurrent;
+    for (size_t i=0; i<parts.size(); ++i)
+    {
+        const ChunkPartPlan& part = parts[i];
+        if (1 == threads || part.cost*threads >= total_cost)
+            chunkparts[i] = computeChunkPart( part.ft, part.first_scale, part.n_scales, part_fft.v[i] );
+        else
+            concurrent.push_back( i );
+    }
+
+    std::vector<std::exception_ptr> error( concurrent.size() );
+
+    // Exceptions must not leave the parallel region, they are rethrown below
+#pragma omp parallel for schedule(dynamic)
+    for (int k=0; k<(int)concurrent.size(); ++k)
+    {
+        int i = concurrent[k];
+        const ChunkPartPlan& part = parts[i];
+        try
+        {
+            chunkparts[i] = computeChunkPart( part.ft, part.first_scale, part.n_scales, part_fft.v[i] );
+        }
+        catch (...)
+        {
+            error[k] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr& e : error)
+        if (e)
+            std::rethrow_exception( e );
+
+    return chunkparts;
+}
+
+
 pChunk Cwt::
-        computeChunkPart( pChunk ft, unsigned first_scale, unsigned n_scales )
+        computeChunkPart( pChunk ft, unsigned first_scale, unsigned n_scales, Tfr::FftImplementation::ptr inverse_fft )
 {
     EXCEPTION_ASSERT( n_scales > 1 || (first_scale == 0 && n_scales==1) );
     TIME_CWTPART TaskTimer tt("computeChunkPart first_scale=%u, n_scales=%u, (%g to %g Hz)",
@@ -584,9 +667,7 @@ pChunk Cwt::
 
         intermediate_wt->n_valid_samples = ft->getInterval().count() - time_support - intermediate_wt->first_valid_sample;
 
-        StftDesc stft;
-        stft.set_exact_chunk_size(n.width);
-        Stft(stft).compute( g, g, Tfr::FftDirection_Inverse );
+        inverse_fft->compute( g, g, DataStorageSize(n.width, n.height), Tfr::FftDirection_Inverse );
 
 //        if (0 /* cpu version */ ) {
 //            TIME_CWTPART TaskTimer tt("inverse ooura, redundant=%u+%u valid=%u",
@@ -1270,8 +1351,13 @@ std::string Cwt::
     ss << "Tfr::Cwt"
        << ", number_of_octaves=" << _number_of_octaves
        << ", scales_per_octave=" << _scales_per_octave
+       << ", tf_resolution=" << _tf_resolution
        << ", wavelet_time_suppport=" << _wavelet_time_suppport
-       << ", wavelet_scale_suppport=" << _wavelet_scale_suppport;
+       << ", wavelet_def_time_suppport=" << _wavelet_def_time_suppport
+       << ", wavelet_scale_suppport=" << _wavelet_scale_suppport
+       << ", least_meaningful_fraction_of_r=" << _least_meaningful_fraction_of_r
+       << ", least_meaningful_samples_per_chunk=" << _least_meaningful_samples_per_chunk
+       << ", jibberish_normalization=" << _jibberish_normalization;
     return ss.str();
 }
 
@@ -1386,4 +1472,102 @@ float Cwt::
 
 
 
+} // namespace Tfr
+
+#include "cpumemorystorage.h"
+#include "test/randombuffer.h"
+#include "timer.h"
+#include "tasktimer.h"
+
+#include <string.h>
+
+namespace Tfr {
+
+void Cwt::
+        test()
+{
+    // It should compute the chunk parts of all octave bands concurrently and
+    // give the same result as computing them one at a time.
+    {
+        float fs = 44100;
+        Cwt cwt(40);
+        cwt.set_wanted_min_hz (40, fs);
+
+        Signal::Interval expected;
+        Signal::Interval J = cwt.requiredInterval (Signal::Interval(0, 1<<14), &expected);
+        Signal::pMonoBuffer b = Test::RandomBuffer::randomBuffer (J, fs, 1)->getChannel (0);
+
+        pChunk concurrent = cwt( b );
+
+#ifdef _OPENMP
+        int threads = omp_get_max_threads ();
+        omp_set_num_threads (1);
+#endif
+        pChunk serial = Cwt(cwt)( b );
+#ifdef _OPENMP
+        omp_set_num_threads (threads);
+#endif
+
+        const std::vector<pChunk>& a = ((CwtChunk*)concurrent.get ())->chunks;
+        const std::vector<pChunk>& c = ((CwtChunk*)serial.get ())->chunks;
+        EXCEPTION_ASSERT_LESS(1u, a.size ());
+        EXCEPTION_ASSERT_EQUALS(a.size (), c.size ());
+        for (size_t i=0; i<a.size (); ++i)
+        {
+            EXCEPTION_ASSERT_EQUALS(a[i]->getInterval (), c[i]->getInterval ());
+            EXCEPTION_ASSERT_EQUALS(a[i]->transform_data->numberOfBytes (), c[i]->transform_data->numberOfBytes ());
+            EXCEPTION_ASSERT_EQUALS(0, memcmp(
+                    CpuMemoryStorage::ReadOnly<1>(a[i]->transform_data).ptr (),
+                    CpuMemoryStorage::ReadOnly<1>(c[i]->transform_data).ptr (),
+                    a[i]->transform_data->numberOfBytes ()));
+        }
+
+        // Computing again reuses the inverse ffts of each part
+        pChunk again = cwt( b );
+        EXCEPTION_ASSERT_EQUALS(0, memcmp(
+                CpuMemoryStorage::ReadOnly<1>(((CwtChunk*)again.get ())->chunks.back ()->transform_data).ptr (),
+                CpuMemoryStorage::ReadOnly<1>(a.back ()->transform_data).ptr (),
+                a.back ()->transform_data->numberOfBytes ()));
+    }
+}
+
+
+void Cwt::
+        benchmark()
+{
+    // It should be faster to compute the chunk parts concurrently than one at
+    // a time.
+#ifdef _OPENMP
+    if (1 < omp_get_max_threads ())
+    {
+        float fs = 44100;
+        int threads = omp_get_max_threads ();
+
+        for (float scales_per_octave : {20, 40, 60, 80})
+        {
+            Cwt cwt(scales_per_octave);
+            Signal::Interval J = cwt.requiredInterval (Signal::Interval(0, 1<<16), 0);
+            Signal::pMonoBuffer b = Test::RandomBuffer::randomBuffer (J, fs, 1)->getChannel (0);
+
+            double T[2];
+            for (int k=0; k<2; ++k)
+            {
+                omp_set_num_threads (k ? threads : 1);
+                Cwt c(cwt);
+                c( b ); // warm up
+                Timer t;
+                c( b );
+                T[k] = t.elapsed ();
+            }
+            omp_set_num_threads (threads);
+
+            TaskInfo(boost::format("Cwt with %g scales per octave, %u scales: serial %s, concurrent %s")
+                     % scales_per_octave % cwt.nScales ()
+                     % TaskTimer::timeToString (T[0])
+                     % TaskTimer::timeToString (T[1]));
+        }
+    }
+#endif
+}
+
 } // namespace Tfr
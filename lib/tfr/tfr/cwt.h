@@ -6,6 +6,7 @@
 #include "fftimplementation.h"
 
 #include <map>
+#include <vector>
 
 namespace Tfr {
 
@@ -113,8 +114,37 @@ public:
 
     unsigned        chunk_alignment() const;
 
+    static void test();
+    static void benchmark();
+
 private:
-    pChunk          computeChunkPart( pChunk ft, unsigned first_scale, unsigned n_scales );
+    /**
+      Describes how to compute the chunk part of one octave band 'c'. 'ft' is
+      a view of the forward fft of the input, downsampled to the band.
+      */
+    struct ChunkPartPlan {
+        unsigned c;
+        pChunk ft;
+        unsigned first_scale;
+        unsigned n_scales;
+        unsigned first_valid_sample;
+        double cost;
+    };
+
+    /**
+      Inverse ffts of the chunk parts, one per part so that parts can be
+      computed concurrently. Kept between calls so that each part reuses its
+      tables, but not shared with copies of this Cwt.
+      */
+    struct PartFft {
+        PartFft() {}
+        PartFft(const PartFft&) {}
+        PartFft& operator=(const PartFft&) { return *this; }
+        std::vector<Tfr::FftImplementation::ptr> v;
+    };
+
+    std::vector<pChunk> computeChunkParts( const std::vector<ChunkPartPlan>& parts );
+    pChunk          computeChunkPart( pChunk ft, unsigned first_scale, unsigned n_scales, Tfr::FftImplementation::ptr inverse_fft );
 
     unsigned        find_bin( unsigned j ) const;
     unsigned        time_support_bin0() const;
@@ -142,6 +172,7 @@ private:
     Tfr::FftImplementation::ptr fft() const;
     Tfr::FftImplementation::ptr fft(int width); // width=0 -> don't care
     void clearFft();
+    PartFft part_fft;
 
     /**
       Default value: _wavelet_time_suppport=3.
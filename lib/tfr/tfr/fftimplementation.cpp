@@ -1,20 +1,30 @@
 #include "fftimplementation.h"
 #include "neat_math.h"
 
+#include "fftooura.h"
+
 #ifdef USE_OPENCL
 #include "fftclfft.h"
 #elif defined(USE_CUDA)
 #include "fftcufft.h"
-#else
-#include "fftooura.h"
+#endif
+
+#ifdef USE_FFTW
+#include "fftw/fftfftw.h"
 #endif
 
 #if defined(USE_CUDA) && !defined(USE_CUFFT)
 #define USE_CUFFT
 #endif
 
+#include "cpumemorystorage.h"
+#include "tasktimer.h"
+#include "timer.h"
 
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
 
 using namespace boost;
 
@@ -27,6 +37,8 @@ shared_ptr<FftImplementation> FftImplementation::
     return make_shared<FftCufft>(); // Gpu, Cuda
 #elif defined(USE_OPENCL)
     return make_shared<FftClFft>(); // Gpu, OpenCL
+#elif defined(USE_FFTW)
+    return make_shared<FftFftw>(); // Cpu, FFTW
 #else
     return make_shared<FftOoura>(); // Cpu
 #endif
@@ -46,4 +58,186 @@ unsigned FftImplementation::
     return spo2g(x);
 }
 
+
+namespace {
+
+struct Backend
+{
+    std::string name;
+    FftImplementation::ptr fft;
+};
+
+
+std::vector<Backend> availableBackends()
+{
+    std::vector<Backend> backends;
+    Backend ooura = { "Ooura", make_shared<FftOoura>() };
+    backends.push_back (ooura);
+#ifdef USE_FFTW
+    Backend fftw = { "FFTW", make_shared<FftFftw>() };
+    backends.push_back (fftw);
+#endif
+#ifdef USE_CUFFT
+    Backend cufft = { "Cufft", make_shared<FftCufft>() };
+    backends.push_back (cufft);
+#endif
+    return backends;
+}
+
+
+bool supportsSize(FftImplementation::ptr fft, unsigned N)
+{
+    return fft->sChunkSizeG (N-1) == N;
+}
+
+
+DataStorage<float>::ptr randomSignal(size_t N)
+{
+    DataStorage<float>::ptr signal(new DataStorage<float>(N));
+    float* p = signal->getCpuMemory ();
+    for (size_t i=0; i<N; ++i)
+        p[i] = rand() / (float)RAND_MAX - 0.5f;
+    return signal;
+}
+
+
+double timeRealTransforms(FftImplementation::ptr fft, unsigned N, unsigned total_samples)
+{
+    DataStorageSize n(N, std::max(1u, total_samples/N));
+    DataStorage<float>::ptr signal = randomSignal (N*n.height);
+    Tfr::ChunkData::ptr spectra(new Tfr::ChunkData((N/2+1)*n.height));
+    DataStorage<float>::ptr inverse(new DataStorage<float>(N*n.height));
+
+    // Warm up, lets a backend prepare its plans
+    fft->compute (signal, spectra, n);
+    fft->inverse (spectra, inverse, n);
+
+    Timer t;
+    fft->compute (signal, spectra, n);
+    fft->inverse (spectra, inverse, n);
+    return t.elapsed ();
+}
+
+} // namespace
+
+
+std::string FftImplementation::
+        build_performance_statistics(bool writeOutput, unsigned max_size)
+{
+    const unsigned total_samples = 1<<20;
+    std::vector<Backend> backends = availableBackends ();
+    std::vector<double> total_time(backends.size (), 0.0);
+
+    boost::scoped_ptr<TaskTimer> tt;
+    if(writeOutput) tt.reset( new TaskTimer("Comparing %u fft backends on %u samples", (unsigned)backends.size (), total_samples));
+
+    for (unsigned N = 128; N <= max_size; N *= 2)
+    {
+        // Powers of two and sizes with a factor 3, if supported
+        unsigned sizes[] = { N, N + N/2 };
+        for (unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+        {
+            std::string line;
+            for (unsigned b=0; b<backends.size (); ++b)
+            {
+                if (!supportsSize (backends[b].fft, sizes[s]))
+                    continue;
+
+                double T = timeRealTransforms (backends[b].fft, sizes[s], total_samples);
+                if (0 == s)
+                    total_time[b] += T;
+
+                line += (boost::format(" %s %.2f ms") % backends[b].name % (T*1e3)).str ();
+            }
+
+            if(writeOutput && !line.empty ())
+                TaskInfo("n=%u:%s", sizes[s], line.c_str ());
+        }
+    }
+
+    unsigned fastest = 0;
+    for (unsigned b=1; b<backends.size (); ++b)
+        if (total_time[b] < total_time[fastest])
+            fastest = b;
+
+    if(writeOutput) TaskInfo("Fastest backend = %s", backends[fastest].name.c_str ());
+    return backends[fastest].name;
+}
+
+
+void FftImplementation::
+        test()
+{
+    // It should compute the discrete fourier transform of a batch of real
+    // signals, and its inverse, with every available backend.
+    {
+        std::vector<Backend> backends = availableBackends ();
+        for (unsigned b=0; b<backends.size (); ++b)
+        {
+            FftImplementation::ptr fft = backends[b].fft;
+
+            unsigned sizes[] = { 256, 384, 1000 };
+            for (unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+            {
+                unsigned N = sizes[s];
+                if (!supportsSize (fft, N))
+                    continue;
+
+                DataStorageSize n(N, 3);
+                DataStorage<float>::ptr signal = randomSignal (N*n.height);
+                Tfr::ChunkData::ptr spectra(new Tfr::ChunkData((N/2+1)*n.height));
+                DataStorage<float>::ptr inverse(new DataStorage<float>(N*n.height));
+
+                fft->compute (signal, spectra, n);
+                fft->inverse (spectra, inverse, n);
+
+                const float* x = signal->getCpuMemory ();
+                const Tfr::ChunkElement* X = spectra->getCpuMemory ();
+                const float* y = inverse->getCpuMemory ();
+
+                double maxdiff = 0, maxinvdiff = 0;
+                for (int row=0; row<n.height; ++row)
+                {
+                    for (unsigned k=0; k<N/2+1; k += 7)
+                    {
+                        std::complex<double> sum = 0;
+                        for (unsigned j=0; j<N; ++j)
+                            sum += (double)x[row*N + j] * std::polar(1.0, -2*M_PI*(double)j*k/N);
+                        std::complex<double> v(X[row*(N/2+1) + k].real (), X[row*(N/2+1) + k].imag ());
+                        maxdiff = std::max(maxdiff, std::abs(v - sum));
+                    }
+
+                    for (unsigned j=0; j<N; ++j)
+                        maxinvdiff = std::max(maxinvdiff, (double)std::fabs(y[row*N + j]/N - x[row*N + j]));
+                }
+
+                EXCEPTION_ASSERTX( maxdiff < 1e-3, boost::format("%s n=%u maxdiff=%g") % backends[b].name % N % maxdiff );
+                EXCEPTION_ASSERTX( maxinvdiff < 1e-5, boost::format("%s n=%u maxinvdiff=%g") % backends[b].name % N % maxinvdiff );
+            }
+        }
+    }
+
+    // It should only suggest sizes that are multiples of 'multiple' and that
+    // the backend itself supports.
+    {
+        std::vector<Backend> backends = availableBackends ();
+        for (unsigned b=0; b<backends.size (); ++b)
+        {
+            FftImplementation::ptr fft = backends[b].fft;
+            unsigned xs[] = { 100, 128, 1000, 3000, 44100 };
+            for (unsigned i=0; i<sizeof(xs)/sizeof(xs[0]); ++i)
+            {
+                unsigned G = fft->sChunkSizeG (xs[i], 4);
+                unsigned S = fft->lChunkSizeS (xs[i], 4);
+                EXCEPTION_ASSERT_LESS( xs[i], G );
+                EXCEPTION_ASSERT_LESS( S, xs[i] );
+                EXCEPTION_ASSERT_EQUALS( G % 4, 0u );
+                EXCEPTION_ASSERT_EQUALS( S % 4, 0u );
+                EXCEPTION_ASSERT( supportsSize (fft, G) );
+                EXCEPTION_ASSERT( supportsSize (fft, S) );
+            }
+        }
+    }
+}
+
 } // namespace Tfr
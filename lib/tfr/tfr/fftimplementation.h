@@ -3,6 +3,7 @@
 
 #include "tfr/chunkdata.h"
 #include <boost/shared_ptr.hpp>
+#include <string>
 
 namespace Tfr {
     enum FftDirection
@@ -79,6 +80,18 @@ namespace Tfr {
           implementation that supports other sizes may override this behaviour.
           */
         virtual unsigned lChunkSizeS(unsigned x, unsigned multiple=1);
+
+        /**
+          Times batched real-to-complex and complex-to-real transforms with
+          each available backend for all powers of two from 128 up to
+          max_size, and for the sizes in between that a backend supports.
+          Returns the name of the backend that was fastest in total on the
+          sizes that all backends support.
+          */
+        static std::string build_performance_statistics(bool writeOutput = false, unsigned max_size = 1<<16);
+
+    public:
+        static void test();
     };
 }
 
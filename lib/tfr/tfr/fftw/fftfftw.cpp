@@ -0,0 +1,366 @@
+#ifdef USE_FFTW
+#include "fftfftw.h"
+
+#include "cpumemorystorage.h"
+#include "tasktimer.h"
+#include "neat_math.h"
+#include "exceptionassert.h"
+
+#include <fftw3.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <map>
+#include <mutex>
+
+//#define TIME_STFT
+#define TIME_STFT if(0)
+
+
+namespace Tfr {
+
+namespace {
+
+enum PlanType
+{
+    Plan_C2C,
+    Plan_R2C,
+    Plan_C2R
+};
+
+
+struct PlanKey
+{
+    PlanType type;
+    int n;
+    int howmany;
+    int direction;
+    bool aligned;
+
+    bool operator<(const PlanKey& b) const
+    {
+        if (type != b.type) return type < b.type;
+        if (n != b.n) return n < b.n;
+        if (howmany != b.howmany) return howmany < b.howmany;
+        if (direction != b.direction) return direction < b.direction;
+        return aligned < b.aligned;
+    }
+};
+
+
+// The FFTW planner is not thread-safe, but executing a plan is.
+std::mutex& planner_lock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+
+class Plan: boost::noncopyable
+{
+public:
+    explicit Plan(fftwf_plan p) : p(p) {}
+
+    ~Plan()
+    {
+        std::lock_guard<std::mutex> l(planner_lock ());
+        fftwf_destroy_plan (p);
+    }
+
+    const fftwf_plan p;
+};
+
+typedef std::shared_ptr<Plan> PlanPtr;
+
+
+/**
+ * Plans are measured on scratch buffers. A plan for aligned data can only be
+ * executed on data with the same SIMD alignment as fftwf_malloc gives.
+ */
+PlanPtr createPlan(const PlanKey& k)
+{
+    TIME_STFT TaskTimer tt("FFTW plan type=%d n=%d howmany=%d direction=%d aligned=%d",
+                           (int)k.type, k.n, k.howmany, k.direction, (int)k.aligned);
+
+    unsigned flags = FFTW_MEASURE;
+    if (!k.aligned)
+        flags |= FFTW_UNALIGNED;
+
+    int n = k.n;
+    int dense = k.type == Plan_C2C ? n : n/2+1;
+    float* r = fftwf_alloc_real (2*(size_t)n*k.howmany);
+    fftwf_complex* c = fftwf_alloc_complex ((size_t)dense*k.howmany);
+
+    fftwf_plan p = 0;
+    switch (k.type)
+    {
+    case Plan_C2C:
+        p = fftwf_plan_many_dft (1, &n, k.howmany, (fftwf_complex*)r, 0, 1, n, c, 0, 1, n, k.direction, flags);
+        break;
+    case Plan_R2C:
+        p = fftwf_plan_many_dft_r2c (1, &n, k.howmany, r, 0, 1, n, c, 0, 1, dense, flags);
+        break;
+    case Plan_C2R:
+        p = fftwf_plan_many_dft_c2r (1, &n, k.howmany, c, 0, 1, dense, r, 0, 1, n, flags);
+        break;
+    }
+
+    fftwf_free (c);
+    fftwf_free (r);
+
+    EXCEPTION_ASSERTX( p, boost::format("FFTW couldn't create a plan for n=%d, howmany=%d") % n % k.howmany );
+    return PlanPtr(new Plan(p));
+}
+
+
+PlanPtr getPlan(const PlanKey& k)
+{
+    std::lock_guard<std::mutex> l(planner_lock ());
+    static std::map<PlanKey, PlanPtr> plans;
+
+    PlanPtr& plan = plans[k];
+    if (!plan)
+        plan = createPlan (k);
+    return plan;
+}
+
+
+/**
+ * Number of transforms computed by each plan for batched transforms. Only
+ * two plans are needed for any number of rows and each block of rows
+ * fits in the cache.
+ */
+int blockSize(int n)
+{
+    return std::max(1, std::min(64, (1<<16) / n));
+}
+
+
+void execute(fftwf_plan p, Tfr::ChunkElement* in, Tfr::ChunkElement* out)
+{
+    fftwf_execute_dft (p, (fftwf_complex*)in, (fftwf_complex*)out);
+}
+
+
+void execute(fftwf_plan p, float* in, Tfr::ChunkElement* out)
+{
+    fftwf_execute_dft_r2c (p, in, (fftwf_complex*)out);
+}
+
+
+void execute(fftwf_plan p, Tfr::ChunkElement* in, float* out)
+{
+    fftwf_execute_dft_c2r (p, (fftwf_complex*)in, out);
+}
+
+
+template<typename In, typename Out>
+void executeBlock(PlanType type, int n, int howmany, int direction, In* in, Out* out)
+{
+    bool aligned = 0 == fftwf_alignment_of ((float*)in) && 0 == fftwf_alignment_of ((float*)out);
+    PlanKey key = { type, n, howmany, direction, aligned };
+    PlanPtr plan = getPlan (key);
+    execute (plan->p, in, out);
+}
+
+
+template<typename In, typename Out>
+void executeRows(PlanType type, int n, int direction, In* in, int in_dist, Out* out, int out_dist, int rows)
+{
+    int B = blockSize (n);
+    int blocks = rows / B;
+
+#pragma omp parallel for
+    for (int b=0; b<blocks; ++b)
+        executeBlock (type, n, B, direction, in + (size_t)b*B*in_dist, out + (size_t)b*B*out_dist);
+
+    for (int r=blocks*B; r<rows; ++r)
+        executeBlock (type, n, 1, direction, in + (size_t)r*in_dist, out + (size_t)r*out_dist);
+}
+
+
+/**
+ * FFTW is allowed to overwrite the input of a C2R transform.
+ */
+class ScratchCopy: boost::noncopyable
+{
+public:
+    ScratchCopy(Tfr::ChunkData::ptr input, size_t elements)
+        :
+          data((Tfr::ChunkElement*)fftwf_alloc_complex (elements))
+    {
+        EXCEPTION_ASSERT_LESS_OR_EQUAL( elements, input->numberOfElements () );
+        Tfr::ChunkElement* in = CpuMemoryStorage::ReadOnly<1>( input ).ptr();
+        memcpy (data, in, elements*sizeof(Tfr::ChunkElement));
+    }
+
+    ~ScratchCopy() { fftwf_free (data); }
+
+    Tfr::ChunkElement* const data;
+};
+
+
+bool isSmooth(unsigned v)
+{
+    if (0 == v)
+        return false;
+
+    const unsigned bases[] = {2, 3, 5, 7};
+    for (unsigned i=0; i<sizeof(bases)/sizeof(bases[0]); ++i)
+        while (v % bases[i] == 0)
+            v /= bases[i];
+    return 1 == v;
+}
+
+} // namespace
+
+
+void FftFftw::
+        compute( Tfr::ChunkData::ptr input, Tfr::ChunkData::ptr output, FftDirection direction )
+{
+    TIME_STFT TaskTimer tt("Fft FFTW");
+
+    int N = output->size().width;
+    int n = input->size().width;
+
+    EXCEPTION_ASSERT( n == N );
+
+    if (input == output)
+    {
+        // Plans are out-of-place
+        Tfr::ChunkData::ptr copy(new Tfr::ChunkData(input->size()));
+        *copy = *input;
+        input = copy;
+    }
+
+    Tfr::ChunkElement* in = CpuMemoryStorage::ReadOnly<1>( input ).ptr();
+    Tfr::ChunkElement* out = CpuMemoryStorage::WriteAll<1>( output ).ptr();
+
+    executeRows (Plan_C2C, N, direction, in, N, out, N, 1);
+}
+
+
+void FftFftw::
+        computeR2C( DataStorage<float>::ptr input, Tfr::ChunkData::ptr output )
+{
+    int denseWidth = output->size().width;
+    int redundantWidth = input->size().width;
+
+    EXCEPTION_ASSERT( denseWidth == redundantWidth/2+1 );
+
+    float* in = CpuMemoryStorage::ReadOnly<1>( input ).ptr();
+    Tfr::ChunkElement* out = CpuMemoryStorage::WriteAll<1>( output ).ptr();
+
+    executeRows (Plan_R2C, redundantWidth, 0, in, redundantWidth, out, denseWidth, 1);
+}
+
+
+void FftFftw::
+        computeC2R( Tfr::ChunkData::ptr input, DataStorage<float>::ptr output )
+{
+    int denseWidth = input->size().width;
+    int redundantWidth = output->size().width;
+
+    EXCEPTION_ASSERT( denseWidth == redundantWidth/2+1 );
+
+    ScratchCopy in(input, denseWidth);
+    float* out = CpuMemoryStorage::WriteAll<1>( output ).ptr();
+
+    executeRows (Plan_C2R, redundantWidth, 0, in.data, denseWidth, out, redundantWidth, 1);
+}
+
+
+void FftFftw::
+        compute( Tfr::ChunkData::ptr inputdata, Tfr::ChunkData::ptr outputdata, DataStorageSize n, FftDirection direction )
+{
+    TIME_STFT TaskTimer tt("Stft FFTW");
+
+    EXCEPTION_ASSERT( inputdata->numberOfBytes() >= outputdata->numberOfBytes() );
+    EXCEPTION_ASSERT_LESS_OR_EQUAL( (size_t)n.width*n.height, outputdata->numberOfElements() );
+
+    if (inputdata == outputdata)
+    {
+        Tfr::ChunkData::ptr copy(new Tfr::ChunkData(inputdata->size()));
+        *copy = *inputdata;
+        inputdata = copy;
+    }
+
+    Tfr::ChunkElement* input = CpuMemoryStorage::ReadOnly<1>( inputdata ).ptr();
+    Tfr::ChunkElement* output = CpuMemoryStorage::WriteAll<1>( outputdata ).ptr();
+
+    executeRows (Plan_C2C, n.width, direction, input, n.width, output, n.width, n.height);
+}
+
+
+void FftFftw::
+        compute( DataStorage<float>::ptr input, Tfr::ChunkData::ptr output, DataStorageSize n )
+{
+    TIME_STFT TaskTimer tt("Stft FFTW R2C");
+
+    DataStorageSize actualSize(n.width/2 + 1, n.height);
+
+    EXCEPTION_ASSERT( (int)output->numberOfElements()/actualSize.width == n.height );
+    EXCEPTION_ASSERT( (int)input->numberOfElements()/n.width == n.height );
+
+    float* in = CpuMemoryStorage::ReadOnly<1>( input ).ptr();
+    Tfr::ChunkElement* out = CpuMemoryStorage::WriteAll<1>( output ).ptr();
+
+    executeRows (Plan_R2C, n.width, 0, in, n.width, out, actualSize.width, n.height);
+}
+
+
+void FftFftw::
+        inverse( Tfr::ChunkData::ptr input, DataStorage<float>::ptr output, DataStorageSize n )
+{
+    TIME_STFT TaskTimer tt("Stft FFTW C2R");
+
+    int denseWidth = n.width/2+1;
+    int redundantWidth = n.width;
+    int batchcount1 = output->numberOfElements()/redundantWidth,
+             batchcount2 = input->numberOfElements()/denseWidth;
+
+    EXCEPTION_ASSERT( batchcount1 == batchcount2 );
+    EXCEPTION_ASSERT( batchcount1 >= n.height );
+
+    ScratchCopy in(input, (size_t)denseWidth*n.height);
+    float* out = CpuMemoryStorage::WriteAll<1>( output ).ptr();
+
+    executeRows (Plan_C2R, redundantWidth, 0, in.data, denseWidth, out, redundantWidth, n.height);
+}
+
+
+unsigned FftFftw::
+        lChunkSizeS(unsigned x, unsigned multiple)
+{
+    multiple = std::max(1u, multiple);
+    EXCEPTION_ASSERT( spo2g(multiple-1) == lpo2s(multiple+1));
+
+    unsigned k = int_div_ceil(x, multiple);
+    k = k > 0 ? k-1 : 0;
+    while (k > 1 && !isSmooth (k))
+        --k;
+
+    unsigned x2 = multiple*k;
+    EXCEPTION_ASSERT( x2 < x );
+    return x2;
+}
+
+
+unsigned FftFftw::
+        sChunkSizeG(unsigned x, unsigned multiple)
+{
+    multiple = std::max(1u, multiple);
+    EXCEPTION_ASSERT( spo2g(multiple-1) == lpo2s(multiple+1));
+
+    unsigned k = x/multiple + 1;
+    while (!isSmooth (k))
+        ++k;
+
+    unsigned x2 = multiple*k;
+    EXCEPTION_ASSERT( x2 > x );
+    return x2;
+}
+
+
+} // namespace Tfr
+#endif // #ifdef USE_FFTW
@@ -0,0 +1,33 @@
+#ifndef FFTFFTW_H
+#define FFTFFTW_H
+
+#include "fftimplementation.h"
+
+namespace Tfr {
+    /**
+     * @brief The FftFftw class computes fourier transforms with FFTW.
+     *
+     * Plans are created once per transform size, batch size, direction and
+     * memory alignment and are then shared by all instances in all threads.
+     * Batched transforms are computed in blocks of rows with one call to FFTW
+     * per block. Real transforms use the native R2C and C2R plans of FFTW
+     * instead of computing a redundant complex transform.
+     *
+     * Any size that is a product of 2, 3, 5 and 7 is supported.
+     */
+    class FftFftw: public FftImplementation {
+    public:
+        void compute( Tfr::ChunkData::ptr input, Tfr::ChunkData::ptr output, FftDirection direction );
+        void computeR2C( DataStorage<float>::ptr input, Tfr::ChunkData::ptr output );
+        void computeC2R( Tfr::ChunkData::ptr input, DataStorage<float>::ptr output );
+
+        void compute( Tfr::ChunkData::ptr input, Tfr::ChunkData::ptr output, DataStorageSize n, FftDirection direction );
+        void compute( DataStorage<float>::ptr inputbuffer, Tfr::ChunkData::ptr transform_data, DataStorageSize n );
+        void inverse( Tfr::ChunkData::ptr inputdata, DataStorage<float>::ptr outputdata, DataStorageSize n );
+
+        unsigned sChunkSizeG(unsigned x, unsigned multiple=1);
+        unsigned lChunkSizeS(unsigned x, unsigned multiple=1);
+    };
+}
+
+#endif // FFTFFTW_H
@@ -12,6 +12,10 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <map>
+#include <mutex>
+#include <tuple>
+
 #ifdef _MSC_VER
 #include "msc_stdc.h"
 #endif
@@ -626,37 +630,118 @@ template<StftDesc::WindowType> float Stft::computeWindowValue( float )
 
 template<StftDesc::WindowType Type>
 void Stft::
-        prepareWindowKernel( DataStorage<float>::ptr source, DataStorage<float>::ptr windowedData )
+        computeWindowTable( std::vector<float>& window, int increment, bool inverse )
 {
-    unsigned increment = p.increment();
-    int windowCount = windowedData->size().width/p.chunk_size();
-
-    std::vector<float> windowfunction(p.chunk_size());
-    float* window = &windowfunction[0];
+    int window_size = window.size();
     float norm = 0;
-    int window_size = p.chunk_size();
-    if (StftDesc::applyWindowOnInverse(Type))
+
+    if (!inverse)
     {
-        for (int x=0;x<window_size; ++x)
+        if (StftDesc::applyWindowOnInverse(Type))
+        {
+            for (int x=0;x<window_size; ++x)
+            {
+                float p = 2.f*(x+1)/(window_size+1) - 1.f;
+                float a = computeWindowValue<Type>(p);
+                norm += a*a;
+                window[x] = a;
+            }
+            norm = sqrt(window_size / norm);
+        }
+        else
         {
-            float p = 2.f*(x+1)/(window_size+1) - 1.f;
-            float a = computeWindowValue<Type>(p);
-            norm += a*a;
-            window[x] = a;
+            for (int x=0;x<window_size; ++x)
+            {
+                float p = 2.f*(x+1)/(window_size+1) - 1.f;
+                float a = computeWindowValue<Type>(p);
+                norm += a;
+                window[x] = a;
+            }
+            norm = window_size / norm;
         }
-        norm = sqrt(p.chunk_size() / norm);
+
+        for (int x=0;x<window_size; ++x)
+            window[x] *= norm;
     }
     else
     {
-        for (int x=0;x<window_size; ++x)
+        float normalizeOverlap = increment/(float)window_size;
+        float normalizeFft = 1.f; // 1.f/window_size;, todo normalize here while going through the data anyways
+        float normalize = normalizeFft*normalizeOverlap;
+
+        if (StftDesc::applyWindowOnInverse(Type))
+        {
+            for (int x=0;x<window_size; ++x)
+            {
+                float p = 2.f*(x+1)/(window_size+1) - 1.f;
+                float a = computeWindowValue<Type>(p);
+                norm += a*a;
+                window[x] = normalize*a;
+            }
+            norm = sqrt(window_size / norm);
+
+            for (int x=0;x<window_size; ++x)
+                window[x] *= norm;
+        }
+        else
         {
-            float p = 2.f*(x+1)/(window_size+1) - 1.f;
-            float a = computeWindowValue<Type>(p);
-            norm += a;
-            window[x] = a;
+            for (int x=0;x<window_size; ++x)
+                window[x] = normalize;
         }
-        norm = p.chunk_size() / norm;
     }
+}
+
+
+Stft::WindowTable Stft::
+        windowTable( StftDesc::WindowType type, int window_size, int increment, bool inverse )
+{
+    typedef std::tuple<int, int, int, bool> Key;
+    static std::mutex tables_lock;
+    static std::map<Key, WindowTable> tables;
+
+    // The forward window doesn't depend on the increment
+    Key key(type, window_size, inverse ? increment : 0, inverse);
+
+    std::lock_guard<std::mutex> l(tables_lock);
+    WindowTable& table = tables[key];
+    if (table)
+        return table;
+
+    boost::shared_ptr<std::vector<float> > window(new std::vector<float>(window_size));
+    std::vector<float>& w = *window;
+
+    switch(type)
+    {
+    case StftDesc::WindowType_Hann:            computeWindowTable<StftDesc::WindowType_Hann>(w, increment, inverse); break;
+    case StftDesc::WindowType_Hamming:         computeWindowTable<StftDesc::WindowType_Hamming>(w, increment, inverse); break;
+    case StftDesc::WindowType_Tukey:           computeWindowTable<StftDesc::WindowType_Tukey>(w, increment, inverse); break;
+    case StftDesc::WindowType_Cosine:          computeWindowTable<StftDesc::WindowType_Cosine>(w, increment, inverse); break;
+    case StftDesc::WindowType_Lanczos:         computeWindowTable<StftDesc::WindowType_Lanczos>(w, increment, inverse); break;
+    case StftDesc::WindowType_Triangular:      computeWindowTable<StftDesc::WindowType_Triangular>(w, increment, inverse); break;
+    case StftDesc::WindowType_Gaussian:        computeWindowTable<StftDesc::WindowType_Gaussian>(w, increment, inverse); break;
+    case StftDesc::WindowType_BarlettHann:     computeWindowTable<StftDesc::WindowType_BarlettHann>(w, increment, inverse); break;
+    case StftDesc::WindowType_Blackman:        computeWindowTable<StftDesc::WindowType_Blackman>(w, increment, inverse); break;
+    case StftDesc::WindowType_Nuttail:         computeWindowTable<StftDesc::WindowType_Nuttail>(w, increment, inverse); break;
+    case StftDesc::WindowType_BlackmanHarris:  computeWindowTable<StftDesc::WindowType_BlackmanHarris>(w, increment, inverse); break;
+    case StftDesc::WindowType_BlackmanNuttail: computeWindowTable<StftDesc::WindowType_BlackmanNuttail>(w, increment, inverse); break;
+    case StftDesc::WindowType_FlatTop:         computeWindowTable<StftDesc::WindowType_FlatTop>(w, increment, inverse); break;
+    default:                                   computeWindowTable<StftDesc::WindowType_Rectangular>(w, increment, inverse); break;
+    }
+
+    table = window;
+    return table;
+}
+
+
+void Stft::
+        prepareWindowKernel( DataStorage<float>::ptr source, DataStorage<float>::ptr windowedData )
+{
+    unsigned increment = p.increment();
+    int window_size = p.chunk_size();
+    int windowCount = windowedData->size().width/window_size;
+
+    WindowTable table = windowTable(p.windowType(), window_size, increment, false);
+    const float* window = &(*table)[0];
 
     CpuMemoryReadOnly<float, 3> in = CpuMemoryStorage::ReadOnly<3>(source);
     CpuMemoryWriteOnly<float, 3> out = CpuMemoryStorage::WriteAll<3>(windowedData);
@@ -672,57 +757,33 @@ void Stft::
 #pragma omp parallel for
             for (int w=0; w<windowCount; ++w)
             {
-                float *o = &out.ref(pos) + w*p.chunk_size();
-                float *i = &in.ref(pos) + w*increment;
+                // Input and output never overlap, let the compiler vectorize this
+                float* __restrict o = &out.ref(pos) + w*window_size;
+                const float* __restrict i = &in.ref(pos) + w*increment;
 
-                for (int x=0; x<p.chunk_size(); ++x)
-                    o[x] = window[x] * i[x] * norm;
+                for (int x=0; x<window_size; ++x)
+                    o[x] = window[x] * i[x];
             }
         }
     }
 }
 
 
-template<StftDesc::WindowType Type, typename T>
+template<typename T>
 void Stft::
         reduceWindowKernel( boost::shared_ptr<DataStorage<T> > windowedSignal, typename DataStorage<T>::ptr signal, const StftChunk* c )
 {
     int increment = c->increment();
     int window_size = c->window_size();
     int windowCount = windowedSignal->size().width/window_size;
-    float normalizeOverlap = increment/(float)window_size;
-    float normalizeFft = 1.f; // 1.f/window_size;, todo normalize here while going through the data anyways
-    float normalize = normalizeFft*normalizeOverlap;
 
     CpuMemoryReadOnly<T, 3> in = CpuMemoryStorage::ReadOnly<3>(windowedSignal);
     CpuMemoryWriteOnly<T, 3> out = CpuMemoryStorage::WriteAll<3>(signal);
 
     typename CpuMemoryWriteOnly<T, 3>::Position pos(0,0,0);
 
-    std::vector<float> windowfunction(window_size);
-    float* window = &windowfunction[0];
-
-    float norm = 0;
-
-    if (StftDesc::applyWindowOnInverse(Type))
-    {
-        for (int x=0;x<window_size; ++x)
-        {
-            float p = 2.f*(x+1)/(window_size+1) - 1.f;
-            float a = computeWindowValue<Type>(p);
-            norm += a*a;
-            window[x] = normalize*a;
-        }
-        norm = sqrt(p.chunk_size() / norm);
-    }
-    else
-    {
-        for (int x=0;x<window_size; ++x)
-            window[x] = normalize;
-
-        norm = 1;
-    }
-
+    WindowTable table = windowTable(c->window_type(), window_size, increment, true);
+    const float* window = &(*table)[0];
 
     int out0 = c->first_valid_sample*increment;
     //int out0 = p.chunk_size()/2 - increment/2 + c->first_valid_sample*increment;
@@ -735,8 +796,6 @@ void Stft::
         for (pos.y=0; pos.y<windowedSignal->size().height; ++pos.y)
         {
             T *o = &out.ref(pos);
-            for (int x=0; x<increment; ++x)
-                if (x>=out0 && x<N+out0) o[x-out0] = 0;
             for (int x=0; x<signal->size().width; ++x)
                 o[x] = 0;
 
@@ -744,19 +803,16 @@ void Stft::
 //#pragma omp parallel for
             for (int w=0; w<windowCount; ++w)
             {
-                T *o = &out.ref(pos);
-                T *i = &in.ref(pos) + w*window_size;
+                const T* __restrict i = &in.ref(pos) + w*window_size;
 
+                // Only the part of this window that overlaps [out0, N+out0)
                 int x0 = w*increment;
-                int x=0;
-                for (; x<window_size; ++x)
-                    //if (x0+x>=out0 && x0+x<N+out0) o[x0+x-out0] += i[x] * normalize;
-                    if (x0+x>=out0 && x0+x<N+out0) o[x0+x-out0] += i[x] * (window[x] * norm);
-
-                //for (; x<window_size-increment; ++x)
-                    //if (x0+x>=out0 && x0+x<N+out0) o[x0+x-out0] += window[x] * i[x] * norm;
-                //for (; x<window_size; ++x)
-                    //if (x0+x>=out0 && x0+x<N+out0) o[x0+x-out0] = window[x] * i[x] * norm;
+                int xbegin = std::max(0, out0 - x0);
+                int xend = std::min(window_size, N + out0 - x0);
+                T* __restrict ow = o + x0 - out0;
+
+                for (int x=xbegin; x<xend; ++x)
+                    ow[x] += i[x] * window[x];
             }
         }
     }
@@ -777,52 +833,7 @@ DataStorage<float>::ptr Stft::
 
     DataStorage<float>::ptr windowedData(new DataStorage<float>(windowCount*p.chunk_size(), source->size().height, source->size().depth ));
 
-    switch(p.windowType())
-    {
-    case StftDesc::WindowType_Hann:
-        prepareWindowKernel<StftDesc::WindowType_Hann>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Hamming:
-        prepareWindowKernel<StftDesc::WindowType_Hamming>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Tukey:
-        prepareWindowKernel<StftDesc::WindowType_Tukey>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Cosine:
-        prepareWindowKernel<StftDesc::WindowType_Cosine>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Lanczos:
-        prepareWindowKernel<StftDesc::WindowType_Lanczos>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Triangular:
-        prepareWindowKernel<StftDesc::WindowType_Triangular>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Gaussian:
-        prepareWindowKernel<StftDesc::WindowType_Gaussian>(source, windowedData);
-        break;
-    case StftDesc::WindowType_BarlettHann:
-        prepareWindowKernel<StftDesc::WindowType_BarlettHann>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Blackman:
-        prepareWindowKernel<StftDesc::WindowType_Blackman>(source, windowedData);
-        break;
-    case StftDesc::WindowType_Nuttail:
-        prepareWindowKernel<StftDesc::WindowType_Nuttail>(source, windowedData);
-        break;
-    case StftDesc::WindowType_BlackmanHarris:
-        prepareWindowKernel<StftDesc::WindowType_BlackmanHarris>(source, windowedData);
-        break;
-    case StftDesc::WindowType_BlackmanNuttail:
-        prepareWindowKernel<StftDesc::WindowType_BlackmanNuttail>(source, windowedData);
-        break;
-    case StftDesc::WindowType_FlatTop:
-        prepareWindowKernel<StftDesc::WindowType_FlatTop>(source, windowedData);
-        break;
-    default:
-        prepareWindowKernel<StftDesc::WindowType_Rectangular>(source, windowedData);
-        break;
-    }
-
+    prepareWindowKernel(source, windowedData);
 
     return windowedData;
 }
@@ -844,51 +855,7 @@ typename DataStorage<T>::ptr Stft::
     unsigned L = c->n_valid_samples*increment;
     typename DataStorage<T>::ptr signal(new DataStorage<T>( L ));
 
-    switch(c->window_type())
-    {
-    case StftDesc::WindowType_Hann:
-        reduceWindowKernel<StftDesc::WindowType_Hann>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Hamming:
-        reduceWindowKernel<StftDesc::WindowType_Hamming>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Tukey:
-        reduceWindowKernel<StftDesc::WindowType_Tukey>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Cosine:
-        reduceWindowKernel<StftDesc::WindowType_Cosine>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Lanczos:
-        reduceWindowKernel<StftDesc::WindowType_Lanczos>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Triangular:
-        reduceWindowKernel<StftDesc::WindowType_Triangular>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Gaussian:
-        reduceWindowKernel<StftDesc::WindowType_Gaussian>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_BarlettHann:
-        reduceWindowKernel<StftDesc::WindowType_BarlettHann>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Blackman:
-        reduceWindowKernel<StftDesc::WindowType_Blackman>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_Nuttail:
-        reduceWindowKernel<StftDesc::WindowType_Nuttail>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_BlackmanHarris:
-        reduceWindowKernel<StftDesc::WindowType_BlackmanHarris>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_BlackmanNuttail:
-        reduceWindowKernel<StftDesc::WindowType_BlackmanNuttail>(windowedSignal, signal, c);
-        break;
-    case StftDesc::WindowType_FlatTop:
-        reduceWindowKernel<StftDesc::WindowType_FlatTop>(windowedSignal, signal, c);
-        break;
-    default:
-        reduceWindowKernel<StftDesc::WindowType_Rectangular>(windowedSignal, signal, c);
-        break;
-    }
+    reduceWindowKernel(windowedSignal, signal, c);
 
     return signal;
 }
@@ -1074,4 +1041,67 @@ Signal::Interval StftChunk::
 }
 
 
+
+void Stft::
+        test()
+{
+    // It should share precomputed window tables between instances
+    {
+        WindowTable a = windowTable(StftDesc::WindowType_Hann, 256, 64, false);
+        WindowTable b = windowTable(StftDesc::WindowType_Hann, 256, 128, false);
+        WindowTable c = windowTable(StftDesc::WindowType_Hann, 256, 64, true);
+        WindowTable d = windowTable(StftDesc::WindowType_Hann, 256, 128, true);
+        WindowTable e = windowTable(StftDesc::WindowType_Hamming, 256, 64, false);
+
+        EXCEPTION_ASSERT(a == b);
+        EXCEPTION_ASSERT(a != c);
+        EXCEPTION_ASSERT(c != d);
+        EXCEPTION_ASSERT(a != e);
+        EXCEPTION_ASSERT(c == windowTable(StftDesc::WindowType_Hann, 256, 64, true));
+        EXCEPTION_ASSERT_EQUALS(a->size (), 256u);
+        EXCEPTION_ASSERT_EQUALS(c->size (), 256u);
+    }
+
+    // It should apply the same normalized window as computing it directly
+    {
+        StftDesc desc;
+        desc.set_exact_chunk_size (256);
+        desc.setWindow (StftDesc::WindowType_Hann, 0.75);
+        Stft stft(desc);
+
+        int window_size = desc.chunk_size ();
+        int increment = desc.increment ();
+        EXCEPTION_ASSERT_EQUALS(increment, 64);
+
+        DataStorage<float>::ptr source(new DataStorage<float>(window_size + 3*increment));
+        float* in = source->getCpuMemory ();
+        for (int i=0; i<source->size ().width; ++i)
+            in[i] = sin(0.1f*i) + 0.5f*cos(0.37f*i);
+
+        DataStorage<float>::ptr windowed = stft.prepareWindow (source);
+        EXCEPTION_ASSERT_EQUALS(windowed->size ().width, 4*window_size);
+        float* out = windowed->getCpuMemory ();
+
+        std::vector<float> a(window_size);
+        float norm = 0;
+        for (int x=0; x<window_size; ++x)
+        {
+            a[x] = computeWindowValue<StftDesc::WindowType_Hann>(2.f*(x+1)/(window_size+1) - 1.f);
+            norm += a[x]*a[x];
+        }
+        norm = sqrt(window_size / norm);
+
+        float maxdiff = 0;
+        for (int w=0; w<4; ++w)
+            for (int x=0; x<window_size; ++x)
+            {
+                float expected = a[x]*in[w*increment + x]*norm;
+                maxdiff = std::max(maxdiff, std::fabs(expected - out[w*window_size + x]));
+            }
+
+        EXCEPTION_ASSERT_LESS(maxdiff, 1e-5f);
+    }
+}
+
+
 } // namespace Tfr
@@ -89,6 +89,17 @@ public:
 
     Tfr::ComplexBuffer::ptr inverseKeepComplex( pChunk chunk );
 
+    typedef boost::shared_ptr<const std::vector<float> > WindowTable;
+
+    /**
+      windowTable returns the normalized window function of a given type and
+      size. Tables are computed once and then shared by all Stft instances
+      in all threads. The forward table doesn't depend on 'increment'.
+
+      The inverse table includes the overlap normalization.
+      */
+    static WindowTable windowTable( StftDesc::WindowType type, int window_size, int increment, bool inverse );
+
 private:
     const StftDesc p;
     FftImplementation::ptr fft;
@@ -114,14 +125,19 @@ private:
     template<typename T>
     typename DataStorage<T>::ptr reduceWindow( boost::shared_ptr<DataStorage<T> > windowedSignal, const StftChunk* c );
 
-    template<StftDesc::WindowType>
     void prepareWindowKernel( DataStorage<float>::ptr in, DataStorage<float>::ptr out );
 
-    template<StftDesc::WindowType, typename T>
+    template<typename T>
     void reduceWindowKernel( boost::shared_ptr<DataStorage<T> > in, typename DataStorage<T>::ptr out, const StftChunk* c );
 
     template<StftDesc::WindowType>
-    float computeWindowValue( float p );
+    static void computeWindowTable( std::vector<float>& window, int increment, bool inverse );
+
+    template<StftDesc::WindowType>
+    static float computeWindowValue( float p );
+
+public:
+    static void test();
 };
 
 class StftChunk: public Chunk
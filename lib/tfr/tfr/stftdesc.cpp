@@ -376,7 +376,8 @@ std::string StftDesc::
        << "window_size=" << chunk_size()
        << ", redundant=" << (compute_redundant()?"C2C":"R2C")
        << ", overlap=" << overlap()
-       << ", window_type=" << windowTypeName();
+       << ", window_type=" << windowTypeName()
+       << ", averaging=" << averaging();
     return ss.str();
 }
 
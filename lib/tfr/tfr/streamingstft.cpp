@@ -0,0 +1,174 @@
+#include "streamingstft.h"
+
+#include "neat_math.h"
+#include "exceptionassert.h"
+#include "tasktimer.h"
+
+//#define TIME_STREAMINGSTFT
+#define TIME_STREAMINGSTFT if(0)
+
+namespace Tfr {
+
+StreamingStft::
+        StreamingStft(const StftDesc& desc)
+    :
+      stft_(desc),
+      started_(false),
+      start_(0),
+      end_(0)
+{
+    // Averaged columns would depend on how the stream is split into pushes
+    EXCEPTION_ASSERT_EQUALS( desc.averaging (), 1 );
+}
+
+
+pChunk StreamingStft::
+        push(Signal::pMonoBuffer b)
+{
+    Signal::Interval I = b->getInterval ();
+    Signal::IntervalType increment = desc ().increment ();
+    Signal::IntervalType chunk_size = desc ().chunk_size ();
+
+    if (!started_ || I.first != end_)
+    {
+        // Start over with the first window that fits in 'b'
+        started_ = true;
+        start_ = align_up(I.first, increment);
+        pending_.clear ();
+    }
+
+    end_ = I.last;
+
+    if (end_ <= start_)
+        return pChunk();
+
+    // Keep samples from start_
+    Signal::IntervalType skip = std::max(Signal::IntervalType(0), start_ - I.first);
+    const float* p = b->waveform_data ()->getCpuMemory ();
+    pending_.insert (pending_.end (), p + skip, p + I.count ());
+
+    Signal::IntervalType available = pending_.size ();
+    if (available < chunk_size)
+        return pChunk();
+
+    Signal::IntervalType n = 1 + (available - chunk_size) / increment;
+    Signal::Interval windows(start_, start_ + (n-1)*increment + chunk_size);
+
+    TIME_STREAMINGSTFT TaskTimer tt(boost::format("StreamingStft %s, %d windows") % windows % n);
+
+    Signal::pMonoBuffer input(new Signal::MonoBuffer(windows, b->sample_rate ()));
+    std::copy (pending_.begin (), pending_.begin () + windows.count (),
+               input->waveform_data ()->getCpuMemory ());
+
+    pChunk chunk = stft_( input );
+    EXCEPTION_ASSERT_EQUALS( (Signal::IntervalType)chunk->nSamples (), n );
+
+    // Stft marks the first windows as invalid for the inverse, none of these
+    // windows has been given out before
+    chunk->first_valid_sample = 0;
+    chunk->n_valid_samples = n;
+
+    pending_.erase (pending_.begin (), pending_.begin () + n*increment);
+    start_ += n*increment;
+
+    return chunk;
+}
+
+
+void StreamingStft::
+        reset()
+{
+    started_ = false;
+    start_ = end_ = 0;
+    pending_.clear ();
+}
+
+} // namespace Tfr
+
+#include "test/randombuffer.h"
+
+namespace Tfr {
+
+void StreamingStft::
+        test()
+{
+    // It should compute the same windows as Stft, each window once, no
+    // matter how the signal is split into pushes.
+    {
+        StftDesc desc;
+        desc.set_exact_chunk_size (256);
+        desc.setWindow (StftDesc::WindowType_Hann, 0.75);
+        desc.enable_inverse (false);
+        int increment = desc.increment ();
+
+        float fs = 44100;
+        Signal::Interval I(0, 10000);
+        Signal::pMonoBuffer signal = Test::RandomBuffer::randomBuffer (I, fs, 1)->getChannel (0);
+        pChunk expected = Stft(desc)( signal );
+        int width = expected->transform_data->numberOfElements () / expected->nSamples ();
+        const ChunkElement* e = expected->transform_data->getCpuMemory ();
+
+        StreamingStft s(desc);
+        Signal::IntervalType next_column = 0;
+        Signal::IntervalType pos = I.first;
+        int pieces[] = {1, 37, 500, 3, 3000, 64, 256, 1000};
+        for (int i=0; pos < I.last; i++)
+        {
+            Signal::Interval piece(pos, std::min(I.last, pos + pieces[i % 8]));
+            Signal::pMonoBuffer b(new Signal::MonoBuffer(piece, fs));
+            std::copy (signal->waveform_data ()->getCpuMemory () + piece.first,
+                       signal->waveform_data ()->getCpuMemory () + piece.last,
+                       b->waveform_data ()->getCpuMemory ());
+            pos = piece.last;
+
+            pChunk c = s.push (b);
+            if (!c)
+                continue;
+
+            // The chunk should continue where the previous chunk ended and
+            // contain only windows that are complete
+            EXCEPTION_ASSERT_EQUALS( c->chunk_offset.asInteger (), next_column );
+            EXCEPTION_ASSERT_EQUALS( c->getInterval (), Signal::Interval(next_column*increment, (next_column + c->nSamples ())*increment) );
+            EXCEPTION_ASSERT_LESS( (next_column + c->nSamples () - 1)*increment + desc.chunk_size (), pos + 1 );
+
+            const ChunkElement* a = c->transform_data->getCpuMemory ();
+            float maxdiff = 0;
+            for (unsigned j=0; j<c->nSamples (); j++)
+                for (int k=0; k<width; k++)
+                    maxdiff = std::max(maxdiff, std::abs(a[j*width + k] - e[(next_column + j)*width + k]));
+            EXCEPTION_ASSERT_LESS( maxdiff, 1e-4f );
+
+            next_column += c->nSamples ();
+        }
+
+        EXCEPTION_ASSERT_EQUALS( next_column, (Signal::IntervalType)expected->nSamples () );
+        EXCEPTION_ASSERT_EQUALS( s.next_window (), next_column*increment );
+    }
+
+    // It should start over when the signal doesn't continue where the previous
+    // buffer ended.
+    {
+        StftDesc desc;
+        desc.set_exact_chunk_size (128);
+        desc.setWindow (StftDesc::WindowType_Hann, 0.5);
+        int increment = desc.increment ();
+
+        StreamingStft s(desc);
+        Signal::pBuffer b = Test::RandomBuffer::randomBuffer (Signal::Interval(0,100), 1000, 1);
+        EXCEPTION_ASSERT( !s.push (b->getChannel (0)) );
+        EXCEPTION_ASSERT_EQUALS( s.next_window (), 0 );
+
+        b = Test::RandomBuffer::randomBuffer (Signal::Interval(1000,1200), 1000, 1);
+        pChunk c = s.push (b->getChannel (0));
+        EXCEPTION_ASSERT( c );
+        EXCEPTION_ASSERT_EQUALS( c->chunk_offset.asInteger (), align_up(1000, increment)/increment );
+        EXCEPTION_ASSERT_EQUALS( c->nSamples (), 1u + (1200 - align_up(1000, increment) - 128)/increment );
+
+        s.reset ();
+        b = Test::RandomBuffer::randomBuffer (Signal::Interval(-10,50), 1000, 1);
+        EXCEPTION_ASSERT( !s.push (b->getChannel (0)) );
+        EXCEPTION_ASSERT_EQUALS( s.next_window (), 0 );
+    }
+}
+
+} // namespace Tfr
@@ -0,0 +1,66 @@
+#ifndef TFR_STREAMINGSTFT_H
+#define TFR_STREAMINGSTFT_H
+
+#include "stft.h"
+
+#include <vector>
+
+namespace Tfr {
+
+/**
+ * @brief The StreamingStft class should compute the stft of a signal that
+ * arrives piece by piece, such as a live recording.
+ *
+ * Each call to push() computes exactly the windows that were completed by
+ * the new samples. Windows start at multiples of StftDesc::increment(), same
+ * as the windows computed by Stft from a buffer given by
+ * StftDesc::requiredInterval, so the columns are identical. Samples that are
+ * still needed by later windows are kept between calls, no window is computed
+ * twice.
+ *
+ * The chunks can be given to a ChunkFilter or MergeChunk like StftBlockFilter
+ * as they are. All columns in a chunk are valid but the chunks are not meant
+ * to be inverted.
+ */
+class StreamingStft
+{
+public:
+    StreamingStft(const StftDesc& desc);
+
+    /**
+     * @brief push appends 'b' to the stream. If 'b' doesn't continue where
+     * the previous buffer ended the stream starts over from 'b'.
+     * @return a chunk with the new windows, or null if 'b' didn't complete
+     * any window.
+     */
+    pChunk push(Signal::pMonoBuffer b);
+
+    /**
+     * @brief reset drops all kept samples, the next push starts a new stream.
+     */
+    void reset();
+
+    /**
+     * @brief next_window is the first sample of the next window to compute.
+     */
+    Signal::IntervalType next_window() const { return start_; }
+
+    const StftDesc& desc() const { return stft_.desc (); }
+
+private:
+    StreamingStft(const StreamingStft&) = delete;
+    StreamingStft& operator=(const StreamingStft&) = delete;
+
+    Stft stft_;
+    bool started_;
+    Signal::IntervalType start_;
+    Signal::IntervalType end_;
+    std::vector<float> pending_; // samples [start_, end_), or fewer after a jump
+
+public:
+    static void test();
+};
+
+} // namespace Tfr
+
+#endif // TFR_STREAMINGSTFT_H
@@ -6,33 +6,51 @@
 #include "tfr/chunkfilter.h"
 #include "tfr/transform.h"
 
+#include <atomic>
+#include <exception>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace Signal;
 using namespace boost;
 
 
 namespace Tfr {
 
+// Threads that are processing channels in any TransformOperationOperation,
+// including the calling workers
+static std::atomic<int> busy_channel_threads(0);
+
+
 class TransformOperationOperation: public Operation
 {
 public:
-    TransformOperationOperation(pTransform t, pChunkFilter chunk_filter, bool no_inverse_tag);
+    TransformOperationOperation(pTransformDesc t, std::vector<pChunkFilter> chunk_filters, bool no_inverse_tag, bool parallel_channels);
 
     // Operation
     pBuffer process(pBuffer b);
 
 private:
-    pTransform transform_;
-    pChunkFilter chunk_filter_;
+    pTransformDesc transform_desc_;
+    std::vector<pTransform> transforms_;
+    std::vector<pChunkFilter> chunk_filters_;
     bool no_inverse_tag_;
+    bool parallel_channels_;
+
+    void processChannel(ChunkAndInverse& ci);
 };
 
 
 TransformOperationOperation::
-        TransformOperationOperation(Tfr::pTransform transform, pChunkFilter chunk_filter, bool no_inverse_tag)
+        TransformOperationOperation(Tfr::pTransformDesc transform_desc, std::vector<pChunkFilter> chunk_filters, bool no_inverse_tag, bool parallel_channels)
     :
-      transform_(transform),
-      chunk_filter_(chunk_filter),
-      no_inverse_tag_(no_inverse_tag)
+      transform_desc_(transform_desc),
+      transforms_{transform_desc->createTransform ()},
+      chunk_filters_(chunk_filters),
+      no_inverse_tag_(no_inverse_tag),
+      parallel_channels_(parallel_channels)
 {
 }
 
@@ -40,43 +58,107 @@ TransformOperationOperation::
 Signal::pBuffer TransformOperationOperation::
         process(Signal::pBuffer b)
 {
-    chunk_filter_->set_number_of_channels(b->number_of_channels ());
-
-    pBuffer r;
-    for (unsigned c=0; c<b->number_of_channels (); ++c)
+    const int C = b->number_of_channels ();
+    for (pChunkFilter& f : chunk_filters_)
+        f->set_number_of_channels(C);
+    if (0 == C)
+        return pBuffer();
+
+    // A Transform may keep scratch data between calls, give each channel
+    // its own when they run concurrently
+    bool parallel = parallel_channels_ && 1 < C;
+    while (parallel && (int)transforms_.size () < C)
+        transforms_.push_back (transform_desc_->createTransform ());
+
+    // Every worker may get here at the same time, only use cores that aren't
+    // already busy with channels of other buffers
+    int threads = 1;
+#ifdef _OPENMP
+    if (parallel)
+        threads = std::max(1, std::min(C, omp_get_max_threads () - busy_channel_threads.load ()));
+#endif
+    busy_channel_threads += threads;
+
+    std::vector<Signal::pMonoBuffer> inverse(C);
+    std::vector<Signal::Interval> covered(C);
+    std::vector<std::exception_ptr> error(C);
+    std::atomic<bool> failed(false);
+
+    // Exceptions must not leave the parallel region, they are rethrown below
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(1 < threads)
+    for (int c=0; c<C; ++c)
       {
-        ChunkAndInverse ci;
-        ci.channel = c;
-        ci.t = transform_;
-        ci.input = b->getChannel (c);
-        ci.chunk = (*ci.t)( ci.input );
-
-        (*chunk_filter_)( ci );
+        if (failed)
+            continue;
 
-        if (!no_inverse_tag_)
+        try
           {
-            if (!ci.inverse)
-                ci.inverse = ci.t->inverse (ci.chunk);
+            ChunkAndInverse ci;
+            ci.channel = c;
+            ci.t = transforms_[parallel ? c : 0];
+            ci.input = b->getChannel (c);
 
-            if (!r)
-                r.reset ( new Signal::Buffer(ci.inverse->getInterval (), ci.inverse->sample_rate (), b->number_of_channels ()));
+            processChannel (ci);
 
-            *r->getChannel (c) |= *ci.inverse;
+            inverse[c] = ci.inverse;
+            covered[c] = ci.chunk->getCoveredInterval ();
           }
-        else
+        catch (...)
           {
-            // If chunk_filter_ has the NoInverseTag it shouldn't compute the inverse
-            EXCEPTION_ASSERTX( !ci.inverse, vartype(*chunk_filter_) );
-
-            r.reset ( new Signal::Buffer(ci.chunk->getCoveredInterval (), b->sample_rate (), b->number_of_channels ()));
+            error[c] = std::current_exception ();
+            failed = true;
           }
+      }
+
+    busy_channel_threads -= threads;
+
+    for (const std::exception_ptr& e : error)
+        if (e)
+            std::rethrow_exception (e);
 
+    pBuffer r;
+    if (!no_inverse_tag_)
+      {
+        r.reset ( new Signal::Buffer(inverse[0]->getInterval (), inverse[0]->sample_rate (), C));
+
+        for (int c=0; c<C; ++c)
+            *r->getChannel (c) |= *inverse[c];
+      }
+    else
+      {
+        r.reset ( new Signal::Buffer(covered[C-1], b->sample_rate (), C));
       }
 
     return r;
 }
 
 
+void TransformOperationOperation::
+        processChannel(ChunkAndInverse& ci)
+{
+    ci.chunk = (*ci.t)( ci.input );
+
+    for (pChunkFilter& f : chunk_filters_)
+      {
+        // A filter that is followed by another filter describes its result
+        // in 'chunk', 'inverse' is then only a shortcut. See NoFusionTag.
+        ci.inverse.reset ();
+        (*f)( ci );
+      }
+
+    if (!no_inverse_tag_)
+      {
+        if (!ci.inverse)
+            ci.inverse = ci.t->inverse (ci.chunk);
+      }
+    else
+      {
+        // If chunk_filter_ has the NoInverseTag it shouldn't compute the inverse
+        EXCEPTION_ASSERTX( !ci.inverse, vartype(*chunk_filters_.back ()) );
+      }
+}
+
+
 TransformOperationDesc::
         TransformOperationDesc(ChunkFilterDesc::ptr f)
     :
@@ -90,26 +172,46 @@ OperationDesc::ptr TransformOperationDesc::
         copy() const
 {
     //ChunkFilterDesc::Ptr chunk_filter = chunk_filter_.read ()->copy();
-    return OperationDesc::ptr (new TransformOperationDesc (chunk_filter_));
+    TransformOperationDesc* d;
+    OperationDesc::ptr o(d = new TransformOperationDesc (chunk_filter_));
+    d->fused_ = fused_;
+    return o;
 }
 
 
 Signal::Operation::ptr TransformOperationDesc::
         createOperation(Signal::ComputingEngine*engine) const
 {
-    Tfr::pTransform t = transformDesc_->createTransform ();
-    pChunkFilter f;
-    {
-        auto c = chunk_filter_.write ();
-        c->transformDesc (transformDesc_);
-        f = c->createChunkFilter (engine);
-    }
-    bool no_inverse_tag = 0!=dynamic_cast<volatile ChunkFilter::NoInverseTag*>(f.get ());
+    std::vector<ChunkFilterDesc::ptr> descs = fused_;
+    descs.push_back (chunk_filter_);
 
-    if (!f)
-        return Signal::Operation::ptr();
+    std::vector<pChunkFilter> filters;
+    bool parallel_channels = true;
+    for (size_t i=0; i<descs.size (); ++i)
+      {
+        pChunkFilter f;
+        {
+            auto c = descs[i].write ();
+            c->transformDesc (transformDesc_);
+            f = c->createChunkFilter (engine);
+        }
+
+        if (!f)
+            return Signal::Operation::ptr();
+
+        // Only the last filter may leave its result outside of the chunk
+        bool last = i+1 == descs.size ();
+        if (!last && (dynamic_cast<volatile ChunkFilter::NoInverseTag*>(f.get ())
+                      || dynamic_cast<volatile ChunkFilter::NoFusionTag*>(f.get ())))
+            return Signal::Operation::ptr();
+
+        parallel_channels &= 0!=dynamic_cast<volatile ChunkFilter::ParallelChannelsTag*>(f.get ());
+        filters.push_back (f);
+      }
 
-    return Signal::Operation::ptr (new TransformOperationOperation( t, f, no_inverse_tag ));
+    bool no_inverse_tag = 0!=dynamic_cast<volatile ChunkFilter::NoInverseTag*>(filters.back ().get ());
+
+    return Signal::Operation::ptr (new TransformOperationOperation( transformDesc_->copy (), filters, no_inverse_tag, parallel_channels ));
 }
 
 
@@ -140,7 +242,50 @@ TransformOperationDesc::Extent TransformOperationDesc::
 QString TransformOperationDesc::
         toString() const
 {
-    return (vartype(*chunk_filter_.get ()) + " on " + transformDesc_->toString ()).c_str();
+    std::string filters;
+    for (const ChunkFilterDesc::ptr& f : fused_)
+        filters += vartype(*f.get ()) + ", ";
+    filters += vartype(*chunk_filter_.get ());
+
+    return (filters + " on " + transformDesc_->toString ()).c_str();
+}
+
+
+QString TransformOperationDesc::
+        persistentId() const
+{
+    // The transform and all filters, in the order they are applied
+    QString filters;
+    for (const ChunkFilterDesc::ptr& f : fused_)
+    {
+        QString id = f.read ()->persistentId ();
+        if (id.isEmpty ())
+            return QString();
+        filters += id + ", ";
+    }
+
+    QString id = chunk_filter_.read ()->persistentId ();
+    if (id.isEmpty ())
+        return QString();
+
+    return filters + id + " on " + QString::fromStdString (transformDesc_->toString ());
+}
+
+
+OperationDesc::ptr TransformOperationDesc::
+        fuse(const Signal::OperationDesc& source) const
+{
+    const TransformOperationDesc* s = dynamic_cast<const TransformOperationDesc*>(&source);
+    if (!s || !(*s->transformDesc_ == *transformDesc_))
+        return OperationDesc::ptr();
+
+    TransformOperationDesc* d;
+    OperationDesc::ptr o(d = new TransformOperationDesc(chunk_filter_));
+    d->transformDesc_ = transformDesc_->copy ();
+    d->fused_ = s->fused_;
+    d->fused_.push_back (s->chunk_filter_);
+    d->fused_.insert (d->fused_.end (), fused_.begin (), fused_.end ());
+    return o;
 }
 
 
@@ -189,7 +334,24 @@ shared_state<ChunkFilterDesc>::write_ptr TransformOperationDesc::
 } // namespace Tfr
 
 #include "dummytransform.h"
+#include "stftdesc.h"
 #include "test/randombuffer.h"
+#include "signal/buffersource.h"
+#include "signal/processing/chain.h"
+#include "signal/processing/workers.h"
+#include "signal/processing/firstmissalgorithm.h"
+#include "signal/processing/persistentcache.h"
+#include "timer.h"
+#include "tasktimer.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QThread>
+
+#include <mutex>
+#include <set>
+#include <thread>
+
 
 namespace Tfr {
 
@@ -221,6 +383,124 @@ private:
     int* i;
 };
 
+class ChannelsChunkFilterDesc: public ChunkFilterDesc
+{
+public:
+    struct Channels {
+        std::mutex lock;
+        std::set<int> channels;
+        std::set<std::thread::id> threads;
+    };
+
+    class ChannelsChunkFilter: public ChunkFilter, public ChunkFilter::ParallelChannelsTag
+    {
+    public:
+        ChannelsChunkFilter(Channels* c):c(c) {}
+
+        void set_number_of_channels( unsigned C ) {
+            EXCEPTION_ASSERT(c->channels.empty ());
+            EXCEPTION_ASSERT_LESS(1u, C);
+        }
+
+        void operator()( ChunkAndInverse& ci ) {
+            std::this_thread::sleep_for (std::chrono::milliseconds(1));
+            std::lock_guard<std::mutex> l(c->lock);
+            EXCEPTION_ASSERT(c->channels.insert (ci.channel).second);
+            c->threads.insert (std::this_thread::get_id ());
+        }
+
+    private:
+        Channels* c;
+    };
+
+    ChannelsChunkFilterDesc(Channels* c):c(c) {}
+
+    ChunkFilter::ptr createChunkFilter(Signal::ComputingEngine*) const {
+        return ChunkFilter::ptr(new ChannelsChunkFilter(c));
+    }
+
+private:
+    Channels* c;
+};
+
+class OrderChunkFilterDesc: public ChunkFilterDesc
+{
+public:
+    class OrderChunkFilter: public ChunkFilter
+    {
+    public:
+        OrderChunkFilter(std::vector<int>* order, int id):order(order),id(id) {}
+
+        void operator()( ChunkAndInverse& ) {
+            order->push_back (id);
+        }
+
+    private:
+        std::vector<int>* order;
+        int id;
+    };
+
+    OrderChunkFilterDesc(std::vector<int>* order, int id):order(order),id(id) {}
+
+    ChunkFilter::ptr createChunkFilter(Signal::ComputingEngine*) const {
+        return ChunkFilter::ptr(new OrderChunkFilter(order, id));
+    }
+
+private:
+    std::vector<int>* order;
+    int id;
+};
+
+class PassChunkFilterDesc: public ChunkFilterDesc
+{
+public:
+    class PassChunkFilter: public ChunkFilter, public ChunkFilter::NoInverseTag
+    {
+    public:
+        void operator()( ChunkAndInverse& ) {}
+    };
+
+    ChunkFilter::ptr createChunkFilter(Signal::ComputingEngine* engine) const {
+        if (0 == engine || dynamic_cast<Signal::ComputingCpu*>(engine))
+            return ChunkFilter::ptr(new PassChunkFilter);
+        return ChunkFilter::ptr();
+    }
+};
+
+
+class ScaleChunkFilterDesc: public ChunkFilterDesc
+{
+public:
+    class ScaleChunkFilter: public ChunkFilter
+    {
+    public:
+        ScaleChunkFilter(float scale):scale(scale) {}
+
+        void operator()( ChunkAndInverse& c ) {
+            ChunkElement* p = c.chunk->transform_data->getCpuMemory ();
+            for (size_t i=0; i<c.chunk->transform_data->numberOfElements (); i++)
+                p[i] *= scale;
+        }
+
+    private:
+        float scale;
+    };
+
+    ScaleChunkFilterDesc(float scale):scale(scale) {}
+
+    ChunkFilter::ptr createChunkFilter(Signal::ComputingEngine*) const {
+        return ChunkFilter::ptr(new ScaleChunkFilter(scale));
+    }
+
+    QString persistentId() const {
+        return QString::fromStdString ((boost::format("Scale %g") % scale).str ());
+    }
+
+private:
+    float scale;
+};
+
+
 void TransformOperationDesc::
         test()
 {
@@ -244,6 +524,187 @@ void TransformOperationDesc::
         Signal::pBuffer b = o->process (Test::RandomBuffer::smallBuffer ());
         EXCEPTION_ASSERT_EQUALS(i, (int)b->number_of_channels ());
     }
+
+    // It should process the channels of a buffer concurrently if the
+    // ChunkFilter has ParallelChannelsTag.
+    {
+        ChannelsChunkFilterDesc::Channels channels;
+        ChunkFilterDesc::ptr cfd(new ChannelsChunkFilterDesc(&channels));
+        cfd.write ()->transformDesc(pTransformDesc(new Tfr::DummyTransformDesc));
+        TransformOperationDesc tod(cfd);
+
+        const int C = 32;
+        Signal::pBuffer b = Test::RandomBuffer::randomBuffer (Signal::Interval(10,1010), 100, C);
+        Signal::Operation::ptr o = tod.createOperation (0);
+        Signal::pBuffer r = o->process (b);
+
+        EXCEPTION_ASSERT(r);
+        EXCEPTION_ASSERT(*r == *b);
+        EXCEPTION_ASSERT_EQUALS((int)channels.channels.size (), C);
+#ifdef _OPENMP
+        if (1 < omp_get_max_threads ())
+            EXCEPTION_ASSERT_LESS(1u, channels.threads.size ());
+        EXCEPTION_ASSERT_LESS_OR_EQUAL(channels.threads.size (), (size_t)omp_get_max_threads ());
+#endif
+    }
+
+    // It should fuse with a source TransformOperationDesc that has an equal
+    // TransformDesc.
+    {
+        std::vector<int> order;
+        ChunkFilterDesc::ptr a(new OrderChunkFilterDesc(&order, 1));
+        ChunkFilterDesc::ptr b(new OrderChunkFilterDesc(&order, 2));
+        ChunkFilterDesc::ptr c(new OrderChunkFilterDesc(&order, 3));
+        for (ChunkFilterDesc::ptr f : {a, b, c})
+            f.write ()->transformDesc(pTransformDesc(new Tfr::DummyTransformDesc));
+
+        TransformOperationDesc ta(a), tb(b), tc(c);
+        Signal::OperationDesc::ptr tab = tb.fuse (ta);
+        EXCEPTION_ASSERT(tab);
+        Signal::OperationDesc::ptr tabc = tc.fuse (*tab.read ());
+        EXCEPTION_ASSERT(tabc);
+        EXCEPTION_ASSERT_EQUALS(tabc.read ()->requiredInterval (Signal::Interval(5,7), 0),
+                                tc.requiredInterval (Signal::Interval(5,7), 0));
+
+        Signal::pBuffer buffer = Test::RandomBuffer::smallBuffer ();
+        Signal::pBuffer r = tabc.read ()->createOperation (0)->process (buffer);
+        EXCEPTION_ASSERT(*r == *buffer);
+        EXCEPTION_ASSERT_EQUALS(order.size (), 3*buffer->number_of_channels ());
+        EXCEPTION_ASSERT_EQUALS(order[0], 1);
+        EXCEPTION_ASSERT_EQUALS(order[1], 2);
+        EXCEPTION_ASSERT_EQUALS(order[2], 3);
+
+        // Not with another transform
+        ChunkFilterDesc::ptr s(new OrderChunkFilterDesc(&order, 4));
+        s.write ()->transformDesc(StftDesc().copy ());
+        EXCEPTION_ASSERT(!tc.fuse (TransformOperationDesc(s)));
+
+        // Not after a filter without an inverse
+        int i = 0;
+        ChunkFilterDesc::ptr d(new DummyChunkFilterDesc(&i));
+        d.write ()->transformDesc(pTransformDesc(new Tfr::DummyTransformDesc));
+        Signal::OperationDesc::ptr tdc = tc.fuse (TransformOperationDesc(d));
+        EXCEPTION_ASSERT(tdc);
+        EXCEPTION_ASSERT(!tdc.read ()->createOperation (0));
+    }
+
+    // It should describe the transform and all of its filters, so that the
+    // results of a filtered chain can be kept by a PersistentCache.
+    {
+        using namespace Signal::Processing;
+
+        class PersistentBufferSource: public Signal::BufferSource {
+        public:
+            PersistentBufferSource(Signal::pBuffer b) : BufferSource(b) {}
+            QString persistentId() const { return "PersistentBufferSource"; }
+        };
+
+        auto filter = [](float scale) {
+            ChunkFilterDesc::ptr f(new ScaleChunkFilterDesc(scale));
+            StftDesc stft;
+            stft.set_exact_chunk_size (64);
+            f.write ()->transformDesc(stft.copy ());
+            return Signal::OperationDesc::ptr(new TransformOperationDesc(f));
+        };
+
+        std::vector<int> order;
+        ChunkFilterDesc::ptr o(new OrderChunkFilterDesc(&order, 1));
+        o.write ()->transformDesc(StftDesc().copy ());
+        EXCEPTION_ASSERT(TransformOperationDesc(o).persistentId ().isEmpty ());
+        EXCEPTION_ASSERT(!(filter(0.5).read ()->persistentId () == filter(0.25).read ()->persistentId ()));
+
+        std::string dir = (QDir::tempPath () + QDir::separator () + "sonicawe-transformoperation-test").toStdString ();
+        PersistentCache::global ().set_directory (dir);
+        PersistentCache::global ().clear ();
+
+        Signal::Interval I(0,1024);
+        Signal::pBuffer b = Test::RandomBuffer::randomBuffer (I, 100, 2);
+        FirstMissAlgorithm schedule;
+        Signal::ComputingEngine::ptr cpu(new Signal::ComputingCpu);
+
+        // Computes the filtered chain in a new session, returns whether any
+        // task was needed
+        auto session = [&](float scale, Signal::pBuffer* result) {
+            Graph g;
+            Step::ptr step(new Step(filter(scale)));
+            GraphVertex vs = g.add_vertex (Step::ptr(new Step(Signal::OperationDesc::ptr(new PersistentBufferSource(b)))));
+            GraphVertex vf = g.add_vertex (step);
+            g.add_edge (vs, vf);
+
+            int tasks = 0;
+            while (Task t = schedule.getTask(g, vf, I, I.first, Signal::Interval::IntervalType_MAX, Workers::ptr(), cpu))
+            {
+                t.run ();
+                tasks++;
+            }
+
+            EXCEPTION_ASSERT(!(I & step.read ()->not_started ()));
+            *result = Step::readFixedLengthFromCache (step, I);
+            return 0 < tasks;
+        };
+
+        Signal::pBuffer r1, r2, r3;
+        EXCEPTION_ASSERT(session(0.5, &r1));
+        EXCEPTION_ASSERT(!session(0.5, &r2));
+        EXCEPTION_ASSERT(*r1 == *r2);
+        EXCEPTION_ASSERT(!(*r1 == *b));
+
+        // Another filter is computed again
+        EXCEPTION_ASSERT(session(0.25, &r3));
+        EXCEPTION_ASSERT(!(*r1 == *r3));
+
+        PersistentCache::global ().clear ();
+        PersistentCache::global ().set_directory ("");
+        QDir(QString::fromStdString (dir)).removeRecursively ();
+    }
+}
+
+
+void TransformOperationDesc::
+        benchmark()
+{
+    // It should scale with the number of workers on a long STFT render
+    {
+        std::string name = "TransformOperationDesc";
+        int argc = 1;
+        char * argv = &name[0];
+        QCoreApplication a(argc,&argv);
+
+        Signal::Interval I(0, 1<<21);
+        Signal::OperationDesc::ptr source(new Signal::BufferSource(
+                Test::RandomBuffer::randomBuffer (I, 44100, 1)));
+
+        StftDesc stft;
+        stft.set_exact_chunk_size (2048);
+        ChunkFilterDesc::ptr cfd(new PassChunkFilterDesc);
+        cfd.write ()->transformDesc(stft.copy ());
+        Signal::OperationDesc::ptr render(new TransformOperationDesc(cfd));
+
+        int max_workers = std::min(64, QThread::idealThreadCount ());
+        for (int workers=1; workers<=max_workers; workers*=2)
+        {
+            for (int batch_size : {0, 4})
+            {
+                using namespace Signal::Processing;
+                Chain::ptr chain = Chain::createDefaultChain (batch_size);
+                chain.write ()->resetDefaultWorkers (workers);
+                TargetMarker::ptr target = chain.write ()->addTarget(render);
+                chain.write ()->addOperationAt(source, target);
+
+                Timer t;
+                target->target_needs ()->updateNeeds(I, Signal::Interval::IntervalType_MIN, 1<<15);
+                EXCEPTION_ASSERT(target->target_needs ()->sleep(60000));
+                double T = t.elapsed ();
+
+                chain.read ()->workers ()->rethrow_any_worker_exception();
+
+                TaskInfo(boost::format("STFT of %s with %d workers%s: %s")
+                         % I % workers
+                         % (batch_size ? " and work stealing" : "")
+                         % TaskTimer::timeToString (T));
+            }
+        }
+    }
 }
 
 } // namespace Tfr
@@ -3,6 +3,8 @@
 
 #include "signal/operation.h"
 
+#include <vector>
+
 namespace Tfr {
 
 class ChunkFilterDesc;
@@ -12,6 +14,13 @@ class TransformDesc;
  * @brief The TransformOperationDesc class should wrap all generic functionality
  * in Signal::Operation and Tfr::Transform so that ChunkFilters can explicilty do
  * only the filtering.
+ *
+ * The channels of a buffer are processed concurrently if the ChunkFilter has
+ * ChunkFilter::ParallelChannelsTag, each channel with its own Transform.
+ *
+ * It should fuse with a source TransformOperationDesc that has an equal
+ * TransformDesc. The fused operation computes the transform once, applies
+ * the ChunkFilters of both in sequence and computes the inverse once.
  */
 class TransformOperationDesc final: public Signal::OperationDesc
 {
@@ -26,7 +35,9 @@ public:
     Signal::Interval affectedInterval(const Signal::Interval&) const;
     Extent extent() const;
     QString toString() const;
+    QString persistentId() const;
     bool operator==(const Signal::OperationDesc&d) const;
+    OperationDesc::ptr fuse(const Signal::OperationDesc& source) const;
 
     boost::shared_ptr<TransformDesc>            transformDesc() const;
     void                                        transformDesc(boost::shared_ptr<TransformDesc>);
@@ -37,8 +48,12 @@ protected:
     shared_state<ChunkFilterDesc> chunk_filter_;
     boost::shared_ptr<TransformDesc> transformDesc_;
 
+    // Filters of fused sources, applied before chunk_filter_, see fuse
+    std::vector<shared_state<ChunkFilterDesc>> fused_;
+
 public:
     static void test();
+    static void benchmark();
 };
 
 } // namespace Tfr
@@ -2,8 +2,14 @@
 
 #include "tfr/freqaxis.h"
 #include "tfr/stftdesc.h"
+#include "tfr/stft.h"
+#include "tfr/fftimplementation.h"
 #include "tfr/dummytransform.h"
 #include "tfr/transformoperation.h"
+#include "tfr/cwt.h"
+#include "tfr/waveletkernel.h"
+#include "tfr/constantq.h"
+#include "tfr/streamingstft.h"
 
 // common backtrace tools
 #include "timer.h"
@@ -28,19 +34,19 @@ string lastname;
         x::test (); \
     } while(false)
 
-int UnitTest::
-        test(bool rethrow_exceptions)
+#define RUNBENCHMARK(x) do { \
+        TaskTimer tt("%s", #x); \
+        lastname = #x; \
+        x::benchmark (); \
+    } while(false)
+
+/**
+ * @brief report prints the exception that is being handled, or rethrows it.
+ */
+static int report(bool rethrow_exceptions)
 {
     try {
-        Timer(); // Init performance counting
-        TaskTimer tt("Running tests");
-
-        RUNTEST(Tfr::FreqAxis);
-        RUNTEST(Tfr::StftDesc);
-        RUNTEST(Tfr::DummyTransform);
-        RUNTEST(Tfr::DummyTransformDesc);
-        RUNTEST(Tfr::TransformOperationDesc);
-
+        throw;
     } catch (const ExceptionAssert& x) {
         if (rethrow_exceptions)
             throw;
@@ -83,9 +89,57 @@ int UnitTest::
         fflush(stderr);
         return 1;
     }
+}
+
+
+int UnitTest::
+        test(bool rethrow_exceptions)
+{
+    try {
+        Timer(); // Init performance counting
+        TaskTimer tt("Running tests");
+
+        RUNTEST(Tfr::FreqAxis);
+        RUNTEST(Tfr::StftDesc);
+        RUNTEST(Tfr::Stft);
+        RUNTEST(Tfr::StreamingStft);
+        RUNTEST(Tfr::FftImplementation);
+        RUNTEST(Tfr::DummyTransform);
+        RUNTEST(Tfr::DummyTransformDesc);
+        RUNTEST(Tfr::TransformOperationDesc);
+#ifndef USE_CUDA
+        RUNTEST(WaveletKernelCpu);
+#endif
+        RUNTEST(Tfr::Cwt);
+        RUNTEST(Tfr::ConstantQDesc);
+        RUNTEST(Tfr::ConstantQ);
+
+    } catch (...) {
+        return report(rethrow_exceptions);
+    }
+
+    printf("\n OK\n\n");
+    return 0;
+}
+
+
+int UnitTest::
+        benchmark(bool rethrow_exceptions)
+{
+    try {
+        Timer(); // Init performance counting
+        TaskTimer tt("Running benchmarks");
+
+        RUNBENCHMARK(Tfr::TransformOperationDesc);
+        RUNBENCHMARK(Tfr::Cwt);
+        RUNBENCHMARK(Tfr::ConstantQ);
+
+    } catch (...) {
+        return report(rethrow_exceptions);
+    }
 
     printf("\n OK\n\n");
     return 0;
 }
 
-} // namespace BacktraceTest
+} // namespace Tfr
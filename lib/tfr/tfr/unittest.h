@@ -7,6 +7,12 @@ class UnitTest
 {
 public:
     static int test(bool rethrow_exceptions=true);
+
+    /**
+     * @brief benchmark runs the benchmarks, they take too long to be part of
+     * the unit tests.
+     */
+    static int benchmark(bool rethrow_exceptions=true);
 };
 
 } // namespace BacktraceTest
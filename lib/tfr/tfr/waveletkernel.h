@@ -12,4 +12,16 @@ void        wtCompute( DataStorage<Tfr::ChunkElement>::ptr in_waveform_ft, Tfr::
 //void        wtInverseBox( float2* in_wavelet, float* out_inverse_waveform, cudaExtent numElem, float4 area, int n_valid_samples, cudaStream_t stream=0 );
 void        wtClamp( Tfr::ChunkData::ptr in_wt, size_t sample_offset, Tfr::ChunkData::ptr out_clamped_wt );
 
+#ifndef USE_CUDA
+/**
+ * @brief The WaveletKernelCpu class should compute the same coefficients with
+ * every vector instruction set as with the scalar code.
+ */
+class WaveletKernelCpu
+{
+public:
+    static void test();
+};
+#endif
+
 #endif // WAVELET_CU_H
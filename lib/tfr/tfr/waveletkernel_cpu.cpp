@@ -4,15 +4,304 @@
 #include "waveletkerneldef.h"
 
 #include "tasktimer.h"
+#include "cpuproperties.h"
+#include "exceptionassert.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define WT_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// The vector kernels are compiled for their own instruction set and are only
+// called if CpuProperties::simd_level() says that the cpu supports it.
+#if defined(__GNUC__)
+#define WT_TARGET(x) __attribute__((target(x)))
+#else
+#define WT_TARGET(x)
+#endif
 
 #define SQRTLOG2E        1.201122409f
 #define PI               3.141592654f
 
-void wtCompute(
+// exp2f(-q*q) rounds to zero in single precision for q*q beyond this
+#define MAX_Q2           150.f
+
+// The vector exp2 builds 2^n from the exponent bits and flushes anything
+// smaller than the smallest normal float to that value
+#define MIN_EXP2         -126.f
+
+
+/**
+  Computes out[w] = in[w]*normalization_factor*exp2f(-q*q) for bins w in
+  [begin, end), where q = (PI - w*aj)*sigma. ChunkElements are interleaved
+  as re,im pairs in 'in' and 'out'.
+
+  Returns the first bin that wasn't computed, the caller takes care of the
+  remaining bins with the scalar code.
+  */
+typedef int (*MorletBand)( const float* in, float* out, int begin, int end, float aj, float sigma, float normalization_factor );
+
+/**
+  Adds the real part of the ChunkElements in 'in' to 'out' for x in [begin, end).
+  Returns the first x that wasn't added.
+  */
+typedef int (*InverseRow)( const float* in, float* out, int begin, int end );
+
+
+static int morletBandScalar( const float*, float*, int begin, int, float, float, float )
+{
+    return begin;
+}
+
+
+static int inverseRowScalar( const float*, float*, int begin, int )
+{
+    return begin;
+}
+
+
+#ifdef WT_SIMD_X86
+
+// Polynomial from Cephes exp2f, x in [-0.5, 0.5]
+#define EXP2_P0 1.535336188319500e-4f
+#define EXP2_P1 1.339887440266574e-3f
+#define EXP2_P2 9.618437357674640e-3f
+#define EXP2_P3 5.550332471162809e-2f
+#define EXP2_P4 2.402264791363012e-1f
+#define EXP2_P5 6.931472028550421e-1f
+
+
+/// 2^x for x in [MIN_EXP2, 0]
+WT_TARGET("sse2")
+static inline __m128 exp2Sse2( __m128 x )
+{
+    x = _mm_max_ps(x, _mm_set1_ps(MIN_EXP2));
+    __m128i n = _mm_cvtps_epi32(x);
+    __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(n));
+
+    __m128 p = _mm_set1_ps(EXP2_P0);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P1));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P2));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P3));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P4));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P5));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+
+    __m128i e = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(e));
+}
+
+
+WT_TARGET("sse2")
+static int morletBandSse2( const float* in, float* out, int begin, int end, float aj, float sigma, float normalization_factor )
+{
+    const __m128 ramp = _mm_setr_ps(0, 1, 2, 3);
+    const __m128 vaj = _mm_set1_ps(aj);
+    const __m128 vpi = _mm_set1_ps(PI);
+    const __m128 vsigma = _mm_set1_ps(sigma);
+    const __m128 vnorm = _mm_set1_ps(normalization_factor);
+    const __m128 zero = _mm_setzero_ps();
+
+    int w = begin;
+    for (; w+4 <= end; w+=4)
+    {
+        __m128 wf = _mm_add_ps(_mm_set1_ps((float)w), ramp);
+        __m128 q = _mm_mul_ps(_mm_sub_ps(vpi, _mm_mul_ps(wf, vaj)), vsigma);
+        __m128 g = _mm_mul_ps(exp2Sse2(_mm_sub_ps(zero, _mm_mul_ps(q, q))), vnorm);
+
+        _mm_storeu_ps(out + 2*w,     _mm_mul_ps(_mm_loadu_ps(in + 2*w),     _mm_unpacklo_ps(g, g)));
+        _mm_storeu_ps(out + 2*w + 4, _mm_mul_ps(_mm_loadu_ps(in + 2*w + 4), _mm_unpackhi_ps(g, g)));
+    }
+
+    return w;
+}
+
+
+WT_TARGET("sse2")
+static int inverseRowSse2( const float* in, float* out, int begin, int end )
+{
+    int x = begin;
+    for (; x+4 <= end; x+=4)
+    {
+        __m128 a = _mm_loadu_ps(in + 2*x);
+        __m128 b = _mm_loadu_ps(in + 2*x + 4);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+        _mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), re));
+    }
+
+    return x;
+}
+
+
+/// 2^x for x in [MIN_EXP2, 0]
+WT_TARGET("avx2,fma")
+static inline __m256 exp2Avx2( __m256 x )
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(MIN_EXP2));
+    __m256i n = _mm256_cvtps_epi32(x);
+    __m256 f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(n));
+
+    __m256 p = _mm256_set1_ps(EXP2_P0);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_P1));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_P2));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_P3));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_P4));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_P5));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f));
+
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+
+WT_TARGET("avx2,fma")
+static int morletBandAvx2( const float* in, float* out, int begin, int end, float aj, float sigma, float normalization_factor )
+{
+    const __m256 ramp = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 vaj = _mm256_set1_ps(aj);
+    const __m256 vpi = _mm256_set1_ps(PI);
+    const __m256 vsigma = _mm256_set1_ps(sigma);
+    const __m256 vnorm = _mm256_set1_ps(normalization_factor);
+
+    int w = begin;
+    for (; w+8 <= end; w+=8)
+    {
+        __m256 wf = _mm256_add_ps(_mm256_set1_ps((float)w), ramp);
+        __m256 q = _mm256_mul_ps(_mm256_fnmadd_ps(wf, vaj, vpi), vsigma);
+        __m256 g = _mm256_mul_ps(exp2Avx2(_mm256_fnmadd_ps(q, q, _mm256_setzero_ps())), vnorm);
+
+        // g0 g0 g1 g1 g4 g4 g5 g5 and g2 g2 g3 g3 g6 g6 g7 g7
+        __m256 lo = _mm256_unpacklo_ps(g, g);
+        __m256 hi = _mm256_unpackhi_ps(g, g);
+
+        _mm256_storeu_ps(out + 2*w,     _mm256_mul_ps(_mm256_loadu_ps(in + 2*w),     _mm256_permute2f128_ps(lo, hi, 0x20)));
+        _mm256_storeu_ps(out + 2*w + 8, _mm256_mul_ps(_mm256_loadu_ps(in + 2*w + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+    }
+
+    return w;
+}
+
+
+WT_TARGET("avx2,fma")
+static int inverseRowAvx2( const float* in, float* out, int begin, int end )
+{
+    int x = begin;
+    for (; x+8 <= end; x+=8)
+    {
+        __m256 a = _mm256_loadu_ps(in + 2*x);
+        __m256 b = _mm256_loadu_ps(in + 2*x + 8);
+        // re0 re1 re4 re5 re2 re3 re6 re7
+        __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+        re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(re), _MM_SHUFFLE(3,1,2,0)));
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_loadu_ps(out + x), re));
+    }
+
+    return x;
+}
+
+
+/// 2^x for x in [MIN_EXP2, 0]
+WT_TARGET("avx512f")
+static inline __m512 exp2Avx512( __m512 x )
+{
+    x = _mm512_max_ps(x, _mm512_set1_ps(MIN_EXP2));
+    __m512i n = _mm512_cvtps_epi32(x);
+    __m512 f = _mm512_sub_ps(x, _mm512_cvtepi32_ps(n));
+
+    __m512 p = _mm512_set1_ps(EXP2_P0);
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(EXP2_P1));
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(EXP2_P2));
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(EXP2_P3));
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(EXP2_P4));
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(EXP2_P5));
+    p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(1.f));
+
+    __m512i e = _mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(e));
+}
+
+
+WT_TARGET("avx512f")
+static int morletBandAvx512( const float* in, float* out, int begin, int end, float aj, float sigma, float normalization_factor )
+{
+    const __m512 ramp = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i dup_lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+    const __m512i dup_hi = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+    const __m512 vaj = _mm512_set1_ps(aj);
+    const __m512 vpi = _mm512_set1_ps(PI);
+    const __m512 vsigma = _mm512_set1_ps(sigma);
+    const __m512 vnorm = _mm512_set1_ps(normalization_factor);
+
+    int w = begin;
+    for (; w+16 <= end; w+=16)
+    {
+        __m512 wf = _mm512_add_ps(_mm512_set1_ps((float)w), ramp);
+        __m512 q = _mm512_mul_ps(_mm512_fnmadd_ps(wf, vaj, vpi), vsigma);
+        __m512 g = _mm512_mul_ps(exp2Avx512(_mm512_fnmadd_ps(q, q, _mm512_setzero_ps())), vnorm);
+
+        _mm512_storeu_ps(out + 2*w,      _mm512_mul_ps(_mm512_loadu_ps(in + 2*w),      _mm512_permutexvar_ps(dup_lo, g)));
+        _mm512_storeu_ps(out + 2*w + 16, _mm512_mul_ps(_mm512_loadu_ps(in + 2*w + 16), _mm512_permutexvar_ps(dup_hi, g)));
+    }
+
+    return w;
+}
+
+
+WT_TARGET("avx512f")
+static int inverseRowAvx512( const float* in, float* out, int begin, int end )
+{
+    const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+
+    int x = begin;
+    for (; x+16 <= end; x+=16)
+    {
+        __m512 a = _mm512_loadu_ps(in + 2*x);
+        __m512 b = _mm512_loadu_ps(in + 2*x + 16);
+        __m512 re = _mm512_permutex2var_ps(a, even, b);
+        _mm512_storeu_ps(out + x, _mm512_add_ps(_mm512_loadu_ps(out + x), re));
+    }
+
+    return x;
+}
+
+#endif // WT_SIMD_X86
+
+
+static MorletBand morletBand( CpuProperties::SimdLevel level )
+{
+    switch (level)
+    {
+#ifdef WT_SIMD_X86
+    case CpuProperties::Simd_AVX512: return morletBandAvx512;
+    case CpuProperties::Simd_AVX2: return morletBandAvx2;
+    case CpuProperties::Simd_SSE2: return morletBandSse2;
+#endif
+    default: return morletBandScalar;
+    }
+}
+
+
+static InverseRow inverseRow( CpuProperties::SimdLevel level )
+{
+    switch (level)
+    {
+#ifdef WT_SIMD_X86
+    case CpuProperties::Simd_AVX512: return inverseRowAvx512;
+    case CpuProperties::Simd_AVX2: return inverseRowAvx2;
+    case CpuProperties::Simd_SSE2: return inverseRowSse2;
+#endif
+    default: return inverseRowScalar;
+    }
+}
+
+
+static void wtCompute(
+        CpuProperties::SimdLevel level,
         DataStorage<Tfr::ChunkElement>::ptr in_waveform_ftp,
         Tfr::ChunkData::ptr out_wavelet_ftp,
         float fs,
-        float /*minHz*/,
         float maxHz,
         int half_sizes,
         float scales_per_octave,
@@ -55,6 +344,11 @@ void wtCompute(
     float wscale = 2*PI/nFrequencyBins;
     sigma_t0 *= SQRTLOG2E;
 
+    // The gaussian is only non-zero within this distance from its center
+    const float max_q = sqrt(MAX_Q2) / sigma_t0;
+
+    MorletBand band = morletBand (level);
+
     //for (int w_bin=0; w_bin<N; ++w_bin)
     //        compute_wavelet_coefficients_elem(
     //                w_bin,
@@ -69,63 +363,189 @@ void wtCompute(
 #pragma omp parallel for
     for( int j=0; j<nScales; j++)
     {
-        Tfr::ChunkElement waveform_ft;
-
-
         // Find period for this thread
 
         int offset = (nScales-1-j)*nFrequencyBins;
         float aj = exp2f(log2_a * (j + first_scale) ) * wscale;
-        for (int w_bin=0; w_bin<N; ++w_bin)
-        {
-            waveform_ft = in_waveform_ft[w_bin];
-            waveform_ft *= normalization_factor;
-            if (0==w_bin)
-                waveform_ft *= 0.5f;
 
+        // Bins outside [begin, end) are too far from the center frequency
+        // of this scale to get anything but zeros.
+        int begin = (int)std::max(0.f, std::floor((PI - max_q)/aj) - 1.f);
+        int end = (int)std::min((float)N, std::ceil((PI + max_q)/aj) + 1.f);
+        begin = std::min(begin, N);
+        end = std::max(end, begin);
+
+        Tfr::ChunkElement* out = out_wavelet_ft + offset;
+        for (int w_bin=0; w_bin<begin; ++w_bin)
+            out[w_bin] = Tfr::ChunkElement(0,0);
+
+        int w_bin = band ((const float*)in_waveform_ft, (float*)out, begin, end, aj, sigma_t0, normalization_factor);
+        for (; w_bin<end; ++w_bin)
+        {
             float q = (-w_bin*aj + PI)*sigma_t0;
 
             // Write wavelet coefficient in output matrix
-            out_wavelet_ft[offset + w_bin] = waveform_ft * exp2f( -q*q );
+            out[w_bin] = in_waveform_ft[w_bin] * (normalization_factor * exp2f( -q*q ));
         }
-        for (int w_bin=N; w_bin<nFrequencyBins; ++w_bin)
-            out_wavelet_ft[offset + w_bin] = Tfr::ChunkElement(0,0);
+
+        if (0 == begin && 0 < end)
+            out[0] *= 0.5f;
+
+        for (int w_bin=end; w_bin<nFrequencyBins; ++w_bin)
+            out[w_bin] = Tfr::ChunkElement(0,0);
     }
 }
 
 
-void wtInverse( Tfr::ChunkData::ptr in_waveletp, DataStorage<float>::ptr out_inverse_waveform, DataStorageSize size )
+void wtCompute(
+        DataStorage<Tfr::ChunkElement>::ptr in_waveform_ftp,
+        Tfr::ChunkData::ptr out_wavelet_ftp,
+        float fs,
+        float /*minHz*/,
+        float maxHz,
+        int half_sizes,
+        float scales_per_octave,
+        float sigma_t0,
+        float normalization_factor )
+{
+    wtCompute (CpuProperties::simd_level (),
+               in_waveform_ftp, out_wavelet_ftp,
+               fs, maxHz, half_sizes, scales_per_octave, sigma_t0, normalization_factor);
+}
+
+
+static void wtInverse( CpuProperties::SimdLevel level, Tfr::ChunkData::ptr in_waveletp, DataStorage<float>::ptr out_inverse_waveform, DataStorageSize size )
 {
     // Multiply the coefficients together and normalize the result
-    Tfr::ChunkElement* in = CpuMemoryStorage::ReadOnly<2>(in_waveletp).ptr();
+    const float* in = (const float*)CpuMemoryStorage::ReadOnly<2>(in_waveletp).ptr();
     float* out = CpuMemoryStorage::WriteAll<1>(out_inverse_waveform).ptr();
 
+    InverseRow row = inverseRow (level);
+
+    // Sum row by row over a few columns at a time to read the coefficients
+    // in the order they're stored, instead of walking down each column
+    const int block = 1024;
     int w = size.width;
-    for (int x=0; x<w; ++x)
+    int h = size.height;
+    int blocks = (w + block - 1) / block;
+
+#pragma omp parallel for
+    for (int b=0; b<blocks; ++b)
     {
-        inverse_elem(
-                x, in, out,
-                size);
+        int x0 = b*block;
+        int x1 = std::min(w, x0 + block);
+
+        for (int x=x0; x<x1; ++x)
+            out[x] = 0;
+
+        for (int fi=0; fi<h; ++fi)
+        {
+            const float* r = in + 2*(size_t)fi*w;
+            int x = row (r, out, x0, x1);
+            for (; x<x1; ++x)
+                out[x] += r[2*x];
+        }
     }
 }
 
 
+void wtInverse( Tfr::ChunkData::ptr in_waveletp, DataStorage<float>::ptr out_inverse_waveform, DataStorageSize size )
+{
+    wtInverse (CpuProperties::simd_level (), in_waveletp, out_inverse_waveform, size);
+}
+
+
 void wtClamp( Tfr::ChunkData::ptr in_wtp, size_t sample_offset, Tfr::ChunkData::ptr out_clamped_wtp )
 {
-    CpuMemoryReadOnly<Tfr::ChunkElement, 2> in_wt = CpuMemoryStorage::ReadOnly<2>( in_wtp );
-    CpuMemoryWriteOnly<Tfr::ChunkElement, 2> out_clamped_wt = CpuMemoryStorage::WriteAll<2>( out_clamped_wtp );
+    const Tfr::ChunkElement* in_wt = CpuMemoryStorage::ReadOnly<2>( in_wtp ).ptr();
+    Tfr::ChunkElement* out_clamped_wt = CpuMemoryStorage::WriteAll<2>( out_clamped_wtp ).ptr();
+
+    int h = out_clamped_wtp->size().height;
+    int w = out_clamped_wtp->size().width;
+    int in_w = in_wtp->size().width;
 
-    int h = out_clamped_wt.numberOfElements().height;
-    int w = out_clamped_wt.numberOfElements().width;
+    EXCEPTION_ASSERT_LESS_OR_EQUAL( sample_offset + w, (size_t)in_w );
+    EXCEPTION_ASSERT_LESS_OR_EQUAL( h, in_wtp->size().height );
+
+    // Each row is a contiguous copy, memcpy picks the widest instructions available
+#pragma omp parallel for
     for (int y=0; y<h; ++y)
+        memcpy( out_clamped_wt + (size_t)y*w, in_wt + (size_t)y*in_w + sample_offset, w*sizeof(Tfr::ChunkElement) );
+}
+
+
+/**
+ * @brief WaveletKernelCpu::test compares each vector instruction set that the
+ * cpu supports with the scalar code, on random input.
+ */
+void WaveletKernelCpu::
+        test()
+{
+    const int nFrequencyBins = 4096, nScales = 64;
+    const float fs = 44100, maxHz = 20000, scales_per_octave = 8, sigma_t0 = 3;
+
+    srand(0);
+    DataStorage<Tfr::ChunkElement>::ptr ft(new DataStorage<Tfr::ChunkElement>(nFrequencyBins));
+    Tfr::ChunkElement* p = CpuMemoryStorage::WriteAll<1>( ft ).ptr();
+    for (int i=0; i<nFrequencyBins; ++i)
+        p[i] = Tfr::ChunkElement(2.f*rand()/RAND_MAX - 1, 2.f*rand()/RAND_MAX - 1);
+
+    // Odd width to get the scalar tail after the vector loops in wtInverse
+    DataStorageSize wt_size(nFrequencyBins, nScales);
+    DataStorageSize inverse_size(nFrequencyBins - 3, nScales);
+
+    Tfr::ChunkData::ptr expected_wt(new Tfr::ChunkData(wt_size));
+    wtCompute (CpuProperties::Simd_None, ft, expected_wt, fs, maxHz, 1, scales_per_octave, sigma_t0, 1);
+
+    Tfr::ChunkData::ptr inverse_in(new Tfr::ChunkData(inverse_size));
+    Tfr::ChunkElement* q = CpuMemoryStorage::WriteAll<2>( inverse_in ).ptr();
+    for (int i=0; i<inverse_size.width*inverse_size.height; ++i)
+        q[i] = Tfr::ChunkElement(2.f*rand()/RAND_MAX - 1, 2.f*rand()/RAND_MAX - 1);
+
+    DataStorage<float>::ptr expected_inverse(new DataStorage<float>(inverse_size.width));
+    wtInverse (CpuProperties::Simd_None, inverse_in, expected_inverse, inverse_size);
+
+    const CpuProperties::SimdLevel levels[] = {
+        CpuProperties::Simd_SSE2,
+        CpuProperties::Simd_AVX2,
+        CpuProperties::Simd_AVX512 };
+
+    for (CpuProperties::SimdLevel level : levels)
     {
-        for (int x=0; x<w; ++x)
+        if (level > CpuProperties::simd_level ())
+            break;
+
+        Tfr::ChunkData::ptr wt(new Tfr::ChunkData(wt_size));
+        wtCompute (level, ft, wt, fs, maxHz, 1, scales_per_octave, sigma_t0, 1);
+
+        const Tfr::ChunkElement* a = CpuMemoryStorage::ReadOnly<2>( wt ).ptr();
+        const Tfr::ChunkElement* b = CpuMemoryStorage::ReadOnly<2>( expected_wt ).ptr();
+
+        // Relative to the largest coefficient of each scale. The error of
+        // exp2(-q*q) grows with q*q far out in the tails of the gaussian,
+        // where the coefficients are tiny, if q is rounded differently.
+        for (int y=0; y<nScales; ++y)
         {
-            CpuMemoryReadOnly<Tfr::ChunkElement, 2>::Position readp( x + sample_offset, y);
-            CpuMemoryWriteOnly<Tfr::ChunkElement, 2>::Position writep( x, y);
+            const Tfr::ChunkElement* ra = a + y*nFrequencyBins;
+            const Tfr::ChunkElement* rb = b + y*nFrequencyBins;
+
+            float row_max = 0;
+            for (int x=0; x<nFrequencyBins; ++x)
+                row_max = std::max(row_max, std::abs(rb[x]));
 
-            out_clamped_wt.write( writep, in_wt.read( readp ));
+            for (int x=0; x<nFrequencyBins; ++x)
+                EXCEPTION_ASSERT_LESS_OR_EQUAL( std::abs(ra[x] - rb[x]), 1e-6f*row_max );
         }
+
+        DataStorage<float>::ptr inverse(new DataStorage<float>(inverse_size.width));
+        wtInverse (level, inverse_in, inverse, inverse_size);
+
+        const float* c = CpuMemoryStorage::ReadOnly<1>( inverse ).ptr();
+        const float* d = CpuMemoryStorage::ReadOnly<1>( expected_inverse ).ptr();
+
+        // The vector code sums the rows in the same order as the scalar code
+        for (int x=0; x<inverse_size.width; ++x)
+            EXCEPTION_ASSERT_LESS_OR_EQUAL( std::abs(c[x] - d[x]), 1e-6f*std::abs(d[x]) );
     }
 }
 
@@ -0,0 +1,267 @@
+#include "constantqblockfilter.h"
+
+#include "heightmap/update/tfrblockupdater.h"
+#include "heightmap/render/glblock.h"
+#include "tfr/constantq.h"
+#include "signal/computingengine.h"
+
+#include "demangle.h"
+
+namespace Heightmap {
+namespace TfrMappings {
+
+ConstantQBlockFilter::
+        ConstantQBlockFilter(ComplexInfo complex_info)
+    :
+      complex_info_(complex_info)
+{}
+
+
+std::vector<Update::IUpdateJob::ptr> ConstantQBlockFilter::
+        prepareUpdate(Tfr::ChunkAndInverse& cai)
+{
+    return prepareUpdate (cai, std::vector<pBlock>{});
+}
+
+
+std::vector<Update::IUpdateJob::ptr> ConstantQBlockFilter::
+        prepareUpdate(Tfr::ChunkAndInverse& pchunk, const std::vector<pBlock>& B)
+{
+    Tfr::ConstantQ* cq = dynamic_cast<Tfr::ConstantQ*>(pchunk.t.get ());
+    EXCEPTION_ASSERT( cq );
+    // The bins give the amplitude of a sinusoid, this shows it at about the
+    // same level as Cwt with default settings
+    float normalization_factor = 12.f;
+
+    Tfr::ConstantQChunk& chunks = *dynamic_cast<Tfr::ConstantQChunk*>( pchunk.chunk.get () );
+
+    float largest_fs =0;
+    for (pBlock b : B)
+        largest_fs = std::max(largest_fs, b->sample_rate ());
+
+    std::vector<Update::IUpdateJob::ptr> R;
+
+    for ( const Tfr::pChunk& chunkpart : chunks.chunks )
+      {
+        Update::IUpdateJob::ptr job(new Update::TfrBlockUpdater::Job{chunkpart, normalization_factor, largest_fs});
+        EXCEPTION_ASSERT_EQUALS( complex_info_, ComplexInfo_Amplitude_Non_Weighted );
+
+        R.push_back (job);
+      }
+
+    return R;
+}
+
+
+ConstantQBlockFilterDesc::
+        ConstantQBlockFilterDesc(ComplexInfo complex_info)
+    :
+      complex_info_(complex_info)
+{
+}
+
+
+MergeChunk::ptr ConstantQBlockFilterDesc::
+        createMergeChunk(Signal::ComputingEngine* engine) const
+{
+    if (dynamic_cast<Signal::ComputingCpu*>(engine))
+        return MergeChunk::ptr(new ConstantQBlockFilter(complex_info_));
+
+    return MergeChunk::ptr();
+}
+
+} // namespace TfrMappings
+} // namespace Heightmap
+
+
+#include "timer.h"
+#include "neat_math.h"
+#include "signal/computingengine.h"
+#include "test/randombuffer.h"
+#include "gltextureread.h"
+
+#include <QApplication>
+#include <QGLWidget>
+
+namespace Heightmap {
+namespace TfrMappings {
+
+void ConstantQBlockFilter::
+        test()
+{
+    std::string name = "ConstantQBlockFilter";
+    int argc = 1;
+    char * argv = &name[0];
+    QApplication a(argc,&argv);
+    QGLWidget w;
+    w.makeCurrent ();
+
+    // It should update a block with constant-Q transform data.
+    {
+        Timer t;
+
+        Tfr::ConstantQDesc cqdesc;
+        float fs = 1024;
+        cqdesc.set_wanted_min_hz(20, fs);
+        Signal::Interval i(0,4);
+        Signal::Interval expected;
+        Signal::Interval data = cqdesc.requiredInterval (i, &expected);
+        EXCEPTION_ASSERT(expected & Signal::Interval(i.first, i.first+1));
+
+        // Create some data to plot into the block
+        Signal::pMonoBuffer buffer = Test::RandomBuffer::randomBuffer (data, fs, 1)->getChannel (0);
+
+        // Create a block to plot into
+        BlockLayout bl(4,4, buffer->sample_rate ());
+        VisualizationParams::ptr vp(new VisualizationParams);
+        Heightmap::FreqAxis fa; fa.setLinear (bl.sample_rate ());
+        vp->display_scale (fa);
+
+        Reference ref = [&]() {
+            Reference ref;
+            Position max_sample_size;
+            max_sample_size.time = 2.f*std::max(1.f, buffer->length ())/bl.texels_per_row ();
+            max_sample_size.scale = 1.f/bl.texels_per_column ();
+            ref.log2_samples_size = Reference::Scale(
+                        floor_log2( max_sample_size.time ),
+                        floor_log2( max_sample_size.scale ));
+            ref.block_index = Reference::Index(0,0);
+            return ref;
+        }();
+
+        Heightmap::pBlock block(new Heightmap::Block(ref, bl, vp));
+        DataStorageSize s(bl.texels_per_row (), bl.texels_per_column ());
+        GlTexture::ptr gltexture(new GlTexture(bl.texels_per_row (), bl.texels_per_column ()));
+        block->glblock.reset( new Render::GlBlock( gltexture ));
+
+        // Create some data to plot into the block
+        Tfr::ChunkAndInverse cai;
+        cai.channel = 0;
+        cai.input = buffer;
+        cai.t = cqdesc.createTransform ();
+        cai.chunk = (*cai.t)( buffer );
+        EXCEPTION_ASSERT_EQUALS(cai.chunk->getCoveredInterval (), expected);
+
+        // Do the merge
+        ComplexInfo complex_info = ComplexInfo_Amplitude_Non_Weighted;
+        Heightmap::MergeChunk::ptr mc( new ConstantQBlockFilter(complex_info) );
+
+        std::queue<Update::UpdateQueue::Job> jobs;
+
+        for (Update::IUpdateJob::ptr job : mc->prepareUpdate (cai))
+        {
+            Update::UpdateQueue::Job uj;
+            uj.intersecting_blocks = std::vector<pBlock>{block};
+            uj.updatejob = job;
+            jobs.push (std::move(uj));
+        }
+
+        Update::TfrBlockUpdater().processJobs (jobs);
+        EXCEPTION_ASSERT_EQUALS(jobs.size (), 0u);
+
+        float T = t.elapsed ();
+        EXCEPTION_ASSERT_LESS(T, 1.0);
+    }
+
+    // It should put a sinusoid in the texel row of its frequency.
+    {
+        float fs = 1024, hz = 100;
+        Tfr::ConstantQDesc cqdesc;
+        cqdesc.set_wanted_min_hz(20, fs);
+        Signal::Interval data = cqdesc.requiredInterval (Signal::Interval(0,4), 0);
+
+        Signal::pMonoBuffer buffer(new Signal::MonoBuffer(data, fs));
+        float* p = buffer->waveform_data ()->getCpuMemory ();
+        for (int i=0; i<(int)data.count (); i++)
+            p[i] = sin(2*M_PI*hz*(data.first + i)/fs);
+
+        // A block with a row for each bin would be too large, the row is
+        // compared with a tolerance instead
+        BlockLayout bl(32,32, fs);
+        VisualizationParams::ptr vp(new VisualizationParams);
+        Heightmap::FreqAxis fa; fa.setLogarithmic (cqdesc.get_min_hz (fs), cqdesc.get_max_hz (fs));
+        vp->display_scale (fa);
+
+        Reference ref = [&]() {
+            Reference ref;
+            Position max_sample_size;
+            max_sample_size.time = 2.f*std::max(1.f, buffer->length ())/bl.texels_per_row ();
+            max_sample_size.scale = 1.f/bl.texels_per_column ();
+            ref.log2_samples_size = Reference::Scale(
+                        floor_log2( max_sample_size.time ),
+                        floor_log2( max_sample_size.scale ));
+            ref.block_index = Reference::Index(0,0);
+            return ref;
+        }();
+
+        Heightmap::pBlock block(new Heightmap::Block(ref, bl, vp));
+        GlTexture::ptr gltexture(new GlTexture(bl.texels_per_row (), bl.texels_per_column ()));
+        block->glblock.reset( new Render::GlBlock( gltexture ));
+
+        Tfr::ChunkAndInverse cai;
+        cai.channel = 0;
+        cai.input = buffer;
+        cai.t = cqdesc.createTransform ();
+        cai.chunk = (*cai.t)( buffer );
+
+        Heightmap::MergeChunk::ptr mc( new ConstantQBlockFilter(ComplexInfo_Amplitude_Non_Weighted) );
+
+        std::queue<Update::UpdateQueue::Job> jobs;
+        for (Update::IUpdateJob::ptr job : mc->prepareUpdate (cai))
+        {
+            Update::UpdateQueue::Job uj;
+            uj.intersecting_blocks = std::vector<pBlock>{block};
+            uj.updatejob = job;
+            jobs.push (std::move(uj));
+        }
+
+        Update::TfrBlockUpdater().processJobs (jobs);
+
+        DataStorage<float>::ptr texels = GlTextureRead(gltexture->getOpenGlTextureId ()).readFloat (0, GL_RED);
+        const float* q = texels->getCpuMemory ();
+        int w = bl.texels_per_row (), h = bl.texels_per_column ();
+        int max_row = -1;
+        float max_value = 0;
+        for (int y=0; y<h; y++)
+            for (int x=0; x<w; x++)
+                if (q[y*w + x] > max_value)
+                {
+                    max_value = q[y*w + x];
+                    max_row = y;
+                }
+
+        float expected_row = fa.getFrequencyScalar (hz) * (h - 1);
+        EXCEPTION_ASSERT_LESS( 0.f, max_value );
+        EXCEPTION_ASSERT_LESS( std::fabs(max_row - expected_row), 1.5f );
+    }
+}
+
+
+void ConstantQBlockFilterDesc::
+        test()
+{
+    // It should instantiate ConstantQBlockFilter for different engines.
+    {
+        ComplexInfo complex_info = ComplexInfo_Amplitude_Non_Weighted;
+        Heightmap::MergeChunkDesc::ptr mcd(new ConstantQBlockFilterDesc(complex_info));
+        MergeChunk::ptr mc = mcd.read ()->createMergeChunk (0);
+
+        EXCEPTION_ASSERT( !mc );
+
+        Signal::ComputingCpu cpu;
+        mc = mcd.read ()->createMergeChunk (&cpu);
+        EXCEPTION_ASSERT( mc );
+        EXCEPTION_ASSERT_EQUALS( vartype(*mc.get ()), "Heightmap::TfrMappings::ConstantQBlockFilter" );
+
+        Signal::ComputingCuda cuda;
+        mc = mcd.read ()->createMergeChunk (&cuda);
+        EXCEPTION_ASSERT( !mc );
+
+        Signal::ComputingOpenCL opencl;
+        mc = mcd.read ()->createMergeChunk (&opencl);
+        EXCEPTION_ASSERT( !mc );
+    }
+}
+
+} // namespace TfrMappings
+} // namespace Heightmap
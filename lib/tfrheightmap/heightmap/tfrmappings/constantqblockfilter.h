@@ -0,0 +1,50 @@
+#ifndef HEIGHTMAP_TFRMAPPINGS_CONSTANTQBLOCKFILTER_H
+#define HEIGHTMAP_TFRMAPPINGS_CONSTANTQBLOCKFILTER_H
+
+#include "mergechunk.h"
+#include "tfr/chunkfilter.h"
+#include "heightmap/block.h"
+
+namespace Heightmap {
+namespace TfrMappings {
+
+/**
+ * @brief The ConstantQBlockFilter class should update a block with constant-Q transform data.
+ */
+class ConstantQBlockFilter: public Heightmap::MergeChunk
+{
+public:
+    ConstantQBlockFilter(ComplexInfo complex_info);
+
+    std::vector<Update::IUpdateJob::ptr> prepareUpdate(Tfr::ChunkAndInverse&) override;
+    std::vector<Update::IUpdateJob::ptr> prepareUpdate(Tfr::ChunkAndInverse&, const std::vector<pBlock>&) override;
+
+private:
+    ComplexInfo complex_info_;
+
+public:
+    static void test();
+};
+
+
+/**
+ * @brief The ConstantQBlockFilterDesc class should instantiate ConstantQBlockFilter for different engines.
+ */
+class ConstantQBlockFilterDesc: public Heightmap::MergeChunkDesc
+{
+public:
+    ConstantQBlockFilterDesc(ComplexInfo complex_info);
+
+    MergeChunk::ptr createMergeChunk(Signal::ComputingEngine* engine) const;
+
+private:
+    ComplexInfo complex_info_;
+
+public:
+    static void test();
+};
+
+} // namespace TfrMappings
+} // namespace Heightmap
+
+#endif // HEIGHTMAP_TFRMAPPINGS_CONSTANTQBLOCKFILTER_H
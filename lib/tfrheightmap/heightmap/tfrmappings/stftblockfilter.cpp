@@ -65,6 +65,7 @@ MergeChunk::ptr StftBlockFilterDesc::
 #include "neat_math.h"
 #include "signal/computingengine.h"
 #include "detectgdb.h"
+#include "tfr/streamingstft.h"
 #include <QApplication>
 #include <QGLWidget>
 
@@ -141,6 +142,38 @@ void StftBlockFilter::
 
         Update::TfrBlockUpdater().processJobs (jobs);
         EXCEPTION_ASSERT_EQUALS(jobs.size (), 0u);
+
+        // It should accept the chunks of a Tfr::StreamingStft as they are
+        Tfr::StreamingStft streaming(stftdesc);
+        Signal::Interval half(data.first, data.first + data.count ()/2);
+        Signal::pMonoBuffer first(new Signal::MonoBuffer(half, buffer->sample_rate ()));
+        Signal::pMonoBuffer second(new Signal::MonoBuffer(Signal::Interval(half.last, data.last), buffer->sample_rate ()));
+        std::copy (p, p + half.count (), first->waveform_data ()->getCpuMemory ());
+        std::copy (p + half.count (), p + data.count (), second->waveform_data ()->getCpuMemory ());
+
+        for (Signal::pMonoBuffer b : {first, second})
+        {
+            Tfr::ChunkAndInverse streamed;
+            streamed.channel = 0;
+            streamed.input = b;
+            streamed.chunk = streaming.push (b);
+            if (!streamed.chunk)
+                continue;
+
+            for (Update::IUpdateJob::ptr job : mc->prepareUpdate (streamed))
+            {
+                EXCEPTION_ASSERT_EQUALS(job->getCoveredInterval (), streamed.chunk->getCoveredInterval ());
+
+                Update::UpdateQueue::Job uj;
+                uj.intersecting_blocks = std::vector<pBlock>{block};
+                uj.updatejob = job;
+                jobs.push (std::move(uj));
+            }
+        }
+
+        EXCEPTION_ASSERT_LESS(0u, jobs.size ());
+        Update::TfrBlockUpdater().processJobs (jobs);
+        EXCEPTION_ASSERT_EQUALS(jobs.size (), 0u);
     }
 }
 
@@ -0,0 +1,160 @@
+#include "streamingstftproducer.h"
+
+#include "heightmap/collection.h"
+#include "heightmap/blockquery.h"
+
+#include "tfr/stftdesc.h"
+
+#include "tasktimer.h"
+
+#include <typeinfo>
+
+//#define DEBUG_INFO
+#define DEBUG_INFO if(0)
+
+namespace Heightmap {
+namespace Update {
+
+StreamingStftProducer::
+        StreamingStftProducer( UpdateQueue::ptr update_queue, Heightmap::TfrMapping::const_ptr tfrmap, TfrMappings::StftBlockFilterParams::ptr params )
+    :
+      update_queue_(update_queue),
+      tfrmap_(tfrmap),
+      params_(params)
+{
+}
+
+
+Signal::Intervals StreamingStftProducer::
+        push( Signal::pBuffer b )
+{
+    Tfr::TransformDesc::ptr t;
+    Heightmap::TfrMapping::Collections C;
+    {
+        auto tm = tfrmap_.read ();
+        t = tm->transform_desc ();
+        C = tm->collections ();
+    }
+
+    // Other transforms, and transforms derived from StftDesc such as
+    // CepstrumDesc, are merged by other MergeChunks
+    const Tfr::StftDesc* stftdesc = dynamic_cast<const Tfr::StftDesc*>(t.get ());
+    if (!stftdesc || typeid(*stftdesc) != typeid(Tfr::StftDesc) || 1 != stftdesc->averaging ())
+    {
+        desc_.reset ();
+        stft_.clear ();
+        return Signal::Intervals();
+    }
+
+    if (!desc_ || !(*desc_ == *t) || stft_.size () != b->number_of_channels ())
+    {
+        desc_ = t->copy ();
+        stft_.clear ();
+        for (unsigned c=0; c<b->number_of_channels (); ++c)
+            stft_.push_back (std::make_shared<Tfr::StreamingStft>(*stftdesc));
+    }
+
+    MergeChunk::ptr merge_chunk( new TfrMappings::StftBlockFilter(params_) );
+    Signal::Intervals streamed;
+
+    for (unsigned c=0; c<b->number_of_channels () && c<C.size (); ++c)
+    {
+        Tfr::ChunkAndInverse cai;
+        cai.channel = c;
+        cai.input = b->getChannel (c);
+        cai.chunk = stft_[c]->push (cai.input);
+        if (!cai.chunk)
+            continue;
+
+        streamed |= cai.chunk->getInterval ();
+
+        BlockCache::ptr cache = C[c].raw ()->cache();
+        std::vector<pBlock> intersecting_blocks = BlockQuery(cache).getIntersectingBlocks( cai.chunk->getCoveredInterval (), false, 0);
+        if (intersecting_blocks.empty ())
+            continue;
+
+        DEBUG_INFO TaskInfo(boost::format("Channel %d. Streaming %s") % c % cai.chunk->getInterval ());
+
+        // The jobs are processed by the UpdateConsumer, don't wait for them
+        for (Update::IUpdateJob::ptr job : merge_chunk->prepareUpdate (cai, intersecting_blocks))
+            update_queue_->push( job, intersecting_blocks );
+    }
+
+    return streamed;
+}
+
+} // namespace Update
+} // namespace Heightmap
+
+#include "tfrblockupdater.h"
+#include "tfr/cepstrum.h"
+
+#include <QApplication>
+#include <QGLWidget>
+
+namespace Heightmap {
+namespace Update {
+
+void StreamingStftProducer::
+        test()
+{
+    std::string name = "StreamingStftProducer";
+    int argc = 1;
+    char * argv = &name[0];
+    QApplication a(argc,&argv);
+    QGLWidget w;
+    w.makeCurrent ();
+
+    // It should update all blocks in a tfrmap with the stft of a signal that
+    // arrives piece by piece.
+    {
+        float fs = 1024;
+        BlockLayout bl(4, 4, SampleRate(fs));
+        Heightmap::TfrMapping::ptr tfrmap(new Heightmap::TfrMapping(bl, ChannelCount(1)));
+        tfrmap.write ()->length( 1 );
+
+        Tfr::StftDesc stftdesc;
+        stftdesc.set_exact_chunk_size (64);
+        stftdesc.setWindow (Tfr::StftDesc::WindowType_Hann, 0.5);
+        stftdesc.enable_inverse (false);
+        tfrmap.write ()->transform_desc( stftdesc.copy () );
+        int increment = stftdesc.increment ();
+
+        {
+            auto c = tfrmap.read ()->collections()[0];
+            Reference entireHeightmap = c->entireHeightmap();
+            c->getBlock (entireHeightmap);
+        }
+
+        UpdateQueue::ptr update_queue(new UpdateQueue::ptr::element_type);
+        StreamingStftProducer producer( update_queue, tfrmap, TfrMappings::StftBlockFilterParams::ptr() );
+
+        // Nothing to merge until a window is complete
+        Signal::pBuffer b(new Signal::Buffer(Signal::Interval(0,40), fs, 1));
+        EXCEPTION_ASSERT_EQUALS( producer.push (b), Signal::Intervals() );
+        EXCEPTION_ASSERT( update_queue->empty () );
+
+        int n = 1 + (200-64)/increment;
+        b.reset (new Signal::Buffer(Signal::Interval(40,200), fs, 1));
+        EXCEPTION_ASSERT_EQUALS( producer.push (b), Signal::Intervals(0, n*increment) );
+
+        UpdateQueue::Job j = update_queue->pop ();
+        EXCEPTION_ASSERT( j );
+        EXCEPTION_ASSERT( dynamic_cast<TfrBlockUpdater::Job*>(j.updatejob.get ()) );
+        EXCEPTION_ASSERT( update_queue->empty () );
+
+        // The windows that were merged aren't merged again
+        b.reset (new Signal::Buffer(Signal::Interval(200,240), fs, 1));
+        EXCEPTION_ASSERT_EQUALS( producer.push (b), Signal::Intervals(n*increment, (n+1)*increment) );
+        update_queue->pop ();
+
+        // Other transforms aren't streamed
+        tfrmap.write ()->transform_desc( Tfr::CepstrumDesc().copy () );
+        b.reset (new Signal::Buffer(Signal::Interval(240,400), fs, 1));
+        EXCEPTION_ASSERT_EQUALS( producer.push (b), Signal::Intervals() );
+        EXCEPTION_ASSERT( update_queue->empty () );
+    }
+}
+
+} // namespace Update
+} // namespace Heightmap
@@ -0,0 +1,58 @@
+#ifndef HEIGHTMAP_UPDATE_STREAMINGSTFTPRODUCER_H
+#define HEIGHTMAP_UPDATE_STREAMINGSTFTPRODUCER_H
+
+#include "heightmap/tfrmapping.h"
+#include "heightmap/tfrmappings/stftblockfilter.h"
+#include "updatequeue.h"
+#include "tfr/streamingstft.h"
+
+#include <memory>
+#include <vector>
+
+namespace Heightmap {
+namespace Update {
+
+/**
+ * @brief The StreamingStftProducer class should update all blocks in a tfrmap
+ * with the stft of a signal that arrives piece by piece, such as a recording.
+ *
+ * Each channel is computed by a Tfr::StreamingStft so no window is computed
+ * twice, and merged by StftBlockFilter.
+ *
+ * It should do nothing unless the transform of the tfrmap is a plain
+ * Tfr::StftDesc without averaging. It should start the streams over when the
+ * transform changes.
+ *
+ * Unlike UpdateProducer it doesn't wait for the update jobs to finish, it may
+ * be called from a recording callback.
+ */
+class StreamingStftProducer
+{
+public:
+    typedef shared_state<StreamingStftProducer> ptr;
+
+    StreamingStftProducer( UpdateQueue::ptr update_queue, Heightmap::TfrMapping::const_ptr tfrmap, TfrMappings::StftBlockFilterParams::ptr params );
+
+    /**
+     * @brief push appends 'b' to the streams and merges the new windows.
+     * @return the samples covered by the new windows, in which the
+     * heightmap is up to date.
+     */
+    Signal::Intervals push( Signal::pBuffer b );
+
+private:
+    UpdateQueue::ptr update_queue_;
+    Heightmap::TfrMapping::const_ptr tfrmap_;
+    TfrMappings::StftBlockFilterParams::ptr params_;
+
+    Tfr::TransformDesc::ptr desc_;
+    std::vector<std::shared_ptr<Tfr::StreamingStft>> stft_;
+
+public:
+    static void test();
+};
+
+} // namespace Update
+} // namespace Heightmap
+
+#endif // HEIGHTMAP_UPDATE_STREAMINGSTFTPRODUCER_H
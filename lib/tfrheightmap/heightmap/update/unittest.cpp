@@ -2,8 +2,10 @@
 
 #include "heightmap/tfrmapping.h"
 #include "heightmap/update/updateproducer.h"
+#include "heightmap/update/streamingstftproducer.h"
 #include "heightmap/tfrmappings/stftblockfilter.h"
 #include "heightmap/tfrmappings/cwtblockfilter.h"
+#include "heightmap/tfrmappings/constantqblockfilter.h"
 #include "heightmap/tfrmappings/waveformblockfilter.h"
 #include "heightmap/tfrmappings/cepstrumblockfilter.h"
 
@@ -41,10 +43,13 @@ int UnitTest::
         RUNTEST(Heightmap::TfrMapping);
         RUNTEST(Heightmap::Update::UpdateProducer);
         RUNTEST(Heightmap::Update::UpdateProducerDesc);
+        RUNTEST(Heightmap::Update::StreamingStftProducer);
         RUNTEST(Heightmap::TfrMappings::StftBlockFilter);
         RUNTEST(Heightmap::TfrMappings::StftBlockFilterDesc);
         RUNTEST(Heightmap::TfrMappings::CwtBlockFilter);
         RUNTEST(Heightmap::TfrMappings::CwtBlockFilterDesc);
+        RUNTEST(Heightmap::TfrMappings::ConstantQBlockFilter);
+        RUNTEST(Heightmap::TfrMappings::ConstantQBlockFilterDesc);
         RUNTEST(Heightmap::TfrMappings::WaveformBlockFilter);
         RUNTEST(Heightmap::TfrMappings::WaveformBlockFilterDesc);
         RUNTEST(Heightmap::TfrMappings::CepstrumBlockFilter);
@@ -7,6 +7,7 @@
 #include "tfr/chunk.h"
 
 #include "tasktimer.h"
+#include "tracerecorder.h"
 #include "timer.h"
 #include "log.h"
 #include "gl.h"
@@ -85,6 +86,8 @@ template <class Q>
 void UpdateConsumer::
         run()
 {
+    TraceRecorder::setThreadName ("UpdateConsumer");
+
     QGLWidget w(0, shared_gl_context);
     w.makeCurrent ();
 
@@ -108,6 +111,7 @@ void UpdateConsumer::
 
             unsigned num_jobs = jobqueue.size ();
             Timer t;
+            TRACE_SCOPE("UpdateConsumer jobs");
 
             while (!jobqueue.empty ())
             {
@@ -13,7 +13,7 @@ namespace Update {
  * @brief The UpdateProducer class should use a MergeChunk to update all
  * blocks in a tfrmap that matches a given Tfr::Chunk.
  */
-class UpdateProducer: public Tfr::ChunkFilter, public Tfr::ChunkFilter::NoInverseTag
+class UpdateProducer: public Tfr::ChunkFilter, public Tfr::ChunkFilter::NoInverseTag, public Tfr::ChunkFilter::ParallelChannelsTag
 {
 public:
     UpdateProducer( UpdateQueue::ptr update_queue, Heightmap::TfrMapping::const_ptr tfrmap, MergeChunk::ptr merge_chunk );
@@ -54,6 +54,15 @@ public:
      */
     Tfr::pChunkFilter createChunkFilter( Signal::ComputingEngine* engine=0 ) const;
 
+    /**
+     * @brief persistentId is empty. The output of UpdateProducer is written
+     * to the heightmap blocks and not to the returned buffer, so results
+     * of the heightmap target must never be loaded from a
+     * Signal::Processing::PersistentCache. The steps below the target may
+     * still be kept.
+     */
+    QString persistentId() const override { return QString(); }
+
 
     void setMergeChunkDesc( MergeChunkDesc::ptr mcdp ) { merge_chunk_desc_ = mcdp; }
 
@@ -21,6 +21,7 @@
 
 // Qt
 #include <QFileInfo>
+#include <QDateTime>
 #include <QVector>
 #include <QFile>
 #include <QByteArray>
@@ -33,6 +34,10 @@
 //#define TIME_AUDIOFILE_LINE(x) TIME(x)
 #define TIME_AUDIOFILE_LINE(x) x
 
+// Number of frames read from sndfile at a time, small enough for the
+// interleaved frames to stay in the cache while they are deinterleaved.
+#define READ_CHUNK_FRAMES (1<<14)
+
 
 using namespace std;
 using namespace boost;
@@ -182,7 +187,8 @@ Audiofile::
         _tried_load(false),
         _sample_rate(0),
         _number_of_samples(0),
-        _number_of_channels(0)
+        _number_of_channels(0),
+        last_read_end_(Signal::Interval::IntervalType_MIN)
 {
     _original_relative_filename = filename;
     _original_absolute_filename = QFileInfo(filename.c_str()).absoluteFilePath().toStdString();
@@ -248,8 +254,19 @@ Audiofile:: // for deserialization
             _tried_load(false),
             _sample_rate(0),
             _number_of_samples(0),
-            _number_of_channels(0)
+            _number_of_channels(0),
+            last_read_end_(Signal::Interval::IntervalType_MIN)
+{
+}
+
+
+Audiofile::
+        ~Audiofile()
 {
+    // The read ahead uses sndfile
+    std::lock_guard<std::mutex> l(read_ahead_lock_);
+    if (read_ahead_.valid ())
+        read_ahead_.wait ();
 }
 
 
@@ -304,45 +321,115 @@ Signal::pBuffer Audiofile::
     VERBOSE_AUDIOFILE tt.reset(new TaskTimer("Loading %s from '%s' (this=%p)",
                  I.toString().c_str(), filename().c_str(), this));
 
-    DataStorage<float> partialfile(DataStorageSize( num_channels(), I.count(), 1));
+    std::future<Signal::pBuffer> read_ahead;
+    bool sequential;
+    {
+        std::lock_guard<std::mutex> l(read_ahead_lock_);
+        if (read_ahead_.valid () && read_ahead_interval_ == I)
+            read_ahead = std::move(read_ahead_);
+        sequential = last_read_end_ == I.first || getInterval ().first == I.first;
+        last_read_end_ = I.last;
+    }
+
+    Signal::pBuffer waveform;
+    if (read_ahead.valid ())
+    {
+        VERBOSE_AUDIOFILE TaskInfo("Using read ahead");
+        waveform = read_ahead.get ();
+    }
+    else
+        waveform = readFrames (I);
+
+    if (!waveform)
+        return zeros( J );
+
+    // Files are mostly read from start to end when opened or scanned
+    if (sequential)
+        startReadAhead (I);
+
+    VERBOSE_AUDIOFILE TaskInfo(boost::format("Read %s, total signal length %s") % waveform->getInterval () % lengthLongFormat());
+    VERBOSE_AUDIOFILE TaskInfo(boost::format("Data size: %lu samples, %lu channels") % (size_t)sndfile->frames() % (size_t)sndfile->channels() );
+    VERBOSE_AUDIOFILE TaskInfo(boost::format("Sample rate: %lu samples/second") % sndfile->samplerate() );
+
+    return waveform;
+}
+
+
+Signal::pBuffer Audiofile::
+        readFrames( const Signal::Interval& I )
+{
+    std::lock_guard<std::mutex> l(sndfile_lock_);
+
     sf_count_t sndfilepos;
     TIME_AUDIOFILE_LINE( sndfilepos = sndfile->seek(I.first, SEEK_SET) );
     if (sndfilepos < 0)
     {
         TaskInfo("%s", str(format("ERROR! Couldn't set read position to %d. An error occured (%d)") % I.first % sndfilepos).c_str());
-        return zeros( J );
+        return Signal::pBuffer();
     }
     if (sndfilepos != I.first)
     {
         TaskInfo("%s", str(format("ERROR! Couldn't set read position to %d. sndfilepos was %d") % I.first % sndfilepos).c_str());
-        return zeros( J );
+        return Signal::pBuffer();
     }
 
-    float* data = CpuMemoryStorage::WriteAll<float,3>( &partialfile ).ptr();
-    sf_count_t readframes;
-    TIME_AUDIOFILE_LINE( readframes = sndfile->read(data, num_channels()*I.count())); // read float
+    int channels = num_channels();
+    Signal::pBuffer waveform( new Signal::Buffer(I.first, I.count(), sample_rate(), channels, Signal::Buffer::Layout_Planar));
 
-    Signal::pBuffer waveform( new Signal::Buffer(I.first, I.count(), sample_rate(), num_channels()));
-    Signal::pTimeSeriesData mergedata = waveform->mergeChannelData ();
-    TIME_AUDIOFILE_LINE( Signal::transpose( mergedata.get(), &partialfile ) );
-    waveform.reset (new Signal::Buffer(I.first, mergedata, sample_rate()));
+    std::vector<float*> dest(channels);
+    for (int c=0; c<channels; c++)
+        dest[c] = CpuMemoryStorage::WriteAll<1>( waveform->getChannel (c)->waveform_data() ).ptr();
 
-    if ((sf_count_t)I.count() > readframes)
+    interleaved_.resize ((size_t)channels*READ_CHUNK_FRAMES);
+
+    sf_count_t readframes = 0;
+    while (readframes < (sf_count_t)I.count())
     {
-        I.last = I.first + readframes;
-        Signal::pBuffer waveform2( new Signal::Buffer(I.first, I.count(), sample_rate(), num_channels()));
-        *waveform2 |= *waveform;
-        waveform.swap (waveform2);
+        sf_count_t n = std::min((sf_count_t)READ_CHUNK_FRAMES, (sf_count_t)I.count() - readframes);
+        sf_count_t r;
+        TIME_AUDIOFILE_LINE( r = sndfile->readf(&interleaved_[0], n) ); // read float
+
+        Signal::deinterleave (&dest[0], &interleaved_[0], channels, r);
+        for (int c=0; c<channels; c++)
+            dest[c] += r;
+
+        readframes += r;
+        if (r < n)
+            break;
     }
 
-    VERBOSE_AUDIOFILE TaskInfo(boost::format("Read %s, total signal length %s") % I % lengthLongFormat());
-    VERBOSE_AUDIOFILE TaskInfo(boost::format("Data size: %lu samples, %lu channels") % (size_t)sndfile->frames() % (size_t)sndfile->channels() );
-    VERBOSE_AUDIOFILE TaskInfo(boost::format("Sample rate: %lu samples/second") % sndfile->samplerate() );
+    if ((sf_count_t)I.count() > readframes)
+    {
+        // Share the samples that were read instead of copying them
+        Signal::Interval read(I.first, I.first + readframes);
+        waveform = waveform->view (read);
+    }
 
     return waveform;
 }
 
 
+void Audiofile::
+        startReadAhead( const Signal::Interval& I )
+{
+    Signal::Interval next = readRawInterval(Signal::Interval(I.last, I.last+1));
+    if (!(next & getInterval ()) || next.first != I.last)
+        return;
+
+    // An unused read ahead is waited for when 'stale' goes out of scope,
+    // after read_ahead_lock_ is released.
+    std::future<Signal::pBuffer> stale;
+
+    std::lock_guard<std::mutex> l(read_ahead_lock_);
+    if (read_ahead_.valid () && read_ahead_interval_ == next)
+        return;
+
+    stale = std::move(read_ahead_);
+    read_ahead_interval_ = next;
+    read_ahead_ = std::async(std::launch::async, [this, next]() { return this->readFrames (next); });
+}
+
+
 Signal::Interval Audiofile::
         readRawInterval( const Signal::Interval& J )
 {
@@ -449,7 +536,18 @@ AudiofileDesc::
         AudiofileDesc(boost::shared_ptr<Audiofile> audiofile)
     :
       audiofile_(audiofile)
-{}
+{
+    // Identifies the contents of the file by its size and modification time
+    QFileInfo info(audiofile_->filename ().c_str ());
+    if (info.exists ())
+        persistent_id_ = QString("Audiofile %1 %2 bytes modified %3, %4 channels, %5 samples at %6 Hz")
+                .arg (info.absoluteFilePath ())
+                .arg (info.size ())
+                .arg (info.lastModified ().toMSecsSinceEpoch ())
+                .arg (audiofile_->num_channels ())
+                .arg (audiofile_->number_of_samples ())
+                .arg (audiofile_->sample_rate ());
+}
 
 
 Signal::Interval AudiofileDesc::
@@ -506,6 +604,13 @@ QString AudiofileDesc::
 }
 
 
+QString AudiofileDesc::
+        persistentId() const
+{
+    return persistent_id_;
+}
+
+
 bool AudiofileDesc::
         operator==(const OperationDesc& d) const
 {
@@ -515,3 +620,100 @@ bool AudiofileDesc::
 }
 
 } // namespace Adapters
+
+
+#include <QDir>
+
+namespace Adapters {
+
+void Audiofile::
+        test()
+{
+    // It should read intervals of a multichannel file into the channels of
+    // the returned buffer, also across the chunks that are read from sndfile
+    // at a time and across the intervals of readRawInterval.
+    {
+        std::string path = (QDir::tempPath () + QDir::separator () + "sonicawe-audiofile-test.wav").toStdString ();
+        const int C = 3;
+        const float fs = 8000;
+        const Signal::IntervalType N = (1<<20) + 3*READ_CHUNK_FRAMES/2 + 17;
+
+        // Float samples are stored exactly
+        std::vector<float> interleaved((size_t)N*C);
+        for (Signal::IntervalType i=0; i<N; i++)
+            for (int c=0; c<C; c++)
+                interleaved[i*C + c] = (i % 1009)*(c+1) - 500*c;
+
+        {
+            SndfileHandle out(path, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_FLOAT, C, fs);
+            EXCEPTION_ASSERT_EQUALS(out.writef (&interleaved[0], N), N);
+        }
+
+        auto check = [&interleaved](Signal::pBuffer b) {
+            for (int c=0; c<C; c++)
+            {
+                const float* p = CpuMemoryStorage::ReadOnly<1>( b->getChannel (c)->waveform_data() ).ptr();
+                Signal::Interval I = b->getInterval ();
+                for (Signal::IntervalType i=I.first; i<I.last; i++)
+                    EXCEPTION_ASSERT_EQUALS(p[i - I.first], interleaved[i*C + c]);
+            }
+        };
+
+        {
+            Audiofile a(path);
+            EXCEPTION_ASSERT_EQUALS(a.num_channels (), (unsigned)C);
+            EXCEPTION_ASSERT_EQUALS(a.sample_rate (), fs);
+            EXCEPTION_ASSERT_EQUALS(a.getInterval (), Signal::Interval(0, N));
+
+            // Read in chunks of READ_CHUNK_FRAMES
+            Signal::pBuffer b = a.readRaw (Signal::Interval(100, 2*READ_CHUNK_FRAMES));
+            EXCEPTION_ASSERT_EQUALS(b->getInterval (), Signal::Interval(0, 1<<20));
+            EXCEPTION_ASSERT_EQUALS((int)b->number_of_channels (), C);
+            check (b);
+
+            // The next interval is read ahead, and returned by the next
+            // sequential read
+            {
+                std::lock_guard<std::mutex> l(a.read_ahead_lock_);
+                EXCEPTION_ASSERT(a.read_ahead_.valid ());
+                EXCEPTION_ASSERT_EQUALS(a.read_ahead_interval_, Signal::Interval(1<<20, N));
+            }
+
+            b = a.readRaw (Signal::Interval((1<<20) + 5, (1<<20) + 10));
+            EXCEPTION_ASSERT_EQUALS(b->getInterval (), Signal::Interval(1<<20, N));
+            check (b);
+            {
+                std::lock_guard<std::mutex> l(a.read_ahead_lock_);
+                EXCEPTION_ASSERT(!a.read_ahead_.valid ());
+            }
+
+            // The same interval can be read again
+            b = a.readRaw (Signal::Interval(READ_CHUNK_FRAMES, READ_CHUNK_FRAMES+1));
+            EXCEPTION_ASSERT_EQUALS(b->getInterval (), Signal::Interval(0, 1<<20));
+            check (b);
+
+            // Samples after the end are zeros
+            b = a.readRaw (Signal::Interval(N, N+10));
+            EXCEPTION_ASSERT_EQUALS(b->getInterval ().first, N);
+            EXCEPTION_ASSERT_EQUALS(b->getChannel (0)->waveform_data()->getCpuMemory ()[0], 0.f);
+        }
+
+        // It should return the samples that could be read if the file is
+        // truncated after it was opened.
+        {
+            Audiofile a(path);
+            const Signal::IntervalType K = 2*READ_CHUNK_FRAMES + 3;
+            qint64 header = QFileInfo(path.c_str ()).size () - N*C*(qint64)sizeof(float);
+            EXCEPTION_ASSERT(QFile::resize (path.c_str (), header + K*C*(qint64)sizeof(float)));
+
+            Signal::pBuffer b = a.readRaw (Signal::Interval(K-10, K));
+            EXCEPTION_ASSERT_EQUALS(b->getInterval (), Signal::Interval(0, K));
+            EXCEPTION_ASSERT_EQUALS((int)b->number_of_channels (), C);
+            check (b);
+        }
+
+        QFile::remove (path.c_str ());
+    }
+}
+
+} // namespace Adapters
@@ -248,6 +248,10 @@
 #include <QByteArray>
 #include <QFile>
 
+// std
+#include <future>
+#include <mutex>
+
 
 class SndfileHandle;
 
@@ -324,6 +328,7 @@ public:
     static bool hasExpectedSuffix( const std::string& suffix );
 
     Audiofile(std::string filename);
+    ~Audiofile();
 
     virtual std::string name();
     virtual Signal::IntervalType number_of_samples();
@@ -343,6 +348,18 @@ private:
      */
     bool tryload();
 
+    /**
+     * @brief readFrames reads 'I' from sndfile and deinterleaves the frames
+     * in chunks directly into the channels of the returned buffer.
+     */
+    Signal::pBuffer readFrames(const Signal::Interval& I);
+
+    /**
+     * @brief startReadAhead starts reading the interval following 'I' on a
+     * background thread, unless a read ahead is already running.
+     */
+    void startReadAhead(const Signal::Interval& I);
+
     /// file can be a QTemporaryFile that deletes itself upon destruction
     boost::shared_ptr<QFile> file;
     boost::shared_ptr<SndfileHandle> sndfile;
@@ -354,6 +371,16 @@ private:
     Signal::IntervalType _number_of_samples;
     unsigned _number_of_channels;
 
+    /// Guards sndfile and interleaved_ which is reused between reads.
+    std::mutex sndfile_lock_;
+    std::vector<float> interleaved_;
+
+    /// Guards read_ahead_ and read_ahead_interval_.
+    std::mutex read_ahead_lock_;
+    Signal::Interval read_ahead_interval_;
+    std::future<Signal::pBuffer> read_ahead_;
+    Signal::IntervalType last_read_end_;
+
     std::vector<char> getRawFileData(unsigned i, unsigned bytes_per_chunk);
     void appendToTempfile(std::vector<char> rawFileData, unsigned i, unsigned bytes_per_chunk);
 
@@ -426,6 +453,9 @@ private:
         }
 #endif
     }
+
+public:
+    static void test();
 };
 
 
@@ -450,9 +480,11 @@ public:
     virtual OperationDesc::ptr copy() const;
     virtual Extent extent() const;
     virtual QString toString() const;
+    virtual QString persistentId() const;
     virtual bool operator==(const OperationDesc& d) const;
 private:
     boost::shared_ptr<Audiofile> audiofile_;
+    QString persistent_id_; // Looked up once instead of on every pass of the scheduler
 };
 
 } // namespace Adapters
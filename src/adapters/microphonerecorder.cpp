@@ -3,6 +3,7 @@
 #include "sawe/configuration.h"
 
 #include "tasktimer.h"
+#include "tracerecorder.h"
 #include "demangle.h"
 
 #include <iostream>
@@ -313,6 +314,14 @@ int MicrophoneRecorder::
                  const PaStreamCallbackTimeInfo * /*timeInfo*/,
                  PaStreamCallbackFlags /*statusFlags*/)
 {
+    static thread_local bool named_thread = false;
+    if (!named_thread && TraceRecorder::enabled ())
+    {
+        TraceRecorder::setThreadName ("MicrophoneRecorder");
+        named_thread = true;
+    }
+    TRACE_SCOPE("MicrophoneRecorder::writeBuffer");
+
     try {
     Signal::IntervalType offset = actual_number_of_samples();
 
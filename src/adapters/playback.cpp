@@ -2,6 +2,7 @@
 
 #include "cpumemorystorage.h"
 #include "tasktimer.h"
+#include "tracerecorder.h"
 
 #include <iostream>
 #include <stdexcept>
@@ -573,6 +574,14 @@ int Playback::
                  const PaStreamCallbackTimeInfo * /*timeInfo*/,
                  PaStreamCallbackFlags /*statusFlags*/)
 {
+    static thread_local bool named_thread = false;
+    if (!named_thread && TraceRecorder::enabled ())
+    {
+        TraceRecorder::setThreadName ("Playback");
+        named_thread = true;
+    }
+    TRACE_SCOPE("Playback::readBuffer");
+
     float FS;
     TIME_PLAYBACK FS = _data.sample_rate();
     TIME_PLAYBACK TaskTimer("Playback::readBuffer Reading [%d, %d)%u# from %d. [%g, %g)%g s",
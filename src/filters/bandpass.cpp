@@ -115,6 +115,16 @@ Tfr::ChunkFilterDesc::ptr Bandpass::
 }
 
 
+QString Bandpass::
+        persistentId() const
+{
+    return QString("Bandpass f1=%1, f2=%2, save_inside=%3")
+            .arg (_f1, 0, 'g', 9)
+            .arg (_f2, 0, 'g', 9)
+            .arg ((int)_save_inside);
+}
+
+
 bool Bandpass::
         isInteriorSelected() const
 {
@@ -9,7 +9,7 @@
 
 namespace Filters {
 
-class BandpassKernel: public Tfr::ChunkFilter
+class BandpassKernel: public Tfr::ChunkFilter, public Tfr::ChunkFilter::ParallelChannelsTag
 {
 public:
     BandpassKernel(float f1, float f2, bool save_inside=false);
@@ -34,6 +34,7 @@ public:
     // ChunkFilterDesc
     Tfr::pChunkFilter    createChunkFilter(Signal::ComputingEngine* engine) const;
     ChunkFilterDesc::ptr copy() const;
+    QString              persistentId() const;
 
     // Filters::Selection
     bool isInteriorSelected() const override;
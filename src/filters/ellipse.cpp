@@ -82,6 +82,18 @@ ChunkFilterDesc::ptr Ellipse::
 }
 
 
+QString Ellipse::
+        persistentId() const
+{
+    return QString("Ellipse t=%1, f=%2, t+r=%3, f+r=%4, save_inside=%5")
+            .arg (_centre_t, 0, 'g', 9)
+            .arg (_centre_f, 0, 'g', 9)
+            .arg (_centre_plus_radius_t, 0, 'g', 9)
+            .arg (_centre_plus_radius_f, 0, 'g', 9)
+            .arg ((int)_save_inside);
+}
+
+
 std::string Ellipse::
         name()
 {
@@ -8,7 +8,7 @@
 
 namespace Filters {
 
-class EllipseKernel: public Tfr::ChunkFilter
+class EllipseKernel: public Tfr::ChunkFilter, public Tfr::ChunkFilter::ParallelChannelsTag
 {
 public:
     EllipseKernel(float t1, float f1, float t2, float f2, bool save_inside=false);
@@ -32,6 +32,7 @@ public:
     // ChunkFilterDesc
     Tfr::pChunkFilter       createChunkFilter(Signal::ComputingEngine* engine=0) const;
     ChunkFilterDesc::ptr    copy() const;
+    QString                 persistentId() const;
 
     float _centre_t, _centre_f, _centre_plus_radius_t, _centre_plus_radius_f;
     bool _save_inside;
@@ -61,6 +61,14 @@ Tfr::pChunkFilter EnvelopeDesc::
 }
 
 
+QString EnvelopeDesc::
+        persistentId() const
+{
+    // No parameters besides the transform
+    return "Envelope";
+}
+
+
 void EnvelopeDesc::
         transformDesc( Tfr::pTransformDesc m )
 {
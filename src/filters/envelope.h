@@ -14,7 +14,7 @@ namespace Filters {
  * than 256 samples. Or a frequency lower than FS/256 (i.e 44100/256=172 Hz).
  * Note that a lower modulation frequency is still detected.
  */
-class Envelope: public Tfr::ChunkFilter
+class Envelope: public Tfr::ChunkFilter, public Tfr::ChunkFilter::NoFusionTag
 {
 public:
     void operator()( Tfr::ChunkAndInverse& chunk );
@@ -33,6 +33,7 @@ public:
 
     Tfr::pChunkFilter createChunkFilter(Signal::ComputingEngine* engine) const;
     void transformDesc( Tfr::pTransformDesc m );
+    QString persistentId() const;
 
 public:
     static void test();
@@ -90,6 +90,18 @@ ChunkFilterDesc::ptr Rectangle::
 }
 
 
+QString Rectangle::
+        persistentId() const
+{
+    return QString("Rectangle s1=%1, f1=%2, s2=%3, f2=%4, save_inside=%5")
+            .arg (_s1, 0, 'g', 9)
+            .arg (_f1, 0, 'g', 9)
+            .arg (_s2, 0, 'g', 9)
+            .arg (_f2, 0, 'g', 9)
+            .arg ((int)_save_inside);
+}
+
+
 bool Rectangle::
         isInteriorSelected() const
 {
@@ -167,6 +179,7 @@ Signal::Intervals Rectangle::
 #include "test/randombuffer.h"
 #include "tfr/transformoperation.h"
 #include "tasktimer.h"
+#include "cpumemorystorage.h"
 
 #include <QApplication>
 
@@ -194,6 +207,38 @@ void Rectangle::
         n->updateNeeds(Signal::Interval(0,10));
         EXCEPTION_ASSERT( n->sleep (200) );
     }
+
+    // It should filter the channels of a buffer concurrently, each channel
+    // as if it was filtered alone.
+    {
+        Tfr::ChunkFilterDesc::ptr cfd(new Rectangle(0.1,200,0.3,400,false));
+        Tfr::pChunkFilter f = cfd.read ()->createChunkFilter (0);
+        EXCEPTION_ASSERT(dynamic_cast<Tfr::ChunkFilter::ParallelChannelsTag*>(f.get ()));
+
+        TransformOperationDesc tod(cfd);
+        Signal::Interval expected;
+        Signal::Interval I = tod.requiredInterval (Signal::Interval(0,1000), &expected);
+
+        const int C = 32;
+        Signal::pBuffer b = Test::RandomBuffer::randomBuffer (I, 2000, C);
+        Signal::pBuffer r = tod.createOperation (0)->process (b);
+        EXCEPTION_ASSERT(r);
+        EXCEPTION_ASSERT_EQUALS((int)r->number_of_channels (), C);
+
+        for (int c=0; c<C; c+=7)
+          {
+            Signal::pBuffer bc(new Signal::Buffer(b->getChannel (c)));
+            Signal::pBuffer rc = tod.createOperation (0)->process (bc);
+            EXCEPTION_ASSERT_EQUALS(rc->getInterval (), r->getInterval ());
+
+            const float* p = r->getChannel (c)->waveform_data ()->getCpuMemory ();
+            const float* q = rc->getChannel (0)->waveform_data ()->getCpuMemory ();
+            float maxdiff = 0;
+            for (int i=0; i<(int)rc->number_of_samples (); i++)
+                maxdiff = std::max(maxdiff, std::fabs(p[i] - q[i]));
+            EXCEPTION_ASSERT_LESS(maxdiff, 1e-5f);
+          }
+    }
 }
 
 } // namespace Filters
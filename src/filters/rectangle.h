@@ -9,7 +9,7 @@
 
 namespace Filters {
 
-class RectangleKernel: public Tfr::CwtChunkFilter
+class RectangleKernel: public Tfr::CwtChunkFilter, public Tfr::ChunkFilter::ParallelChannelsTag
 {
 public:
     RectangleKernel(float s1, float f1, float s2, float f2, bool save_inside=false);
@@ -34,6 +34,7 @@ public:
     Tfr::pChunkFilter               createChunkFilter(Signal::ComputingEngine* engine) const;
     Signal::OperationDesc::Extent   extent() const;
     ChunkFilterDesc::ptr            copy() const;
+    QString                         persistentId() const;
 
     // Filters::Selection
     bool isInteriorSelected() const override;
@@ -7,11 +7,13 @@
 #include "tfr/cwt.h"
 #include "configuration.h"
 #include "tools/applicationerrorlogcontroller.h"
+#include "signal/processing/persistentcache.h"
 
 // gpumisc
 #include "demangle.h"
 #include "computationkernel.h"
 #include "glinfo.h"
+#include "tracerecorder.h"
 
 // std
 #include <sstream>
@@ -112,6 +114,12 @@ Application::
     Sawe::Configuration::resetDefaultSettings();
     Sawe::Configuration::parseCommandLineOptions(argc, argv);
 
+    if (Sawe::Configuration::feature("trace"))
+    {
+        TraceRecorder::setEnabled (true);
+        TraceRecorder::setThreadName ("Render");
+    }
+
     if (!Sawe::Configuration::use_saved_state())
     {
         QSettings().remove("reset on next startup");
@@ -128,6 +136,13 @@ Application::
         QSettings().setValue("value", value);
     }
 
+    // Opt-in, keeps results of processing steps between sessions
+    if (QSettings().value("persistent cache", false).toBool())
+    {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/steps";
+        Signal::Processing::PersistentCache::global ().set_directory (dir.toStdString ());
+    }
+
     if (!prevent_log_system_and_execute_args)
     {
         execute_command_line_options(); // will call 'exit(0)' on invalid arguments
@@ -141,6 +156,15 @@ Application::
 
     _projects.clear();
     delete shared_glwidget_;
+
+    if (TraceRecorder::enabled ())
+    {
+        string filename = log_directory().toStdString () + "/sonicawe-trace.json";
+        if (TraceRecorder::dump (filename))
+            TaskInfo("Wrote trace to %s", filename.c_str ());
+        else
+            TaskInfo("Couldn't write trace to %s", filename.c_str ());
+    }
 }
 
 
@@ -355,6 +355,9 @@ static const char _sawe_usage_string[] =
     "    --mono=1            Makes Sonic AWE only process the first channel\n"
     "    --use_saved_state=0 Disables restoring old user interface states\n"
     "    --skip_update_check=1 Disables checking for new versions\n"
+    "    --feature=trace     Records a timeline of all threads into\n"
+    "                        sonicawe-trace.json in the log directory, open it in\n"
+    "                        chrome://tracing or ui.perfetto.dev\n"
     "\n"
     "Ways of extracting data from a Continious Gabor Wavelet Transform (CWT)\n"
     "    --get_csv=number    Saves the given chunk number into sawe.csv which \n"
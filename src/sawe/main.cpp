@@ -239,6 +239,9 @@ int main(int argc, char *argv[])
     if (argc == 2 && 0 == strcmp(argv[1],"--test"))
         return Test::UnitTest::test ();
 
+    if (argc == 2 && 0 == strcmp(argv[1],"--benchmark"))
+        return Test::UnitTest::benchmark ();
+
 #ifdef USE_CUDA
     if (0) {
         ResampleTest rt;
@@ -354,7 +354,9 @@ void Project::
 
     TaskTimer tt("Project::createMainWindow");
 
-    processing_chain_ = Signal::Processing::Chain::createDefaultChain ();
+    // Let the cpu workers prefetch a few tasks at a time and steal from each
+    // other instead of all waiting for the scheduler
+    processing_chain_ = Signal::Processing::Chain::createDefaultChain (4);
 
     command_invoker_.reset( new Tools::Commands::CommandInvoker(this) );
 
@@ -170,6 +170,12 @@ useopencl {
 usecuda: CONFIG += cuda
 
 
+# #######################################################################
+# FFTW
+# #######################################################################
+usefftw: CONFIG += fftw
+
+
 # #######################################################################
 # Deploy configuration
 # #######################################################################
@@ -33,6 +33,7 @@
 #include "tools/openwatchedfilecontroller.h"
 #include "tools/recordmodel.h"
 #include "tools/applicationerrorlogcontroller.h"
+#include "adapters/audiofile.h"
 #include "adapters/playback.h"
 #include "adapters/microphonerecorder.h"
 #include "filters/absolutevalue.h"
@@ -90,6 +91,7 @@ int UnitTest::
         RUNTEST(Gauss);
         // PortAudio complains if testing Microphone in the end
         RUNTEST(Adapters::MicrophoneRecorderDesc);
+        RUNTEST(Adapters::Audiofile);
         RUNTEST(Filters::Selection);
         RUNTEST(Filters::EnvelopeDesc);
         RUNTEST(Filters::Normalize);
@@ -150,4 +152,11 @@ int UnitTest::
     return 0;
 }
 
+
+int UnitTest::
+        benchmark()
+{
+    return Tfr::UnitTest::benchmark (false);
+}
+
 } // namespace Test
@@ -7,6 +7,11 @@ class UnitTest
 {
 public:
     static int test();
+
+    /**
+     * @brief benchmark runs the benchmarks of all libraries.
+     */
+    static int benchmark();
 };
 
 } // namespace Test
@@ -125,6 +125,8 @@ void RecordController::
     connect(model()->render_view, SIGNAL(destroying()), SLOT(destroying()));
     connect(model()->render_view, SIGNAL(prePaint()), view_, SLOT(prePaint()));
 
+    model()->streamStft (model()->render_view->model);
+
     if (model()->recording)
     {
         ui->actionRecord->setVisible (true);
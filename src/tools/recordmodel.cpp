@@ -3,9 +3,16 @@
 #include "adapters/recorder.h"
 #include "adapters/microphonerecorder.h"
 #include "sawe/project.h"
+#include "rendermodel.h"
+#include "heightmap/update/streamingstftproducer.h"
+#include "signal/processing/graphinvalidator.h"
 
 #include <QSemaphore>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace Tools
 {
 
@@ -34,12 +41,54 @@ RecordModel::
 class GotDataCallback: public Adapters::Recorder::IGotDataCallback
 {
 public:
-    void setInvalidator(Signal::Processing::IInvalidator::ptr i) { i_ = i; }
+    ~GotDataCallback() {
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            quit_ = true;
+        }
+
+        wakeup_.notify_all ();
+        if (thread_.joinable ())
+            thread_.join ();
+    }
+
+    void setInvalidator(Signal::Processing::IInvalidator::ptr i) {
+        i_ = i;
+
+        // To find out if the heightmap reads the recording directly
+        auto g = dynamic_cast<const Signal::Processing::GraphInvalidator*>(i.raw ());
+        std::lock_guard<std::mutex> l(lock_);
+        dag_ = g ? g->dag () : Signal::Processing::Dag::ptr::weak_ptr();
+        recorder_step_ = g ? g->step () : Signal::Processing::Step::ptr::weak_ptr();
+    }
+
     void setRecordModel(RecordModel* model) { model_ = model; }
+    void setStreamingStft(Heightmap::Update::StreamingStftProducer::ptr stft,
+                          Signal::Processing::Step::ptr::weak_ptr target,
+                          Adapters::Recorder::ptr::weak_ptr recording) {
+        std::lock_guard<std::mutex> l(lock_);
+        stft_ = stft;
+        target_ = target;
+        recording_ = recording;
+        if (!thread_.joinable ())
+            thread_ = std::thread(&GotDataCallback::run, this);
+    }
 
+    // Called from the audio callback, the stft is computed in thread_
     virtual void markNewlyRecordedData(Signal::Interval what) {
         if (i_)
             i_.read ()->deprecateCache(what);
+
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (Adapters::Recorder::ptr recording = recording_.lock ())
+            {
+                data_ = recording.raw ()->data ();
+                pending_ = pending_ ? pending_.spanned (what) : what;
+                wakeup_.notify_one ();
+            }
+        }
+
         if (model_)
             emit model_->markNewlyRecordedData(what);
     }
@@ -47,6 +96,77 @@ public:
 private:
     Signal::Processing::IInvalidator::ptr i_;
     RecordModel* model_ = 0;
+
+    // Guarded by lock_
+    std::mutex lock_;
+    std::condition_variable wakeup_;
+    Signal::Interval pending_;
+    shared_state<Adapters::Recorder::Data> data_;
+    Heightmap::Update::StreamingStftProducer::ptr stft_;
+    Signal::Processing::Step::ptr::weak_ptr target_;
+    Signal::Processing::Step::ptr::weak_ptr recorder_step_;
+    Signal::Processing::Dag::ptr::weak_ptr dag_;
+    Adapters::Recorder::ptr::weak_ptr recording_;
+    bool quit_ = false;
+    std::thread thread_;
+
+    void run() {
+        std::unique_lock<std::mutex> l(lock_);
+        while (!quit_)
+        {
+            if (!pending_)
+            {
+                wakeup_.wait (l);
+                continue;
+            }
+
+            Signal::Interval what = pending_;
+            pending_ = Signal::Interval();
+            shared_state<Adapters::Recorder::Data> data = data_;
+            Heightmap::Update::StreamingStftProducer::ptr stft = stft_;
+            Signal::Processing::Step::ptr target = target_.lock ();
+            Signal::Processing::Step::ptr recorder_step = recorder_step_.lock ();
+            Signal::Processing::Dag::ptr dag = dag_.lock ();
+
+            l.unlock ();
+            if (target && recorder_step && dag && readsDirectly (dag, target, recorder_step))
+                stream (stft, data, target, what);
+            l.lock ();
+        }
+    }
+
+    // Filters between the recorder and the heightmap would be skipped
+    static bool readsDirectly(Signal::Processing::Dag::ptr dag, Signal::Processing::Step::ptr target,
+                              Signal::Processing::Step::ptr recorder_step) {
+        std::vector<Signal::Processing::Step::ptr> sources = dag.read ()->sourceSteps (target);
+        return 1 == sources.size () && sources[0] == recorder_step;
+    }
+
+    static void stream(Heightmap::Update::StreamingStftProducer::ptr stft, shared_state<Adapters::Recorder::Data> data,
+                       Signal::Processing::Step::ptr target, Signal::Interval what) {
+        // Recorder::data is lock free
+        Signal::pBuffer b = data.read ()->samples.read (what);
+        Signal::Intervals streamed = stft.write ()->push (b);
+
+        // The heightmap is already up to date for the streamed samples
+        if (streamed)
+            markAsComputed (target, streamed, b->sample_rate (), b->number_of_channels ());
+    }
+
+    static void markAsComputed(Signal::Processing::Step::ptr target, Signal::Intervals streamed, float fs, unsigned num_channels) {
+        std::vector<std::pair<int, Signal::Interval>> tasks;
+        {
+            auto step = target.write ();
+            for (const Signal::Interval& I : streamed & step->not_started ())
+                tasks.push_back (std::make_pair (step->registerTask (I), I));
+        }
+
+        // Same as the output of the heightmap target, which only writes to
+        // the heightmap and returns silence
+        for (const auto& t : tasks)
+            Signal::Processing::Step::finishTask (target, t.first, Signal::pBuffer(
+                    new Signal::Buffer(t.second, fs, num_channels)));
+    }
 };
 
 
@@ -63,6 +183,7 @@ RecordModel* RecordModel::
     RecordModel* record_model = new RecordModel(project, render_view, recorder);
     record_model->recorder_desc = desc;
     record_model->invalidator = i;
+    record_model->callback_ = callback;
 
     dynamic_cast<GotDataCallback*>(&*callback.write ())->setInvalidator (i);
     dynamic_cast<GotDataCallback*>(&*callback.write ())->setRecordModel (record_model);
@@ -71,6 +192,19 @@ RecordModel* RecordModel::
 }
 
 
+void RecordModel::
+        streamStft( RenderModel* render_model )
+{
+    Heightmap::Update::StreamingStftProducer::ptr stft(new Heightmap::Update::StreamingStftProducer(
+            render_model->block_update_queue,
+            render_model->tfr_mapping (),
+            render_model->get_stft_block_filter_params ()));
+
+    dynamic_cast<GotDataCallback*>(&*callback_.write ())->setStreamingStft (
+                stft, render_model->target_marker ()->step (), recording);
+}
+
+
 //bool RecordModel::
 //        canCreateRecordModel( Sawe::Project* )
 //{
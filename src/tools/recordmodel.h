@@ -13,6 +13,7 @@ namespace Tools
 {
 
 class RenderView;
+class RenderModel;
 
 /**
  * @brief The RecordModel class should describe the operation required to perform a recording.
@@ -43,6 +44,19 @@ public:
 
     Signal::OperationDesc::ptr recorderDesc() { return recorder_desc; }
 
+    /**
+     * @brief streamStft merges the stft of newly recorded samples into the
+     * heightmap of 'render_model' as they arrive, see
+     * Heightmap::Update::StreamingStftProducer. The heightmap target is then
+     * up to date for those samples, so the workers don't compute whole
+     * chunks again for each piece of the recording.
+     *
+     * The stft is computed in a thread of its own, not in the audio callback.
+     * Nothing is streamed while there are filters between the recording and
+     * the heightmap target, the workers compute the heightmap then.
+     */
+    void streamStft( RenderModel* render_model );
+
 signals:
     void markNewlyRecordedData(Signal::Interval what);
 
@@ -50,6 +64,7 @@ private:
     RecordModel( Sawe::Project* project, RenderView* render_view, Adapters::Recorder::ptr recording );
 
     Signal::OperationDesc::ptr recorder_desc;
+    Adapters::Recorder::IGotDataCallback::ptr callback_;
 
 public:
     static void test();
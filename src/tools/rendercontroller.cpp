@@ -19,7 +19,9 @@
 #include "heightmap/tfrmappings/stftblockfilter.h"
 #include "heightmap/tfrmappings/cwtblockfilter.h"
 #include "heightmap/tfrmappings/cepstrumblockfilter.h"
+#include "heightmap/tfrmappings/constantqblockfilter.h"
 #include "tfr/cwt.h"
+#include "tfr/constantq.h"
 #include "tfr/stft.h"
 #include "tfr/cepstrum.h"
 #include "tfr/transformoperation.h"
@@ -279,12 +281,18 @@ void RenderController::
         transformChanged()
 {
     bool isCwt = dynamic_cast<const Tfr::Cwt*>(currentTransform().get ());
+    bool isConstantQ = dynamic_cast<const Tfr::ConstantQDesc*>(currentTransform().get ());
 
     if (isCwt)
     {
         float scales_per_octave = model()->transform_descs ()->getParam<Tfr::Cwt>().scales_per_octave ();
         tf_resolution->setValue ( scales_per_octave );
     }
+    else if (isConstantQ)
+    {
+        int bins_per_octave = model()->transform_descs ()->getParam<Tfr::ConstantQDesc>().bins_per_octave ();
+        tf_resolution->setValue ( bins_per_octave );
+    }
     else
     {
         int chunk_size = model()->transform_descs ()->getParam<Tfr::StftDesc>().chunk_size ();
@@ -340,8 +348,11 @@ void RenderController::
         receiveSetTimeFrequencyResolution( qreal value )
 {
     bool isCwt = dynamic_cast<const Tfr::Cwt*>(currentTransform().get ());
+    bool isConstantQ = dynamic_cast<const Tfr::ConstantQDesc*>(currentTransform().get ());
     if (isCwt)
         model()->transform_descs ()->getParam<Tfr::Cwt>().scales_per_octave ( value );
+    else if (isConstantQ)
+        model()->transform_descs ()->getParam<Tfr::ConstantQDesc>().bins_per_octave ( (int)(value + 0.5) );
     else
         model()->transform_descs ()->getParam<Tfr::StftDesc>().set_approximate_chunk_size( value );
 
@@ -417,8 +428,11 @@ void RenderController::
 
         // TODO add tfr resolution string to TransformDesc
         bool isCwt = dynamic_cast<const Tfr::Cwt*>(t.get ());
+        const Tfr::ConstantQDesc* cq = dynamic_cast<const Tfr::ConstantQDesc*>(t.get ());
         if (isCwt)
             tf_resolution->setToolTip(QString("Time/frequency resolution\nMorlet std: %1\nScales per octave").arg(c.sigma(), 0, 'f', 1));
+        else if (cq)
+            tf_resolution->setToolTip(QString("Time/frequency resolution\nQ: %1\nBins per octave").arg(cq->q(), 0, 'f', 1));
         else
             tf_resolution->setToolTip(QString("Time/frequency resolution\nSTFT window: %1 samples").arg(s.chunk_size()));
     }
@@ -450,6 +464,7 @@ void RenderController::
 
     std::string oldTransform_name = currentTransform() ? vartype(*currentTransform()) : "(null)";
     bool wasCwt = dynamic_cast<const Tfr::Cwt*>(currentTransform().get ());
+    bool wasConstantQ = dynamic_cast<const Tfr::ConstantQDesc*>(currentTransform().get ());
 
     model()->set_filter (adapter);
 
@@ -463,6 +478,7 @@ void RenderController::
     hz_scale->setEnabled( true );
 
     bool isCwt = dynamic_cast<const Tfr::Cwt*>(currentTransform().get ());
+    bool isConstantQ = dynamic_cast<const Tfr::ConstantQDesc*>(currentTransform().get ());
 
     if (isCwt || wasCwt) {
         auto td = model()->transform_descs ().write ();
@@ -492,6 +508,19 @@ void RenderController::
         c.wavelet_fast_time_support( wavelet_fast_time_support );
     }
 
+    if (isConstantQ && !wasConstantQ)
+    {
+        tf_resolution->setRange (4, 96);
+        tf_resolution->setDecimals (0);
+        // transformChanged updates value accordingly
+    }
+
+    if (!isConstantQ && wasConstantQ && !isCwt)
+    {
+        tf_resolution->setRange (1<<5, 1<<20, Widgets::ValueSlider::Logaritmic);
+        tf_resolution->setDecimals (0);
+    }
+
     // abort target needs
     auto needs = model ()->target_marker ()->target_needs ();
     auto step = needs->step ().lock (); // lock weak_ptr
@@ -585,6 +614,19 @@ void RenderController::
 }
 
 
+void RenderController::
+        receiveSetTransform_ConstantQ()
+{
+    // Setup the kernel that will take the transform data and create an image
+    Heightmap::MergeChunkDesc::ptr mcdp(new Heightmap::TfrMappings::ConstantQBlockFilterDesc(Heightmap::ComplexInfo_Amplitude_Non_Weighted));
+
+    // Get a copy of the transform to use
+    Tfr::TransformDesc::ptr transform_desc = model()->transform_descs ().write ()->getParam<Tfr::ConstantQDesc>().copy();
+
+    setBlockFilter(mcdp, transform_desc);
+}
+
+
 void RenderController::
         receiveSetTransform_Cwt_phase()
 {
@@ -874,6 +916,7 @@ void RenderController::
     // ComboBoxAction* transform
     {   connect(ui->actionTransform_Cwt, SIGNAL(triggered()), SLOT(receiveSetTransform_Cwt()));
         connect(ui->actionTransform_Stft, SIGNAL(triggered()), SLOT(receiveSetTransform_Stft()));
+        connect(ui->actionTransform_ConstantQ, SIGNAL(triggered()), SLOT(receiveSetTransform_ConstantQ()));
 //        connect(ui->actionTransform_Cwt_phase, SIGNAL(triggered()), SLOT(receiveSetTransform_Cwt_phase()));
 //        connect(ui->actionTransform_Cwt_reassign, SIGNAL(triggered()), SLOT(receiveSetTransform_Cwt_reassign()));
 //        connect(ui->actionTransform_Cwt_ridge, SIGNAL(triggered()), SLOT(receiveSetTransform_Cwt_ridge()));
@@ -884,6 +927,7 @@ void RenderController::
         transform->setObjectName("ComboBoxActiontransform");
         transform->addActionItem( ui->actionTransform_Stft );
         transform->addActionItem( ui->actionTransform_Cwt );
+        transform->addActionItem( ui->actionTransform_ConstantQ );
 
         if (!Sawe::Configuration::feature("stable")) {
             transform->addActionItem( ui->actionTransform_Cepstrum );
@@ -76,6 +76,7 @@ namespace Tools
         // ComboBoxAction transform
         void receiveSetTransform_Cwt();
         void receiveSetTransform_Stft();
+        void receiveSetTransform_ConstantQ();
         void receiveSetTransform_Cwt_phase();
 #ifdef USE_CUDA
         void receiveSetTransform_Cwt_reassign();
@@ -180,7 +180,7 @@ void RenderModel::
     Signal::Processing::IInvalidator::ptr i =
             render_operation_desc_.raw ()->getInvalidator ();
     if (i)
-        i->deprecateCache(Signal::Interval::Interval_ALL);
+        i->deprecateCacheSoon(Signal::Interval::Interval_ALL);
 }
 
 
@@ -203,7 +203,7 @@ void RenderModel::
     Signal::Processing::IInvalidator::ptr i =
             render_operation_desc_.raw ()->getInvalidator ();
     if (i)
-        i->deprecateCache(Signal::Interval::Interval_ALL);
+        i->deprecateCacheSoon(Signal::Interval::Interval_ALL);
 }
 
 
@@ -249,7 +249,7 @@ void RenderModel::
         Signal::Processing::IInvalidator::ptr i =
                 render_operation_desc_.raw ()->getInvalidator ();
         if (i)
-            i->deprecateCache(Signal::Interval::Interval_ALL);
+            i->deprecateCacheSoon(Signal::Interval::Interval_ALL);
     }
 }
 
@@ -292,7 +292,7 @@ void RenderModel::
     Signal::Processing::IInvalidator::ptr i =
             render_operation_desc_.raw ()->getInvalidator ();
     if (i)
-        i->deprecateCache(Signal::Interval::Interval_ALL);
+        i->deprecateCacheSoon(Signal::Interval::Interval_ALL);
 }
 
 
@@ -32,6 +32,7 @@
 #include "GlException.h"
 #include "glPushContext.h"
 #include "demangle.h"
+#include "tracerecorder.h"
 #include "glframebuffer.h"
 #include "neat_math.h"
 #include "gluunproject.h"
@@ -964,6 +965,8 @@ void RenderView::
 void RenderView::
         paintGL()
 {
+    TRACE_SCOPE("RenderView::paintGL");
+
     model->renderer->collection = model->tfr_mapping ().read ()->collections()[0];
     model->renderer->init();
     if (!model->renderer->isInitialized())
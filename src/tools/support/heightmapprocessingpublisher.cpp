@@ -84,6 +84,12 @@ void HeightmapProcessingPublisher::
             % center
             % update_size);
 
+    // Prefetch the input of the heightmap ahead of the motion, changing
+    // direction drops the old prefetch
+    Intervals prefetch_samples = prefetch_.update (center, timer_.elapsed ());
+    prefetch_samples &= target_interval;
+    prefetch_samples -= needed_samples;
+
     target_needs_->deprecateCache (things_to_add);
     target_needs_->updateNeeds(
                 needed_samples,
@@ -91,6 +97,7 @@ void HeightmapProcessingPublisher::
                 update_size,
                 0
             );
+    target_needs_->updatePrefetch (prefetch_samples);
 
     failed_allocation_ = false;
     foreach( const Heightmap::Collection::ptr &c, tfrmapping_->collections() )
@@ -178,12 +185,12 @@ void HeightmapProcessingPublisher::
         Heightmap::Reference entireHeightmap = collection.read ()->entireHeightmap();
         unsigned frame_number = collection.read ()->frame_number();
 
-        collection->getBlock(entireHeightmap)->frame_number_last_used = frame_number - 2;
+        collection.raw ()->cache ()->touch (collection->getBlock(entireHeightmap), frame_number - 2);
         hpp.update();
 
         EXCEPTION_ASSERT(hpp.isHeightmapDone ());
 
-        collection->getBlock(entireHeightmap)->frame_number_last_used = frame_number;
+        collection.raw ()->cache ()->touch (collection->getBlock(entireHeightmap), frame_number);
         hpp.update();
 
         EXCEPTION_ASSERT(!hpp.isHeightmapDone ());
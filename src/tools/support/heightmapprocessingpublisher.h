@@ -4,6 +4,8 @@
 #include "heightmap/tfrmapping.h"
 #include "signal/intervals.h"
 #include "signal/processing/targetneeds.h"
+#include "signal/processing/velocityprefetch.h"
+#include "timer.h"
 
 #include <QObject>
 
@@ -19,6 +21,12 @@ namespace Support {
  * publishes work prioritization to a target and assumes that there is a worker
  * somewhere that will detect this. That worker may fetch the required data
  * through some signal processing chain but this publisher doesn't care.
+ *
+ * It also publishes a prefetch ahead of where the view is moving, whether
+ * the user is navigating or the view is following the playback marker. The
+ * prefetch only computes the steps below the heightmap target, such as
+ * reading and filtering the signal. The heightmap is computed when its
+ * blocks are created, chunks for blocks that don't exist yet are discarded.
  */
 class HeightmapProcessingPublisher: public QObject
 {
@@ -40,6 +48,8 @@ private:
     float*                                  t_center_;
     Signal::UnsignedIntervalType            preferred_update_size_;
     bool                                    failed_allocation_;
+    Signal::Processing::VelocityPrefetch    prefetch_;
+    Timer                                   timer_;
 
     bool isHeightmapDone() const;
     bool failedAllocation() const;
@@ -7,6 +7,7 @@
 #include "tfr/stftfilter.h"
 #include "tfr/cepstrum.h"
 #include "tfr/cwtchunk.h"
+#include "tfr/constantq.h"
 
 #include "commentcontroller.h"
 #include "heightmap/render/renderer.h"
@@ -438,6 +439,52 @@ public:
         fa = chunk->freqAxis;
     }
 
+    FetchDataTransform( RenderModel* m, const Tfr::ConstantQDesc* cq, float t )
+    {
+        Signal::Processing::Step::ptr s = m->project ()->default_target ()->step().lock();
+        Signal::OperationDesc::Extent x = m->project ()->processing_chain ().read ()->extent(m->project ()->default_target ());
+        float fs = x.sample_rate.get_value_or (1);
+
+        Signal::IntervalType sample = std::max(0.f, t) * fs;
+        const Signal::Interval I = cq->requiredInterval (Signal::Interval(sample, sample+1), 0);
+        Tfr::pChunk chunk = (*cq->createTransform ())( Signal::Processing::Step::readFixedLengthFromCache (s,I)->getChannel (0));
+
+        Tfr::ConstantQChunk* cqchunk = dynamic_cast<Tfr::ConstantQChunk*>( chunk.get() );
+        unsigned octaves = cqchunk->chunks.size();
+        unsigned bins = cq->bins_per_octave();
+
+        EXCEPTION_ASSERT( octaves*bins == cq->nScales() );
+
+        abslog.reset( new DataStorage<float>(cq->nScales()));
+
+        float* dst = abslog->getCpuMemory();
+        for (unsigned j=0; j < octaves; ++j)
+        {
+            Tfr::ConstantQChunkPart* chunkpart = dynamic_cast<Tfr::ConstantQChunkPart*>(cqchunk->chunks[j].get());
+            Tfr::ChunkElement* src = chunkpart->transform_data->getCpuMemory();
+
+            unsigned stride = chunkpart->nSamples();
+            double scale = chunkpart->original_sample_rate / chunkpart->sample_rate;
+
+            // Take the frame closest to 'sample' among the valid frames of
+            // this octave
+            int x = floor(sample / scale - chunkpart->chunk_offset.asFloat() + 0.5);
+            x = std::max(x, chunkpart->first_valid_sample);
+            x = std::min(x, chunkpart->first_valid_sample + chunkpart->n_valid_samples - 1);
+
+            // The highest octave comes first in the chunk but last along the
+            // frequency axis, bin 0 is the lowest frequency in each octave
+            float* octave = dst + (octaves - 1 - chunkpart->octave)*bins;
+            for (unsigned i=0; i<bins; ++i)
+            {
+                Tfr::ChunkElement& v = src[i*stride + x];
+                octave[i] = abs(v);
+            }
+        }
+
+        fa = chunk->freqAxis;
+    }
+
     virtual float operator()( float /*t*/, float hz, bool* is_valid_value )
     {
         float i = std::max( 0.f, fa.getFrequencyScalar( hz ) );
@@ -505,6 +552,8 @@ boost::shared_ptr<TooltipModel::FetchData> TooltipModel::FetchData::
         r.reset( new FetchDataTransform( view->model, stft, t ) );
     else if (const Tfr::Cwt* cwt = dynamic_cast<const Tfr::Cwt*>(transform.get ()))
         r.reset( new FetchDataTransform( view->model, cwt, t ) );
+    else if (const Tfr::ConstantQDesc* cq = dynamic_cast<const Tfr::ConstantQDesc*>(transform.get ()))
+        r.reset( new FetchDataTransform( view->model, cq, t ) );
     else
     {
         return r;
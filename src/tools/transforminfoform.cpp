@@ -8,6 +8,7 @@
 #include "heightmap/collection.h"
 #include "heightmap/render/renderer.h"
 #include "tfr/cwt.h"
+#include "tfr/constantq.h"
 #include "tfr/stft.h"
 #include "tfr/cepstrum.h"
 #include "tfr/drawnwaveform.h"
@@ -150,6 +151,7 @@ void TransformInfoForm::
 
     Tfr::TransformDesc::ptr f = renderview->model->transform_desc();
     const Tfr::Cwt* cwt = dynamic_cast<const Tfr::Cwt*>(f.get ());
+    const Tfr::ConstantQDesc* constantq = dynamic_cast<const Tfr::ConstantQDesc*>(f.get ());
     const Tfr::StftDesc* stft = dynamic_cast<const Tfr::StftDesc*>(f.get ());
     const Tfr::CepstrumDesc* cepstrum = dynamic_cast<const Tfr::CepstrumDesc*>(f.get ());
     const Tfr::DrawnWaveform* waveform = dynamic_cast<const Tfr::DrawnWaveform*>(f.get ());
@@ -180,8 +182,8 @@ void TransformInfoForm::
     {
         bool cwt = false, stft = false, cepstrum = false;
 #endif
-    ui->minHzLabel->setVisible(cwt);
-    ui->minHzEdit->setVisible(cwt);
+    ui->minHzLabel->setVisible(cwt || constantq);
+    ui->minHzEdit->setVisible(cwt || constantq);
     ui->maxHzLabel->setVisible(false);
     ui->maxHzEdit->setVisible(false);
     ui->binResolutionLabel->setVisible(stft);
@@ -216,6 +218,20 @@ void TransformInfoForm::
         setEditText( ui->minHzEdit, QString("%1").arg(cwt->get_wanted_min_hz(fs)) );
         //setEditText( ui->maxHzEdit, QString("%1").arg(cwt->get_max_hz(fs)) );
     }
+    else if (constantq)
+    {
+        addRow("Type", "Constant-Q");
+
+        addRow("Bins per octave", QString("%1").arg(constantq->bins_per_octave()));
+        addRow("Octaves", QString("%1").arg(constantq->number_of_octaves()));
+        addRow("Scales", QString("%1").arg(constantq->nScales()));
+        addRow("Q", QString("%1").arg(constantq->q()));
+        addRow("Window size", QString("%1").arg(constantq->fft_size()));
+        addRow("Max hz", QString("%1").arg(constantq->get_max_hz(fs)));
+        addRow("Actual min hz", QString("%1").arg(constantq->get_min_hz(fs)));
+        addRow("Amplification factor", QString("%1").arg(renderview->model->renderer->render_settings.y_scale));
+        setEditText( ui->minHzEdit, QString("%1").arg(constantq->get_min_hz(fs)) );
+    }
     else if (stft)
     {
         addRow("Type", "Short time fourier");
@@ -296,6 +312,18 @@ void TransformInfoForm::
     if (newValue>fs/2)
         newValue=fs/2;
 
+    // The number of octaves of ConstantQDesc is given by the min hz
+    if (dynamic_cast<const Tfr::ConstantQDesc*>(renderview->model->transform_desc().get ()))
+    {
+        auto td = renderview->model->transform_descs ().write ();
+        Tfr::ConstantQDesc& constantq = td->getParam<Tfr::ConstantQDesc>();
+
+        int number_of_octaves = constantq.number_of_octaves ();
+        constantq.set_wanted_min_hz(newValue, fs);
+        if (constantq.number_of_octaves () == number_of_octaves)
+            return;
+    }
+    else
     {
         auto td = renderview->model->transform_descs ().write ();
         Tfr::Cwt& cwt = td->getParam<Tfr::Cwt>();
@@ -21,6 +21,12 @@ WorkerController::
     connect(a, SIGNAL(toggled(bool)), SLOT(setEnabled(bool)));
 
     mainwindow->addAction( a );
+
+    QAction* log = new QAction(mainwindow);
+    log->setShortcut(QKeySequence("Ctrl+Alt+Shift+P"));
+    connect(log, SIGNAL(triggered()), view_, SLOT(logPerfCounters()));
+
+    mainwindow->addAction( log );
 }
 
 
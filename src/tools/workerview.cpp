@@ -3,6 +3,8 @@
 
 #include "support/paintline.h"
 
+#include "tasktimer.h"
+
 namespace Tools {
 
 WorkerView::
@@ -20,6 +22,20 @@ Sawe::Project* WorkerView::
 }
 
 
+Signal::Processing::PerfCounters::Snapshot WorkerView::
+        perfCounters()
+{
+    return project_->processing_chain ().read ()->perfCounters ();
+}
+
+
+void WorkerView::
+        logPerfCounters()
+{
+    TaskInfo("%s", perfCounters ().toJson ().c_str ());
+}
+
+
 void WorkerView::
         draw()
 {
@@ -3,6 +3,8 @@
 
 #include <QObject>
 
+#include "signal/processing/perfcounters.h"
+
 namespace Sawe { class Project; }
 
 namespace Tools {
@@ -15,10 +17,17 @@ public:
 
     Sawe::Project* project();
 
+    /**
+     * @brief perfCounters tells what each step and each worker in the
+     * processing chain has spent its time on.
+     */
+    Signal::Processing::PerfCounters::Snapshot perfCounters();
+
 signals:
 
 public slots:
     virtual void draw();
+    void logPerfCounters();
 
 private:
     Sawe::Project* project_;